@@ -36,6 +36,10 @@
 #define LIO_IO_ALISTIO          00010   /* single stride async listio */
 #define LIO_IO_SYNCV            00020   /* single-buffer readv/writev */
 #define LIO_IO_SYNCP            00040   /* pread/pwrite */
+#define LIO_IO_URING            00100   /* io_uring read/write */
+#define LIO_IO_URINGB           00200   /* io_uring, split in a batch of requests */
+#define LIO_IO_URINGF           00400   /* io_uring read/write on a registered buffer */
+#define LIO_IO_LAIO             01000   /* linux native aio, io_submit/io_getevents */
 
 #ifdef sgi
 #define LIO_IO_ATYPES           00077   /* all io types */
@@ -43,7 +47,9 @@
 #endif /* sgi */
 #if defined(__linux__) && !defined(__UCLIBC__)
 #define LIO_IO_TYPES            00061   /* all io types */
-#define LIO_IO_ATYPES           00077   /* all io types */
+#define LIO_IO_ATYPES           01777   /* all io types */
+/* all io_uring io types */
+#define LIO_IO_URING_TYPES	(LIO_IO_URING|LIO_IO_URINGB|LIO_IO_URINGF)
 #endif
 #if defined(__sun) || defined(__hpux) || defined(_AIX) || defined(__UCLIBC__)
 #define LIO_IO_TYPES            00021   /* all io types except pread/pwrite */
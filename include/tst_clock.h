@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2026 Linux Test Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __TST_CLOCK_H__
+#define __TST_CLOCK_H__
+
+/*
+ * CLOCK_MONOTONIC in nanoseconds, for timing the operations of the
+ * benchmarks; see tst_hist.h for keeping the results.
+ */
+unsigned long long tst_clock_ns(void);
+
+#endif	/* __TST_CLOCK_H__ */
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2026 Linux Test Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __TST_HIST_H__
+#define __TST_HIST_H__
+
+/*
+ * Latency histogram for the benchmarks.
+ *
+ * Latencies are kept in log-linear buckets, four to each power of two
+ * nanoseconds, so a percentile is never off by more than a quarter of
+ * its value and 256 buckets cover anything up to hours.
+ *
+ *	struct tst_hist h;
+ *
+ *	memset(&h, 0, sizeof(h));
+ *	...
+ *	tst_hist_add(&h, ns);
+ *	...
+ *	printf("p99 %.1fus\n", tst_hist_usecs(&h, 0.99));
+ */
+
+#define TST_HIST_BUCKETS	256
+
+struct tst_hist {
+	unsigned long long count;
+	unsigned long long max_ns;
+	unsigned long long bucket[TST_HIST_BUCKETS];
+};
+
+/* Account one latency of ns nanoseconds. */
+void tst_hist_add(struct tst_hist *h, unsigned long long ns);
+
+/* Add the samples of src to dst. */
+void tst_hist_merge(struct tst_hist *dst, const struct tst_hist *src);
+
+/*
+ * The latency in microseconds below which the fraction q of the samples
+ * fall, at most the largest one seen; 0 for an empty histogram.
+ */
+double tst_hist_usecs(const struct tst_hist *h, double q);
+
+/*
+ * The smallest and largest latency in nanoseconds that bucket b holds,
+ * for printing the histogram itself.  Empty buckets are best skipped.
+ */
+unsigned long long tst_hist_bucket_min(int b);
+unsigned long long tst_hist_bucket_max(int b);
+
+#endif	/* __TST_HIST_H__ */
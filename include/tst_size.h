@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2026 Linux Test Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __TST_SIZE_H__
+#define __TST_SIZE_H__
+
+/*
+ * Parse a size given on the command line, a number with an optional k, m
+ * or g suffix (either case, powers of 1024), into *size.  Returns 0, or
+ * -1 when str is not such a size.
+ */
+int tst_parse_size(const char *str, unsigned long long *size);
+
+#endif	/* __TST_SIZE_H__ */
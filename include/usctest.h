@@ -100,6 +100,17 @@ struct tblock {
  ***********************************************************************/
 extern struct tblock tblock;
 
+/***********************************************************************
+ * Syscall timing for -t: usc_timing_start() returns a CLOCK_MONOTONIC
+ * timestamp in ns, usc_timing_stop() accounts the call started at that
+ * time into a tst_hist and usc_timing_report() prints the calls/sec
+ * and p50/p99/max latency from TEST_CLEANUP.
+ ***********************************************************************/
+
+unsigned long long usc_timing_start(void);
+void usc_timing_stop(unsigned long long start);
+void usc_timing_report(void);
+
 /***********************************************************************
  * TEST: calls a system call
  *
@@ -109,9 +120,14 @@ extern struct tblock tblock;
  ***********************************************************************/
 #define TEST(SCALL) \
 	do { \
+		unsigned long long _usc_start = 0; \
+		if (STD_TIMING_ON) \
+			_usc_start = usc_timing_start(); \
 		errno = 0; \
 		TEST_RETURN = SCALL; \
 		TEST_ERRNO = errno; \
+		if (STD_TIMING_ON) \
+			usc_timing_stop(_usc_start); \
 	} while (0)
 
 /***********************************************************************
@@ -126,7 +142,17 @@ extern struct tblock tblock;
  * errors.
  *
  ***********************************************************************/
-#define TEST_VOID(SCALL) do { errno = 0; SCALL; TEST_ERRNO = errno; } while (0)
+#define TEST_VOID(SCALL) \
+	do { \
+		unsigned long long _usc_start = 0; \
+		if (STD_TIMING_ON) \
+			_usc_start = usc_timing_start(); \
+		errno = 0; \
+		SCALL; \
+		TEST_ERRNO = errno; \
+		if (STD_TIMING_ON) \
+			usc_timing_stop(_usc_start); \
+	} while (0)
 
 /***********************************************************************
  * TEST_CLEANUP: print system call timing stats and errno log entries
@@ -140,6 +166,7 @@ extern struct tblock tblock;
 #define TEST_CLEANUP \
 do { \
 	int i; \
+	usc_timing_report(); \
 	if (!STD_ERRNO_LOG) \
 		break; \
 	for (i = 0; i < USC_MAX_ERRNO; ++i) { \
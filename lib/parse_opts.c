@@ -41,10 +41,13 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <stdint.h>
+#include <time.h>
 
 #include "test.h"
 #include "ltp_priv.h"
 #include "usctest.h"
+#include "tst_clock.h"
+#include "tst_hist.h"
 
 #ifndef UNIT_TEST
 #define UNIT_TEST	0
@@ -674,6 +677,66 @@ int usc_test_looping(int counter)
 		return 0;
 }
 
+/*
+ * Syscall timing (-t).  Each TEST() call is accounted in a tst_hist; the
+ * rate is taken over the wall-clock time from the first call to the end
+ * of the last one, so it includes the test's own work between calls.
+ */
+static struct {
+	unsigned long long total;
+	unsigned long long min;
+	unsigned long long first;
+	unsigned long long last;
+	struct tst_hist hist;
+} usc_timing = { .min = ~0ULL };
+
+unsigned long long usc_timing_start(void)
+{
+	unsigned long long now = tst_clock_ns();
+
+	if (!usc_timing.first)
+		usc_timing.first = now;
+	return now;
+}
+
+void usc_timing_stop(unsigned long long start)
+{
+	unsigned long long d;
+
+	usc_timing.last = tst_clock_ns();
+	d = usc_timing.last - start;
+
+	tst_hist_add(&usc_timing.hist, d);
+	usc_timing.total += d;
+	if (d < usc_timing.min)
+		usc_timing.min = d;
+}
+
+void usc_timing_report(void)
+{
+	const struct tst_hist *h = &usc_timing.hist;
+	unsigned long long wall;
+	int b;
+
+	if (!STD_TIMING_ON || !h->count)
+		return;
+
+	wall = MAX(usc_timing.last - usc_timing.first, 1ULL);
+	tst_resm(TINFO, "TIMING: %llu calls, %.0f calls/sec, avg %llu ns",
+		 h->count, h->count * 1e9 / wall, usc_timing.total / h->count);
+	tst_resm(TINFO, "TIMING: min %llu ns, p50 %.0f ns, p99 %.0f ns, "
+		 "max %llu ns", usc_timing.min, tst_hist_usecs(h, 0.50) * 1000,
+		 tst_hist_usecs(h, 0.99) * 1000, h->max_ns);
+
+	for (b = 0; b < TST_HIST_BUCKETS; b++) {
+		if (!h->bucket[b])
+			continue;
+		tst_resm(TINFO, "TIMING: %10llu - %10llu ns: %llu",
+			 tst_hist_bucket_min(b), tst_hist_bucket_max(b),
+			 h->bucket[b]);
+	}
+}
+
 /*
  * This function recressively calls itself max times.
  */
@@ -112,6 +112,16 @@
 #include <aio.h>
 #endif
 #endif
+#if defined(__linux__) && !defined(__UCLIBC__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+#ifdef HAVE_LINUX_AIO_ABI_H
+#include <linux/aio_abi.h>
+#endif
+#endif
 #include <stdlib.h>		/* atoi, abs */
 
 #include "tlibio.h"		/* defines LIO* marcos */
@@ -166,6 +176,12 @@ struct lio_info_type Lio_info1[] = {
 	 "single stride async listio using pause"},
 	{"v", LIO_IO_SYNCV, "single buffer sync readv/writev"},
 	{"P", LIO_IO_SYNCP, "sync pread/pwrite"},
+#if defined(__linux__) && !defined(__UCLIBC__)
+	{"u", LIO_IO_URING, "io_uring i/o"},
+	{"U", LIO_IO_URINGB, "io_uring i/o split in a batch of requests"},
+	{"F", LIO_IO_URINGF, "io_uring i/o using a registered buffer"},
+	{"n", LIO_IO_LAIO, "linux native aio using io_submit/io_getevents"},
+#endif
 };
 
 /*
@@ -178,6 +194,14 @@ struct lio_info_type Lio_info2[] = {
 	{"alistio", LIO_IO_ALISTIO, "single stride async listio"},
 	{"syncv", LIO_IO_SYNCV, "single buffer sync readv/writev"},
 	{"syncp", LIO_IO_SYNCP, "pread/pwrite"},
+#if defined(__linux__) && !defined(__UCLIBC__)
+	{"uring", LIO_IO_URING, "io_uring read/write"},
+	{"uringbatch", LIO_IO_URINGB,
+	 "io_uring read/write split in a batch of requests"},
+	{"uringfixed", LIO_IO_URINGF,
+	 "io_uring read/write using a registered buffer"},
+	{"laio", LIO_IO_LAIO, "linux native aio (io_submit/io_getevents)"},
+#endif
 	{"active", LIO_WAIT_ACTIVE, "spin on status/control values"},
 	{"recall", LIO_WAIT_RECALL,
 	 "use recall(2)/aio_suspend(3) to wait for i/o to complete"},
@@ -494,10 +518,399 @@ static void wait4sync_io(int fd, int read)
 	select(fd + 1, read ? &s : NULL, read ? NULL : &s, NULL, NULL);
 }
 
+#if defined(__linux__) && !defined(__UCLIBC__)
+/***********************************************************************
+ * io_uring and linux native aio
+ *
+ * These i/o types are driven directly through their system calls, so
+ * the tests need neither liburing nor libaio.  One ring and one aio
+ * context are set up on first use.  Neither may be shared with a parent
+ * process, so a child of fork() sets up its own.
+ *
+ * A LIO_IO_URINGB request to a file or block device is split in up to
+ * LIO_URING_ENTRIES requests of at least LIO_URING_CHUNK bytes, which
+ * are submitted with one system call.
+ * A LIO_IO_URINGF request goes through a buffer that is owned by this
+ * module and registered with the ring, so the caller's buffer does not
+ * have to stay mapped between calls.
+ *
+ * LIO_WAIT_ACTIVE spins on the completion queue or polls io_getevents(2);
+ * all other wait methods block in io_uring_enter(2) or io_getevents(2).
+ *
+ * Return Value
+ *   Like pread/pwrite: -errno on failure, or the bytes transferred.
+ ***********************************************************************/
+#define LIO_URING_ENTRIES	8
+#define LIO_URING_CHUNK		4096
+
+#ifdef HAVE_LINUX_IO_URING_H
+static struct lio_uring {
+	pid_t pid;		/* process that set up the ring */
+	int fd;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ring;
+	void *cq_ring;
+	size_t sq_size;
+	size_t cq_size;
+	size_t sqes_size;
+	struct iovec fixed;	/* the registered buffer */
+} Lio_ring = {.fd = -1 };
+
+static void lio_uring_close(void)
+{
+	munmap(Lio_ring.sq_ring, Lio_ring.sq_size);
+	munmap(Lio_ring.cq_ring, Lio_ring.cq_size);
+	munmap(Lio_ring.sqes, Lio_ring.sqes_size);
+	close(Lio_ring.fd);
+	Lio_ring.fd = -1;
+	/* the registration went with the ring */
+	free(Lio_ring.fixed.iov_base);
+	Lio_ring.fixed.iov_base = NULL;
+	Lio_ring.fixed.iov_len = 0;
+}
+
+static int lio_uring_setup(void)
+{
+	struct io_uring_params p;
+	char *sq, *cq;
+
+	if (Lio_ring.fd != -1) {
+		if (Lio_ring.pid == getpid())
+			return 0;
+		lio_uring_close();	/* inherited from the parent */
+	}
+
+	memset(&p, 0, sizeof(p));
+	if ((Lio_ring.fd = syscall(__NR_io_uring_setup, LIO_URING_ENTRIES,
+				   &p)) == -1)
+		return -1;
+	Lio_ring.pid = getpid();
+	Lio_ring.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	Lio_ring.cq_size = p.cq_off.cqes +
+	    p.cq_entries * sizeof(struct io_uring_cqe);
+	Lio_ring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	sq = mmap(0, Lio_ring.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		  Lio_ring.fd, IORING_OFF_SQ_RING);
+	cq = mmap(0, Lio_ring.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		  Lio_ring.fd, IORING_OFF_CQ_RING);
+	Lio_ring.sqes = mmap(0, Lio_ring.sqes_size, PROT_READ | PROT_WRITE,
+			     MAP_SHARED, Lio_ring.fd, IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED
+	    || Lio_ring.sqes == MAP_FAILED) {
+		close(Lio_ring.fd);
+		Lio_ring.fd = -1;
+		return -1;
+	}
+	Lio_ring.sq_ring = sq;
+	Lio_ring.cq_ring = cq;
+	Lio_ring.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	Lio_ring.sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	Lio_ring.sq_array = (unsigned *)(sq + p.sq_off.array);
+	Lio_ring.cq_head = (unsigned *)(cq + p.cq_off.head);
+	Lio_ring.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	Lio_ring.cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	Lio_ring.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+}
+
+/*
+ * Make sure the registered buffer holds at least size bytes.
+ */
+static int lio_uring_fixed(int size)
+{
+	struct iovec iov;
+
+	if (Lio_ring.fixed.iov_len >= (size_t)size)
+		return 0;
+
+	if (Lio_ring.fixed.iov_base != NULL) {
+		syscall(__NR_io_uring_register, Lio_ring.fd,
+			IORING_UNREGISTER_BUFFERS, NULL, 0);
+		free(Lio_ring.fixed.iov_base);
+		Lio_ring.fixed.iov_base = NULL;
+		Lio_ring.fixed.iov_len = 0;
+	}
+	iov.iov_len = (size + 4095) & ~4095;
+	if ((iov.iov_base = valloc(iov.iov_len)) == NULL)
+		return -1;
+	if (syscall(__NR_io_uring_register, Lio_ring.fd,
+		    IORING_REGISTER_BUFFERS, &iov, 1) == -1) {
+		free(iov.iov_base);
+		return -1;
+	}
+	Lio_ring.fixed = iov;
+	return 0;
+}
+
+/*
+ * Submit size bytes at offset as nr requests and wait for them all.
+ * Returns the bytes transferred, or -errno of the first failed request.
+ */
+static int lio_uring_rw(int opcode, int fd, char *buf, int size,
+			off64_t offset, int nr, int active)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	unsigned tail, head;
+	int chunk = (size + nr - 1) / nr;
+	int submit, done, ret, err = 0, total = 0;
+	int i;
+
+	tail = *Lio_ring.sq_tail;
+	for (i = 0; i < nr; i++, tail++) {
+		sqe = &Lio_ring.sqes[tail & *Lio_ring.sq_mask];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = opcode;
+		sqe->fd = fd;
+		sqe->addr = (unsigned long)(buf + i * chunk);
+		sqe->len = (i == nr - 1) ? size - i * chunk : chunk;
+		sqe->off = offset + i * chunk;
+		sqe->user_data = i;
+		Lio_ring.sq_array[tail & *Lio_ring.sq_mask] =
+		    tail & *Lio_ring.sq_mask;
+	}
+	__atomic_store_n(Lio_ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+	for (submit = nr, done = 0; done < nr;) {
+		if (submit || !active) {
+			ret = syscall(__NR_io_uring_enter, Lio_ring.fd, submit,
+				      active ? 0 : nr - done,
+				      active ? 0 : IORING_ENTER_GETEVENTS,
+				      NULL, 0);
+			if (ret == -1 && errno != EINTR) {
+				/* do not leave requests behind in the ring */
+				err = -errno;
+				lio_uring_close();
+				return err;
+			}
+			if (ret > 0)
+				submit -= ret;
+		}
+
+		head = *Lio_ring.cq_head;
+		while (head != __atomic_load_n(Lio_ring.cq_tail,
+					       __ATOMIC_ACQUIRE)) {
+			cqe = &Lio_ring.cqes[head & *Lio_ring.cq_mask];
+			if (cqe->res < 0) {
+				if (err == 0)
+					err = cqe->res;
+			} else {
+				total += cqe->res;
+			}
+			head++;
+			done++;
+		}
+		__atomic_store_n(Lio_ring.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	return err ? err : total;
+}
+
+static int lio_uring_io(int write, int method, int fd, char *buffer,
+			int size, off64_t offset)
+{
+	struct stat st;
+	char *buf = buffer;
+	int active = method & LIO_WAIT_ACTIVE;
+	int nr = 1, stream, ret, total = 0;
+	int opcode;
+
+	if (lio_uring_setup() == -1) {
+		sprintf(Errormsg,
+			"%s/%d io_uring_setup(%d, &p) failed, errno=%d %s",
+			__FILE__, __LINE__, LIO_URING_ENTRIES, errno,
+			strerror(errno));
+		return -errno;
+	}
+
+	if (method & LIO_IO_URINGF) {
+		if (lio_uring_fixed(size) == -1) {
+			sprintf(Errormsg,
+				"%s/%d io_uring_register(%d, IORING_REGISTER_BUFFERS, iov, 1) nbyte:%d failed, errno=%d %s",
+				__FILE__, __LINE__, Lio_ring.fd, size, errno,
+				strerror(errno));
+			return -errno;
+		}
+		buf = Lio_ring.fixed.iov_base;
+		if (write)
+			memcpy(buf, buffer, size);
+		opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+	} else {
+		opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+	}
+
+	/*
+	 * Pipes and the like are neither split, nor left with a short
+	 * transfer; like read(2)/write(2) here, the rest is sent again.
+	 */
+	stream = fstat(fd, &st) == 0 && !S_ISREG(st.st_mode)
+	    && !S_ISBLK(st.st_mode);
+	if ((method & LIO_IO_URINGB) && !stream) {
+		nr = size / LIO_URING_CHUNK;
+		if (nr > LIO_URING_ENTRIES)
+			nr = LIO_URING_ENTRIES;
+		if (nr < 1)
+			nr = 1;
+	}
+
+	sprintf(Lio_SysCall,
+		"io_uring_enter(%d, %d, %d) %s%s, fd:%d, nbyte:%d, off:%lld",
+		Lio_ring.fd, nr, active ? 0 : nr,
+		write ? "IORING_OP_WRITE" : "IORING_OP_READ",
+		(method & LIO_IO_URINGF) ? "_FIXED" : "", fd, size,
+		(long long)offset);
+
+	if (Debug_level) {
+		printf("DEBUG %s/%d: %s\n", __FILE__, __LINE__, Lio_SysCall);
+	}
+
+	do {
+		if ((ret = lio_uring_rw(opcode, fd, buf + total, size - total,
+					offset + total, nr, active)) < 0) {
+			sprintf(Errormsg,
+				"%s/%d %s failed, errno=%d %s",
+				__FILE__, __LINE__, Lio_SysCall, -ret,
+				strerror(-ret));
+			return ret;
+		}
+		total += ret;
+	} while (stream && ret > 0 && total < size);
+
+	if (!write && buf != buffer)
+		memcpy(buffer, buf, total);
+
+	if (total != size) {
+		sprintf(Errormsg, "%s/%d %s returned=%d",
+			__FILE__, __LINE__, Lio_SysCall, total);
+	} else if (Debug_level > 1)
+		printf
+		    ("DEBUG %s/%d: io_uring %s completed without error (ret %d)\n",
+		     __FILE__, __LINE__, write ? "write" : "read", total);
+
+	return total;
+}
+#else
+static int lio_uring_io(int write, int method, int fd, char *buffer,
+			int size, off64_t offset)
+{
+	sprintf(Errormsg, "%s/%d io_uring is not supported by this build",
+		__FILE__, __LINE__);
+	return -ENOSYS;
+}
+#endif /* HAVE_LINUX_IO_URING_H */
+
+#ifdef HAVE_LINUX_AIO_ABI_H
+static aio_context_t Lio_aio_ctx;
+static pid_t Lio_aio_pid;	/* process that set up Lio_aio_ctx */
+
+static int lio_laio_io(int write, int method, int fd, char *buffer,
+		       int size, off64_t offset)
+{
+	struct iocb cb, *cbs[1];
+	struct io_event ev;
+	struct timespec zero = { 0, 0 };
+	struct stat st;
+	int active = method & LIO_WAIT_ACTIVE;
+	int stream, ret, total = 0;
+
+	if (Lio_aio_ctx == 0 || Lio_aio_pid != getpid()) {
+		/* a context inherited from the parent can not be used */
+		Lio_aio_ctx = 0;
+		if (syscall(__NR_io_setup, LIO_URING_ENTRIES, &Lio_aio_ctx)
+		    == -1) {
+			sprintf(Errormsg,
+				"%s/%d io_setup(%d, &ctx) failed, errno=%d %s",
+				__FILE__, __LINE__, LIO_URING_ENTRIES, errno,
+				strerror(errno));
+			return -errno;
+		}
+		Lio_aio_pid = getpid();
+	}
+
+	sprintf(Lio_SysCall,
+		"io_submit(ctx, 1, &iocb) %s, fd:%d, nbyte:%d, off:%lld",
+		write ? "IOCB_CMD_PWRITE" : "IOCB_CMD_PREAD", fd, size,
+		(long long)offset);
+
+	if (Debug_level) {
+		printf("DEBUG %s/%d: %s\n", __FILE__, __LINE__, Lio_SysCall);
+	}
+
+	/* as with io_uring, the rest of a short transfer to a pipe is resent */
+	stream = fstat(fd, &st) == 0 && !S_ISREG(st.st_mode)
+	    && !S_ISBLK(st.st_mode);
+	do {
+		memset(&cb, 0, sizeof(cb));
+		cb.aio_fildes = fd;
+		cb.aio_lio_opcode = write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+		cb.aio_buf = (unsigned long)(buffer + total);
+		cb.aio_nbytes = size - total;
+		cb.aio_offset = offset + total;
+		cbs[0] = &cb;
+
+		if (syscall(__NR_io_submit, Lio_aio_ctx, 1, cbs) == -1) {
+			sprintf(Errormsg,
+				"%s/%d %s failed, errno=%d %s",
+				__FILE__, __LINE__, Lio_SysCall, errno,
+				strerror(errno));
+			return -errno;
+		}
+
+		while ((ret = syscall(__NR_io_getevents, Lio_aio_ctx,
+				      active ? 0 : 1, 1, &ev,
+				      active ? &zero : NULL)) != 1) {
+			if (ret == -1 && errno != EINTR) {
+				sprintf(Errormsg,
+					"%s/%d io_getevents(ctx, 1, 1, &ev) after %s failed, errno=%d %s",
+					__FILE__, __LINE__, Lio_SysCall, errno,
+					strerror(errno));
+				return -errno;
+			}
+		}
+
+		if ((long long)ev.res < 0) {
+			sprintf(Errormsg,
+				"%s/%d %s failed, errno=%d %s",
+				__FILE__, __LINE__, Lio_SysCall, (int)-ev.res,
+				strerror((int)-ev.res));
+			return (int)ev.res;
+		}
+		total += (int)ev.res;
+	} while (stream && ev.res > 0 && total < size);
+
+	if (total != size) {
+		sprintf(Errormsg, "%s/%d %s returned=%d",
+			__FILE__, __LINE__, Lio_SysCall, total);
+	} else if (Debug_level > 1)
+		printf
+		    ("DEBUG %s/%d: io_submit %s completed without error (ret %d)\n",
+		     __FILE__, __LINE__, write ? "write" : "read", total);
+
+	return total;
+}
+#else
+static int lio_laio_io(int write, int method, int fd, char *buffer,
+		       int size, off64_t offset)
+{
+	sprintf(Errormsg,
+		"%s/%d linux native aio is not supported by this build",
+		__FILE__, __LINE__);
+	return -ENOSYS;
+}
+#endif /* HAVE_LINUX_AIO_ABI_H */
+#endif /* linux */
+
 /***********************************************************************
  * Generic write function
  * This function can be used to do a write using write(2), writea(2),
- * aio_write(3), writev(2), pwrite(2),
+ * aio_write(3), writev(2), pwrite(2), io_uring or io_submit(2),
  * or single stride listio(2)/lio_listio(3).
  * By setting the desired bits in the method
  * bitmask, the caller can control the type of write and the wait method
@@ -1014,6 +1427,16 @@ int lio_write_buffer(int fd,		/* open file descriptor */
 	}			/* LIO_IO_SYNCP */
 #endif
 
+#if defined(__linux__) && !defined(__UCLIBC__)
+	else if (method & LIO_IO_URING_TYPES) {
+		return lio_uring_io(1, method, fd, buffer, size, poffset);
+	}			/* LIO_IO_URING_TYPES */
+
+	else if (method & LIO_IO_LAIO) {
+		return lio_laio_io(1, method, fd, buffer, size, poffset);
+	}			/* LIO_IO_LAIO */
+#endif
+
 	else {
 		printf("DEBUG %s/%d: No I/O method chosen\n", __FILE__,
 		       __LINE__);
@@ -1067,7 +1490,7 @@ int lio_write_buffer(int fd,		/* open file descriptor */
 /***********************************************************************
  * Generic read function
  * This function can be used to do a read using read(2), reada(2),
- * aio_read(3), readv(2), pread(2),
+ * aio_read(3), readv(2), pread(2), io_uring or io_submit(2),
  * or single stride listio(2)/lio_listio(3).
  * By setting the desired bits in the method
  * bitmask, the caller can control the type of read and the wait method
@@ -1587,6 +2010,16 @@ int lio_read_buffer(int fd,	/* open file descriptor */
 	}			/* LIO_IO_SYNCP */
 #endif
 
+#if defined(__linux__) && !defined(__UCLIBC__)
+	else if (method & LIO_IO_URING_TYPES) {
+		return lio_uring_io(0, method, fd, buffer, size, poffset);
+	}			/* LIO_IO_URING_TYPES */
+
+	else if (method & LIO_IO_LAIO) {
+		return lio_laio_io(0, method, fd, buffer, size, poffset);
+	}			/* LIO_IO_LAIO */
+#endif
+
 	else {
 		printf("DEBUG %s/%d: No I/O method chosen\n", __FILE__,
 		       __LINE__);
@@ -1987,7 +2420,17 @@ struct unit_info_t {
 	LIO_IO_ALISTIO | LIO_WAIT_SIGPAUSE, SIGUSR1, "async listio sigpause"},
 	{
 	LIO_IO_ASYNC, SIGUSR2, "async io, def wait, sigusr2"}, {
-LIO_IO_ALISTIO, SIGUSR2, "async listio, def wait, sigusr2"},};
+	LIO_IO_ALISTIO, SIGUSR2, "async listio, def wait, sigusr2"},
+#if defined(__linux__) && !defined(__UCLIBC__)
+	{
+	LIO_IO_URING, 0, "io_uring"}, {
+	LIO_IO_URING | LIO_WAIT_ACTIVE, 0, "io_uring active"}, {
+	LIO_IO_URINGB, 0, "io_uring batch"}, {
+	LIO_IO_URINGF, 0, "io_uring fixed buffer"}, {
+	LIO_IO_LAIO, 0, "linux native aio"}, {
+	LIO_IO_LAIO | LIO_WAIT_ACTIVE, 0, "linux native aio active"},
+#endif
+};
 
 int main(argc, argv)
 int argc;
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2026 Linux Test Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "tst_hist.h"
+
+static int bucket(unsigned long long ns)
+{
+	int b;
+
+	if (ns < 4)
+		return ns;
+	b = 63 - __builtin_clzll(ns);
+	b = (b << 2) | ((ns >> (b - 2)) & 3);
+	return b < TST_HIST_BUCKETS ? b : TST_HIST_BUCKETS - 1;
+}
+
+/* buckets 4 to 7 are never used, 4ns and up start at bucket 8 */
+unsigned long long tst_hist_bucket_max(int b)
+{
+	int e = b >> 2;
+
+	if (b < 8)
+		return b < 4 ? b : 3;
+	return ((4ULL | (b & 3)) << (e - 2)) + (1ULL << (e - 2)) - 1;
+}
+
+unsigned long long tst_hist_bucket_min(int b)
+{
+	if (b < 4)
+		return b;
+	return tst_hist_bucket_max(b - 1) + 1;
+}
+
+void tst_hist_add(struct tst_hist *h, unsigned long long ns)
+{
+	h->bucket[bucket(ns)]++;
+	h->count++;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+}
+
+void tst_hist_merge(struct tst_hist *dst, const struct tst_hist *src)
+{
+	int b;
+
+	for (b = 0; b < TST_HIST_BUCKETS; b++)
+		dst->bucket[b] += src->bucket[b];
+	dst->count += src->count;
+	if (src->max_ns > dst->max_ns)
+		dst->max_ns = src->max_ns;
+}
+
+double tst_hist_usecs(const struct tst_hist *h, double q)
+{
+	unsigned long long want = q * h->count;
+	unsigned long long seen = 0, ns;
+	int b;
+
+	if (h->count == 0)
+		return 0.0;
+	for (b = 0; b < TST_HIST_BUCKETS - 1; b++) {
+		seen += h->bucket[b];
+		if (seen > want)
+			break;
+	}
+	ns = tst_hist_bucket_max(b);
+	if (ns > h->max_ns)
+		ns = h->max_ns;
+	return ns / 1000.0;
+}
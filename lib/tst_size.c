@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2026 Linux Test Project
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tst_size.h"
+
+int tst_parse_size(const char *str, unsigned long long *size)
+{
+	unsigned long long val;
+	int shift = 0;
+	char *end;
+
+	if (strchr(str, '-'))
+		return -1;
+	errno = 0;
+	val = strtoull(str, &end, 0);
+	if (end == str || errno)
+		return -1;
+
+	switch (*end) {
+	case 'k':
+	case 'K':
+		shift = 10;
+		break;
+	case 'm':
+	case 'M':
+		shift = 20;
+		break;
+	case 'g':
+	case 'G':
+		shift = 30;
+		break;
+	case '\0':
+		break;
+	default:
+		return -1;
+	}
+	if (shift && *++end != '\0')
+		return -1;
+	if (val > (~0ULL >> shift))
+		return -1;
+
+	*size = val << shift;
+	return 0;
+}
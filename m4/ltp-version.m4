@@ -0,0 +1 @@
+20140828])
@@ -638,7 +638,7 @@ int main(int argc, char **argv)
 		fprintf(stderr, "pan(%s): %s\n", panname, zoo_error);
 		++exit_stat;
 	}
-	fclose(zoofile);
+	zoo_close(zoofile);
 	if (logfile && fmt_print) {
 		if (uname(&unamebuf) == -1)
 			fprintf(stderr, "ERROR: uname(): %s\n",
@@ -963,7 +963,7 @@ run_child(struct coll_entry *colle, struct tag_pgrp *active, int quiet_mode,
 	} else if (cpid == 0) {
 		/* child */
 
-		fclose(zoofile);
+		zoo_detach(zoofile);
 		close(errpipe[0]);
 		fcntl(errpipe[1], F_SETFD, 1);	/* close the pipe if we succeed */
 		setpgrp();
@@ -48,14 +48,21 @@
  *		Symbol Table Header
  *		Symbol Table Node
  *
- *	A symbol table header consists of a magic number, a pointer to
- *	the first node in the symbol table, and a cursor that is used
- *	when sequentialy stepping thru the entire list.
+ *	A symbol table header consists of a magic number, pointers to
+ *	the first and last node in the symbol table, a cursor that is used
+ *	when sequentialy stepping thru the entire list, a hash table and
+ *	the arena the nodes are allocated from.
  *
  *	Symbol table nodes contain a pointer to a key, a pointer to this
- *	key's data, and a pointer to the next node in the chain.
+ *	key's data, a pointer to the next node in insertion order and a
+ *	pointer to the next node in the same hash bucket.
  *	Note that to create a hierarchical symbol table, a node is created
  *	whose data points to a symbol table header.
+ *
+ *	Small tables (most per-test key tables) are searched linearly; the
+ *	hash table is created once a table grows past SYM_HASH_MIN entries
+ *	and doubled whenever it is full, so lookups and appends stay O(1)
+ *	no matter how many tags a scan produces.
  */
 
 #include <stdio.h>
@@ -68,6 +75,10 @@
 
 #define SYM_MAGIC	0xbadc0de
 
+#define SYM_HASH_MIN	8	/* entries before a hash table is built */
+#define ARENA_MIN	256	/* first arena chunk, doubled up to ARENA_MAX */
+#define ARENA_MAX	65536
+
 /*
  * Some functions can report an error message by assigning it to this
  * string.
@@ -79,6 +90,7 @@ static char *sym_error = NULL;
  *	Memory Allocators
  *
  * newsym() allocates a new symbol table header node
+ * arena_alloc(...) carves memory out of a table's arena
  * mknode(...) allocates a new symbol table entry
  */
 
@@ -93,40 +105,128 @@ SYM newsym(void)
 
 	h->magic = SYM_MAGIC;
 	h->sym = NULL;
+	h->last = NULL;
 	h->cursor = NULL;
+	h->htab = NULL;
+	h->hsize = 0;
+	h->count = 0;
+	h->arena = NULL;
 	return (h);
 }
 
-static struct sym *mknode(struct sym *next, char *key, void *data)
+static void *arena_alloc(SYM sym, size_t len)
+{
+	struct sym_arena *a = sym->arena;
+	size_t size;
+	void *p;
+
+	len = (len + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+	if (a == NULL || a->size - a->used < len) {
+		size = a == NULL ? ARENA_MIN : a->size * 2;
+		if (size > ARENA_MAX)
+			size = ARENA_MAX;
+		if (size < len)
+			size = len;
+
+		if ((a = malloc(sizeof(*a) + size)) == NULL) {
+			sym_error = "sym arena malloc failed!";
+			return (NULL);
+		}
+		a->next = sym->arena;
+		a->used = 0;
+		a->size = size;
+		sym->arena = a;
+	}
+
+	p = a->mem + a->used;
+	a->used += len;
+	return (p);
+}
+
+static void arena_free(SYM sym)
+{
+	struct sym_arena *a, *na;
+
+	for (a = sym->arena; a != NULL; a = na) {
+		na = a->next;
+		free(a);
+	}
+	sym->arena = NULL;
+}
+
+/* FNV-1a */
+static unsigned int hash_key(const char *key)
+{
+	unsigned int h = 2166136261u;
+
+	while (*key)
+		h = (h ^ (unsigned char)*key++) * 16777619u;
+	return (h);
+}
+
+static struct sym *mknode(SYM sym, char *key, void *data)
 {
 	struct sym *n;
+	size_t len = strlen(key) + 1;
 
-	if ((n = (struct sym *)malloc(sizeof(struct sym))) == NULL) {
-		sym_error = "sym node malloc failed!";
+	if ((n = arena_alloc(sym, sizeof(struct sym) + len)) == NULL)
 		return (NULL);
-	}
 
-	n->next = next;
-	n->key = strdup(key);
+	n->next = NULL;
+	n->hnext = NULL;
+	n->hash = hash_key(key);
+	n->key = (char *)(n + 1);
+	memcpy(n->key, key, len);
 	n->data = data;
 
-	if (n->key == NULL) {
-		sym_error = "sym node strdup(key) failed!";
-		return (NULL);
-	}
 	return (n);
 }
 
+/*
+ * (Re)build the hash table with room for at least 'count' entries.
+ * If this fails the table falls back to linear lookups.
+ */
+static void rehash(SYM sym, unsigned int count)
+{
+	struct sym **htab, *se;
+	unsigned int hsize;
+
+	for (hsize = SYM_HASH_MIN * 2; hsize < count; hsize *= 2) ;
+
+	if ((htab = calloc(hsize, sizeof(*htab))) == NULL) {
+		free(sym->htab);
+		sym->htab = NULL;
+		sym->hsize = 0;
+		return;
+	}
+
+	for (se = sym->sym; se != NULL; se = se->next) {
+		se->hnext = htab[se->hash & (hsize - 1)];
+		htab[se->hash & (hsize - 1)] = se;
+	}
+
+	free(sym->htab);
+	sym->htab = htab;
+	sym->hsize = hsize;
+}
+
 /*
  * Search for a key in a single-level symbol table hierarchy.
  */
-static struct sym *find_key1(struct sym *sym, char *key)
+static struct sym *find_key1(SYM sym, char *key)
 {
-	while (sym != NULL)
-		if (strcmp(sym->key, key) == 0)
-			return (sym);
-		else
-			sym = sym->next;
+	struct sym *se;
+	unsigned int hash = hash_key(key);
+
+	if (sym->htab != NULL)
+		se = sym->htab[hash & (sym->hsize - 1)];
+	else
+		se = sym->sym;
+
+	for (; se != NULL; se = sym->htab != NULL ? se->hnext : se->next)
+		if (se->hash == hash && strcmp(se->key, key) == 0)
+			return (se);
 	return (NULL);
 }
 
@@ -135,20 +235,23 @@ static struct sym *find_key1(struct sym *sym, char *key)
  */
 static int add_key(SYM sym, char *key, void *data)
 {
-	register struct sym *sn;
+	struct sym *sn;
 
-	if (sym->sym == NULL) {
-		sym->sym = mknode(NULL, key, data);
-		if (sym->sym == NULL) {
-			return (-1);
-		}
-	} else {
-		for (sn = sym->sym; sn != NULL && sn->next != NULL;
-		     sn = sn->next) ;
-		sn->next = mknode(NULL, key, data);
-		assert(sn->next != NULL);
-		if (sn->next == NULL)
-			return (-1);
+	if ((sn = mknode(sym, key, data)) == NULL)
+		return (-1);
+
+	if (sym->last == NULL)
+		sym->sym = sn;
+	else
+		sym->last->next = sn;
+	sym->last = sn;
+	sym->count++;
+
+	if (sym->htab != NULL && sym->count <= sym->hsize) {
+		sn->hnext = sym->htab[sn->hash & (sym->hsize - 1)];
+		sym->htab[sn->hash & (sym->hsize - 1)] = sn;
+	} else if (sym->count > SYM_HASH_MIN) {
+		rehash(sym, sym->count);
 	}
 	return (0);
 }
@@ -208,7 +311,7 @@ int sym_put(SYM sym, char *key, void *data, int flags)
 		return (EINVAL);
 
 	for (kk = (char **)keys, csym = sym;
-	     *kk != NULL && (nsym = find_key1(csym->sym, *kk)) != NULL;
+	     *kk != NULL && (nsym = find_key1(csym, *kk)) != NULL;
 	     csym = nsym->data) {
 
 		if (*++kk == NULL)
@@ -276,7 +379,7 @@ void *sym_get(SYM sym, char *key)
 		return (NULL);
 
 	for (kk = (char **)keys, csym = sym;
-	     *kk != NULL && (nsym = find_key1(csym->sym, *kk)) != NULL;
+	     *kk != NULL && (nsym = find_key1(csym, *kk)) != NULL;
 	     csym = nsym->data) {
 
 		if (*++kk == NULL)
@@ -451,13 +554,18 @@ int sym_rm(SYM sym, int flags)
 	for (se = sym->sym; se != NULL;) {
 		sym_rm((SYM) se->data, flags);
 		nse = se->next;
-		if (flags & RM_KEY)
-			free(se->key);
 		if (flags & RM_DATA)
 			free(se->data);
-		free(se);
 		se = nse;
 	}
+
+	/* nodes and keys go with the arena */
+	arena_free(sym);
+	free(sym->htab);
+	sym->sym = sym->last = sym->cursor = NULL;
+	sym->htab = NULL;
+	sym->hsize = sym->count = 0;
+
 	if (!(flags & RM_DATA))
 		free(sym);
 	return 0;
@@ -34,6 +34,8 @@
 #ifndef _SYMBOL_H_
 #define _SYMBOL_H_
 
+#include <stddef.h>
+
 /*
  *	"Generic" Symbol Table
  *
@@ -42,18 +44,36 @@
  *  key names.
  */
 struct sym {
-    struct sym *next;
-    char       *key;
-    void       *data;
+    struct sym   *next;		/* next in insertion order */
+    struct sym   *hnext;	/* next in hash chain */
+    unsigned int  hash;
+    char         *key;
+    void         *data;
+};
+
+/*
+ * Nodes and keys are carved out of per-table arena chunks, which are
+ * released all at once by sym_rm().
+ */
+struct sym_arena {
+    struct sym_arena *next;
+    size_t            used;
+    size_t            size;
+    char              mem[];
 };
 
 /*
  * Symbol Table Header
  */
 struct symh {
-    int         magic;
-    struct sym *sym;
-    struct sym *cursor;
+    int                magic;
+    struct sym        *sym;		/* first node */
+    struct sym        *last;		/* last node, for appending */
+    struct sym        *cursor;
+    struct sym       **htab;		/* NULL while the table is small */
+    unsigned int       hsize;
+    unsigned int       count;
+    struct sym_arena  *arena;
 };
 
 /*
@@ -89,7 +109,7 @@ int   sym_rm  (SYM sym,   int flags                        );
 /*
  * Flags for sym_rm
  */
-#define	RM_KEY	001		/* free() on key pointer */
+#define	RM_KEY	001		/* free() on key pointer (keys live in the arena) */
 #define	RM_DATA	002		/* free() on data pointer */
 
 /*
@@ -47,26 +47,29 @@
  * 	available lines start with '#'
  * 	expected line fromat: pid_t,tag,cmdline
  *
+ * The authoritative copy is a fixed-slot registry in "<zoofile>.reg" that
+ * every user mmap()s.  Entries are claimed and released with an atomic
+ * compare-and-swap on the slot's pid, so no file lock is taken and no
+ * file is scanned; line N of the text file is rewritten in place (one
+ * pwrite) whenever slot N changes.
+ *
  */
 
 #include <signal.h>
 #include <stdlib.h>		/* for getenv */
 #include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "zoolib.h"
 
-char zoo_error[ZELEN];
+#define ZOO_MAGIC	0x7a6f6f32	/* "zoo2" */
 
-#ifdef __linux__
-/* glibc2.2 definition needs -D_XOPEN_SOURCE, which breaks other things. */
-extern int sighold(int __sig);
-extern int sigrelse(int __sig);
-#endif
+char zoo_error[ZELEN];
 
 /* zoo_mark(): private function to make an entry to the zoo
  * 	returns 0 on success, -1 on error */
 static int zoo_mark(zoo_t z, char *entry);
-static int zoo_lock(zoo_t z);
-static int zoo_unlock(zoo_t z);
 /* cat_args(): helper function to make cmdline from argc, argv */
 char *cat_args(int argc, char **argv);
 
@@ -90,96 +93,224 @@ char *zoo_getname(void)
 zoo_t zoo_open(char *zooname)
 {
 	zoo_t new_zoo;
+	struct stat st;
 
-	new_zoo = (zoo_t) fopen(zooname, "r+");
-	if (!new_zoo) {
-		if (errno == ENOENT) {
-			/* file doesn't exist, try fopen(xxx, "a+") */
-			new_zoo = (zoo_t) fopen(zooname, "a+");
-			if (!new_zoo) {
-				/* total failure */
-				snprintf(zoo_error, ZELEN,
-					 "Could not open zoo as \"%s\", errno:%d %s",
-					 zooname, errno, strerror(errno));
-				return 0;
-			}
-			fclose(new_zoo);
-			new_zoo = fopen(zooname, "r+");
-		} else {
+	if ((new_zoo = malloc(sizeof(*new_zoo))) == NULL ||
+	    (new_zoo->reg_name = malloc(strlen(zooname) + 5)) == NULL) {
+		snprintf(zoo_error, ZELEN,
+			 "Malloc Error, %s/%d", __FILE__, __LINE__);
+		free(new_zoo);
+		return NULL;
+	}
+	sprintf(new_zoo->reg_name, "%s.reg", zooname);
+	new_zoo->reg_fd = -1;
+
+	new_zoo->text_fd = open(zooname, O_RDWR | O_CREAT, 0666);
+	if (new_zoo->text_fd == -1) {
+		snprintf(zoo_error, ZELEN,
+			 "Could not open zoo as \"%s\", errno:%d %s",
+			 zooname, errno, strerror(errno));
+		free(new_zoo->reg_name);
+		free(new_zoo);
+		return NULL;
+	}
+
+	/*
+	 * Every user holds a shared lock on the registry for as long as it
+	 * has the zoo open; the last one takes it exclusively to unlink
+	 * the registry, so retry if we got one that was unlinked meanwhile.
+	 */
+	for (;;) {
+		new_zoo->reg_fd = open(new_zoo->reg_name, O_RDWR | O_CREAT,
+				       0666);
+		if (new_zoo->reg_fd == -1 ||
+		    flock(new_zoo->reg_fd, LOCK_SH) ||
+		    fstat(new_zoo->reg_fd, &st)) {
 			snprintf(zoo_error, ZELEN,
-				 "Could not open zoo as \"%s\", errno:%d %s",
-				 zooname, errno, strerror(errno));
+				 "Could not open zoo registry \"%s\", "
+				 "errno:%d %s", new_zoo->reg_name, errno,
+				 strerror(errno));
+			goto err;
 		}
+		if (st.st_nlink)
+			break;
+		close(new_zoo->reg_fd);
 	}
+
+	/* a new (all zero) registry has every slot free */
+	if (st.st_size < (off_t)sizeof(struct zoo_registry) &&
+	    ftruncate(new_zoo->reg_fd, sizeof(struct zoo_registry))) {
+		snprintf(zoo_error, ZELEN,
+			 "Could not size zoo registry \"%s\", errno:%d %s",
+			 new_zoo->reg_name, errno, strerror(errno));
+		goto err;
+	}
+
+	new_zoo->reg = mmap(NULL, sizeof(struct zoo_registry),
+			    PROT_READ | PROT_WRITE, MAP_SHARED,
+			    new_zoo->reg_fd, 0);
+	if (new_zoo->reg == MAP_FAILED) {
+		snprintf(zoo_error, ZELEN,
+			 "Could not map zoo registry \"%s\", errno:%d %s",
+			 new_zoo->reg_name, errno, strerror(errno));
+		goto err;
+	}
+
+	/* racing openers store the same values */
+	if (new_zoo->reg->magic == 0) {
+		new_zoo->reg->nslots = ZOO_SLOTS;
+		__sync_bool_compare_and_swap(&new_zoo->reg->magic, 0,
+					     ZOO_MAGIC);
+	}
+	if (new_zoo->reg->magic != ZOO_MAGIC ||
+	    new_zoo->reg->nslots != ZOO_SLOTS) {
+		snprintf(zoo_error, ZELEN,
+			 "\"%s\" is not a zoo registry of %d slots",
+			 new_zoo->reg_name, ZOO_SLOTS);
+		munmap(new_zoo->reg, sizeof(struct zoo_registry));
+		goto err;
+	}
+
 	return new_zoo;
+
+err:
+	if (new_zoo->reg_fd != -1)
+		close(new_zoo->reg_fd);
+	close(new_zoo->text_fd);
+	free(new_zoo->reg_name);
+	free(new_zoo);
+	return NULL;
+}
+
+static int pid_dead(pid_t p)
+{
+	return kill(p, 0) == -1 && errno == ESRCH;
+}
+
+/* is slot i in use by a process that is still around? */
+static int zoo_slot_live(struct zoo_registry *reg, int i)
+{
+	pid_t p = reg->pids[i], owner;
+
+	if (p == 0)
+		return 0;
+	if (p > 0)
+		return !pid_dead(p);
+	owner = reg->owners[i];
+	return owner == 0 || !pid_dead(owner);
+}
+
+/*
+ * Take over slot i if it was left behind by a dead process: an entry
+ * whose pid is gone, or a slot stuck busy by a writer that died.
+ * Returns 1 with the slot busy and owned by us.
+ */
+static int zoo_reclaim(struct zoo_registry *reg, int i)
+{
+	pid_t p = reg->pids[i], owner;
+
+	if (p > 0)
+		return pid_dead(p) &&
+		    __sync_bool_compare_and_swap(&reg->pids[i], p, -1);
+	if (p == -1) {
+		owner = reg->owners[i];
+		return owner != 0 && pid_dead(owner) &&
+		    __sync_bool_compare_and_swap(&reg->owners[i], owner,
+						 getpid());
+	}
+	return 0;
 }
 
 int zoo_close(zoo_t z)
+{
+	int i;
+
+	/* we are the last user if nobody else holds the shared lock */
+	if (flock(z->reg_fd, LOCK_EX | LOCK_NB) == 0) {
+		for (i = 0; i < ZOO_SLOTS; i++)
+			if (zoo_slot_live(z->reg, i))
+				break;
+		if (i == ZOO_SLOTS)
+			unlink(z->reg_name);
+	}
+
+	return zoo_detach(z);
+}
+
+int zoo_detach(zoo_t z)
 {
 	int ret;
 
-	ret = fclose(z);
+	/* the flock belongs to the open file description, which a forked
+	 * child shares with its parent: only drop our references to it */
+	close(z->reg_fd);
+	munmap(z->reg, sizeof(struct zoo_registry));
+	ret = close(z->text_fd);
 	if (ret) {
 		snprintf(zoo_error, ZELEN,
 			 "closing zoo caused error, errno:%d %s",
 			 errno, strerror(errno));
 	}
+	free(z->reg_name);
+	free(z);
 	return ret;
 }
 
+/* rewrite line 'slot' of the text zoo file from the registry */
+static void zoo_export(zoo_t z, int slot)
+{
+	off_t off = (off_t)slot * (BUFLEN - 1);
+
+	if (pwrite(z->text_fd, z->reg->lines[slot], BUFLEN - 1, off) !=
+	    BUFLEN - 1)
+		snprintf(zoo_error, ZELEN,
+			 "error writing to zoo file, errno:%d %s",
+			 errno, strerror(errno));
+}
+
 static int zoo_mark(zoo_t z, char *entry)
 {
-	FILE *fp = (FILE *) z;
-	int found = 0;
-	long pos;
+	struct zoo_registry *reg;
 	char buf[BUFLEN];
+	pid_t p;
+	int i;
 
-	if (fp == NULL)
-		return -1;
-
-	if (zoo_lock(z))
+	if (z == NULL)
 		return -1;
+	reg = z->reg;
+	p = atoi(entry);
 
 	/* first fit */
-	rewind(fp);
-
-	do {
-		pos = ftell(fp);
-
-		if (fgets(buf, BUFLEN, fp) == NULL)
+	for (i = 0; i < ZOO_SLOTS; i++)
+		if (reg->pids[i] == 0 &&
+		    __sync_bool_compare_and_swap(&reg->pids[i], 0, -1))
 			break;
 
-		if (buf[0] == '#') {
-			rewind(fp);
-			if (fseek(fp, pos, SEEK_SET)) {
-				/* error */
-				snprintf(zoo_error, ZELEN,
-					 "seek error while writing to zoo file, errno:%d %s",
-					 errno, strerror(errno));
-				return -1;
-			}
-			/* write the entry, left justified, and padded/truncated to the
-			 * same size as the previous entry */
-			fprintf(fp, "%-*.*s\n", (int)strlen(buf) - 1,
-				(int)strlen(buf) - 1, entry);
-			found = 1;
-			break;
-		}
-	} while (1);
+	/* none free: take over one left behind by a crashed pan or test */
+	if (i == ZOO_SLOTS)
+		for (i = 0; i < ZOO_SLOTS; i++)
+			if (zoo_reclaim(reg, i))
+				break;
 
-	if (!found) {
-		if (fseek(fp, 0, SEEK_END)) {
-			snprintf(zoo_error, ZELEN,
-				 "error seeking to end of zoo file, errno:%d %s",
-				 errno, strerror(errno));
-			return -1;
-		}
-		fprintf(fp, "%-*.*s\n", 79, 79, entry);
+	if (i == ZOO_SLOTS) {
+		snprintf(zoo_error, ZELEN,
+			 "zoo is full (%d active entries)", ZOO_SLOTS);
+		return -1;
 	}
-	fflush(fp);
 
-	if (zoo_unlock(z))
-		return -1;
+	reg->owners[i] = getpid();
+
+	/* left justified and padded to the size of a line */
+	snprintf(buf, BUFLEN, "%-*.*s", BUFLEN - 2, BUFLEN - 2, entry);
+	memcpy(reg->lines[i], buf, BUFLEN - 2);
+	reg->lines[i][BUFLEN - 2] = '\n';
+	zoo_export(z, i);
+
+	/* publish the entry only once its line is complete */
+	reg->owners[i] = 0;
+	__sync_synchronize();
+	reg->pids[i] = p;
+
 	return 0;
 }
 
@@ -205,80 +336,55 @@ int zoo_mark_args(zoo_t z, pid_t p, char *tag, int ac, char **av)
 
 int zoo_clear(zoo_t z, pid_t p)
 {
-	FILE *fp = (FILE *) z;
-	long pos;
-	char buf[BUFLEN];
-	pid_t that_pid;
-	int found = 0;
+	struct zoo_registry *reg;
+	int i;
 
-	if (fp == NULL)
+	if (z == NULL)
 		return -1;
+	reg = z->reg;
 
-	if (zoo_lock(z))
-		return -1;
-	rewind(fp);
-
-	do {
-		pos = ftell(fp);
-
-		if (fgets(buf, BUFLEN, fp) == NULL)
+	for (i = 0; i < ZOO_SLOTS; i++)
+		if (reg->pids[i] == p &&
+		    __sync_bool_compare_and_swap(&reg->pids[i], p, -1))
 			break;
 
-		if (buf[0] == '#')
-			continue;
-
-		that_pid = atoi(buf);
-		if (that_pid == p) {
-			if (fseek(fp, pos, SEEK_SET)) {
-				/* error */
-				snprintf(zoo_error, ZELEN,
-					 "seek error while writing to zoo file, errno:%d %s",
-					 errno, strerror(errno));
-				return -1;
-			}
-			if (ftell(fp) != pos) {
-				printf("fseek failed\n");
-			}
-			fputs("#", fp);
-			found = 1;
-			break;
-		}
-	} while (1);
-
-	fflush(fp);
-
-	/* FIXME: unlock zoo file */
-	if (zoo_unlock(z))
-		return -1;
-
-	if (!found) {
+	if (i == ZOO_SLOTS) {
 		snprintf(zoo_error, ZELEN,
 			 "zoo_clear() did not find pid(%d)", p);
 		return 1;
 	}
-	return 0;
+	reg->owners[i] = getpid();
 
+	reg->lines[i][0] = '#';
+	zoo_export(z, i);
+
+	/* the slot may be reused only once the text line is recycled */
+	reg->owners[i] = 0;
+	__sync_synchronize();
+	reg->pids[i] = 0;
+
+	return 0;
 }
 
 pid_t zoo_getpid(zoo_t z, char *tag)
 {
-	FILE *fp = (FILE *) z;
+	struct zoo_registry *reg;
 	char buf[BUFLEN], *s;
-	pid_t this_pid = -1;
+	pid_t this_pid;
+	int i;
 
-	if (fp == NULL)
+	if (z == NULL)
 		return -1;
+	reg = z->reg;
 
-	if (zoo_lock(z))
-		return -1;
-
-	rewind(fp);
-	do {
-		if (fgets(buf, BUFLEN, fp) == NULL)
-			break;
+	for (i = 0; i < ZOO_SLOTS; i++) {
+		this_pid = reg->pids[i];
+		if (this_pid <= 0)
+			continue;	/* free or being updated */
 
-		if (buf[0] == '#')
-			continue;	/* recycled line */
+		__sync_synchronize();
+		memcpy(buf, reg->lines[i], BUFLEN - 2);
+		buf[BUFLEN - 2] = '\0';
 
 		if ((s = strchr(buf, ',')) == NULL)
 			continue;	/* line was not expected format */
@@ -286,85 +392,14 @@ pid_t zoo_getpid(zoo_t z, char *tag)
 		if (strncmp(s + 1, tag, strlen(tag)))
 			continue;	/* tag does not match */
 
-		this_pid = atoi(buf);
-		break;
-	} while (1);
-
-	if (zoo_unlock(z))
-		return -1;
-	return this_pid;
-}
-
-int zoo_lock(zoo_t z)
-{
-	FILE *fp = (FILE *) z;
-	struct flock zlock;
-	sigset_t block_these;
-	int ret;
-
-	if (fp == NULL)
-		return -1;
-
-	zlock.l_whence = zlock.l_start = zlock.l_len = 0;
-	zlock.l_type = F_WRLCK;
-
-	sigemptyset(&block_these);
-	sigaddset(&block_these, SIGINT);
-	sigaddset(&block_these, SIGTERM);
-	sigaddset(&block_these, SIGHUP);
-	sigaddset(&block_these, SIGUSR1);
-	sigaddset(&block_these, SIGUSR2);
-	sigprocmask(SIG_BLOCK, &block_these, NULL);
-
-	do {
-		ret = fcntl(fileno(fp), F_SETLKW, &zlock);
-	} while (ret == -1 && errno == EINTR);
+		/* the slot could have been recycled while we copied it */
+		if (reg->pids[i] != this_pid)
+			continue;
 
-	sigprocmask(SIG_UNBLOCK, &block_these, NULL);
-	if (ret == -1) {
-		snprintf(zoo_error, ZELEN,
-			 "failed to unlock zoo file, errno:%d %s",
-			 errno, strerror(errno));
-		return -1;
+		return this_pid;
 	}
-	return 0;
-
-}
 
-int zoo_unlock(zoo_t z)
-{
-	FILE *fp = (FILE *) z;
-	struct flock zlock;
-	sigset_t block_these;
-	int ret;
-
-	if (fp == NULL)
-		return -1;
-
-	zlock.l_whence = zlock.l_start = zlock.l_len = 0;
-	zlock.l_type = F_UNLCK;
-
-	sigemptyset(&block_these);
-	sigaddset(&block_these, SIGINT);
-	sigaddset(&block_these, SIGTERM);
-	sigaddset(&block_these, SIGHUP);
-	sigaddset(&block_these, SIGUSR1);
-	sigaddset(&block_these, SIGUSR2);
-	sigprocmask(SIG_BLOCK, &block_these, NULL);
-
-	do {
-		ret = fcntl(fileno(fp), F_SETLKW, &zlock);
-	} while (ret == -1 && errno == EINTR);
-
-	sigprocmask(SIG_UNBLOCK, &block_these, NULL);
-
-	if (ret == -1) {
-		snprintf(zoo_error, ZELEN,
-			 "failed to lock zoo file, errno:%d %s",
-			 errno, strerror(errno));
-		return -1;
-	}
-	return 0;
+	return -1;
 }
 
 char *cat_args(int argc, char **argv)
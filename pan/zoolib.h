@@ -41,12 +41,36 @@
 #include <fcntl.h>
 #include <sys/signal.h>
 
-typedef FILE *zoo_t;
 #define ZELEN 512
 extern char zoo_error[ZELEN];
 #define BUFLEN 81
 
-int lock_file( FILE *fp, short ltype, char **errmsg );
+/* number of entries the active registry holds */
+#define ZOO_SLOTS 4096
+
+/*
+ * Shared registry, mmap()ed by every pan and ltp-bump using the same zoo.
+ * pids[] is scanned and updated with atomic compare-and-swap; a slot is
+ * free when its pid is 0 and busy (being written) when it is -1, in which
+ * case owners[] holds the pid of the process writing it.
+ */
+struct zoo_registry {
+	unsigned int magic;
+	unsigned int nslots;
+	volatile pid_t pids[ZOO_SLOTS];
+	volatile pid_t owners[ZOO_SLOTS];
+	char lines[ZOO_SLOTS][BUFLEN - 1];	/* as in the text file */
+};
+
+struct zoo {
+	struct zoo_registry *reg;
+	int text_fd;		/* the text zoo file, kept for `cat` */
+	int reg_fd;		/* holds a shared flock while open */
+	char *reg_name;		/* removed by the last zoo_close() */
+};
+
+typedef struct zoo *zoo_t;
+
 /* FILE *open_file( char *file, char *mode, char **errmsg ); */
 
 void wait_handler();
@@ -56,13 +80,18 @@ void wait_handler();
  * 	returns NULL on error */
 char *zoo_getname(void);
 
-/* zoo_open(): open a zoo file for use
+/* zoo_open(): open a zoo for use; the registry is kept in "<zooname>.reg"
  * 	returns NULL on error */
 zoo_t zoo_open(char *zooname);
 
-/* zoo_close(): close an open zoo file */
+/* zoo_close(): close an open zoo, removing the registry when it has no
+ *	live entries left */
 int zoo_close(zoo_t z);
 
+/* zoo_detach(): release a zoo inherited over fork() without touching the
+ *	registry lock or file, so the parent keeps its zoo open */
+int zoo_detach(zoo_t z);
+
 /* zoo_mark_cmdline(): make an entry to the zoo
  *	returns 0 on success, -1 on error */
 int zoo_mark_cmdline(zoo_t z, pid_t p, char *tag, char *cmdline);
@@ -20,9 +20,11 @@
 /*                                                                            */
 /******************************************************************************/
 
+#define _GNU_SOURCE
 #include <sys/socket.h>
 #include <sys/poll.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -67,6 +69,37 @@ static struct sigaction sigint_action;
 
 struct nlmsghdr *nlhdr;
 
+/*
+ * Benchmark mode, selected by any of -b, -m, -q or -r: events are read
+ * in batches with recvmmsg(), receive buffer overruns are counted
+ * instead of being fatal and a throughput report is printed at exit.
+ */
+static int bench;
+static int batch = 1;		/* -m: messages per recvmmsg() */
+static int quiet;		/* -q: don't print the events */
+static int rcvbuf;		/* -r: SO_RCVBUF size */
+static FILE *binlog;		/* -b: binary event log */
+
+/*
+ * The proc connector numbers its messages with a per cpu counter that
+ * only advances while someone listens, so a gap in the sequence of a
+ * cpu is the number of events we lost there.
+ */
+static int nr_cpus;
+static __u32 *last_seq;
+static char *seen_cpu;
+
+static unsigned long nr_events;
+static unsigned long nr_lost;
+static unsigned long nr_overruns;
+
+/* one record of the -b log */
+struct pec_record {
+	__u32 seq;		/* cn_msg sequence number */
+	__u32 lost;		/* events lost on this cpu right before */
+	struct proc_event event;
+};
+
 /*
  * Handler for signal int. Set exit flag.
  *
@@ -222,6 +255,160 @@ static void process_event(struct nlmsghdr *nlhdr)
 	}
 }
 
+/*
+ * Account for and log one PEC event, print it unless quiet.
+ *
+ * @nlhdr: the netlinke pacakge
+ */
+static void handle_event(struct nlmsghdr *nlhdr)
+{
+	struct cn_msg *msg;
+	struct proc_event *pe;
+	struct pec_record rec;
+	__u32 lost = 0;
+
+	msg = (struct cn_msg *)NLMSG_DATA(nlhdr);
+	pe = (struct proc_event *)msg->data;
+
+	/* the ack of our listen request carries our own sequence */
+	if (pe->what != PROC_EVENT_NONE && pe->cpu < (__u32)nr_cpus) {
+		if (seen_cpu[pe->cpu])
+			lost = msg->seq - last_seq[pe->cpu] - 1;
+		seen_cpu[pe->cpu] = 1;
+		last_seq[pe->cpu] = msg->seq;
+		nr_lost += lost;
+	}
+	nr_events++;
+
+	if (binlog) {
+		rec.seq = msg->seq;
+		rec.lost = lost;
+		memcpy(&rec.event, pe, sizeof(rec.event));
+		if (fwrite(&rec, sizeof(rec), 1, binlog) != 1) {
+			fprintf(stderr, "failed to write event log\n");
+			exit(1);
+		}
+	}
+
+	if (!quiet)
+		process_event(nlhdr);
+}
+
+/*
+ * Receive PEC events in batches until SIGINT.
+ *
+ * @sd: socket descriptor
+ * @to: the sockaddr of PEC, to close listening on errors
+ */
+static void listen_batched(int sd, struct sockaddr_nl *to)
+{
+	struct mmsghdr *msgs;
+	struct iovec *iovs;
+	struct nlmsghdr *nlh;
+	struct pollfd pfd;
+	char *bufs;
+	int i, n, len;
+
+	msgs = calloc(batch, sizeof(*msgs));
+	iovs = calloc(batch, sizeof(*iovs));
+	bufs = malloc(batch * NLMSG_SPACE(MAX_MSG_SIZE));
+	if (!msgs || !iovs || !bufs) {
+		fprintf(stderr, "lack of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < batch; i++) {
+		iovs[i].iov_base = bufs + i * NLMSG_SPACE(MAX_MSG_SIZE);
+		iovs[i].iov_len = NLMSG_SPACE(MAX_MSG_SIZE);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	pfd.fd = sd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	while (!exit_flag) {
+		if (poll(&pfd, 1, -1) == -1) {
+			if (errno == EINTR)
+				break;
+			control_pec(sd, to, PROC_CN_MCAST_IGNORE);
+			fprintf(stderr, "failed to poll\n");
+			exit(1);
+		}
+
+		n = recvmmsg(sd, msgs, batch, MSG_DONTWAIT, NULL);
+		if (n == -1) {
+			if (errno == EINTR)
+				break;
+			if (errno == EAGAIN)
+				continue;
+			if (errno == ENOBUFS) {
+				/* the kernel dropped events, the seq gaps
+				 * tell how many */
+				nr_overruns++;
+				continue;
+			}
+			control_pec(sd, to, PROC_CN_MCAST_IGNORE);
+			fprintf(stderr, "failed to receive from netlink\n");
+			exit(1);
+		}
+
+		for (i = 0; i < n; i++) {
+			nlh = iovs[i].iov_base;
+			len = msgs[i].msg_len;
+			for (; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+				if (nlh->nlmsg_type == NLMSG_ERROR) {
+					fprintf(stderr,
+						"err message recieved.\n");
+					exit(1);
+				}
+				/* message sent from kernel */
+				if (nlh->nlmsg_type == NLMSG_DONE &&
+				    nlh->nlmsg_pid == 0)
+					handle_event(nlh);
+			}
+		}
+	}
+
+	free(bufs);
+	free(iovs);
+	free(msgs);
+}
+
+/*
+ * Print the benchmark report.
+ *
+ * @sd: socket descriptor
+ * @secs: how long we listened
+ */
+static void report(int sd, double secs)
+{
+	int size = 0;
+	socklen_t optlen = sizeof(size);
+
+	getsockopt(sd, SOL_SOCKET, SO_RCVBUF, &size, &optlen);
+	fprintf(stderr, "events: %lu in %.3f secs, %.0f events/sec\n",
+		nr_events, secs, secs > 0 ? nr_events / secs : 0.0);
+	fprintf(stderr, "lost: %lu events, %lu receive buffer overruns\n",
+		nr_lost, nr_overruns);
+	fprintf(stderr, "batch: %d messages, rcvbuf: %d bytes\n",
+		batch, size);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: pec_listener [-q] [-m batch] [-r rcvbuf] "
+		"[-b logfile]\n");
+	fprintf(stderr, "  -q         don't print the events\n");
+	fprintf(stderr, "  -m batch   receive up to batch events per "
+		"recvmmsg()\n");
+	fprintf(stderr, "  -r rcvbuf  socket receive buffer size in bytes\n");
+	fprintf(stderr, "  -b logfile log every event as a binary "
+		"struct pec_record\n");
+	fprintf(stderr, "Any option selects the benchmark mode, which counts "
+		"lost events\nand reports the event rate on exit.\n");
+	exit(1);
+}
+
 int main(int argc, char **argv)
 {
 	int ret;
@@ -229,6 +416,46 @@ int main(int argc, char **argv)
 	struct sockaddr_nl l_local;
 	struct sockaddr_nl src_addr;
 	struct pollfd pfd;
+	struct timespec start, stop;
+	int c;
+
+	while ((c = getopt(argc, argv, "b:m:qr:")) != -1) {
+		switch (c) {
+		case 'b':
+			binlog = fopen(optarg, "w");
+			if (!binlog) {
+				fprintf(stderr, "failed to open %s\n", optarg);
+				exit(1);
+			}
+			/* keep the log writes off the receive path */
+			setvbuf(binlog, NULL, _IOFBF, 1 << 20);
+			break;
+		case 'm':
+			batch = atoi(optarg);
+			if (batch < 1)
+				usage();
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		case 'r':
+			rcvbuf = atoi(optarg);
+			if (rcvbuf < 1)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	bench = binlog || batch > 1 || quiet || rcvbuf;
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	last_seq = calloc(nr_cpus, sizeof(*last_seq));
+	seen_cpu = calloc(nr_cpus, sizeof(*seen_cpu));
+	if (!last_seq || !seen_cpu) {
+		fprintf(stderr, "lack of memory\n");
+		exit(1);
+	}
 
 	sigint_action.sa_flags = SA_ONESHOT;
 	sigint_action.sa_handler = &sigint_handler;
@@ -262,6 +489,16 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	/* root may go past net.core.rmem_max */
+	if (rcvbuf &&
+	    setsockopt(sd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf,
+		       sizeof(rcvbuf)) == -1 &&
+	    setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+		       sizeof(rcvbuf)) == -1) {
+		fprintf(stderr, "failed to set receive buffer size\n");
+		exit(1);
+	}
+
 	/* Open PEC listening */
 	ret = control_pec(sd, &src_addr, PROC_CN_MCAST_LISTEN);
 	if (!ret) {
@@ -269,11 +506,16 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
 	/* Receive msg from PEC */
+	if (bench)
+		listen_batched(sd, &src_addr);
+
 	pfd.fd = sd;
 	pfd.events = POLLIN;
 	pfd.revents = 0;
-	while (!exit_flag) {
+	while (!bench && !exit_flag) {
 
 		ret = poll(&pfd, 1, -1);
 		if (ret == 0 || (ret == -1 && errno != EINTR)) {
@@ -302,7 +544,7 @@ int main(int argc, char **argv)
 			case NLMSG_DONE:
 				/* message sent from kernel */
 				if (nlhdr->nlmsg_pid == 0)
-					process_event(nlhdr);
+					handle_event(nlhdr);
 				break;
 			default:
 				break;
@@ -310,6 +552,8 @@ int main(int argc, char **argv)
 		}
 	}
 
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
 	/* Close PEC listening */
 	ret = control_pec(sd, &src_addr, PROC_CN_MCAST_IGNORE);
 	if (!ret) {
@@ -317,6 +561,15 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (bench)
+		report(sd, stop.tv_sec - start.tv_sec +
+		       (stop.tv_nsec - start.tv_nsec) / 1e9);
+
+	if (binlog && fclose(binlog)) {
+		fprintf(stderr, "failed to write event log\n");
+		exit(1);
+	}
+
 	close(sd);
 	free(nlhdr);
 
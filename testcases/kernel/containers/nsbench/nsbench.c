@@ -0,0 +1,357 @@
+/*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+* the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*
+***************************************************************************
+ * Namespace creation and teardown benchmark.
+ *
+ * N threads each create and tear down a set of namespaces (pid, net,
+ * ipc, uts, mnt, user or any combination) over and over, either with
+ * clone() of a new task or with unshare() in a forked child, the two
+ * ways libclone sets up its tests.  For every set and method the rate
+ * of creations and the latency percentiles of the creation and of the
+ * teardown are reported.
+ *
+ * Creation is the clone() or unshare() call itself.  Teardown runs
+ * from telling the task to exit to its waitpid() returning; the kernel
+ * frees part of a network namespace later from a workqueue, which is
+ * not included.
+ */
+
+#define _GNU_SOURCE 1
+#include <sys/wait.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include "test.h"
+#include "tst_clock.h"
+#include "tst_hist.h"
+#include <libclone.h>
+
+char *TCID = "nsbench";
+int TST_TOTAL = 1;
+
+#define STACK_SIZE	(getpagesize() * 6)
+
+static const struct {
+	const char *name;
+	unsigned long flag;
+} ns_types[] = {
+	{"pid", CLONE_NEWPID},
+	{"net", CLONE_NEWNET},
+	{"ipc", CLONE_NEWIPC},
+	{"uts", CLONE_NEWUTS},
+	{"mnt", CLONE_NEWNS},
+	{"user", CLONE_NEWUSER},
+};
+
+#define NS_ALL	(CLONE_NEWPID | CLONE_NEWNET | CLONE_NEWIPC | \
+		 CLONE_NEWUTS | CLONE_NEWNS | CLONE_NEWUSER)
+
+static const char *default_sets = "pid,net,ipc,uts,mnt,user,all";
+
+/* what the task of the unshare method reports back */
+struct unshare_res {
+	unsigned long long ns;
+	int err;		/* errno of a failed unshare(), else 0 */
+};
+
+struct worker {
+	pthread_t tid;
+	int go[2];		/* tells the namespace task to exit */
+	char *stack;
+	unsigned long errors;
+	int first_errno;
+	struct tst_hist create;
+	struct tst_hist teardown;
+};
+
+static int nthreads = 1;
+static unsigned long iterations = 1000;
+static unsigned long cur_flags;
+static int cur_method;		/* T_CLONE or T_UNSHARE */
+
+/* the namespace task of the clone method: wait to be told to exit */
+static int clone_child(void *arg)
+{
+	struct worker *w = arg;
+	char c;
+
+	return read(w->go[0], &c, 1) != 1;
+}
+
+/* wait for pid after telling it to go, account the teardown */
+static int teardown(struct worker *w, pid_t pid)
+{
+	unsigned long long t0;
+	int status;
+
+	t0 = tst_clock_ns();
+	if (write(w->go[1], "x", 1) != 1)
+		return -1;
+	if (waitpid(pid, &status, 0) != pid)
+		return -1;
+	tst_hist_add(&w->teardown, tst_clock_ns() - t0);
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+static int clone_once(struct worker *w)
+{
+	unsigned long long t0, t1;
+	pid_t pid;
+
+	t0 = tst_clock_ns();
+	pid = ltp_clone(cur_flags | SIGCHLD, clone_child, w, STACK_SIZE,
+			w->stack);
+	t1 = tst_clock_ns();
+	if (pid == -1)
+		return -1;
+	tst_hist_add(&w->create, t1 - t0);
+	return teardown(w, pid);
+}
+
+static int unshare_once(struct worker *w)
+{
+	struct unshare_res res;
+	unsigned long long t0;
+	pid_t pid;
+	ssize_t n;
+	int rpipe[2];
+	int err;
+	char c;
+
+	/*
+	 * A pipe per task, so that the parent, having closed the write end,
+	 * sees EOF rather than blocking if the task dies before reporting.
+	 */
+	if (pipe(rpipe))
+		return -1;
+	pid = fork();
+	if (pid == -1) {
+		err = errno;
+		close(rpipe[0]);
+		close(rpipe[1]);
+		errno = err;
+		return -1;
+	}
+	if (pid == 0) {
+		close(rpipe[0]);
+		t0 = tst_clock_ns();
+		res.err = ltp_syscall(SYS_unshare, cur_flags) == -1 ? errno : 0;
+		res.ns = tst_clock_ns() - t0;
+		if (write(rpipe[1], &res, sizeof(res)) != sizeof(res) ||
+		    res.err)
+			_exit(1);
+		_exit(read(w->go[0], &c, 1) != 1);
+	}
+
+	close(rpipe[1]);
+	n = read(rpipe[0], &res, sizeof(res));
+	close(rpipe[0]);
+	if (n == 0)
+		res.err = ECHILD;
+	else if (n != sizeof(res))
+		res.err = n == -1 ? errno : EIO;
+	if (res.err) {
+		err = res.err;
+		waitpid(pid, NULL, 0);
+		errno = err;
+		return -1;
+	}
+	tst_hist_add(&w->create, res.ns);
+	return teardown(w, pid);
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long i;
+	int ret;
+
+	for (i = 0; i < iterations; i++) {
+		if (cur_method == T_CLONE)
+			ret = clone_once(w);
+		else
+			ret = unshare_once(w);
+		if (ret == -1) {
+			if (!w->errors)
+				w->first_errno = errno;
+			w->errors++;
+		}
+	}
+	return NULL;
+}
+
+static void run(struct worker *workers, const char *set, unsigned long flags,
+		int method)
+{
+	struct tst_hist create, tdown;
+	unsigned long long start, stop;
+	unsigned long errors = 0;
+	int first_errno = 0;
+	double secs;
+	int i;
+
+	cur_flags = flags;
+	cur_method = method;
+	for (i = 0; i < nthreads; i++) {
+		memset(&workers[i].create, 0, sizeof(workers[i].create));
+		memset(&workers[i].teardown, 0, sizeof(workers[i].teardown));
+		workers[i].errors = 0;
+		workers[i].first_errno = 0;
+	}
+
+	start = tst_clock_ns();
+	for (i = 0; i < nthreads; i++) {
+		errno = pthread_create(&workers[i].tid, NULL, worker,
+				       &workers[i]);
+		if (errno)
+			tst_brkm(TBROK | TERRNO, NULL, "pthread_create failed");
+	}
+	for (i = 0; i < nthreads; i++)
+		pthread_join(workers[i].tid, NULL);
+	stop = tst_clock_ns();
+
+	memset(&create, 0, sizeof(create));
+	memset(&tdown, 0, sizeof(tdown));
+	for (i = 0; i < nthreads; i++) {
+		tst_hist_merge(&create, &workers[i].create);
+		tst_hist_merge(&tdown, &workers[i].teardown);
+		if (workers[i].errors && !errors)
+			first_errno = workers[i].first_errno;
+		errors += workers[i].errors;
+	}
+
+	secs = (stop - start) / 1e9;
+	printf("%-16s %-7s %8llu %10.0f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %7lu",
+	       set, method == T_CLONE ? "clone" : "unshare", create.count,
+	       secs > 0 ? create.count / secs : 0.0,
+	       tst_hist_usecs(&create, 0.5), tst_hist_usecs(&create, 0.99),
+	       create.max_ns / 1000.0,
+	       tst_hist_usecs(&tdown, 0.5), tst_hist_usecs(&tdown, 0.99),
+	       tdown.max_ns / 1000.0, errors);
+	if (errors)
+		printf(" (%s)", strerror(first_errno));
+	printf("\n");
+	fflush(stdout);
+}
+
+/* "pid+net" -> CLONE_NEWPID | CLONE_NEWNET, 0 if invalid */
+static unsigned long parse_set(char *set)
+{
+	unsigned long flags = 0;
+	char *tok, *save;
+	unsigned int i;
+
+	for (tok = strtok_r(set, "+", &save); tok;
+	     tok = strtok_r(NULL, "+", &save)) {
+		if (!strcmp(tok, "all")) {
+			flags |= NS_ALL;
+			continue;
+		}
+		for (i = 0; i < ARRAY_SIZE(ns_types); i++)
+			if (!strcmp(tok, ns_types[i].name))
+				break;
+		if (i == ARRAY_SIZE(ns_types))
+			return 0;
+		flags |= ns_types[i].flag;
+	}
+	return flags;
+}
+
+static void usage(char *prog)
+{
+	printf("%s [-t threads] [-i iterations] [-m clone|unshare|both] "
+	       "[-s sets]\n", prog);
+	printf("  -t threads     creating threads (default 1)\n");
+	printf("  -i iterations  creations per thread and set (default 1000)\n");
+	printf("  -m method      clone a task or unshare in a forked one "
+	       "(default both)\n");
+	printf("  -s sets        comma separated namespace sets, each a '+' "
+	       "separated list of\n"
+	       "                 pid,net,ipc,uts,mnt,user or all "
+	       "(default %s)\n", default_sets);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct worker *workers;
+	char *sets = NULL, *set, *save, *name;
+	unsigned long flags;
+	int do_clone = 1, do_unshare = 1;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "t:i:m:s:")) != -1) {
+		switch (c) {
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'i':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			do_clone = !strcmp(optarg, "clone") ||
+			    !strcmp(optarg, "both");
+			do_unshare = !strcmp(optarg, "unshare") ||
+			    !strcmp(optarg, "both");
+			if (!do_clone && !do_unshare)
+				usage(argv[0]);
+			break;
+		case 's':
+			sets = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || nthreads < 1 || iterations < 1)
+		usage(argv[0]);
+	if (!sets)
+		sets = strdup(default_sets);
+
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!workers)
+		tst_brkm(TBROK | TERRNO, NULL, "malloc failed");
+	for (i = 0; i < nthreads; i++) {
+		workers[i].stack = malloc(STACK_SIZE);
+		if (!workers[i].stack)
+			tst_brkm(TBROK | TERRNO, NULL, "malloc failed");
+		if (pipe(workers[i].go))
+			tst_brkm(TBROK | TERRNO, NULL, "pipe failed");
+	}
+
+	printf("%d threads, %lu creations per thread\n", nthreads, iterations);
+	printf("%-16s %-7s %8s %10s %9s %9s %9s %9s %9s %9s %7s\n", "set",
+	       "method", "ops", "ops/s", "cr50(us)", "cr99(us)", "crmax(us)",
+	       "td50(us)", "td99(us)", "tdmax(us)", "errors");
+	for (set = strtok_r(sets, ",", &save); set;
+	     set = strtok_r(NULL, ",", &save)) {
+		name = strdup(set);
+		if (!name)
+			tst_brkm(TBROK | TERRNO, NULL, "malloc failed");
+		flags = parse_set(set);
+		if (!flags)
+			usage(argv[0]);
+		if (do_clone)
+			run(workers, name, flags, T_CLONE);
+		if (do_unshare)
+			run(workers, name, flags, T_UNSHARE);
+		free(name);
+	}
+
+	tst_exit();
+}
@@ -21,6 +21,7 @@
 
 #define _GNU_SOURCE
 #define __USE_GNU
+#include "config.h"
 
 #include <errno.h>
 #include <stdio.h>
@@ -34,6 +35,12 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <math.h>
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
 
 #ifndef PAGE_SIZE
 #define PAGE_SIZE sysconf(_SC_PAGE_SIZE)
@@ -43,12 +50,23 @@
 #define __align_mask(x,mask)	(((x)+(mask))&~(mask))
 #define kb(x)			((x) >> 10)
 
-const char usage[] = "Usage: iobw [-direct] threads chunk_size data_size\n";
+const char usage[] =
+    "Usage: iobw [-direct] [-depth n] [-interval ms] [-csv file] threads "
+    "chunk_size data_size\n"
+    "       iobw -fairness csv_file...\n"
+    "  -depth n     keep n O_DIRECT requests in flight per task (io_uring)\n"
+    "  -interval ms sample each task's bandwidth and IOPS every ms\n"
+    "  -csv file    append the samples to file (- for stdout)\n"
+    "  -fairness    summarize the samples of several cgroups' runs\n";
+const char csv_header[] = "group,task,op,t_ms,bytes,ios,kib_s,iops\n";
 const char child_fmt[] = "(%s) task %3d: time %4lu.%03lu bw %7lu KiB/s (%s)\n";
 const char parent_fmt[] =
     "(%s) parent %d: time %4lu.%03lu bw %7lu KiB/s (%s)\n";
 
 static int directio = 0;
+static int depth = 1;
+static long interval_ms = 0;
+static int csv_fd = -1;
 static size_t data_size = 0;
 static size_t chunk_size = 0;
 
@@ -77,6 +95,202 @@ static void print_results(int id, iops_t op, size_t bytes, struct timeval *diff)
 		* 1000000L / 1024, iops[op]);
 }
 
+/*
+ * Per-task, per-op bandwidth samples: every interval_ms the bytes and
+ * requests completed since the previous sample go to the CSV file.
+ */
+struct sampler {
+	int id;
+	iops_t op;
+	struct timeval start;
+	struct timeval last;
+	size_t bytes;
+	size_t ios;
+};
+
+static long tv_ms(struct timeval *tv)
+{
+	return tv->tv_sec * 1000L + tv->tv_usec / 1000;
+}
+
+static void sample_init(struct sampler *s, int id, iops_t op)
+{
+	s->id = id;
+	s->op = op;
+	gettimeofday(&s->start, NULL);
+	s->last = s->start;
+	s->bytes = s->ios = 0;
+}
+
+static void sample_add(struct sampler *s, size_t bytes, int flush)
+{
+	struct timeval now, t, diff;
+	char line[256];
+	long us;
+	int len;
+
+	s->bytes += bytes;
+	s->ios += bytes ? 1 : 0;
+	if (!interval_ms || csv_fd < 0)
+		return;
+	gettimeofday(&now, NULL);
+	timersub(&now, &s->last, &diff);
+	us = diff.tv_sec * 1000000L + diff.tv_usec;
+	if (us < interval_ms * 1000L && !(flush && s->ios))
+		return;
+	if (us == 0)
+		us = 1;
+	timersub(&now, &s->start, &t);
+	len = snprintf(line, sizeof(line), "%s,%d,%s,%ld,%zu,%zu,%.0f,%.0f\n",
+		       mygroup, s->id, s->op == OP_WRITE ? "write" : "read",
+		       tv_ms(&t), s->bytes, s->ios,
+		       s->bytes * 1000000.0 / 1024 / us,
+		       s->ios * 1000000.0 / us);
+	/* O_APPEND and a single write keep the tasks' lines whole */
+	if (write(csv_fd, line, len) != len)
+		fprintf(stderr, "WARNING: task %d couldn't write a sample\n",
+			s->id);
+	s->last = now;
+	s->bytes = s->ios = 0;
+}
+
+#ifdef HAVE_LINUX_IO_URING_H
+/*
+ * A bare io_uring with depth entries, used for -depth > 1 instead of
+ * pulling in libaio or liburing.
+ */
+struct uring {
+	int fd;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+};
+
+static int uring_init(struct uring *r, unsigned entries)
+{
+	struct io_uring_params p;
+	char *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	r->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0)
+		return -1;
+	sq = mmap(0, p.sq_off.array + p.sq_entries * sizeof(unsigned),
+		  PROT_READ | PROT_WRITE, MAP_SHARED, r->fd,
+		  IORING_OFF_SQ_RING);
+	cq = mmap(0, p.cq_off.cqes + p.cq_entries * sizeof(*r->cqes),
+		  PROT_READ | PROT_WRITE, MAP_SHARED, r->fd,
+		  IORING_OFF_CQ_RING);
+	r->sqes = mmap(0, p.sq_entries * sizeof(*r->sqes),
+		       PROT_READ | PROT_WRITE, MAP_SHARED, r->fd,
+		       IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || r->sqes == MAP_FAILED)
+		return -1;
+	r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *)(sq + p.sq_off.array);
+	r->cq_head = (unsigned *)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+}
+
+/*
+ * Write or read data_size bytes of fd sequentially with up to depth
+ * chunk_size requests in flight, each using its own slice of bufs.  A
+ * request that completes short is resubmitted for the rest of its chunk.
+ */
+static int uring_io(struct uring *r, int fd, iops_t op, char *bufs,
+		    struct sampler *s)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int freeslots[depth];
+	int partial[depth];
+	size_t slot_off[depth];
+	size_t slot_done[depth];
+	int nfree = depth, npartial = 0;
+	size_t off = 0;
+	unsigned tail, head;
+	int submit, ret, slot;
+
+	for (slot = 0; slot < depth; slot++)
+		freeslots[slot] = slot;
+	while (off < data_size || nfree < depth) {
+		tail = *r->sq_tail;
+		for (submit = 0; npartial || (nfree && off < data_size);
+		     submit++) {
+			if (npartial) {
+				slot = partial[--npartial];
+			} else {
+				slot = freeslots[--nfree];
+				slot_off[slot] = off;
+				slot_done[slot] = 0;
+				off += chunk_size;
+			}
+			sqe = &r->sqes[tail & *r->sq_mask];
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = op == OP_WRITE ? IORING_OP_WRITE :
+			    IORING_OP_READ;
+			sqe->fd = fd;
+			sqe->addr = (unsigned long)(bufs + slot * chunk_size +
+						    slot_done[slot]);
+			sqe->len = chunk_size - slot_done[slot];
+			sqe->off = slot_off[slot] + slot_done[slot];
+			sqe->user_data = slot;
+			r->sq_array[tail & *r->sq_mask] = tail & *r->sq_mask;
+			tail++;
+		}
+		__atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+		ret = syscall(__NR_io_uring_enter, r->fd, submit, 1,
+			      IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret < 0 && errno != EINTR)
+			return -errno;
+		head = *r->cq_head;
+		while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &r->cqes[head & *r->cq_mask];
+			if (cqe->res < 0)
+				return cqe->res;
+			if (cqe->res == 0)
+				return -EIO;
+			slot = cqe->user_data;
+			slot_done[slot] += cqe->res;
+			if (slot_done[slot] < chunk_size)
+				partial[npartial++] = slot;
+			else
+				freeslots[nfree++] = slot;
+			sample_add(s, cqe->res, 0);
+			head++;
+		}
+		__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return 0;
+}
+#else
+/* -depth > 1 is refused at option parsing without io_uring */
+struct uring {
+	int fd;
+};
+
+static int uring_init(struct uring *r, unsigned entries)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+static int uring_io(struct uring *r, int fd, iops_t op, char *bufs,
+		    struct sampler *s)
+{
+	return -ENOSYS;
+}
+#endif /* HAVE_LINUX_IO_URING_H */
+
 static void thread(int id)
 {
 	struct timeval start, stop, diff;
@@ -86,14 +300,17 @@ static void thread(int id)
 	int flags = O_CREAT | O_RDWR | O_LARGEFILE;
 	char filename[32];
 
-	ret = posix_memalign(&buf, PAGE_SIZE, chunk_size);
+	struct uring ring;
+	struct sampler smp;
+
+	ret = posix_memalign(&buf, PAGE_SIZE, chunk_size * depth);
 	if (ret < 0) {
 		fprintf(stderr,
 			"ERROR: task %d couldn't allocate %zu bytes (%s)\n",
 			id, chunk_size, strerror(errno));
 		exit(1);
 	}
-	memset(buf, 0xaa, chunk_size);
+	memset(buf, 0xaa, chunk_size * depth);
 
 	snprintf(filename, sizeof(filename), "%s-%d-iobw.tmp", mygroup, id);
 	if (directio)
@@ -105,12 +322,25 @@ static void thread(int id)
 		free(buf);
 		exit(1);
 	}
+	if (depth > 1 && uring_init(&ring, depth) < 0) {
+		fprintf(stderr, "ERROR: task %d couldn't set up io_uring (%s)\n",
+			id, strerror(errno));
+		ret = 1;
+		goto out;
+	}
 
 	/* Write */
 	lseek(fd, 0, SEEK_SET);
 	n = 0;
 	gettimeofday(&start, NULL);
-	while (n < data_size) {
+	sample_init(&smp, id + 1, OP_WRITE);
+	if (depth > 1 && (i = uring_io(&ring, fd, OP_WRITE, buf, &smp))) {
+		fprintf(stderr, "ERROR: task %d writing to %s (%s)\n",
+			id, filename, strerror(-i));
+		ret = 1;
+		goto out;
+	}
+	while (depth == 1 && n < data_size) {
 		i = write(fd, buf, chunk_size);
 		if (i < 0) {
 			fprintf(stderr, "ERROR: task %d writing to %s (%s)\n",
@@ -119,7 +349,9 @@ static void thread(int id)
 			goto out;
 		}
 		n += i;
+		sample_add(&smp, i, 0);
 	}
+	sample_add(&smp, 0, 1);
 	gettimeofday(&stop, NULL);
 	timersub(&stop, &start, &diff);
 	print_results(id + 1, OP_WRITE, data_size, &diff);
@@ -128,7 +360,14 @@ static void thread(int id)
 	lseek(fd, 0, SEEK_SET);
 	n = 0;
 	gettimeofday(&start, NULL);
-	while (n < data_size) {
+	sample_init(&smp, id + 1, OP_READ);
+	if (depth > 1 && (i = uring_io(&ring, fd, OP_READ, buf, &smp))) {
+		fprintf(stderr, "ERROR: task %d reading to %s (%s)\n",
+			id, filename, strerror(-i));
+		ret = 1;
+		goto out;
+	}
+	while (depth == 1 && n < data_size) {
 		i = read(fd, buf, chunk_size);
 		if (i < 0) {
 			fprintf(stderr, "ERROR: task %d reading to %s (%s)\n",
@@ -137,7 +376,9 @@ static void thread(int id)
 			goto out;
 		}
 		n += i;
+		sample_add(&smp, i, 0);
 	}
+	sample_add(&smp, 0, 1);
 	gettimeofday(&stop, NULL);
 	timersub(&stop, &start, &diff);
 	print_results(id + 1, OP_READ, data_size, &diff);
@@ -208,17 +449,149 @@ unsigned long long memparse(char *ptr, char **retptr)
 	return ret;
 }
 
+/*
+ * -fairness: read the samples written by the iobw runs of several cgroups
+ * and print, per op, each group's bandwidth, share and how steady its
+ * samples were (coefficient of variation), plus Jain's fairness index
+ * (sum x)^2 / (n * sum x^2) over the groups' bandwidths.
+ */
+#define MAX_GROUPS	64
+
+struct group_stats {
+	char name[64];
+	double bytes;
+	long end_ms[128];	/* per task, so 1-based ids up to 127 */
+	double sum;		/* of the samples' KiB/s */
+	double sum2;
+	long nsamples;
+};
+
+static int fairness(int nfiles, char **files)
+{
+	static struct group_stats gs[NUM_IOPS][MAX_GROUPS];
+	int ngroups = 0;
+	char line[512], name[64], opname[8];
+	long t_ms, task;
+	size_t bytes, ios;
+	double kibs, rate, x, sumx, sumx2, bw, total, mean;
+	long span;
+	FILE *f;
+	int i, g, op;
+
+	for (i = 0; i < nfiles; i++) {
+		if ((f = fopen(files[i], "r")) == NULL) {
+			fprintf(stderr, "ERROR: couldn't open %s (%s)\n",
+				files[i], strerror(errno));
+			return 1;
+		}
+		while (fgets(line, sizeof(line), f)) {
+			if (sscanf(line, "%63[^,],%ld,%7[^,],%ld,%zu,%zu,%lf,%lf",
+				   name, &task, opname, &t_ms, &bytes, &ios,
+				   &kibs, &rate) != 8)
+				continue;	/* header */
+			op = strcmp(opname, "write") ? OP_READ : OP_WRITE;
+			for (g = 0; g < ngroups; g++)
+				if (!strcmp(gs[0][g].name, name))
+					break;
+			if (g == ngroups) {
+				if (ngroups == MAX_GROUPS)
+					continue;
+				strcpy(gs[OP_WRITE][g].name, name);
+				strcpy(gs[OP_READ][g].name, name);
+				ngroups++;
+			}
+			gs[op][g].bytes += bytes;
+			if (task > 0 && task < 128 &&
+			    t_ms > gs[op][g].end_ms[task])
+				gs[op][g].end_ms[task] = t_ms;
+			gs[op][g].sum += kibs;
+			gs[op][g].sum2 += kibs * kibs;
+			gs[op][g].nsamples++;
+		}
+		fclose(f);
+	}
+	for (op = OP_WRITE; op < NUM_IOPS; op++) {
+		total = sumx = sumx2 = 0;
+		for (g = 0; g < ngroups; g++)
+			total += gs[op][g].bytes;
+		fprintf(stdout, "%-20s %10s %6s %6s %8s\n", iops[op],
+			"KiB/s", "share", "cv", "samples");
+		for (g = 0; g < ngroups; g++) {
+			/* the group's bandwidth over its slowest task */
+			for (task = 1, span = 0; task < 128; task++)
+				if (gs[op][g].end_ms[task] > span)
+					span = gs[op][g].end_ms[task];
+			bw = span ? gs[op][g].bytes / 1024 * 1000 / span : 0;
+			mean = gs[op][g].nsamples ?
+			    gs[op][g].sum / gs[op][g].nsamples : 0;
+			x = mean ? sqrt(fabs(gs[op][g].sum2 /
+					     gs[op][g].nsamples - mean * mean))
+			    / mean : 0;
+			fprintf(stdout, "%-20s %10.0f %5.1f%% %6.2f %8ld\n",
+				gs[op][g].name, bw,
+				total ? 100 * gs[op][g].bytes / total : 0, x,
+				gs[op][g].nsamples);
+			sumx += bw;
+			sumx2 += bw * bw;
+		}
+		fprintf(stdout, "%s fairness (Jain) %.3f over %d groups\n",
+			iops[op], sumx2 ? sumx * sumx / (ngroups * sumx2) : 0,
+			ngroups);
+	}
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	struct timeval start, stop, diff;
 	char *end;
 	int i;
 
-	if (argv[1] && strcmp(argv[1], "-direct") == 0) {
-		directio = 1;
+	char *csv = NULL;
+
+	if (argv[1] && strcmp(argv[1], "-fairness") == 0) {
+		if (argc < 3) {
+			fprintf(stderr, usage);
+			exit(1);
+		}
+		exit(fairness(argc - 2, argv + 2));
+	}
+	while (argv[1] && argv[1][0] == '-' && argv[1][1]) {
+		if (strcmp(argv[1], "-direct") == 0) {
+			directio = 1;
+		} else if (strcmp(argv[1], "-depth") == 0 && argv[2]) {
+			depth = atoi(argv[2]);
+			argc--;
+			argv++;
+		} else if (strcmp(argv[1], "-interval") == 0 && argv[2]) {
+			interval_ms = atol(argv[2]);
+			argc--;
+			argv++;
+		} else if (strcmp(argv[1], "-csv") == 0 && argv[2]) {
+			csv = argv[2];
+			argc--;
+			argv++;
+		} else {
+			fprintf(stderr, usage);
+			exit(1);
+		}
 		argc--;
 		argv++;
 	}
+	if (depth < 1 || interval_ms < 0) {
+		fprintf(stderr, usage);
+		exit(1);
+	}
+#ifndef HAVE_LINUX_IO_URING_H
+	if (depth > 1) {
+		fprintf(stderr, "ERROR: -depth needs io_uring, which is not "
+			"supported by this build\n");
+		exit(1);
+	}
+#endif
+	/* queued I/O only bypasses the page cache with O_DIRECT */
+	if (depth > 1)
+		directio = 1;
 	if (argc != 4) {
 		fprintf(stderr, usage);
 		exit(1);
@@ -246,6 +619,24 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	if (csv) {
+		csv_fd = strcmp(csv, "-") ? open(csv, O_WRONLY | O_CREAT |
+						 O_APPEND, 0644) : 1;
+		if (csv_fd < 0) {
+			fprintf(stderr, "ERROR: couldn't open %s (%s)\n",
+				csv, strerror(errno));
+			exit(1);
+		}
+		if (lseek(csv_fd, 0, SEEK_END) <= 0 &&
+		    write(csv_fd, csv_header, sizeof(csv_header) - 1) < 0) {
+			fprintf(stderr, "ERROR: couldn't write %s (%s)\n",
+				csv, strerror(errno));
+			exit(1);
+		}
+		if (!interval_ms)
+			interval_ms = 100;
+	}
+
 	children = malloc(sizeof(pid_t) * threads);
 	if (!children) {
 		fprintf(stderr, "ERROR: not enough memory\n");
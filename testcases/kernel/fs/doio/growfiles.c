@@ -47,6 +47,7 @@
  *  re-exec self (if wanted)
  *  Determine number of files
  *  malloc space or i/o buffer
+ *  fork workers that split the files between them (if wanted)
  *  Loop until stop is set
  *    Determine if hit iteration, time, max errors or num bytes reached
  *    Loop through each file
@@ -78,7 +79,9 @@
 #include <sys/time.h>
 #include <sys/param.h>
 #include <sys/signal.h>
+#include <sys/wait.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <errno.h>
 #include <string.h>
 #include <inttypes.h>
@@ -110,6 +113,9 @@ int shrinkfile(int fd, char *filename, int trunc_incr,
 	       int trunc_inter, int just_trunc);
 int check_write(int fd, int cf_inter, char *filename, int mode);
 int check_file(int fd, int cf_inter, char *filename, int no_file_check);
+struct dirty_map;
+int check_dirty(int fd, int cf_inter, char *filename, int no_file_check,
+		struct dirty_map *map);
 int file_size(int fd);
 int lkfile(int fd, int operation, int lklevel);
 
@@ -250,6 +256,40 @@ struct fileinfo_t {
 	int mode;
 } Fileinfo;
 
+/*
+ * With -k the files are split between Workers processes.  The workers
+ * form Worker_sets groups and each group owns the files whose index
+ * modulo Worker_sets is the group number, so more than one worker per
+ * file means Workers / Worker_sets workers sharing each file.
+ */
+int Workers = 1;		/* number of worker processes (-k) */
+int Worker_sets = 1;		/* number of disjoint file sets */
+int Worker = 0;			/* this worker, 0 is the original process */
+int *Worker_pids = NULL;	/* pids of the workers forked before us */
+
+/*
+ * With -K the whole file check only reads back the regions this process
+ * wrote since the last successful check.  Each file keeps a sorted list
+ * of non overlapping [start, end) extents; a new map covers the whole
+ * file so the first check of a file is a full one.
+ */
+struct extent {
+	off_t start;
+	off_t end;
+};
+
+struct dirty_map {
+	struct extent *ext;
+	int cnt;
+	int max;
+} *Dirty = NULL;
+
+static void start_workers(int per_file);
+static void wait_workers(void);
+static void dirty_reset(struct dirty_map *map, off_t end);
+static void dirty_add(struct dirty_map *map, off_t start, off_t end);
+static void dirty_clip(struct dirty_map *map, off_t size);
+
 /*
  * Define open flags that will be used when '-o random' option is used.
  * Note: If there is more than one growfiles doing its thing to the same
@@ -383,6 +423,8 @@ int main(int argc, char **argv)
 	char reason[128];	/* reason for loop termination */
 	int num_procs = 1;
 	int forker_mode = 0;
+	int per_file = 1;	/* workers sharing each file */
+	int incr_check = 0;	/* only check the dirty extents */
 	int reexec = REXEC_INIT;	/* reexec info */
 	char *exec_path = NULL;
 
@@ -409,7 +451,7 @@ int main(int argc, char **argv)
 	 * Process options
 	 */
 	while ((ind = getopt(argc, argv,
-			     "hB:C:c:bd:D:e:Ef:g:H:I:i:lL:n:N:O:o:pP:q:wt:r:R:s:S:T:uU:W:xy"))
+			     "hB:C:c:bd:D:e:Ef:g:H:I:i:k:KlL:n:N:O:o:pP:q:wt:r:R:s:S:T:uU:W:xy"))
 	       != EOF) {
 		switch (ind) {
 
@@ -591,6 +633,22 @@ int main(int argc, char **argv)
 #endif
 			break;
 
+		case 'k':
+			if (sscanf(optarg, "%i:%i", &Workers, &per_file) <
+			    1 || Workers < 1 || per_file < 1) {
+
+				fprintf(stderr,
+					"%s%s: --k option arg invalid\n",
+					Progname, TagName);
+				usage();
+				exit(1);
+			}
+			break;
+
+		case 'K':
+			incr_check = 1;
+			break;
+
 		case 'l':
 			lockfile++;
 			if (lockfile > 2)
@@ -1360,6 +1418,22 @@ no whole file checking will be performed!\n", Progname, TagName,
 #endif
 	}
 
+	if (incr_check) {
+		if ((Dirty = calloc(num_files, sizeof(*Dirty))) == NULL) {
+			fprintf(stderr,
+				"%s%s: %d %s/%d: malloc(%d) failed: %s\n",
+				Progname, TagName, Pid, __FILE__, __LINE__,
+				(int)(num_files * sizeof(*Dirty)),
+				strerror(errno));
+			exit(1);
+		}
+		for (ind = 0; ind < num_files; ind++)
+			dirty_reset(&Dirty[ind], INT_MAX);
+	}
+
+	if (Workers > 1)
+		start_workers(per_file);
+
 	/*
 	 * This is the main iteration loop.
 	 * Each iteration, all files can  be opened, written to,
@@ -1397,6 +1471,9 @@ no whole file checking will be performed!\n", Progname, TagName,
 		 */
 		for (ind = 0; ind < num_files; ind++) {
 
+			if (ind % Worker_sets != Worker % Worker_sets)
+				continue;	/* another worker's file */
+
 			fflush(stdout);
 			fflush(stderr);
 
@@ -1495,6 +1572,10 @@ no whole file checking will be performed!\n", Progname, TagName,
 				continue;
 			}
 
+			if (Dirty && !(Mode & MODE_FIFO))
+				dirty_add(&Dirty[ind], Woffset,
+					  Woffset + Grow_incr);
+
 			/*
 			 * check if last write is not corrupted
 			 */
@@ -1504,12 +1585,18 @@ no whole file checking will be performed!\n", Progname, TagName,
 			}
 
 			/*
-			 * Check that whole file is not corrupted.
+			 * Check that whole file is not corrupted,
+			 * or just the parts written since the last check.
 			 */
-			if (check_file(fd, file_check_inter, filename,
-				       no_file_check) != 0) {
+			if (Dirty)
+				ret = check_dirty(fd, file_check_inter,
+						  filename, no_file_check,
+						  &Dirty[ind]);
+			else
+				ret = check_file(fd, file_check_inter,
+						 filename, no_file_check);
+			if (ret != 0)
 				handle_error();
-			}
 
 			/*
 			 * shrink file by desired amount if it is time
@@ -1542,6 +1629,8 @@ no whole file checking will be performed!\n", Progname, TagName,
 					     Iter_cnt, filename);
 
 				unlink(filename);
+				if (Dirty)
+					dirty_reset(&Dirty[ind], 0);
 			}
 
 			/*
@@ -1592,6 +1681,9 @@ no whole file checking will be performed!\n", Progname, TagName,
 	fflush(stdout);
 	fflush(stderr);
 
+	if (Worker == 0)
+		wait_workers();
+
 	cleanup();
 
 	if (Errors) {
@@ -1704,6 +1796,7 @@ void sig_handler(int sig)
 static void notify_others(void)
 {
 	static int send_signals = 0;
+	static int send_workers = 0;
 	int ind;
 
 	if (Sync_with_others && send_signals == 0) {
@@ -1730,6 +1823,24 @@ static void notify_others(void)
 #endif
 	}
 
+	/*
+	 * The workers are one growfiles, stop them all whether or not
+	 * -y was given.  Earlier workers pass it on to the later ones.
+	 */
+	if (Worker_pids && send_workers == 0) {
+		send_workers = 1;
+		for (ind = 0; ind < Workers; ind++) {
+			if (Worker_pids[ind] == 0 || Worker_pids[ind] == Pid)
+				continue;
+			if (Debug > 1)
+				printf
+				    ("%s%s: %d DEBUG2 %s/%d: Sending SIGUSR2 to worker %d\n",
+				     Progname, TagName, Pid, __FILE__, __LINE__,
+				     Worker_pids[ind]);
+			kill(Worker_pids[ind], SIGUSR2);
+		}
+	}
+
 }
 
 /***********************************************************************
@@ -1779,7 +1890,9 @@ int cleanup(void)
 		if (Debug > 2)
 			printf("%s: %d DEBUG3 Removing all %d files\n",
 			       Progname, Pid, num_files);
-		for (ind = 0; ind <= num_files; ind++) {
+		for (ind = 0; ind < num_files; ind++) {
+			if (ind % Worker_sets != Worker % Worker_sets)
+				continue;
 			unlink(filenames + (ind * PATH_MAX));
 		}
 	}
@@ -1789,20 +1902,106 @@ int cleanup(void)
 	return 0;
 }
 
+/***********************************************************************
+ * fork Workers - 1 more processes to split the files with.
+ * Each worker returns from here with Worker set to its index, its own
+ * pid and its own random seed.  -B is split evenly between them.
+ ***********************************************************************/
+static void start_workers(int per_file)
+{
+	int ind;
+	int pid;
+
+	Worker_sets = Workers / per_file;
+	if (Worker_sets < 1)
+		Worker_sets = 1;
+	if (Worker_sets > num_files)
+		Worker_sets = num_files;
+
+	if ((Worker_pids = calloc(Workers, sizeof(int))) == NULL) {
+		fprintf(stderr, "%s%s: %d %s/%d: malloc(%d) failed: %s\n",
+			Progname, TagName, Pid, __FILE__, __LINE__,
+			(int)(Workers * sizeof(int)), strerror(errno));
+		exit(1);
+	}
+	Worker_pids[0] = Pid;
+
+	if (bytes_to_consume)
+		bytes_to_consume = (bytes_to_consume + Workers - 1) / Workers;
+
+	if (Debug > 1)
+		printf("%s%s: %d DEBUG2 %s/%d: starting %d workers, "
+		       "%d per file\n", Progname, TagName, Pid, __FILE__,
+		       __LINE__, Workers, Workers / Worker_sets);
+
+	fflush(stdout);		/* ensure pending i/o is flushed before forking */
+	fflush(stderr);
+
+	for (ind = 1; ind < Workers; ind++) {
+		if ((pid = fork()) == 0) {
+			Worker = ind;
+			Pid = getpid();
+			random_range_seed(Seed + ind);
+			return;
+		}
+		if (pid == -1) {
+			fprintf(stderr,
+				"%s%s: %d %s/%d: fork of worker %d failed: %s\n",
+				Progname, TagName, Pid, __FILE__, __LINE__, ind,
+				strerror(errno));
+			notify_others();
+			wait_workers();
+			exit(1);
+		}
+		Worker_pids[ind] = pid;
+	}
+}
+
+/***********************************************************************
+ * reap the other workers, each failed worker counts as one error.
+ ***********************************************************************/
+static void wait_workers(void)
+{
+	int ind;
+	int status;
+
+	for (ind = 1; ind < Workers; ind++) {
+		if (Worker_pids == NULL || Worker_pids[ind] == 0)
+			continue;
+		if (waitpid(Worker_pids[ind], &status, 0) == -1) {
+			fprintf(stderr,
+				"%s%s: %d %s/%d: waitpid(%d) failed: %s\n",
+				Progname, TagName, Pid, __FILE__, __LINE__,
+				Worker_pids[ind], strerror(errno));
+			Errors++;
+			continue;
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			fprintf(stderr,
+				"%s%s: %d %s/%d: worker %d (pid %d) failed, "
+				"status %#x\n", Progname, TagName, Pid,
+				__FILE__, __LINE__, ind, Worker_pids[ind],
+				status);
+			Errors++;
+		}
+		Worker_pids[ind] = 0;
+	}
+}
+
 /***********************************************************************
  *
  ***********************************************************************/
 void usage(void)
 {
 	fprintf(stderr,
-		"Usage: %s%s [-bhEluy][[-g grow_incr][-i num][-t trunc_incr][-T trunc_inter]\n",
+		"Usage: %s%s [-bhEKluy][[-g grow_incr][-i num][-t trunc_incr][-T trunc_inter]\n",
 		Progname, TagName);
 	fprintf(stderr,
 		"[-d auto_dir][-e maxerrs][-f auto_file][-N num_files][-w][-c chk_inter][-D debug]\n");
 	fprintf(stderr,
 		"[-s seed][-S seq_auto_files][-p][-P PANIC][-I io_type][-o open_flags][-B maxbytes]\n");
 	fprintf(stderr,
-		"[-r iosizes][-R lseeks][-U unlk_inter][-W tagname] [files]\n");
+		"[-r iosizes][-R lseeks][-U unlk_inter][-W tagname][-k workers[:per_file]] [files]\n");
 
 	return;
 
@@ -1834,7 +2033,14 @@ void help(void)
   -H delay       Amount of time to delay between each file (default 0.0)\n\
   -I io_type Specifies io type: s - sync, p - polled async, a - async (def s)\n\
 		 l - listio sync, L - listio async, r - random\n\
+		 u - io_uring, U - io_uring batched, F - io_uring fixed buffer\n\
+		 n - linux native aio\n\
   -i iteration   Specfied to grow each file num times. 0 means forever (default 1)\n\
+  -k wrk[:per]   Split the files between wrk worker processes, per workers\n\
+		 sharing each file (default 1:1).  Use -l when per > 1.\n\
+		 -B is split evenly between the workers.\n\
+  -K             Only check what was written since the last whole file check\n\
+		 (-c), tracked as dirty extents.  The first check is a full one.\n\
   -l             Specfied to do file locking around write/read/trunc\n\
 		 If specified twice, file locking after open to just before close\n\
   -L time        Specfied to exit after time secs, must be used with -i.\n\
@@ -2910,6 +3116,247 @@ int check_file(int fd, int cf_inter, char *filename, int no_file_check)
 
 }				/* end of check_file */
 
+/***********************************************************************
+ * dirty extent map of a file, see struct dirty_map.
+ ***********************************************************************/
+static void dirty_reset(struct dirty_map *map, off_t end)
+{
+	if (map->ext == NULL) {
+		map->max = 16;
+		if ((map->ext = malloc(map->max * sizeof(*map->ext))) == NULL) {
+			fprintf(stderr,
+				"%s%s: %d %s/%d: malloc(%d) failed: %s\n",
+				Progname, TagName, Pid, __FILE__, __LINE__,
+				(int)(map->max * sizeof(*map->ext)),
+				strerror(errno));
+			exit(1);
+		}
+	}
+	map->cnt = 0;
+	if (end > 0) {
+		map->ext[0].start = 0;
+		map->ext[0].end = end;
+		map->cnt = 1;
+	}
+}
+
+static void dirty_add(struct dirty_map *map, off_t start, off_t end)
+{
+	struct extent *ext;
+	int lo, hi;
+
+	if (start >= end)
+		return;
+
+	/*
+	 * Writes mostly append, so search from the end: lo is the first
+	 * extent ending at or after start, hi the first one starting
+	 * after end.  Everything in [lo, hi) touches the new extent.
+	 */
+	for (lo = map->cnt; lo > 0 && map->ext[lo - 1].end >= start; lo--) ;
+	for (hi = lo; hi < map->cnt && map->ext[hi].start <= end; hi++) ;
+
+	if (lo < hi) {
+		if (map->ext[lo].start < start)
+			start = map->ext[lo].start;
+		if (map->ext[hi - 1].end > end)
+			end = map->ext[hi - 1].end;
+		memmove(&map->ext[lo + 1], &map->ext[hi],
+			(map->cnt - hi) * sizeof(*map->ext));
+		map->cnt -= hi - lo - 1;
+	} else {
+		if (map->cnt == map->max) {
+			ext = realloc(map->ext,
+				      2 * map->max * sizeof(*map->ext));
+			if (ext == NULL) {
+				/* fall back to one extent covering them all */
+				if (map->ext[0].start < start)
+					start = map->ext[0].start;
+				if (map->ext[map->cnt - 1].end > end)
+					end = map->ext[map->cnt - 1].end;
+				map->ext[0].start = start;
+				map->ext[0].end = end;
+				map->cnt = 1;
+				return;
+			}
+			map->ext = ext;
+			map->max *= 2;
+		}
+		memmove(&map->ext[lo + 1], &map->ext[lo],
+			(map->cnt - lo) * sizeof(*map->ext));
+		map->cnt++;
+	}
+	map->ext[lo].start = start;
+	map->ext[lo].end = end;
+}
+
+/* drop what a truncate took away */
+static void dirty_clip(struct dirty_map *map, off_t size)
+{
+	while (map->cnt && map->ext[map->cnt - 1].start >= size)
+		map->cnt--;
+	if (map->cnt && map->ext[map->cnt - 1].end > size)
+		map->ext[map->cnt - 1].end = size;
+}
+
+/***********************************************************************
+ * check buf against the pattern expected at offset.
+ * Returns -1 if it matches, otherwise the index of the first bad byte.
+ ***********************************************************************/
+static int check_pattern(char *buf, int size, int offset, char **errmsg)
+{
+	if (Pattern == PATTERN_OFFSET)
+		return datapidchk(STATIC_NUM, buf, size, offset, errmsg);
+	else if (Pattern == PATTERN_PID)
+		return datapidchk(Pid, buf, size, offset, errmsg);
+	else if (Pattern == PATTERN_ASCII)
+		return dataasciichk(NULL, buf, size, offset, errmsg);
+	else if (Pattern == PATTERN_RANDOM)
+		return -1;	/* no checks for random */
+	else if (Pattern == PATTERN_ALT)
+		return databinchk('a', buf, size, offset, errmsg);
+	else if (Pattern == PATTERN_CHKER)
+		return databinchk('c', buf, size, offset, errmsg);
+	else if (Pattern == PATTERN_CNTING)
+		return databinchk('C', buf, size, offset, errmsg);
+	else if (Pattern == PATTERN_ZEROS)
+		return databinchk('z', buf, size, offset, errmsg);
+	else if (Pattern == PATTERN_ONES)
+		return databinchk('o', buf, size, offset, errmsg);
+	else
+		return dataasciichk(NULL, buf, size, offset, errmsg);
+}
+
+/***********************************************************************
+ * Like check_file() but only reads back the dirty extents of map,
+ * which are cleared once they all verified.  The file offset is left
+ * where it was.
+ ***********************************************************************/
+int check_dirty(int fd, int cf_inter, char *filename, int no_file_check,
+		struct dirty_map *map)
+{
+	int fsize;
+	static int cf_count = 0;
+	char *buf;
+	int ret;
+	int ret_val = 0;
+	int ind;
+	int rd_cnt;
+	int rd_size;
+	int checked = 0;
+	off_t cur_offset;
+	char *errmsg;
+
+	cf_count++;
+
+	if (cf_inter == 0 || (cf_count % cf_inter != 0)) {
+		if (Debug > 4)
+			printf
+			    ("%s: %d DEBUG5 %s/%d: No file check - not time, iter=%d, cnt=%d\n",
+			     Progname, Pid, __FILE__, __LINE__, cf_inter,
+			     cf_count);
+		return 0;	/* no check done */
+	}
+
+	if (no_file_check) {
+		if (Debug > 4)
+			printf
+			    ("%s: %d DEBUG5 %s/%d: No file check, lseek grow or random lseeks\n",
+			     Progname, Pid, __FILE__, __LINE__);
+		return 0;
+	}
+
+	/*
+	 * Hold the lock from the stat until after the last read so a
+	 * trunc can not "corrupt" the data, see check_file().
+	 */
+	lkfile(fd, LOCK_SH, LKLVL0);
+
+	if ((fsize = file_size(fd)) == -1) {
+		lkfile(fd, LOCK_UN, LKLVL0);
+		return -1;
+	}
+
+	dirty_clip(map, fsize);
+	if (map->cnt == 0) {
+		if (Debug > 2)
+			printf
+			    ("%s: %d DEBUG3 %s/%d: No file validation, nothing written since last check\n",
+			     Progname, Pid, __FILE__, __LINE__);
+		lkfile(fd, LOCK_UN, LKLVL0);
+		return 0;
+	}
+
+	if ((cur_offset = lseek(fd, 0, SEEK_CUR)) == -1) {
+		fprintf(stderr, "%s%s: %d %s/%d: tell(%d) failed: %s\n",
+			Progname, TagName, Pid, __FILE__, __LINE__, fd,
+			strerror(errno));
+		lkfile(fd, LOCK_UN, LKLVL0);
+		return -1;
+	}
+
+	if ((buf = malloc(MAX_FC_READ)) == NULL) {
+		fprintf(stderr, "%s%s: %s/%d: malloc(%d) failed: %s\n",
+			Progname, TagName, __FILE__, __LINE__, MAX_FC_READ,
+			strerror(errno));
+		lkfile(fd, LOCK_UN, LKLVL0);
+		return -1;
+	}
+
+	for (ind = 0; ind < map->cnt && ret_val == 0; ind++) {
+		for (rd_cnt = map->ext[ind].start; rd_cnt < map->ext[ind].end;
+		     rd_cnt += rd_size) {
+			if (map->ext[ind].end - rd_cnt > MAX_FC_READ)
+				rd_size = MAX_FC_READ;
+			else
+				rd_size = map->ext[ind].end - rd_cnt;
+
+			lseek(fd, rd_cnt, SEEK_SET);
+#if NEWIO
+			ret = lio_read_buffer(fd, io_type, buf, rd_size,
+					      SIGUSR1, &errmsg, 0);
+#else
+			ret =
+			    read_buffer(fd, io_type, buf, rd_size, 0, &errmsg);
+#endif
+			if (ret != rd_size) {
+				fprintf(stderr, "%s%s: %d %s/%d: %d CFd %s\n",
+					Progname, TagName, Pid, __FILE__,
+					__LINE__, Iter_cnt, errmsg);
+				ret_val = -1;
+				break;
+			}
+
+			if (check_pattern(buf, rd_size, rd_cnt, &errmsg) >= 0) {
+				fprintf(stderr,
+					"%s%s: %d %s/%d: %d CFd %s in file %s\n",
+					Progname, TagName, Pid, __FILE__,
+					__LINE__, Iter_cnt, errmsg, filename);
+				fflush(stderr);
+				ret_val = 1;
+				break;
+			}
+			checked += rd_size;
+		}
+	}
+
+	lseek(fd, cur_offset, SEEK_SET);
+	lkfile(fd, LOCK_UN, LKLVL0);
+	free(buf);
+
+	if (ret_val == 0) {
+		if (Debug > 2)
+			printf
+			    ("%s: %d DEBUG3 %s/%d: verified %d bytes in %d dirty extents\n",
+			     Progname, Pid, __FILE__, __LINE__, checked,
+			     map->cnt);
+		dirty_reset(map, 0);
+	}
+
+	return ret_val;
+
+}				/* end of check_dirty */
+
 /***********************************************************************
  *
  ***********************************************************************/
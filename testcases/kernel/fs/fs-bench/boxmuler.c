@@ -3,7 +3,8 @@
 
 #define M_2PI (M_PI*2)
 
-int box_muler(int min, int max)
+/* seed is NULL for random(), else the rand_r() state of the caller */
+static int box_muler_seed(int min, int max, unsigned int *seed)
 {
 	double u1, u2, z;
 	int i;
@@ -16,8 +17,10 @@ int box_muler(int min, int max)
 	range = max - min;
 	ave = range / 2;
 	for (i = 0; i < 10; i++) {
-		u1 = ((double)(random() % 1000000)) / 1000000;
-		u2 = ((double)(random() % 1000000)) / 1000000;
+		u1 = ((double)((seed ? rand_r(seed) : random()) % 1000000)) /
+		    1000000;
+		u2 = ((double)((seed ? rand_r(seed) : random()) % 1000000)) /
+		    1000000;
 		z = sqrt(-2.0 * log(u1)) * cos(M_2PI * u2);
 		ZZ = min + (ave + (z * (ave / 4)));
 		if (ZZ >= min && ZZ < max) {
@@ -26,3 +29,14 @@ int box_muler(int min, int max)
 	}
 	return (-1);
 }
+
+int box_muler(int min, int max)
+{
+	return box_muler_seed(min, max, NULL);
+}
+
+/* box_muler() for threads, each with its own seed */
+int box_muler_r(int min, int max, unsigned int *seed)
+{
+	return box_muler_seed(min, max, seed);
+}
@@ -0,0 +1,319 @@
+/* meta-bench.c (GPL)*/
+/*
+ * Parallel metadata benchmark built from the pieces of create-files,
+ * random-access and random-del-create: N threads run mkdir, create,
+ * stat, open-read-close, unlink and rmdir phases over one shared tree
+ * of fanout x fanout directories, with box-muler file sizes, and each
+ * phase reports its rate and latency percentiles.
+ *
+ * The threads take the files of a phase from a shared counter in
+ * batches, so a phase ends when the last batch is done; stat and read
+ * visit the files in a scattered order.
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "tst_hist.h"
+
+#define MAXFSIZE	(1024 * 192)
+#define BUFS		8192
+#define BATCH		64	/* files taken from the counter at a time */
+
+extern int box_muler_r(int, int, unsigned int *);
+
+enum phase {
+	PH_MKDIR,
+	PH_CREATE,
+	PH_STAT,
+	PH_READ,
+	PH_UNLINK,
+	PH_RMDIR,
+	NPHASES,
+};
+
+static const char *phase_names[NPHASES] = {
+	"mkdir", "create", "stat", "read", "unlink", "rmdir",
+};
+
+struct worker {
+	pthread_t tid;
+	int id;
+	unsigned int seed;
+	unsigned long errors;
+	struct tst_hist hist;
+	char buf[BUFS];
+};
+
+static int nthreads = 1;
+static unsigned long nfiles = 10000;
+static unsigned int fanout = 64;
+static int maxsize = MAXFSIZE;
+static char *wbuf;
+
+static enum phase cur_phase;
+static unsigned long item_base;	/* of the current step */
+static unsigned long nitems;	/* of the current step */
+static unsigned long next_item;	/* shared counter */
+static unsigned long stride;	/* scatters stat and read */
+
+static void dir_name(char *buf, unsigned long d)
+{
+	if (d < fanout)
+		sprintf(buf, "%2.2lx", d);
+	else
+		sprintf(buf, "%2.2lx/%2.2lx", d / fanout - 1, d % fanout);
+}
+
+static void file_name(char *buf, unsigned long i)
+{
+	unsigned long leaf = i % (fanout * fanout);
+
+	sprintf(buf, "%2.2lx/%2.2lx/%8.8lx", leaf / fanout, leaf % fanout, i);
+}
+
+/*
+ * Directories are numbered top level first; each level is a step of its
+ * own so that no thread works on a child before its parent exists or on
+ * a parent before its children are gone.
+ */
+static int do_item(struct worker *w, unsigned long item)
+{
+	char name[64];
+	struct stat st;
+	int fd, c, size;
+
+	switch (cur_phase) {
+	case PH_MKDIR:
+	case PH_RMDIR:
+		dir_name(name, item_base + item);
+		if (cur_phase == PH_MKDIR)
+			return mkdir(name, S_IRWXU);
+		return rmdir(name);
+	case PH_CREATE:
+		file_name(name, item);
+		if ((fd = open(name, O_WRONLY | O_CREAT | O_EXCL,
+			       S_IRUSR | S_IWUSR)) < 0)
+			return -1;
+		if ((size = box_muler_r(0, maxsize, &w->seed)) < 0)
+			size = maxsize;
+		if (size && write(fd, wbuf, size) != size) {
+			close(fd);
+			return -1;
+		}
+		return close(fd);
+	case PH_STAT:
+		file_name(name, item * stride % nitems);
+		return stat(name, &st);
+	case PH_READ:
+		file_name(name, item * stride % nitems);
+		if ((fd = open(name, O_RDONLY)) < 0)
+			return -1;
+		while ((c = read(fd, w->buf, BUFS)) > 0)
+			;
+		close(fd);
+		return c;
+	case PH_UNLINK:
+		file_name(name, item);
+		return unlink(name);
+	default:
+		return -1;
+	}
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+	struct timespec t0, t1;
+	unsigned long long ns;
+	unsigned long item, end;
+
+	for (;;) {
+		item = __sync_fetch_and_add(&next_item, BATCH);
+		if (item >= nitems)
+			break;
+		end = item + BATCH < nitems ? item + BATCH : nitems;
+		for (; item < end; item++) {
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			if (do_item(w, item) < 0)
+				w->errors++;
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			ns = (t1.tv_sec - t0.tv_sec) * 1000000000ULL +
+			    t1.tv_nsec - t0.tv_nsec;
+			tst_hist_add(&w->hist, ns);
+		}
+	}
+	return NULL;
+}
+
+/* run items [base, base + count) of the current phase on all threads */
+static void run_step(struct worker *workers, unsigned long base,
+		     unsigned long count)
+{
+	int i;
+
+	item_base = base;
+	nitems = count;
+	next_item = 0;
+	for (i = 0; i < nthreads; i++) {
+		errno = pthread_create(&workers[i].tid, NULL, worker,
+				       &workers[i]);
+		if (errno) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nthreads; i++)
+		pthread_join(workers[i].tid, NULL);
+}
+
+static void run_phase(struct worker *workers, enum phase ph)
+{
+	struct timespec start, stop;
+	struct tst_hist hist;
+	unsigned long errors = 0;
+	double secs;
+	int i;
+
+	cur_phase = ph;
+	for (i = 0; i < nthreads; i++) {
+		memset(&workers[i].hist, 0, sizeof(workers[i].hist));
+		workers[i].errors = 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (ph == PH_MKDIR) {
+		run_step(workers, 0, fanout);
+		run_step(workers, fanout, fanout * fanout);
+	} else if (ph == PH_RMDIR) {
+		run_step(workers, fanout, fanout * fanout);
+		run_step(workers, 0, fanout);
+	} else
+		run_step(workers, 0, nfiles);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	memset(&hist, 0, sizeof(hist));
+	for (i = 0; i < nthreads; i++) {
+		tst_hist_merge(&hist, &workers[i].hist);
+		errors += workers[i].errors;
+	}
+	secs = stop.tv_sec - start.tv_sec +
+	    (stop.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%-8s %10llu %8.3f %10.0f %9.1f %9.1f %9.1f %9.1f %9.1f %8lu\n",
+	       phase_names[ph], hist.count, secs,
+	       secs > 0 ? hist.count / secs : 0.0,
+	       tst_hist_usecs(&hist, 0.5), tst_hist_usecs(&hist, 0.9),
+	       tst_hist_usecs(&hist, 0.99), tst_hist_usecs(&hist, 0.999),
+	       hist.max_ns / 1000.0, errors);
+}
+
+static unsigned long gcd(unsigned long a, unsigned long b)
+{
+	while (b) {
+		unsigned long t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static void usage(char *prog)
+{
+	printf("%s [-t threads] [-n files] [-f fanout] [-s maxsize] "
+	       "[-p phases] dir\n", prog);
+	printf("  -t threads  worker threads (default 1)\n");
+	printf("  -n files    files in the tree (default 10000)\n");
+	printf("  -f fanout   subdirectories per level, 2 levels "
+	       "(default 64, max 256)\n");
+	printf("  -s maxsize  upper bound of the box-muler file sizes "
+	       "(default %d)\n", MAXFSIZE);
+	printf("  -p phases   comma separated subset of "
+	       "mkdir,create,stat,read,unlink,rmdir (default all)\n");
+	exit(1);
+}
+
+int main(int ac, char **av)
+{
+	struct worker *workers;
+	char *phases = NULL;
+	char *tok;
+	int run[NPHASES];
+	time_t t;
+	int c, i;
+
+	while ((c = getopt(ac, av, "t:n:f:s:p:")) != -1) {
+		switch (c) {
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'n':
+			nfiles = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			fanout = atoi(optarg);
+			break;
+		case 's':
+			maxsize = atoi(optarg);
+			break;
+		case 'p':
+			phases = optarg;
+			break;
+		default:
+			usage(av[0]);
+		}
+	}
+	if (optind != ac - 1 || nthreads < 1 || nfiles < 1 || fanout < 1 ||
+	    fanout > 256 || maxsize < 1)
+		usage(av[0]);
+
+	for (i = 0; i < NPHASES; i++)
+		run[i] = phases == NULL;
+	for (tok = phases ? strtok(phases, ",") : NULL; tok;
+	     tok = strtok(NULL, ",")) {
+		for (i = 0; i < NPHASES; i++)
+			if (!strcmp(tok, phase_names[i]))
+				break;
+		if (i == NPHASES)
+			usage(av[0]);
+		run[i] = 1;
+	}
+
+	if (mkdir(av[optind], S_IRWXU) < 0 && errno != EEXIST) {
+		perror(av[optind]);
+		exit(1);
+	}
+	if (chdir(av[optind]) < 0) {
+		perror(av[optind]);
+		exit(1);
+	}
+	if ((wbuf = calloc(1, maxsize)) == NULL ||
+	    (workers = calloc(nthreads, sizeof(*workers))) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	time(&t);
+	for (i = 0; i < nthreads; i++)
+		workers[i].seed = (unsigned int)getpid() ^ (unsigned int)t ^ i;
+	/* a stride coprime to nfiles makes item * stride % nfiles a shuffle */
+	for (stride = nfiles / 2 + 7919; gcd(stride, nfiles) != 1; stride++)
+		;
+
+	printf("%d threads, %lu files, %u x %u dirs, sizes < %d\n",
+	       nthreads, nfiles, fanout, fanout, maxsize);
+	printf("%-8s %10s %8s %10s %9s %9s %9s %9s %9s %8s\n", "phase",
+	       "ops", "secs", "ops/s", "p50(us)", "p90(us)", "p99(us)",
+	       "p99.9(us)", "max(us)", "errors");
+	for (i = 0; i < NPHASES; i++)
+		if (run[i])
+			run_phase(workers, i);
+
+	free(workers);
+	free(wbuf);
+	return 0;
+}
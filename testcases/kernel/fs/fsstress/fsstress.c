@@ -32,6 +32,10 @@
 
 #include "config.h"
 #include "global.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include "tst_hist.h"
 #ifdef HAVE_SYS_PRCTL_H
 # include <sys/prctl.h>
 #endif
@@ -104,8 +108,54 @@ typedef struct flist {
 typedef struct pathname {
 	int len;
 	char *path;
+	int dirid;		/* parent directory id for -D, see at_dirfd() */
+	int base;		/* offset of the last component in path */
 } pathname_t;
 
+/*
+ * With -D the parent directory of each name is looked up in an LRU cache
+ * of open directory fds keyed by directory id, and the *at() syscalls are
+ * used with just the last path component.
+ */
+typedef struct dirfd_ent {
+	int id;
+	int fd;
+	struct dirfd_ent *hnext;
+	struct dirfd_ent *prev;
+	struct dirfd_ent *next;
+} dirfd_ent_t;
+
+/*
+ * With -t the workers are threads sharing one directory tree.  The entries
+ * of each file type are then spread over nshards arrays by id, each with
+ * its own lock, and the ops get private copies of entries instead of
+ * pointers into the arrays; flist[].nfiles is kept as the total count.
+ */
+typedef struct fshard {
+	pthread_mutex_t lock;
+	int nfiles;
+	int nslots;
+	fent_t *fents;
+} fshard_t;
+
+#define	NFENTCOPY	4	/* get_fname() results alive at once */
+
+typedef struct opstat {
+	unsigned long long total_ns;
+	struct tst_hist lat;
+} opstat_t;
+
+typedef struct worker {
+	pthread_t tid;
+	int id;
+	struct random_data rdata;
+	char rstate[64];
+	fent_t fents[NFENTCOPY];
+	int nfent;
+	fent_t dirfent;		/* dirid_to_fent() result */
+	opstat_t stats[OP_LAST];
+} worker_t;
+
 #define	FT_DIR	0
 #define	FT_DIRm	(1 << FT_DIR)
 #define	FT_REG	1
@@ -123,6 +173,10 @@ typedef struct pathname {
 
 #define	FLIST_SLOT_INCR	16
 #define	NDCACHE	64
+#define	NDIRFDHASH	1024
+#define	MAXSHARDS	256
+#define	DIRFDS_PER_THREAD	32	/* default -D with -t */
+#define	DIRID_NONE	(-2)	/* pathname is not relative to a dirid */
 
 #define	MAXFSIZE	((1ULL << 63) - 1ULL)
 #define	MAXFSIZE32	((1ULL << 40) - 1ULL)
@@ -204,10 +258,18 @@ flist_t flist[FT_nft] = {
 };
 
 int dcache[NDCACHE];
+__thread dirfd_ent_t *dirfd_ents;
+__thread dirfd_ent_t *dirfd_hash[NDIRFDHASH];
+__thread dirfd_ent_t dirfd_lru;
+__thread unsigned long dirfd_hits;
+__thread unsigned long dirfd_misses;
+fshard_t *fshards[FT_nft];
+__thread worker_t *self;	/* NULL unless a -t worker */
 int errrange;
 int errtag;
 opty_t *freq_table;
 int freq_table_size;
+int fullpaths = 1;
 #ifndef NO_XFS
 xfs_fsop_geom_t geom;
 #endif
@@ -218,10 +280,13 @@ off64_t maxfsize;
 char *myprog;
 int namerand;
 int nameseq;
+int ndirfds;
 int nops;
 int nproc = 1;
+int nshards;
+int nthreads;
 int operations = 1;
-int procid;
+__thread int procid;
 int rtpct;
 unsigned long seed = 0;
 ino_t top_ino;
@@ -233,6 +298,19 @@ int no_xfs = 1;
 #endif
 sig_atomic_t should_stop = 0;
 
+/* random() for the ops; each -t worker has its own state */
+long fss_random(void)
+{
+	int32_t r;
+
+	if (self == NULL)
+		return random();
+	random_r(&self->rdata, &r);
+	return r;
+}
+
+#define	random()	fss_random()
+
 void add_to_flist(int, int, int);
 void append_pathname(pathname_t *, char *);
 #ifndef NO_XFS
@@ -246,9 +324,18 @@ void dcache_enter(int, int);
 void dcache_init(void);
 fent_t *dcache_lookup(int);
 void dcache_purge(int);
+void del_fent(int, fent_t *);
 void del_from_flist(int, int);
+void del_from_shard(int, int);
+int dirfd_get(int);
+void dirfd_init(void);
+void dirfd_flush(void);
+void dirfd_purge(int);
 int dirid_to_name(char *, int);
+void doops(void);
 void doproc(void);
+void dothreads(void);
+void *doworker(void *);
 void fent_to_name(pathname_t *, flist_t *, fent_t *);
 void fix_parent(int, int);
 void free_pathname(pathname_t *);
@@ -269,7 +356,9 @@ int readlink_path(pathname_t *, char *, size_t);
 int rename_path(pathname_t *, pathname_t *);
 int rmdir_path(pathname_t *);
 void separate_pathname(pathname_t *, char *, pathname_t *);
+int shard_pick(int, int, fent_t *);
 void show_ops(int, char *);
+void show_opstats(worker_t *, double);
 int stat64_path(pathname_t *, struct stat64 *);
 int symlink_path(const char *, pathname_t *);
 int truncate64_path(pathname_t *, off64_t);
@@ -314,7 +403,7 @@ int main(int argc, char **argv)
 	nops = sizeof(ops) / sizeof(ops[0]);
 	ops_end = &ops[nops];
 	myprog = argv[0];
-	while ((c = getopt(argc, argv, "cd:e:f:i:l:n:p:rs:vwzHSX")) != -1) {
+	while ((c = getopt(argc, argv, "cd:e:f:i:l:n:p:rs:t:vwzD:HSX")) != -1) {
 		switch (c) {
 		case 'c':
 			/*Don't cleanup */
@@ -359,6 +448,14 @@ int main(int argc, char **argv)
 		case 's':
 			seed = strtoul(optarg, NULL, 0);
 			break;
+		case 't':
+			nthreads = atoi(optarg);
+			if (nthreads <= 0) {
+				fprintf(stderr, "%s - bad thread count %s\n",
+					myprog, optarg);
+				exit(1);
+			}
+			break;
 		case 'v':
 			verbose = 1;
 			break;
@@ -382,9 +479,31 @@ int main(int argc, char **argv)
 		case 'X':
 			no_xfs = 1;
 			break;
+		case 'D':
+			ndirfds = atoi(optarg);
+			if (ndirfds <= 0) {
+				fprintf(stderr, "%s - bad dirfd count %s\n",
+					myprog, optarg);
+				exit(1);
+			}
+			break;
 		}
 	}
 
+	if (nthreads) {
+		if (nproc != 1) {
+			fprintf(stderr, "%s - -p and -t are exclusive\n",
+				myprog);
+			exit(1);
+		}
+		/* threads share the cwd, so never chdir() to shorten names */
+		if (!ndirfds)
+			ndirfds = DIRFDS_PER_THREAD;
+	}
+
+	/* full names are only needed to print them */
+	fullpaths = !ndirfds || verbose || ilistlen;
+
 	if (no_xfs && errtag) {
 		fprintf(stderr, "error injection only works on XFS\n");
 		exit(1);
@@ -478,7 +597,10 @@ int main(int argc, char **argv)
 		unlink(buf);
 
 
-		if (nproc == 1) {
+		if (nthreads) {
+			procid = 0;
+			dothreads();
+		} else if (nproc == 1) {
 			procid = 0;
 			doproc();
 		} else {
@@ -554,7 +676,23 @@ void add_to_flist(int ft, int id, int parent)
 {
 	fent_t *fep;
 	flist_t *ftp;
-
+	fshard_t *shp;
+
+	if (nthreads) {
+		shp = &fshards[ft][id & (nshards - 1)];
+		pthread_mutex_lock(&shp->lock);
+		if (shp->nfiles == shp->nslots) {
+			shp->nslots += FLIST_SLOT_INCR;
+			shp->fents = realloc(shp->fents,
+					     shp->nslots * sizeof(fent_t));
+		}
+		fep = &shp->fents[shp->nfiles++];
+		fep->id = id;
+		fep->parent = parent;
+		pthread_mutex_unlock(&shp->lock);
+		__sync_fetch_and_add(&flist[ft].nfiles, 1);
+		return;
+	}
 	ftp = &flist[ft];
 	if (ftp->nfiles == ftp->nslots) {
 		ftp->nslots += FLIST_SLOT_INCR;
@@ -583,7 +721,64 @@ void append_pathname(pathname_t * name, char *str)
 	name->len += len;
 }
 
+/*
+ * Returns 0 if name has to be resolved by path, 1 with *dfd set to the fd
+ * of its parent directory (AT_FDCWD for the top directory) or -1 if that
+ * could not be opened.
+ */
+int at_dirfd(pathname_t * name, int *dfd)
+{
+	if (!ndirfds || name->dirid == DIRID_NONE)
+		return 0;
+	*dfd = dirfd_get(name->dirid);
+	return *dfd == -1 ? -1 : 1;
+}
+
+/*
+ * at_dirfd() for two names.  The first fd is dup()ed so that looking up
+ * the second one cannot evict it; release it with at_close().
+ */
+int at_dirfd2(pathname_t * name1, int *dfd1, pathname_t * name2, int *dfd2)
+{
+	int rval;
+
+	if ((rval = at_dirfd(name1, dfd1)) <= 0)
+		return rval;
+	if (*dfd1 != AT_FDCWD && (*dfd1 = dup(*dfd1)) < 0)
+		return -1;
+	if ((rval = at_dirfd(name2, dfd2)) <= 0) {
+		if (*dfd1 != AT_FDCWD)
+			close(*dfd1);
+		if (rval == 0)
+			errno = EINVAL;
+		return -1;
+	}
+	return 1;
+}
+
+void at_close(int dfd)
+{
+	if (dfd != AT_FDCWD)
+		close(dfd);
+}
+
+#define AT_BASE(name)	(&(name)->path[(name)->base])
+
 #ifndef NO_XFS
+/* the attr_* calls have no *at() variants, go through /proc instead */
+char *at_procpath(pathname_t * name, char *buf, int *rval)
+{
+	int dfd;
+
+	*rval = at_dirfd(name, &dfd);
+	if (*rval <= 0)
+		return name->path;
+	if (dfd == AT_FDCWD)
+		return AT_BASE(name);
+	snprintf(buf, PATH_MAX, "/proc/self/fd/%d/%s", dfd, AT_BASE(name));
+	return buf;
+}
+
 int
 attr_list_path(pathname_t * name, char *buffer, const int buffersize, int flags,
 	       attrlist_cursor_t * cursor)
@@ -591,9 +786,13 @@ attr_list_path(pathname_t * name, char *buffer, const int buffersize, int flags,
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	char pbuf[PATH_MAX], *path;
 
-	rval = attr_list(name->path, buffer, buffersize, flags, cursor);
-	if (rval >= 0 || errno != ENAMETOOLONG)
+	path = at_procpath(name, pbuf, &rval);
+	if (rval < 0)
+		return rval;
+	rval = attr_list(path, buffer, buffersize, flags, cursor);
+	if (rval >= 0 || errno != ENAMETOOLONG || path != name->path)
 		return rval;
 	separate_pathname(name, buf, &newname);
 	if (chdir(buf) == 0) {
@@ -610,9 +809,13 @@ int attr_remove_path(pathname_t * name, const char *attrname, int flags)
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	char pbuf[PATH_MAX], *path;
 
-	rval = attr_remove(name->path, attrname, flags);
-	if (rval >= 0 || errno != ENAMETOOLONG)
+	path = at_procpath(name, pbuf, &rval);
+	if (rval < 0)
+		return rval;
+	rval = attr_remove(path, attrname, flags);
+	if (rval >= 0 || errno != ENAMETOOLONG || path != name->path)
 		return rval;
 	separate_pathname(name, buf, &newname);
 	if (chdir(buf) == 0) {
@@ -630,9 +833,13 @@ attr_set_path(pathname_t * name, const char *attrname, const char *attrvalue,
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	char pbuf[PATH_MAX], *path;
 
-	rval = attr_set(name->path, attrname, attrvalue, valuelength, flags);
-	if (rval >= 0 || errno != ENAMETOOLONG)
+	path = at_procpath(name, pbuf, &rval);
+	if (rval < 0)
+		return rval;
+	rval = attr_set(path, attrname, attrvalue, valuelength, flags);
+	if (rval >= 0 || errno != ENAMETOOLONG || path != name->path)
 		return rval;
 	separate_pathname(name, buf, &newname);
 	if (chdir(buf) == 0) {
@@ -664,6 +871,13 @@ int creat_path(pathname_t * name, mode_t mode)
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	int dfd;
+
+	if ((rval = at_dirfd(name, &dfd)) < 0)
+		return rval;
+	if (rval)
+		return openat(dfd, AT_BASE(name),
+				O_CREAT | O_WRONLY | O_TRUNC, mode);
 
 	rval = creat(name->path, mode);
 	if (rval >= 0 || errno != ENAMETOOLONG)
@@ -710,13 +924,24 @@ void dcache_purge(int dirid)
 		*dcp = -1;
 }
 
+/* remove fep, as returned by get_fname(), from the list of type ft */
+void del_fent(int ft, fent_t * fep)
+{
+	if (nthreads)
+		del_from_shard(ft, fep->id);
+	else
+		del_from_flist(ft, fep - flist[ft].fents);
+}
+
 void del_from_flist(int ft, int slot)
 {
 	flist_t *ftp;
 
 	ftp = &flist[ft];
-	if (ft == FT_DIR)
+	if (ft == FT_DIR) {
 		dcache_purge(ftp->fents[slot].id);
+		dirfd_purge(ftp->fents[slot].id);
+	}
 	if (slot != ftp->nfiles - 1) {
 		if (ft == FT_DIR)
 			dcache_purge(ftp->fents[ftp->nfiles - 1].id);
@@ -725,12 +950,49 @@ void del_from_flist(int ft, int slot)
 		ftp->nfiles--;
 }
 
+/* -t version of del_from_flist(); another thread may have got there first */
+void del_from_shard(int ft, int id)
+{
+	fshard_t *shp;
+	int i;
+
+	if (ft == FT_DIR)
+		dirfd_purge(id);
+	shp = &fshards[ft][id & (nshards - 1)];
+	pthread_mutex_lock(&shp->lock);
+	for (i = 0; i < shp->nfiles; i++) {
+		if (shp->fents[i].id == id) {
+			shp->fents[i] = shp->fents[--shp->nfiles];
+			pthread_mutex_unlock(&shp->lock);
+			__sync_fetch_and_sub(&flist[ft].nfiles, 1);
+			return;
+		}
+	}
+	pthread_mutex_unlock(&shp->lock);
+}
+
 fent_t *dirid_to_fent(int dirid)
 {
 	fent_t *efep;
 	fent_t *fep;
 	flist_t *flp;
+	fshard_t *shp;
+	int i;
 
+	if (nthreads) {
+		shp = &fshards[FT_DIR][dirid & (nshards - 1)];
+		fep = NULL;
+		pthread_mutex_lock(&shp->lock);
+		for (i = 0; i < shp->nfiles; i++) {
+			if (shp->fents[i].id == dirid) {
+				fep = &self->dirfent;
+				*fep = shp->fents[i];
+				break;
+			}
+		}
+		pthread_mutex_unlock(&shp->lock);
+		return fep;
+	}
 	if ((fep = dcache_lookup(dirid)))
 		return fep;
 	flp = &flist[FT_DIR];
@@ -743,13 +1005,168 @@ fent_t *dirid_to_fent(int dirid)
 	return NULL;
 }
 
+void dirfd_unlink(dirfd_ent_t * dep)
+{
+	dep->prev->next = dep->next;
+	dep->next->prev = dep->prev;
+}
+
+void dirfd_link_head(dirfd_ent_t * dep)
+{
+	dep->next = dirfd_lru.next;
+	dep->prev = &dirfd_lru;
+	dirfd_lru.next->prev = dep;
+	dirfd_lru.next = dep;
+}
+
+void dirfd_unhash(dirfd_ent_t * dep)
+{
+	dirfd_ent_t **dpp;
+
+	for (dpp = &dirfd_hash[dep->id % NDIRFDHASH]; *dpp != dep;
+	     dpp = &(*dpp)->hnext) ;
+	*dpp = dep->hnext;
+	close(dep->fd);
+	dep->id = -1;
+}
+
+/* look dirid up in the dirfd cache, making it the most recently used */
+dirfd_ent_t *dirfd_lookup(int dirid)
+{
+	dirfd_ent_t *dep;
+
+	for (dep = dirfd_hash[dirid % NDIRFDHASH]; dep; dep = dep->hnext) {
+		if (dep->id == dirid) {
+			dirfd_unlink(dep);
+			dirfd_link_head(dep);
+			return dep;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Return an fd for directory dirid, AT_FDCWD for the top directory or -1.
+ * A miss opens the path from the nearest cached ancestor with a single
+ * openat() and replaces the least recently used entry.  Ancestors more
+ * than PATH_MAX / 2 bytes up are looked up (and so cached) recursively.
+ */
+int dirfd_get(int dirid)
+{
+	char buf[MAXNAMELEN];
+	char path[PATH_MAX];
+	dirfd_ent_t *dep;
+	fent_t *fep;
+	int fd;
+	int i;
+	int id;
+	int pfd;
+	int pos;
+
+	if (dirid == -1)
+		return AT_FDCWD;
+	if ((dep = dirfd_lookup(dirid))) {
+		dirfd_hits++;
+		return dep->fd;
+	}
+	dirfd_misses++;
+	pos = sizeof(path) - 1;
+	path[pos] = '\0';
+	for (id = dirid;;) {
+		if ((fep = dirid_to_fent(id)) == NULL) {
+			errno = ENOENT;
+			return -1;
+		}
+		i = sprintf(buf, "%c%x", flist[FT_DIR].tag, id);
+		namerandpad(id, buf, i);
+		i = strlen(buf);
+		if (path[pos])
+			path[--pos] = '/';
+		pos -= i;
+		memcpy(&path[pos], buf, i);
+		id = fep->parent;
+		if (id == -1) {
+			pfd = AT_FDCWD;
+			break;
+		}
+		if ((dep = dirfd_lookup(id))) {
+			pfd = dep->fd;
+			break;
+		}
+		if (pos < (int)sizeof(path) / 2) {
+			if ((pfd = dirfd_get(id)) == -1)
+				return -1;
+			break;
+		}
+	}
+	if ((fd = openat(pfd, &path[pos], O_RDONLY | O_DIRECTORY)) < 0)
+		return -1;
+	dep = dirfd_lru.prev;
+	if (dep->id != -1)
+		dirfd_unhash(dep);
+	dep->id = dirid;
+	dep->fd = fd;
+	dep->hnext = dirfd_hash[dirid % NDIRFDHASH];
+	dirfd_hash[dirid % NDIRFDHASH] = dep;
+	dirfd_unlink(dep);
+	dirfd_link_head(dep);
+	return fd;
+}
+
+void dirfd_init(void)
+{
+	int i;
+
+	if (!ndirfds)
+		return;
+	if (dirfd_ents == NULL &&
+	    (dirfd_ents = calloc(ndirfds, sizeof(*dirfd_ents))) == NULL) {
+		perror("dirfd cache");
+		_exit(1);
+	}
+	dirfd_lru.next = dirfd_lru.prev = &dirfd_lru;
+	for (i = 0; i < ndirfds; i++) {
+		dirfd_ents[i].id = -1;
+		dirfd_link_head(&dirfd_ents[i]);
+	}
+	memset(dirfd_hash, 0, sizeof(dirfd_hash));
+	dirfd_hits = dirfd_misses = 0;
+}
+
+void dirfd_flush(void)
+{
+	int i;
+
+	for (i = 0; i < ndirfds; i++) {
+		if (dirfd_ents[i].id != -1)
+			dirfd_unhash(&dirfd_ents[i]);
+	}
+}
+
+/* the directory is gone or has a new id; its subdirectories keep theirs */
+void dirfd_purge(int dirid)
+{
+	dirfd_ent_t *dep;
+
+	if (!ndirfds)
+		return;
+	for (dep = dirfd_hash[dirid % NDIRFDHASH]; dep; dep = dep->hnext) {
+		if (dep->id == dirid) {
+			dirfd_unhash(dep);
+			dirfd_unlink(dep);
+			dep->next = &dirfd_lru;
+			dep->prev = dirfd_lru.prev;
+			dirfd_lru.prev->next = dep;
+			dirfd_lru.prev = dep;
+			return;
+		}
+	}
+}
+
 void doproc(void)
 {
 	struct stat64 statbuf;
 	char buf[10];
-	int opno;
-	int rval;
-	opdesc_t *p;
 
 	sprintf(buf, "p%x", procid);
 	(void)mkdir(buf, 0777);
@@ -763,12 +1180,43 @@ void doproc(void)
 	srandom(seed);
 	if (namerand)
 		namerand = random();
+	dirfd_init();
+	doops();
+	if (ndirfds) {
+		if (verbose)
+			printf("%d: dirfd cache %lu hits %lu misses\n",
+			       procid, dirfd_hits, dirfd_misses);
+		dirfd_flush();
+	}
+}
+
+void doops(void)
+{
+	struct stat64 statbuf;
+	struct timespec t0;
+	struct timespec t1;
+	unsigned long long ns;
+	opstat_t *osp;
+	int opno;
+	int rval;
+	opdesc_t *p;
+
 	for (opno = 0; opno < operations; opno++) {
 		p = &ops[freq_table[random() % freq_table_size]];
 		if ((unsigned long)p->func < 4096)
 			abort();
 
-		p->func(opno, random());
+		if (self) {
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			p->func(opno, random());
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			ns = (t1.tv_sec - t0.tv_sec) * 1000000000ULL +
+			    t1.tv_nsec - t0.tv_nsec;
+			osp = &self->stats[p->op];
+			osp->total_ns += ns;
+			tst_hist_add(&osp->lat, ns);
+		} else
+			p->func(opno, random());
 		/*
 		 * test for forced shutdown by stat'ing the test
 		 * directory.  If this stat returns EIO, assume
@@ -778,27 +1226,117 @@ void doproc(void)
 			rval = stat64(".", &statbuf);
 			if (rval == EIO) {
 				fprintf(stderr, "Detected EIO\n");
-				return;
+				break;
 			}
 		}
 	}
 }
 
+/*
+ * -t: run nthreads workers in one directory "t", each doing -n operations
+ * on the shared file lists, and report per-op throughput and latency.
+ */
+void dothreads(void)
+{
+	struct stat64 statbuf;
+	struct timespec start;
+	struct timespec end;
+	worker_t *workers;
+	fshard_t *shp;
+	int ft;
+	int i;
+
+	(void)mkdir("t", 0777);
+	if (chdir("t") < 0 || stat64(".", &statbuf) < 0) {
+		perror("t");
+		exit(1);
+	}
+	top_ino = statbuf.st_ino;
+	homedir = getcwd(NULL, 0);
+	srandom(seed);
+	if (namerand)
+		namerand = random();
+	for (nshards = 1; nshards < 4 * nthreads && nshards < MAXSHARDS;)
+		nshards <<= 1;
+	for (ft = 0; ft < FT_nft; ft++) {
+		if ((fshards[ft] = calloc(nshards, sizeof(fshard_t))) == NULL) {
+			perror("flist shards");
+			exit(1);
+		}
+		for (i = 0; i < nshards; i++)
+			pthread_mutex_init(&fshards[ft][i].lock, NULL);
+	}
+	if ((workers = calloc(nthreads, sizeof(*workers))) == NULL) {
+		perror("workers");
+		exit(1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nthreads; i++) {
+		workers[i].id = i;
+		errno = pthread_create(&workers[i].tid, NULL, doworker,
+				       &workers[i]);
+		if (errno) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nthreads; i++)
+		pthread_join(workers[i].tid, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	show_opstats(workers, (end.tv_sec - start.tv_sec) +
+		     (end.tv_nsec - start.tv_nsec) / 1e9);
+	for (ft = 0; ft < FT_nft; ft++) {
+		for (i = 0, shp = fshards[ft]; i < nshards; i++, shp++) {
+			pthread_mutex_destroy(&shp->lock);
+			free(shp->fents);
+		}
+		free(fshards[ft]);
+		fshards[ft] = NULL;
+		flist[ft].nfiles = 0;
+	}
+	free(workers);
+	free(homedir);
+	if (chdir("..") < 0)
+		perror("..");
+}
+
+void *doworker(void *arg)
+{
+	worker_t *wp = arg;
+
+	self = wp;
+	procid = wp->id;
+	initstate_r(seed + procid, wp->rstate, sizeof(wp->rstate),
+		    &wp->rdata);
+	dirfd_init();
+	doops();
+	if (verbose)
+		printf("%d: dirfd cache %lu hits %lu misses\n",
+		       procid, dirfd_hits, dirfd_misses);
+	dirfd_flush();
+	free(dirfd_ents);
+	return NULL;
+}
+
 void fent_to_name(pathname_t * name, flist_t * flp, fent_t * fep)
 {
 	char buf[MAXNAMELEN];
 	int i;
+	fent_t fe;
 	fent_t *pfep;
 
 	if (fep == NULL)
 		return;
-	if (fep->parent != -1) {
-		pfep = dirid_to_fent(fep->parent);
+	fe = *fep;		/* with -t, fep may be reused by the recursion */
+	if (fe.parent != -1 && fullpaths) {
+		pfep = dirid_to_fent(fe.parent);
 		fent_to_name(name, &flist[FT_DIR], pfep);
 		append_pathname(name, "/");
 	}
-	i = sprintf(buf, "%c%x", flp->tag, fep->id);
-	namerandpad(fep->id, buf, i);
+	i = sprintf(buf, "%c%x", flp->tag, fe.id);
+	namerandpad(fe.id, buf, i);
+	name->dirid = fe.parent;
+	name->base = name->len;
 	append_pathname(name, buf);
 }
 
@@ -806,9 +1344,35 @@ void fix_parent(int oldid, int newid)
 {
 	fent_t *fep;
 	flist_t *flp;
+	fshard_t *shp;
 	int i;
 	int j;
+	int k;
 
+	if (nthreads) {
+		/*
+		 * Hold every shard while rewriting, else an entry added under
+		 * oldid to a shard already scanned would keep the stale id.
+		 * Everyone else only ever holds one shard, so this can't
+		 * deadlock.
+		 */
+		for (i = 0; i < FT_nft; i++)
+			for (k = 0, shp = fshards[i]; k < nshards; k++, shp++)
+				pthread_mutex_lock(&shp->lock);
+		for (i = 0; i < FT_nft; i++) {
+			for (k = 0, shp = fshards[i]; k < nshards; k++, shp++) {
+				for (j = 0, fep = shp->fents; j < shp->nfiles;
+				     j++, fep++) {
+					if (fep->parent == oldid)
+						fep->parent = newid;
+				}
+			}
+		}
+		for (i = 0; i < FT_nft; i++)
+			for (k = 0, shp = fshards[i]; k < nshards; k++, shp++)
+				pthread_mutex_unlock(&shp->lock);
+		return;
+	}
 	for (i = 0, flp = flist; i < FT_nft; i++, flp++) {
 		for (j = 0, fep = flp->fents; j < flp->nfiles; j++, fep++) {
 			if (fep->parent == oldid)
@@ -835,12 +1399,15 @@ int generate_fname(fent_t * fep, int ft, pathname_t * name, int *idp, int *v)
 	int len;
 
 	flp = &flist[ft];
-	len = sprintf(buf, "%c%x", flp->tag, id = nameseq++);
+	id = __sync_fetch_and_add(&nameseq, 1);
+	len = sprintf(buf, "%c%x", flp->tag, id);
 	namerandpad(id, buf, len);
-	if (fep) {
+	if (fep && fullpaths) {
 		fent_to_name(name, &flist[FT_DIR], fep);
 		append_pathname(name, "/");
 	}
+	name->dirid = fep ? fep->id : -1;
+	name->base = name->len;
 	append_pathname(name, buf);
 	*idp = id;
 	*v = verbose;
@@ -862,55 +1429,56 @@ get_fname(int which, long r, pathname_t * name, flist_t ** flpp, fent_t ** fepp,
 	flist_t *flp;
 	int i;
 	int j;
+	int n[FT_nft];
 	int x;
 
+	/* with -t the counts change under us, so work from a snapshot */
 	for (i = 0, c = 0, flp = flist; i < FT_nft; i++, flp++) {
-		if (which & (1 << i))
-			c += flp->nfiles;
-	}
-	if (c == 0) {
-		if (flpp)
-			*flpp = NULL;
-		if (fepp)
-			*fepp = NULL;
-		*v = verbose;
-		return 0;
+		n[i] = which & (1 << i) ? flp->nfiles : 0;
+		c += n[i];
 	}
+	if (c == 0)
+		goto none;
 	x = (int)(r % c);
-	for (i = 0, c = 0, flp = flist; i < FT_nft; i++, flp++) {
-		if (which & (1 << i)) {
-			if (x < c + flp->nfiles) {
-				fep = &flp->fents[x - c];
-				if (name)
-					fent_to_name(name, flp, fep);
-				if (flpp)
-					*flpp = flp;
-				if (fepp)
-					*fepp = fep;
-				*v = verbose;
-				for (j = 0; !*v && j < ilistlen; j++) {
-					if (ilist[j] == fep->id) {
-						*v = 1;
-						break;
-					}
-				}
-				return 1;
-			}
-			c += flp->nfiles;
+	for (i = 0; x >= n[i]; i++)
+		x -= n[i];
+	flp = &flist[i];
+	if (nthreads) {
+		fep = &self->fents[self->nfent++ % NFENTCOPY];
+		if (!shard_pick(i, x, fep))
+			goto none;
+	} else
+		fep = &flp->fents[x];
+	if (name)
+		fent_to_name(name, flp, fep);
+	if (flpp)
+		*flpp = flp;
+	if (fepp)
+		*fepp = fep;
+	*v = verbose;
+	for (j = 0; !*v && j < ilistlen; j++) {
+		if (ilist[j] == fep->id) {
+			*v = 1;
+			break;
 		}
 	}
-#ifdef DEBUG
-	fprintf(stderr, "fsstress: get_fname failure\n");
-	abort();
-#endif
-	return -1;
+	return 1;
 
+ none:
+	if (flpp)
+		*flpp = NULL;
+	if (fepp)
+		*fepp = NULL;
+	*v = verbose;
+	return 0;
 }
 
 void init_pathname(pathname_t * name)
 {
 	name->len = 0;
 	name->path = NULL;
+	name->dirid = DIRID_NONE;
+	name->base = 0;
 }
 
 int lchown_path(pathname_t * name, uid_t owner, gid_t group)
@@ -918,6 +1486,13 @@ int lchown_path(pathname_t * name, uid_t owner, gid_t group)
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	int dfd;
+
+	if ((rval = at_dirfd(name, &dfd)) < 0)
+		return rval;
+	if (rval)
+		return fchownat(dfd, AT_BASE(name), owner, group,
+				AT_SYMLINK_NOFOLLOW);
 
 	rval = lchown(name->path, owner, group);
 	if (rval >= 0 || errno != ENAMETOOLONG)
@@ -939,6 +1514,17 @@ int link_path(pathname_t * name1, pathname_t * name2)
 	pathname_t newname1;
 	pathname_t newname2;
 	int rval;
+	int dfd1;
+	int dfd2;
+
+	if ((rval = at_dirfd2(name1, &dfd1, name2, &dfd2))) {
+		if (rval < 0)
+			return rval;
+		rval = linkat(dfd1, AT_BASE(name1), dfd2,
+				 AT_BASE(name2), 0);
+		at_close(dfd1);
+		return rval;
+	}
 
 	rval = link(name1->path, name2->path);
 	if (rval >= 0 || errno != ENAMETOOLONG)
@@ -990,6 +1576,12 @@ int lstat64_path(pathname_t * name, struct stat64 *sbuf)
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	int dfd;
+
+	if ((rval = at_dirfd(name, &dfd)) < 0)
+		return rval;
+	if (rval)
+		return fstatat64(dfd, AT_BASE(name), sbuf, AT_SYMLINK_NOFOLLOW);
 
 	rval = lstat64(name->path, sbuf);
 	if (rval >= 0 || errno != ENAMETOOLONG)
@@ -1024,6 +1616,12 @@ int mkdir_path(pathname_t * name, mode_t mode)
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	int dfd;
+
+	if ((rval = at_dirfd(name, &dfd)) < 0)
+		return rval;
+	if (rval)
+		return mkdirat(dfd, AT_BASE(name), mode);
 
 	rval = mkdir(name->path, mode);
 	if (rval >= 0 || errno != ENAMETOOLONG)
@@ -1042,6 +1640,12 @@ int mknod_path(pathname_t * name, mode_t mode, dev_t dev)
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	int dfd;
+
+	if ((rval = at_dirfd(name, &dfd)) < 0)
+		return rval;
+	if (rval)
+		return mknodat(dfd, AT_BASE(name), mode, dev);
 
 	rval = mknod(name->path, mode, dev);
 	if (rval >= 0 || errno != ENAMETOOLONG)
@@ -1080,6 +1684,12 @@ int open_path(pathname_t * name, int oflag)
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	int dfd;
+
+	if ((rval = at_dirfd(name, &dfd)) < 0)
+		return rval;
+	if (rval)
+		return openat(dfd, AT_BASE(name), oflag);
 
 	rval = open(name->path, oflag);
 	if (rval >= 0 || errno != ENAMETOOLONG)
@@ -1098,6 +1708,20 @@ DIR *opendir_path(pathname_t * name)
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	DIR *rval;
+	int dfd;
+	int fd;
+
+	switch (at_dirfd(name, &dfd)) {
+	case -1:
+		return NULL;
+	case 1:
+		fd = openat(dfd, AT_BASE(name), O_RDONLY | O_DIRECTORY);
+		if (fd < 0)
+			return NULL;
+		if ((rval = fdopendir(fd)) == NULL)
+			close(fd);
+		return rval;
+	}
 
 	rval = opendir(name->path);
 	if (rval || errno != ENAMETOOLONG)
@@ -1137,6 +1761,12 @@ int readlink_path(pathname_t * name, char *lbuf, size_t lbufsiz)
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	int dfd;
+
+	if ((rval = at_dirfd(name, &dfd)) < 0)
+		return rval;
+	if (rval)
+		return readlinkat(dfd, AT_BASE(name), lbuf, lbufsiz);
 
 	rval = readlink(name->path, lbuf, lbufsiz);
 	if (rval >= 0 || errno != ENAMETOOLONG)
@@ -1158,6 +1788,17 @@ int rename_path(pathname_t * name1, pathname_t * name2)
 	pathname_t newname1;
 	pathname_t newname2;
 	int rval;
+	int dfd1;
+	int dfd2;
+
+	if ((rval = at_dirfd2(name1, &dfd1, name2, &dfd2))) {
+		if (rval < 0)
+			return rval;
+		rval = renameat(dfd1, AT_BASE(name1), dfd2,
+				 AT_BASE(name2));
+		at_close(dfd1);
+		return rval;
+	}
 
 	rval = rename(name1->path, name2->path);
 	if (rval >= 0 || errno != ENAMETOOLONG)
@@ -1209,6 +1850,12 @@ int rmdir_path(pathname_t * name)
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	int dfd;
+
+	if ((rval = at_dirfd(name, &dfd)) < 0)
+		return rval;
+	if (rval)
+		return unlinkat(dfd, AT_BASE(name), AT_REMOVEDIR);
 
 	rval = rmdir(name->path);
 	if (rval >= 0 || errno != ENAMETOOLONG)
@@ -1240,6 +1887,28 @@ void separate_pathname(pathname_t * name, char *buf, pathname_t * newname)
 
 #define WIDTH 80
 
+/*
+ * Copy the x'th entry of type ft, counting across shards from shard x,
+ * into *fep.  Falls back to any entry if that shard has been emptied.
+ */
+int shard_pick(int ft, int x, fent_t * fep)
+{
+	fshard_t *shp;
+	int i;
+
+	for (i = 0; i < nshards; i++) {
+		shp = &fshards[ft][(x + i) & (nshards - 1)];
+		pthread_mutex_lock(&shp->lock);
+		if (shp->nfiles) {
+			*fep = shp->fents[(x / nshards) % shp->nfiles];
+			pthread_mutex_unlock(&shp->lock);
+			return 1;
+		}
+		pthread_mutex_unlock(&shp->lock);
+	}
+	return 0;
+}
+
 void show_ops(int flag, char *lead_str)
 {
 	opdesc_t *p;
@@ -1276,11 +1945,52 @@ void show_ops(int flag, char *lead_str)
 	}
 }
 
+void show_opstats(worker_t * workers, double secs)
+{
+	opstat_t sum;
+	opstat_t *osp;
+	unsigned long long total;
+	opdesc_t *p;
+	int i;
+
+	for (p = ops, total = 0; p < ops_end; p++) {
+		for (i = 0; i < nthreads; i++)
+			total += workers[i].stats[p->op].lat.count;
+	}
+	if (secs <= 0)
+		secs = 1e-9;
+	printf("%d threads: %llu ops in %.3fs, %.0f ops/s\n",
+	       nthreads, total, secs, total / secs);
+	printf("%-12s %10s %10s %10s %10s %10s %10s\n", "op", "count",
+	       "ops/s", "avg(us)", "p50(us)", "p99(us)", "max(us)");
+	for (p = ops; p < ops_end; p++) {
+		memset(&sum, 0, sizeof(sum));
+		for (i = 0; i < nthreads; i++) {
+			osp = &workers[i].stats[p->op];
+			sum.total_ns += osp->total_ns;
+			tst_hist_merge(&sum.lat, &osp->lat);
+		}
+		if (sum.lat.count == 0)
+			continue;
+		printf("%-12s %10llu %10.0f %10.1f %10.1f %10.1f %10.1f\n",
+		       p->name, sum.lat.count, sum.lat.count / secs,
+		       sum.total_ns / 1000.0 / sum.lat.count,
+		       tst_hist_usecs(&sum.lat, 0.5),
+		       tst_hist_usecs(&sum.lat, 0.99), sum.lat.max_ns / 1000.0);
+	}
+}
+
 int stat64_path(pathname_t * name, struct stat64 *sbuf)
 {
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	int dfd;
+
+	if ((rval = at_dirfd(name, &dfd)) < 0)
+		return rval;
+	if (rval)
+		return fstatat64(dfd, AT_BASE(name), sbuf, 0);
 
 	rval = stat64(name->path, sbuf);
 	if (rval >= 0 || errno != ENAMETOOLONG)
@@ -1299,12 +2009,18 @@ int symlink_path(const char *name1, pathname_t * name)
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	int dfd;
 
 	if (!strcmp(name1, name->path)) {
 		printf("yikes! %s %s\n", name1, name->path);
 		return 0;
 	}
 
+	if ((rval = at_dirfd(name, &dfd)) < 0)
+		return rval;
+	if (rval)
+		return symlinkat(name1, dfd, AT_BASE(name));
+
 	rval = symlink(name1, name->path);
 	if (rval >= 0 || errno != ENAMETOOLONG)
 		return rval;
@@ -1322,6 +2038,17 @@ int truncate64_path(pathname_t * name, off64_t length)
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	int dfd;
+	int fd;
+
+	if ((rval = at_dirfd(name, &dfd))) {
+		if (rval < 0 ||
+		    (fd = openat(dfd, AT_BASE(name), O_WRONLY)) < 0)
+			return -1;
+		rval = ftruncate64(fd, length);
+		close(fd);
+		return rval;
+	}
 
 	rval = truncate64(name->path, length);
 	if (rval >= 0 || errno != ENAMETOOLONG)
@@ -1340,6 +2067,12 @@ int unlink_path(pathname_t * name)
 	char buf[MAXNAMELEN];
 	pathname_t newname;
 	int rval;
+	int dfd;
+
+	if ((rval = at_dirfd(name, &dfd)) < 0)
+		return rval;
+	if (rval)
+		return unlinkat(dfd, AT_BASE(name), 0);
 
 	rval = unlink(name->path);
 	if (rval >= 0 || errno != ENAMETOOLONG)
@@ -1359,7 +2092,8 @@ void usage(void)
 	printf
 	    ("       %s [-c][-d dir][-e errtg][-f op_name=freq][-l loops][-n nops]\n",
 	     myprog);
-	printf("          [-p nproc][-r len][-s seed][-v][-w][-z][-S]\n");
+	printf("          [-p nproc][-r len][-s seed][-t nthreads][-v][-w][-z][-S]\n");
+	printf("          [-D ndirfds]\n");
 	printf("where\n");
 	printf
 	    ("   -c               specifies not to remove files(cleanup) after execution\n");
@@ -1380,6 +2114,10 @@ void usage(void)
 	printf("   -r               specifies random name padding\n");
 	printf
 	    ("   -s seed          specifies the seed for the random generator (default random)\n");
+	printf
+	    ("   -t nthreads      runs nthreads threads on one shared directory tree\n");
+	printf
+	    ("                    instead of processes and reports per-op latencies\n");
 	printf("   -v               specifies verbose mode\n");
 	printf
 	    ("   -w               zeros frequencies of non-write operations\n");
@@ -1389,6 +2127,10 @@ void usage(void)
 	printf("   -H               prints usage and exits\n");
 	printf
 	    ("   -X               don't do anything XFS specific (default with -DNO_XFS)\n");
+	printf
+	    ("   -D ndirfds       resolve names with *at() syscalls relative to an LRU\n");
+	printf
+	    ("                    cache of ndirfds open directories instead of by path\n");
 }
 
 void write_freq(void)
@@ -1545,7 +2287,7 @@ void attr_set_f(int opno, long r)
 	init_pathname(&f);
 	if (!get_fname(FT_ANYm, r, &f, NULL, NULL, &v))
 		append_pathname(&f, ".");
-	sprintf(aname, "a%x", nameseq++);
+	sprintf(aname, "a%x", __sync_fetch_and_add(&nameseq, 1));
 	li = (int)(random() % (sizeof(lengths) / sizeof(lengths[0])));
 	len = (int)(random() % lengths[li]);
 	if (len == 0)
@@ -2340,7 +3082,7 @@ void rename_f(int opno, long r)
 			oldid = fep->id;
 			fix_parent(oldid, id);
 		}
-		del_from_flist(flp - flist, fep - flp->fents);
+		del_fent(flp - flist, fep);
 		add_to_flist(flp - flist, id, parid);
 	}
 	if (v)
@@ -2421,7 +3163,7 @@ void rmdir_f(int opno, long r)
 	e = rmdir_path(&f) < 0 ? errno : 0;
 	check_cwd();
 	if (e == 0)
-		del_from_flist(FT_DIR, fep - flist[FT_DIR].fents);
+		del_fent(FT_DIR, fep);
 	if (v)
 		printf("%d/%d: rmdir %s %d\n", procid, opno, f.path, e);
 	free_pathname(&f);
@@ -2556,7 +3298,7 @@ void unlink_f(int opno, long r)
 	e = unlink_path(&f) < 0 ? errno : 0;
 	check_cwd();
 	if (e == 0)
-		del_from_flist(flp - flist, fep - flp->fents);
+		del_fent(flp - flist, fep);
 	if (v)
 		printf("%d/%d: unlink %s %d\n", procid, opno, f.path, e);
 	free_pathname(&f);
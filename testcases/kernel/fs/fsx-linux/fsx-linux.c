@@ -35,8 +35,12 @@
  * $FreeBSD: src/tools/regression/fsx/fsx.c,v 1.1 2001/12/20 04:15:57 jkh Exp $
  *
  *	Add multi-file testing feature -- Zach Brown <zab@clusterfs.com>
+ *
+ *	With -T each thread runs its own fsx, with its own model and log,
+ *	either on a file of its own or (-u) on its own range of one file.
  */
 
+#include "config.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #if defined(_UWIN) || defined(__linux__)
@@ -59,6 +63,13 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <linux/falloc.h>
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
 
 /*
  *	A log entry is an operation and a bunch of arguments.
@@ -72,9 +83,9 @@ struct log_entry {
 
 #define	LOGSIZE	1000
 
-struct log_entry oplog[LOGSIZE];	/* the log */
-int logptr = 0;			/* current position in log */
-int logcount = 0;		/* total ops */
+__thread struct log_entry oplog[LOGSIZE];	/* the log */
+__thread int logptr = 0;	/* current position in log */
+__thread int logcount = 0;	/* total ops */
 
 /*
  *	Define operations
@@ -87,21 +98,36 @@ int logcount = 0;		/* total ops */
 #define OP_MAPREAD	5
 #define OP_MAPWRITE	6
 #define OP_SKIPPED	7
+#define OP_PUNCH_HOLE	8
+#define OP_ZERO_RANGE	9
+#define OP_COPY_RANGE	10
+#define OP_DIRECTREAD	11
+#define OP_DIRECTWRITE	12
+#define OP_URINGREAD	13
+#define OP_URINGWRITE	14
+
+#define URING_BATCH	4	/* max requests per io_uring op */
 
 int page_size;
 int page_mask;
 
+/*
+ * Everything describing one test stream is per thread; the main thread's
+ * copy is the only one used without -T.
+ */
 char *original_buf;		/* a pointer to the original data */
-char *good_buf;			/* a pointer to the correct data */
-char *temp_buf;			/* a pointer to the current data */
-char *fname;			/* name of our test file */
-char logfile[1024];		/* name of our log file */
-char goodfile[1024];		/* name of our test file */
-
-off_t file_size = 0;
-off_t biggest = 0;
+__thread char *good_buf;	/* a pointer to the correct data */
+__thread char *temp_buf;	/* a pointer to the current data */
+__thread char *dio_buf;		/* page aligned bounce buffer for -Z */
+__thread char *fname;		/* name of our test file */
+__thread char logfile[1024];	/* name of our log file */
+__thread char goodfile[1024];	/* name of our test file */
+
+__thread off_t file_size = 0;
+__thread off_t biggest = 0;
+__thread off_t range_base = 0;	/* -u: file offset of our range */
 char state[256];
-unsigned long testcalls = 0;	/* calls to function "test" */
+__thread unsigned long testcalls = 0;	/* calls to function "test" */
 
 unsigned long simulatedopcount = 0;	/* -b flag */
 int closeprob = 0;		/* -c flag */
@@ -124,9 +150,44 @@ int randomoplen = 1;		/* -O flag disables it */
 int seed = 1;			/* -S flag */
 int mapped_writes = 1;		/* -W flag disables */
 int mapped_reads = 1;		/* -R flag disables it */
-int fsxgoodfd = 0;
-FILE *fsxlogf = NULL;
-int badoff = -1;
+int punch_hole = 0;		/* -H flag */
+int zero_range = 0;		/* -z flag */
+int copy_range = 0;		/* -C flag */
+int direct_io = 0;		/* -Z flag */
+int uring_io = 0;		/* -U flag */
+int extra_ops[8];		/* the enabled ops of the above */
+int nextra_ops = 0;
+int nthreads = 0;		/* -T flag */
+int shared = 0;			/* -u flag */
+char *dirpath = NULL;		/* -P flag */
+__thread int fsxgoodfd = 0;
+__thread FILE *fsxlogf = NULL;
+__thread int badoff = -1;
+
+struct fsx_thread {
+	pthread_t tid;
+	int id;
+	char path[PATH_MAX];
+	char tag[16];
+	struct random_data rdata;
+	char rstate[256];
+	unsigned long testcalls;
+};
+
+__thread struct fsx_thread *self;	/* NULL unless a -T thread */
+
+/* random() for the tests; each -T thread has its own state */
+long fsx_random(void)
+{
+	int32_t r;
+
+	if (self == NULL)
+		return random();
+	random_r(&self->rdata, &r);
+	return r;
+}
+
+#define	random()	fsx_random()
 
 void vwarnc(code, fmt, ap)
 int code;
@@ -252,6 +313,49 @@ void logdump(void)
 			    badoff < lp->args[! !down])
 				prt("\t******WWWW");
 			break;
+		case OP_DIRECTREAD:
+		case OP_URINGREAD:
+			prt("%s 0x%x thru 0x%x (0x%x bytes)",
+			    lp->operation == OP_DIRECTREAD ? "DIRECTREAD" :
+			    "URINGREAD ", lp->args[0],
+			    lp->args[0] + lp->args[1] - 1, lp->args[1]);
+			if (lp->operation == OP_URINGREAD)
+				prt(" in %d", lp->args[2]);
+			if (badoff >= lp->args[0] &&
+			    badoff < lp->args[0] + lp->args[1])
+				prt("\t***RRRR***");
+			break;
+		case OP_DIRECTWRITE:
+		case OP_URINGWRITE:
+			prt("%s 0x%x thru 0x%x (0x%x bytes)",
+			    lp->operation == OP_DIRECTWRITE ? "DIRECTWRITE" :
+			    "URINGWRITE ", lp->args[0],
+			    lp->args[0] + lp->args[1] - 1, lp->args[1]);
+			if (lp->operation == OP_URINGWRITE)
+				prt(" in %d", lp->args[2]);
+			if (badoff >= lp->args[0] &&
+			    badoff < lp->args[0] + lp->args[1])
+				prt("\t***WWWW");
+			break;
+		case OP_PUNCH_HOLE:
+		case OP_ZERO_RANGE:
+			prt("%s 0x%x thru 0x%x (0x%x bytes)",
+			    lp->operation == OP_PUNCH_HOLE ? "PUNCH    " :
+			    "ZERO     ", lp->args[0],
+			    lp->args[0] + lp->args[1] - 1, lp->args[1]);
+			if (badoff >= lp->args[0] &&
+			    badoff < lp->args[0] + lp->args[1])
+				prt("\t******PPPP");
+			break;
+		case OP_COPY_RANGE:
+			prt("COPY     0x%x thru 0x%x (0x%x bytes) to 0x%x thru 0x%x",
+			    lp->args[0], lp->args[0] + lp->args[1] - 1,
+			    lp->args[1], lp->args[2],
+			    lp->args[2] + lp->args[1] - 1);
+			if (badoff >= lp->args[2] &&
+			    badoff < lp->args[2] + lp->args[1])
+				prt("\t******CCCC");
+			break;
 		case OP_CLOSEOPEN:
 			prt("CLOSE/OPEN");
 			break;
@@ -329,62 +433,102 @@ void report_failure(int status)
 #define short_at(cp) ((unsigned short)((*((unsigned char *)(cp)) << 8) | \
 				        *(((unsigned char *)(cp)) + 1)))
 
-void check_buffers(unsigned offset, unsigned size)
+#define	MAX_BAD_RANGES	16	/* bad ranges listed by check_buffers() */
+#define	BAD_RANGE_GAP	16	/* good bytes that end a bad range */
+
+/*
+ * Number of equal leading bytes of a and b, comparing a word at a time.
+ */
+unsigned same_len(const char *a, const char *b, unsigned len)
 {
-	unsigned char c, t;
+	uint64_t x, y;
 	unsigned i = 0;
-	unsigned n = 0;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	for (; i + 8 <= len; i += 8) {
+		memcpy(&x, a + i, 8);
+		memcpy(&y, b + i, 8);
+		if (x != y)
+			return i + (__builtin_ctzll(x ^ y) >> 3);
+	}
+#endif
+	while (i < len && a[i] == b[i])
+		i++;
+	return i;
+}
+
+/*
+ * Compare buf against good_buf at offset and, on a mismatch, list the bad
+ * ranges: runs of differing bytes up to BAD_RANGE_GAP good bytes apart.
+ */
+void check_buffers(char *buf, unsigned offset, unsigned size)
+{
+	unsigned i = 0;
+	unsigned n;
+	unsigned len;
 	unsigned op = 0;
 	unsigned bad = 0;
+	unsigned nranges = 0;
+	unsigned total = 0;
 
-	if (memcmp(good_buf + offset, temp_buf, size) != 0) {
-		prt("READ BAD DATA: offset = 0x%x, size = 0x%x\n",
-		    offset, size);
-		prt("OFFSET\tGOOD\tBAD\tRANGE\n");
-		while (size > 0) {
-			c = good_buf[offset];
-			t = temp_buf[i];
-			if (c != t) {
-				if (n == 0) {
-					bad = short_at(&temp_buf[i]);
-					prt("%#07x\t%#06x\t%#06x", offset,
-					    short_at(&good_buf[offset]), bad);
-					op = temp_buf[offset & 1 ? i + 1 : i];
-				}
-				n++;
-				badoff = offset;
+	if (memcmp(good_buf + offset, buf, size) == 0)
+		return;
+
+	prt("READ BAD DATA: offset = 0x%x, size = 0x%x\n", offset, size);
+	prt("OFFSET\tGOOD\tBAD\tRANGE\n");
+	while ((i += same_len(good_buf + offset + i, buf + i, size - i)) <
+	       size) {
+		/* i is bad: extend the range over short good runs */
+		for (len = 1; i + len < size; len += n) {
+			if (good_buf[offset + i + len] != buf[i + len]) {
+				n = 1;
+				continue;
 			}
-			offset++;
-			i++;
-			size--;
+			n = same_len(good_buf + offset + i + len,
+				     buf + i + len, size - i - len);
+			if (n >= BAD_RANGE_GAP || i + len + n == size)
+				break;
 		}
-		if (n) {
-			prt("\t%#7x\n", n);
-			if (bad)
-				prt("operation# (mod 256) for the bad data"
-				    "may be %u\n", ((unsigned)op & 0xff));
-			else
-				prt("operation# (mod 256) for the bad data"
-				    "unknown, check HOLE and EXTEND ops\n");
-		} else
-			prt("????????????????\n");
-		report_failure(110);
-	}
+		if (nranges++ < MAX_BAD_RANGES) {
+			prt("%#07x\t%#06x\t%#06x\t%#7x\n", offset + i,
+			    short_at(&good_buf[offset + i]),
+			    short_at(&buf[i]), len);
+		}
+		if (nranges == 1) {
+			bad = short_at(&buf[i]);
+			op = buf[(offset + i) & 1 ? i + 1 : i];
+		}
+		total += len;
+		badoff = offset + i + len - 1;
+		i += len;
+	}
+	if (nranges > MAX_BAD_RANGES)
+		prt("... %u more bad ranges\n", nranges - MAX_BAD_RANGES);
+	prt("0x%x bad bytes in %u ranges\n", total, nranges);
+	if (bad)
+		prt("operation# (mod 256) for the bad data"
+		    "may be %u\n", ((unsigned)op & 0xff));
+	else
+		prt("operation# (mod 256) for the bad data"
+		    "unknown, check HOLE and EXTEND ops\n");
+	report_failure(110);
 }
 
 struct test_file {
 	char *path;
 	int fd;
-} *test_files = NULL;
+	int dfd;		/* O_DIRECT fd for -Z */
+};
 
-int num_test_files = 0;
+__thread struct test_file *test_files = NULL;
+__thread int num_test_files = 0;
 enum fd_iteration_policy {
 	FD_SINGLE,
 	FD_ROTATE,
 	FD_RANDOM,
 };
-int fd_policy = FD_RANDOM;
-int fd_last = 0;
+__thread int fd_policy = FD_RANDOM;
+__thread int fd_last = 0;
 
 struct test_file *get_tf(void)
 {
@@ -444,12 +588,15 @@ void open_test_files(char **argv, int argc)
 	for (i = 0, tf = test_files; i < num_test_files; i++, tf++) {
 
 		tf->path = argv[i];
-		tf->fd = open(tf->path, O_RDWR | (lite ? 0 : O_CREAT | O_TRUNC),
+		tf->fd = open(tf->path,
+			      O_RDWR | (lite || shared ? 0 : O_CREAT | O_TRUNC),
 			      0666);
 		if (tf->fd < 0) {
 			prterr(tf->path);
 			exit(91);
 		}
+		/* an unsupported O_DIRECT is caught by probe_extra_ops() */
+		tf->dfd = direct_io ? open(tf->path, O_RDWR | O_DIRECT) : -1;
 	}
 
 	if (quiet || fd_policy == FD_SINGLE)
@@ -465,7 +612,7 @@ void close_test_files(void)
 	struct test_file *tf;
 
 	for (i = 0, tf = test_files; i < num_test_files; i++, tf++) {
-		if (close(tf->fd)) {
+		if (close(tf->fd) || (tf->dfd >= 0 && close(tf->dfd))) {
 			prterr("close");
 			report_failure(99);
 		}
@@ -510,8 +657,8 @@ void check_trunc_hack(void)
 	ftruncate(fd, 0);
 }
 
-static char *tf_buf = NULL;
-static int max_tf_len = 0;
+static __thread char *tf_buf = NULL;
+static __thread int max_tf_len = 0;
 
 void alloc_tf_buf(void)
 {
@@ -563,6 +710,13 @@ output_line(struct test_file *tf, int op, unsigned offset,
 		[OP_TRUNCATE] = "trunc from",
 		[OP_MAPREAD] = "mapread",
 		[OP_MAPWRITE] = "mapwrite",
+		[OP_PUNCH_HOLE] = "punch",
+		[OP_ZERO_RANGE] = "zero",
+		[OP_COPY_RANGE] = "copy from",
+		[OP_DIRECTREAD] = "directread",
+		[OP_DIRECTWRITE] = "directwrite",
+		[OP_URINGREAD] = "uringread",
+		[OP_URINGWRITE] = "uringwrite",
 	};
 
 	/* W. */
@@ -614,7 +768,7 @@ void doread(unsigned offset, unsigned size)
 
 	output_line(tf, OP_READ, offset, size, &t);
 
-	ret = lseek(fd, (off_t) offset, SEEK_SET);
+	ret = lseek(fd, range_base + offset, SEEK_SET);
 	if (ret == (off_t) - 1) {
 		prterr("doread: lseek");
 		report_failure(140);
@@ -635,7 +789,7 @@ void doread(unsigned offset, unsigned size)
 			    iret, size);
 		report_failure(141);
 	}
-	check_buffers(offset, size);
+	check_buffers(temp_buf, offset, size);
 }
 
 void domapread(unsigned offset, unsigned size)
@@ -673,7 +827,7 @@ void domapread(unsigned offset, unsigned size)
 	map_size = pg_offset + size;
 
 	if ((p = mmap(0, map_size, PROT_READ, MAP_FILE | MAP_SHARED, fd,
-		      (off_t) (offset - pg_offset))) == MAP_FAILED) {
+		      range_base + (offset - pg_offset))) == MAP_FAILED) {
 		prterr("domapread: mmap");
 		report_failure(190);
 	}
@@ -704,7 +858,7 @@ void domapread(unsigned offset, unsigned size)
 		prt("       %lu.%06lu munmap done\n", t.tv_sec, t.tv_usec);
 	}
 
-	check_buffers(offset, size);
+	check_buffers(temp_buf, offset, size);
 }
 
 void gendata(char *original_buf, char *good_buf, unsigned offset, unsigned size)
@@ -752,7 +906,7 @@ void dowrite(unsigned offset, unsigned size)
 
 	output_line(tf, OP_WRITE, offset, size, &t);
 
-	ret = lseek(fd, (off_t) offset, SEEK_SET);
+	ret = lseek(fd, range_base + offset, SEEK_SET);
 	if (ret == (off_t) - 1) {
 		prterr("dowrite: lseek");
 		report_failure(150);
@@ -833,7 +987,7 @@ void domapwrite(unsigned offset, unsigned size)
 
 	if ((p =
 	     mmap(0, map_size, PROT_READ | PROT_WRITE, MAP_FILE | MAP_SHARED,
-		  fd, (off_t) (offset - pg_offset))) == MAP_FAILED) {
+		  fd, range_base + (offset - pg_offset))) == MAP_FAILED) {
 		prterr("domapwrite: mmap");
 		report_failure(202);
 	}
@@ -913,12 +1067,483 @@ void dotruncate(unsigned size)
 	}
 }
 
+void dofallocate(int op, unsigned offset, unsigned size)
+{
+	struct timeval t;
+	struct test_file *tf = get_tf();
+	int mode = FALLOC_FL_KEEP_SIZE;
+
+	mode |= op == OP_PUNCH_HOLE ? FALLOC_FL_PUNCH_HOLE :
+	    FALLOC_FL_ZERO_RANGE;
+	gettimeofday(&t, NULL);
+	if (size == 0) {
+		if (!quiet && testcalls > simulatedopcount)
+			prt("skipping zero size %s\n",
+			    op == OP_PUNCH_HOLE ? "punch" : "zero");
+		log4(OP_SKIPPED, op, offset, size, &t);
+		return;
+	}
+
+	log4(op, offset, size, 0, &t);
+
+	memset(good_buf + offset, '\0', size);
+
+	if (testcalls <= simulatedopcount)
+		return;
+
+	output_line(tf, op, offset, size, &t);
+
+	if (fallocate(tf->fd, mode, range_base + offset, size) == -1) {
+		prterr("dofallocate: fallocate");
+		report_failure(161);
+	}
+}
+
+void docopyrange(unsigned soff, unsigned doff, unsigned size)
+{
+	struct timeval t;
+	struct test_file *tf = get_tf();
+	loff_t in, out;
+	ssize_t ret;
+	unsigned done;
+
+	gettimeofday(&t, NULL);
+	if (size == 0 || (soff < doff + size && doff < soff + size)) {
+		if (!quiet && testcalls > simulatedopcount)
+			prt("skipping %s copy_file_range\n",
+			    size ? "overlapping" : "zero size");
+		log4(OP_SKIPPED, OP_COPY_RANGE, soff, size, &t);
+		return;
+	}
+
+	log4(OP_COPY_RANGE, soff, size, doff, &t);
+
+	memcpy(good_buf + doff, good_buf + soff, size);
+	if (file_size < doff + size) {
+		if (file_size < doff)
+			memset(good_buf + file_size, '\0', doff - file_size);
+		file_size = doff + size;
+	}
+
+	if (testcalls <= simulatedopcount)
+		return;
+
+	output_line(tf, OP_COPY_RANGE, soff, size, &t);
+
+	in = range_base + soff;
+	out = range_base + doff;
+	for (done = 0; done < size; done += ret) {
+		ret = syscall(__NR_copy_file_range, tf->fd, &in, tf->fd, &out,
+			      (size_t) (size - done), 0);
+		if (ret <= 0) {
+			if (ret == 0)
+				prt("short copy_file_range: 0x%x bytes instead"
+				    " of 0x%x\n", done, size);
+			else
+				prterr("docopyrange: copy_file_range");
+			report_failure(162);
+		}
+	}
+}
+
+void dodirectread(unsigned offset, unsigned size)
+{
+	struct timeval t;
+	struct test_file *tf = get_tf();
+	ssize_t ret;
+
+	gettimeofday(&t, NULL);
+	if (size == 0) {
+		if (!quiet && testcalls > simulatedopcount)
+			prt("skipping zero size direct read\n");
+		log4(OP_SKIPPED, OP_DIRECTREAD, offset, size, &t);
+		return;
+	}
+
+	log4(OP_DIRECTREAD, offset, size, 0, &t);
+
+	if (testcalls <= simulatedopcount)
+		return;
+
+	output_line(tf, OP_DIRECTREAD, offset, size, &t);
+
+	ret = pread(tf->dfd, dio_buf, size, range_base + offset);
+	if (ret != size) {
+		if (ret == -1)
+			prterr("dodirectread: pread");
+		else
+			prt("short direct read: 0x%x bytes instead of 0x%x\n",
+			    (unsigned)ret, size);
+		report_failure(142);
+	}
+	check_buffers(dio_buf, offset, size);
+}
+
+void dodirectwrite(unsigned offset, unsigned size)
+{
+	struct timeval t;
+	struct test_file *tf = get_tf();
+	ssize_t ret;
+
+	gettimeofday(&t, NULL);
+	if (size == 0) {
+		if (!quiet && testcalls > simulatedopcount)
+			prt("skipping zero size direct write\n");
+		log4(OP_SKIPPED, OP_DIRECTWRITE, offset, size, &t);
+		return;
+	}
+
+	log4(OP_DIRECTWRITE, offset, size, file_size, &t);
+
+	gendata(original_buf, good_buf, offset, size);
+	if (file_size < offset + size) {
+		if (file_size < offset)
+			memset(good_buf + file_size, '\0', offset - file_size);
+		file_size = offset + size;
+	}
+
+	if (testcalls <= simulatedopcount)
+		return;
+
+	output_line(tf, OP_DIRECTWRITE, offset, size, &t);
+
+	memcpy(dio_buf, good_buf + offset, size);
+	ret = pwrite(tf->dfd, dio_buf, size, range_base + offset);
+	if (ret != size) {
+		if (ret == -1)
+			prterr("dodirectwrite: pwrite");
+		else
+			prt("short direct write: 0x%x bytes instead of 0x%x\n",
+			    (unsigned)ret, size);
+		report_failure(152);
+	}
+}
+
+#ifdef HAVE_LINUX_IO_URING_H
+/*
+ * A bare io_uring, set up per thread by uring_init(); the uring ops split
+ * their range in up to URING_BATCH requests submitted with one syscall.
+ */
+struct uring {
+	int fd;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ring;
+	void *cq_ring;
+	size_t sq_size;
+	size_t cq_size;
+};
+
+__thread struct uring ring = {.fd = -1 };
+
+int uring_init(void)
+{
+	struct io_uring_params p;
+	char *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	ring.fd = syscall(__NR_io_uring_setup, URING_BATCH, &p);
+	if (ring.fd < 0)
+		return -1;
+	ring.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring.cq_size = p.cq_off.cqes +
+	    p.cq_entries * sizeof(struct io_uring_cqe);
+	sq = mmap(0, ring.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		  ring.fd, IORING_OFF_SQ_RING);
+	cq = mmap(0, ring.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		  ring.fd, IORING_OFF_CQ_RING);
+	ring.sqes = mmap(0, p.sq_entries * sizeof(struct io_uring_sqe),
+			 PROT_READ | PROT_WRITE, MAP_SHARED, ring.fd,
+			 IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || ring.sqes == MAP_FAILED) {
+		close(ring.fd);
+		ring.fd = -1;
+		return -1;
+	}
+	ring.sq_ring = sq;
+	ring.cq_ring = cq;
+	ring.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	ring.sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	ring.sq_array = (unsigned *)(sq + p.sq_off.array);
+	ring.cq_head = (unsigned *)(cq + p.cq_off.head);
+	ring.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	ring.cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	ring.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+}
+
+void uring_exit(void)
+{
+	munmap(ring.sq_ring, ring.sq_size);
+	munmap(ring.cq_ring, ring.cq_size);
+	munmap(ring.sqes, URING_BATCH * sizeof(struct io_uring_sqe));
+	close(ring.fd);
+	ring.fd = -1;
+}
+
+/*
+ * Submit nr reads or writes of len[i] bytes at off[i] from/to buf[i] on fd
+ * and wait for them all.  Returns the index of the first request that did
+ * not transfer all its bytes with its result in *res, or -1.
+ */
+int uring_rw(int opcode, int fd, char **buf, unsigned *off, unsigned *len,
+	     int nr, int *res)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	unsigned tail, head;
+	int bad = -1;
+	int ret;
+	int i;
+
+	tail = *ring.sq_tail;
+	for (i = 0; i < nr; i++, tail++) {
+		sqe = &ring.sqes[tail & *ring.sq_mask];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = opcode;
+		sqe->fd = fd;
+		sqe->addr = (unsigned long)buf[i];
+		sqe->len = len[i];
+		sqe->off = range_base + off[i];
+		sqe->user_data = i;
+		ring.sq_array[tail & *ring.sq_mask] = tail & *ring.sq_mask;
+	}
+	__atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+	for (i = 0; i < nr;) {
+		ret = syscall(__NR_io_uring_enter, ring.fd, i ? 0 : nr, nr - i,
+			      IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret < 0 && errno != EINTR) {
+			*res = -errno;
+			return 0;
+		}
+		head = *ring.cq_head;
+		while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &ring.cqes[head & *ring.cq_mask];
+			if (cqe->res != (int)len[cqe->user_data] && bad < 0) {
+				bad = cqe->user_data;
+				*res = cqe->res;
+			}
+			head++;
+			i++;
+		}
+		__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+	}
+	return bad;
+}
+
+void douring(int op, unsigned offset, unsigned size)
+{
+	struct timeval t;
+	struct test_file *tf = get_tf();
+	char *buf[URING_BATCH];
+	unsigned off[URING_BATCH];
+	unsigned len[URING_BATCH];
+	int nr = 1 + random() % URING_BATCH;
+	int i;
+	int res;
+
+	gettimeofday(&t, NULL);
+	if (size == 0) {
+		if (!quiet && testcalls > simulatedopcount)
+			prt("skipping zero size io_uring %s\n",
+			    op == OP_URINGREAD ? "read" : "write");
+		log4(OP_SKIPPED, op, offset, size, &t);
+		return;
+	}
+	if ((unsigned)nr > size)
+		nr = size;
+
+	log4(op, offset, size, nr, &t);
+
+	if (op == OP_URINGWRITE) {
+		gendata(original_buf, good_buf, offset, size);
+		if (file_size < offset + size) {
+			if (file_size < offset)
+				memset(good_buf + file_size, '\0',
+				       offset - file_size);
+			file_size = offset + size;
+		}
+	}
+
+	if (testcalls <= simulatedopcount)
+		return;
+
+	output_line(tf, op, offset, size, &t);
+
+	for (i = 0; i < nr; i++) {
+		off[i] = offset + i * (size / nr);
+		len[i] = i < nr - 1 ? size / nr : size - i * (size / nr);
+		buf[i] = (op == OP_URINGREAD ? temp_buf - offset : good_buf) +
+		    off[i];
+	}
+	i = uring_rw(op == OP_URINGREAD ? IORING_OP_READ : IORING_OP_WRITE,
+		     tf->fd, buf, off, len, nr, &res);
+	if (i >= 0) {
+		if (res < 0) {
+			errno = -res;
+			prterr(op == OP_URINGREAD ? "douring: read" :
+			       "douring: write");
+		} else
+			prt("short io_uring %s at 0x%x: 0x%x bytes instead of"
+			    " 0x%x\n", op == OP_URINGREAD ? "read" : "write",
+			    off[i], res, len[i]);
+		report_failure(op == OP_URINGREAD ? 143 : 153);
+	}
+	if (op == OP_URINGREAD)
+		check_buffers(temp_buf, offset, size);
+}
+#else
+/* -U is refused at option parsing, these only keep the callers building */
+struct uring {
+	int fd;
+};
+
+__thread struct uring ring = {.fd = -1 };
+
+int uring_init(void)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+void uring_exit(void)
+{
+}
+
+void douring(int op, unsigned offset, unsigned size)
+{
+}
+#endif /* HAVE_LINUX_IO_URING_H */
+
+/*
+ * Pick offset and size for one of the ops enabled by -H, -z, -C, -Z and
+ * -U.  Reads and fallocates stay within the file; writes and copy
+ * destinations within flen.  Direct I/O is rounded to pages.
+ */
+void doextra(int op)
+{
+	unsigned long offset = random();
+	unsigned long size = maxoplen;
+	unsigned long doff;
+	unsigned long end;
+
+	if (randomoplen)
+		size = random() % (maxoplen + 1);
+	switch (op) {
+	case OP_PUNCH_HOLE:
+	case OP_ZERO_RANGE:
+	case OP_DIRECTREAD:
+	case OP_URINGREAD:
+	case OP_COPY_RANGE:
+		end = file_size;
+		break;
+	default:
+		end = maxfilelen;
+		break;
+	}
+	if (op == OP_DIRECTREAD || op == OP_DIRECTWRITE)
+		end &= ~(unsigned long)page_mask;
+	offset = end ? offset % end : 0;
+	if (offset + size > end)
+		size = end - offset;
+	if (op == OP_DIRECTREAD || op == OP_DIRECTWRITE) {
+		offset &= ~(unsigned long)page_mask;
+		size &= ~(unsigned long)page_mask;
+	}
+
+	switch (op) {
+	case OP_PUNCH_HOLE:
+	case OP_ZERO_RANGE:
+		dofallocate(op, offset, size);
+		break;
+	case OP_COPY_RANGE:
+		doff = random() % maxfilelen;
+		if (doff + size > maxfilelen)
+			size = maxfilelen - doff;
+		docopyrange(offset, doff, size);
+		break;
+	case OP_DIRECTREAD:
+		dodirectread(offset, size);
+		break;
+	case OP_DIRECTWRITE:
+		dodirectwrite(offset, size);
+		break;
+	default:
+		douring(op, offset, size);
+		break;
+	}
+}
+
+/*
+ * Turn the extra ops the kernel or the file system of fd does not support
+ * off again and build extra_ops[] from those left.
+ */
+void probe_extra_ops(char *path, int fd)
+{
+	loff_t in = 0, out = 0;
+	int dfd;
+
+	if (punch_hole && fallocate(fd, FALLOC_FL_KEEP_SIZE |
+				    FALLOC_FL_PUNCH_HOLE, 0, 1) == -1) {
+		prt("main: filesystem does not support fallocate punch hole, "
+		    "disabling\n");
+		punch_hole = 0;
+	}
+	if (zero_range && fallocate(fd, FALLOC_FL_KEEP_SIZE |
+				    FALLOC_FL_ZERO_RANGE, 0, 1) == -1) {
+		prt("main: filesystem does not support fallocate zero range, "
+		    "disabling\n");
+		zero_range = 0;
+	}
+	if (copy_range &&
+	    syscall(__NR_copy_file_range, fd, &in, fd, &out, 0, 0) == -1) {
+		prt("main: copy_file_range not supported, disabling\n");
+		copy_range = 0;
+	}
+	if (direct_io) {
+		if ((dfd = open(path, O_RDWR | O_DIRECT)) < 0) {
+			prt("main: filesystem does not support O_DIRECT, "
+			    "disabling\n");
+			direct_io = 0;
+		} else
+			close(dfd);
+	}
+	if (uring_io) {
+		if (uring_init()) {
+			prt("main: io_uring not supported, disabling\n");
+			uring_io = 0;
+		} else
+			uring_exit();
+	}
+
+	if (punch_hole)
+		extra_ops[nextra_ops++] = OP_PUNCH_HOLE;
+	if (zero_range)
+		extra_ops[nextra_ops++] = OP_ZERO_RANGE;
+	if (copy_range)
+		extra_ops[nextra_ops++] = OP_COPY_RANGE;
+	if (direct_io) {
+		extra_ops[nextra_ops++] = OP_DIRECTREAD;
+		extra_ops[nextra_ops++] = OP_DIRECTWRITE;
+	}
+	if (uring_io) {
+		extra_ops[nextra_ops++] = OP_URINGREAD;
+		extra_ops[nextra_ops++] = OP_URINGWRITE;
+	}
+}
+
 void writefileimage()
 {
 	ssize_t iret;
 	int fd = get_fd();
 
-	if (lseek(fd, (off_t) 0, SEEK_SET) == (off_t) - 1) {
+	if (lseek(fd, range_base, SEEK_SET) == (off_t) - 1) {
 		prterr("writefileimage: lseek");
 		report_failure(171);
 	}
@@ -931,7 +1556,7 @@ void writefileimage()
 			    (unsigned long)iret, (unsigned long long)file_size);
 		report_failure(172);
 	}
-	if (lite ? 0 : ftruncate(fd, file_size) == -1) {
+	if (lite || shared ? 0 : ftruncate(fd, file_size) == -1) {
 		prt("ftruncate2: %llx\n", (unsigned long long)file_size);
 		prterr("writefileimage: ftruncate");
 		report_failure(173);
@@ -976,13 +1601,18 @@ void test(void)
 	unsigned long offset;
 	unsigned long size = maxoplen;
 	unsigned long rv = random();
-	unsigned long op = rv % (3 + !lite + mapped_writes);
+	unsigned long nops = 3 + !lite + mapped_writes;
+	unsigned long op = rv % (nops + nextra_ops);
 
 	/* turn off the map read if necessary */
 
 	if (op == 2 && !mapped_reads)
 		op = 0;
 
+	/* the other threads' ranges must not move: write instead */
+	if (op == 3 && shared && !lite)
+		op = 1;
+
 	if (simulatedopcount > 0 && testcalls == simulatedopcount)
 		writefileimage();
 
@@ -1001,7 +1631,9 @@ void test(void)
 	 * TRUNCATE:    op = 3
 	 * MAPWRITE:    op = 3 or 4
 	 */
-	if (lite ? 0 : op == 3 && (style & 1) == 0)	/* vanilla truncate? */
+	if (op >= nops)
+		doextra(extra_ops[op - nops]);
+	else if (lite ? 0 : op == 3 && (style & 1) == 0) /* vanilla truncate? */
 		dotruncate(random() % maxfilelen);
 	else {
 		if (randomoplen)
@@ -1050,10 +1682,10 @@ int sig;
 void usage(void)
 {
 	fprintf(stdout, "usage: %s",
-		"fsx [-dnqLOW] [-b opnum] [-c Prob] [-l flen] [-m "
+		"fsx [-dnqzCHLOUWZ] [-b opnum] [-c Prob] [-l flen] [-m "
 		"start:end] [-o oplen] [-p progressinterval] [-r readbdy] [-s style] [-t "
 		"truncbdy] [-w writebdy] [-D startingop] [-N numops] [-P dirpath] [-S seed] "
-		"[ -I random|rotate ] fname [additional paths to fname..]\n"
+		"[-T nthreads [-u]] [ -I random|rotate ] fname [additional paths to fname..]\n"
 		"	-b opnum: beginning operation number (default 1)\n"
 		"	-c P: 1 in P chance of file close+open at each op (default infinity)\n"
 		"	-d: debug output for all operations [-d -d = more debugging]\n"
@@ -1075,9 +1707,18 @@ void usage(void)
 		"	-S seed: for random # generator (default 1) 0 gets timestamp\n"
 		"	-W: mapped write operations DISabled\n"
 		"	-R: read() system calls only (mapped reads disabled)\n"
+		"	-z: fallocate zero range operations ENabled\n"
+		"	-C: copy_file_range operations ENabled\n"
+		"	-H: fallocate punch hole operations ENabled\n"
+		"	-U: io_uring batched read and write operations ENabled\n"
+		"	-Z: O_DIRECT page aligned read and write operations ENabled\n"
 		"	-I: When multiple paths to the file are given each operation uses\n"
 		"	    a different path.  Iterate through them in order with 'rotate'\n"
 		"	    or chose then at 'random'.  (defaults to random)\n"
+		"	-T nthreads: run nthreads independent tests at once, each on its\n"
+		"	    own file fname.N with its own .fsxgood and .fsxlog\n"
+		"	-u: with -T, share fname instead, each thread using a page aligned\n"
+		"	    1/nthreads of flen (no truncates or size checks)\n"
 		"	fname: this filename is REQUIRED (no default)\n");
 	exit(90);
 }
@@ -1114,11 +1755,223 @@ int getnum(char *s, char **e)
 	return (ret);
 }
 
+/*
+ * Open paths, all names of one test file, and the .fsxgood and .fsxlog
+ * files named after it plus tag, and set up the model of its contents.
+ */
+void setup_test(char **paths, int npaths, char *tag)
+{
+	int i;
+
+	fname = paths[0];
+	open_test_files(paths, npaths);
+
+	goodfile[0] = 0;
+	if (dirpath) {
+		strncpy(goodfile, dirpath, sizeof(goodfile) - 2);
+		strcat(goodfile, "/");
+	}
+	strncat(goodfile, dirpath ? basename(fname) : fname, 256);
+	strcat(goodfile, tag);
+	strcat(goodfile, ".fsxgood");
+	fsxgoodfd = open(goodfile, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fsxgoodfd < 0) {
+		prterr(goodfile);
+		exit(92);
+	}
+	logfile[0] = 0;
+	if (dirpath) {
+		strncpy(logfile, dirpath, sizeof(logfile) - 2);
+		strcat(logfile, "/");
+	}
+	strncat(logfile, dirpath ? basename(fname) : fname, 256);
+	strcat(logfile, tag);
+	strcat(logfile, ".fsxlog");
+	fsxlogf = fopen(logfile, "w");
+	if (fsxlogf == NULL) {
+		prterr(logfile);
+		exit(93);
+	}
+	if (lite) {
+		off_t ret;
+		int fd = get_fd();
+		file_size = maxfilelen = lseek(fd, (off_t) 0, SEEK_END);
+		if (file_size == (off_t) - 1) {
+			prterr(fname);
+			warn("main: lseek eof");
+			exit(94);
+		}
+		ret = lseek(fd, (off_t) 0, SEEK_SET);
+		if (ret == (off_t) - 1) {
+			prterr(fname);
+			warn("main: lseek 0");
+			exit(95);
+		}
+	}
+	if (original_buf == NULL) {
+		original_buf = malloc(maxfilelen);
+		if (original_buf == NULL)
+			exit(96);
+		for (i = 0; i < maxfilelen; i++)
+			original_buf[i] = random() % 256;
+	}
+
+	good_buf = malloc(maxfilelen);
+	if (good_buf == NULL)
+		exit(97);
+	memset(good_buf, '\0', maxfilelen);
+
+	temp_buf = malloc(maxoplen);
+	if (temp_buf == NULL)
+		exit(99);
+	memset(temp_buf, '\0', maxoplen);
+
+	if (lite) {		/* zero entire existing file */
+		ssize_t written;
+		int fd = get_fd();
+
+		written = write(fd, good_buf, (size_t) maxfilelen);
+		if (written != maxfilelen) {
+			if (written == -1) {
+				prterr(fname);
+				warn("main: error on write");
+			} else
+				warn("main: short write, 0x%x bytes instead"
+				     "of 0x%x\n",
+				     (unsigned)written, maxfilelen);
+			exit(98);
+		}
+	} else if (shared)
+		file_size = maxfilelen;
+	else
+		check_trunc_hack();
+
+	if (self == NULL)
+		probe_extra_ops(fname, test_files[0].fd);
+	if (direct_io && posix_memalign((void **)&dio_buf, page_size,
+					maxoplen + page_size))
+		exit(99);
+	if (uring_io && uring_init()) {
+		prterr("io_uring_setup");
+		exit(1);
+	}
+}
+
+void finish_test(void)
+{
+	close_test_files();
+	if (tf_buf)
+		free(tf_buf);
+	free(good_buf);
+	free(temp_buf);
+	free(dio_buf);
+	if (ring.fd >= 0)
+		uring_exit();
+	fclose(fsxlogf);
+	close(fsxgoodfd);
+}
+
+void *test_thread(void *arg)
+{
+	struct fsx_thread *ft = arg;
+	char *path = ft->path;
+	long n = numops;
+
+	self = ft;
+	initstate_r(seed + ft->id, ft->rstate, sizeof(ft->rstate),
+		    &ft->rdata);
+	range_base = shared ? (off_t) ft->id * maxfilelen : 0;
+	setup_test(&path, 1, ft->tag);
+	while (n == -1 || n--)
+		test();
+	ft->testcalls = testcalls;
+	finish_test();
+	return NULL;
+}
+
+/*
+ * -T: thread N runs the test on fname.N or, with -u, on bytes
+ * [N * flen, (N + 1) * flen) of fname, flen being cut to a page aligned
+ * share of -l.  Only fname itself may be given.
+ */
+int run_threads(char **argv, int argc)
+{
+	struct fsx_thread *threads;
+	struct timeval start, end;
+	unsigned long total = 0;
+	char path[PATH_MAX];
+	double secs;
+	int fd;
+	int i;
+
+	if (argc != 1 || lite) {
+		prt("-T takes a single fname and no -L\n");
+		exit(1);
+	}
+	if (shared) {
+		maxfilelen = (maxfilelen / nthreads) & ~page_mask;
+		if (maxfilelen == 0) {
+			prt("-l too small for %d threads\n", nthreads);
+			exit(1);
+		}
+		sizechecks = 0;
+		snprintf(path, sizeof(path), "%s", argv[0]);
+	} else
+		snprintf(path, sizeof(path), "%s.0", argv[0]);
+	/* thread 0 truncates fname.0 again, -u keeps fname at this size */
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0 ||
+	    (shared && ftruncate(fd, (off_t) maxfilelen * nthreads))) {
+		prterr(path);
+		exit(91);
+	}
+	probe_extra_ops(path, fd);
+	close(fd);
+	original_buf = malloc(maxfilelen);
+	if (original_buf == NULL)
+		exit(96);
+	for (i = 0; i < maxfilelen; i++)
+		original_buf[i] = random() % 256;
+
+	threads = calloc(nthreads, sizeof(*threads));
+	if (threads == NULL)
+		exit(96);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++) {
+		threads[i].id = i;
+		if (shared) {
+			snprintf(threads[i].path, sizeof(threads[i].path),
+				 "%s", argv[0]);
+			sprintf(threads[i].tag, ".%d", i);
+		} else
+			snprintf(threads[i].path, sizeof(threads[i].path),
+				 "%s.%d", argv[0], i);
+		errno = pthread_create(&threads[i].tid, NULL, test_thread,
+				       &threads[i]);
+		if (errno) {
+			prterr("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i].tid, NULL);
+		total += threads[i].testcalls;
+	}
+	gettimeofday(&end, NULL);
+	secs = end.tv_sec - start.tv_sec +
+	    (end.tv_usec - start.tv_usec) / 1e6;
+	prt("%d threads: %lu operations in %.3fs, %.0f ops/s\n",
+	    nthreads, total, secs, secs > 0 ? total / secs : 0.0);
+	prt("All operations completed A-OK!\n");
+	free(threads);
+	free(original_buf);
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
-	int i, style, ch;
+	int style, ch;
 	char *endp;
-	int dirpath = 0;
 
 	goodfile[0] = 0;
 	logfile[0] = 0;
@@ -1129,7 +1982,7 @@ int main(int argc, char **argv)
 	setvbuf(stdout, NULL, _IOLBF, 0);	/* line buffered stdout */
 
 	while ((ch = getopt(argc, argv,
-			    "b:c:dl:m:no:p:qr:s:t:w:D:I:LN:OP:RS:W"))
+			    "b:c:dl:m:no:p:qr:s:t:uw:zCD:HI:LN:OP:RS:T:UWZ"))
 	       != EOF)
 		switch (ch) {
 		case 'b':
@@ -1226,11 +2079,7 @@ int main(int argc, char **argv)
 			randomoplen = 0;
 			break;
 		case 'P':
-			strncpy(goodfile, optarg, sizeof(goodfile));
-			strcat(goodfile, "/");
-			strncpy(logfile, optarg, sizeof(logfile));
-			strcat(logfile, "/");
-			dirpath = 1;
+			dirpath = optarg;
 			break;
 		case 'R':
 			mapped_reads = 0;
@@ -1244,6 +2093,35 @@ int main(int argc, char **argv)
 			if (seed < 0)
 				usage();
 			break;
+		case 'T':
+			nthreads = getnum(optarg, &endp);
+			if (nthreads <= 0)
+				usage();
+			break;
+		case 'u':
+			shared = 1;
+			break;
+		case 'z':
+			zero_range = 1;
+			break;
+		case 'C':
+			copy_range = 1;
+			break;
+		case 'H':
+			punch_hole = 1;
+			break;
+		case 'U':
+#ifdef HAVE_LINUX_IO_URING_H
+			uring_io = 1;
+#else
+			fprintf(stderr, "fsx: -U: io_uring is not supported "
+				"by this build\n");
+			exit(1);
+#endif
+			break;
+		case 'Z':
+			direct_io = 1;
+			break;
 		case 'W':
 			mapped_writes = 0;
 			if (!quiet)
@@ -1274,72 +2152,10 @@ int main(int argc, char **argv)
 	initstate(seed, state, 256);
 	setstate(state);
 
-	open_test_files(argv, argc);
-
-	strncat(goodfile, dirpath ? basename(fname) : fname, 256);
-	strcat(goodfile, ".fsxgood");
-	fsxgoodfd = open(goodfile, O_RDWR | O_CREAT | O_TRUNC, 0666);
-	if (fsxgoodfd < 0) {
-		prterr(goodfile);
-		exit(92);
-	}
-	strncat(logfile, dirpath ? basename(fname) : fname, 256);
-	strcat(logfile, ".fsxlog");
-	fsxlogf = fopen(logfile, "w");
-	if (fsxlogf == NULL) {
-		prterr(logfile);
-		exit(93);
-	}
-	if (lite) {
-		off_t ret;
-		int fd = get_fd();
-		file_size = maxfilelen = lseek(fd, (off_t) 0, SEEK_END);
-		if (file_size == (off_t) - 1) {
-			prterr(fname);
-			warn("main: lseek eof");
-			exit(94);
-		}
-		ret = lseek(fd, (off_t) 0, SEEK_SET);
-		if (ret == (off_t) - 1) {
-			prterr(fname);
-			warn("main: lseek 0");
-			exit(95);
-		}
-	}
-	original_buf = malloc(maxfilelen);
-	if (original_buf == NULL)
-		exit(96);
-	for (i = 0; i < maxfilelen; i++)
-		original_buf[i] = random() % 256;
-
-	good_buf = malloc(maxfilelen);
-	if (good_buf == NULL)
-		exit(97);
-	memset(good_buf, '\0', maxfilelen);
-
-	temp_buf = malloc(maxoplen);
-	if (temp_buf == NULL)
-		exit(99);
-	memset(temp_buf, '\0', maxoplen);
-
-	if (lite) {		/* zero entire existing file */
-		ssize_t written;
-		int fd = get_fd();
-
-		written = write(fd, good_buf, (size_t) maxfilelen);
-		if (written != maxfilelen) {
-			if (written == -1) {
-				prterr(fname);
-				warn("main: error on write");
-			} else
-				warn("main: short write, 0x%x bytes instead"
-				     "of 0x%x\n",
-				     (unsigned)written, maxfilelen);
-			exit(98);
-		}
-	} else
-		check_trunc_hack();
+	if (nthreads)
+		return run_threads(argv, argc);
 
+	setup_test(argv, argc, "");
 	while (numops == -1 || numops--)
 		test();
 
@@ -1352,6 +2168,7 @@ int main(int argc, char **argv)
 	free(original_buf);
 	free(good_buf);
 	free(temp_buf);
+	free(dio_buf);
 
 	return 0;
 }
@@ -57,6 +57,7 @@
 #include "io.h"
 #include "dump.h"
 #include "timer.h"
+#include "stats.h"
 #include "signals.h"
 #include "childmain.h"
 
@@ -100,7 +101,7 @@ void add_action(test_env_t * env, const child_args_t * args,
 		const action_t target)
 {
 
-	if (env->action_list_entry == args->t_kids) {	/* we should never get here */
+	if (env->action_list_entry == ACTION_SLOTS(args)) {	/* we should never get here */
 		printf
 		    ("ATTEMPT TO ADD MORE ENTRIES TO LBA WRITE LIST THEN ALLOWED, CODE BUG!!!\n");
 		abort();
@@ -158,18 +159,11 @@ void decrement_io_count(const child_args_t * args, test_env_t * env,
  */
 void write_error_mark(fd_t fd, char *data)
 {
-	OFF_T ActualBytePos = 0;
 	long tcnt = 0;
 
-	ActualBytePos = Seek(fd, 0);
-	if (ActualBytePos != 0) {
-		/* could not seek to LBA 0 */
-		return;
-	}
-
 	memcpy(data, "DISKTEST ERROR OCCURRED",
 	       strlen("DISKTEST ERROR OCCURRED"));
-	tcnt = Write(fd, data, BLK_SIZE);
+	tcnt = WriteAt(fd, data, BLK_SIZE, 0);
 }
 
 /*
@@ -542,7 +536,7 @@ void miscompare_dump(const child_args_t * args, const char *data,
  * that the io completed successfully.
  */
 void complete_io(test_env_t * env, const child_args_t * args,
-		 const action_t target)
+		 const action_t target, unsigned long long lat_ns)
 {
 	unsigned char *wbitmap = (unsigned char *)env->shared_mem + BMP_OFFSET;
 	int i = 0;
@@ -550,6 +544,7 @@ void complete_io(test_env_t * env, const child_args_t * args,
 	if (target.oper == WRITER) {
 		(env->hbeat_stats.wbytes) += target.trsiz * BLK_SIZE;
 		env->hbeat_stats.wcount++;
+		add_latency(&env->hbeat_stats.wlat, lat_ns);
 		for (i = 0; i < target.trsiz; i++) {
 			*(wbitmap +
 			  (((target.lba - args->offset - args->start_lba) +
@@ -560,12 +555,145 @@ void complete_io(test_env_t * env, const child_args_t * args,
 	} else {
 		(env->hbeat_stats.rbytes) += target.trsiz * BLK_SIZE;
 		env->hbeat_stats.rcount++;
+		add_latency(&env->hbeat_stats.rlat, lat_ns);
 	}
 	if (args->flags & CLD_FLG_LBA_SYNC) {
 		remove_action(env, target);
 	}
 }
 
+/*
+ * Fills buf with the data a write to target should carry, which is also
+ * what a read of target is compared against.
+ */
+void fill_io_data(const child_args_t * args, const test_env_t * env,
+		  char *buf, action_t target)
+{
+	if (args->flags & CLD_FLG_LPTYPE) {
+		fill_buffer(buf, target.trsiz, &(target.lba),
+			    sizeof(OFF_T), CLD_FLG_LPTYPE);
+	} else {
+		memcpy(buf, env->data_buffer, target.trsiz * BLK_SIZE);
+	}
+	if (args->flags & CLD_FLG_MBLK) {
+		mark_buffer(buf, target.trsiz * BLK_SIZE, &(target.lba), args,
+			    env);
+	}
+}
+
+/*
+ * Delay delayTime msecs before continuing, for simulated
+ * processing time, requested by user
+ */
+void io_delay(const child_args_t * args, const OFF_T delayMask,
+	      const int this_thread_id)
+{
+	unsigned long delayTime;
+
+#ifndef _DEBUG
+	(void)this_thread_id;	/* only named in the debug message */
+#endif
+	if (args->delayTimeMin == args->delayTimeMax) {	/* static delay time */
+		/* only sleep if delay is greater then zero */
+		if (args->delayTimeMin > 0) {
+			Sleep(args->delayTimeMin);
+		}
+	} else {		/* random delay time between min & max */
+		do {
+			delayTime =
+			    (unsigned long)(rand() & delayMask)
+			    + args->delayTimeMin;
+		} while (delayTime > args->delayTimeMax);
+#ifdef _DEBUG
+		PDBG3(DBUG, args, "Thread %d: Delay time = %lu\n",
+		      this_thread_id, delayTime);
+#endif
+		Sleep(delayTime);
+	}
+}
+
+/*
+ * With -Ia a thread keeps up to qdepth transfers in flight.  Each slot
+ * has its own buffer, so the data of a write is left alone until it
+ * completes, and remembers the action and the retries left for it.
+ */
+typedef struct io_slot {
+	action_t target;
+	char *buffer;		/* 'buf' is the aligned 'buffer' */
+	char *buf;
+	unsigned int retries;
+	io_track_t track;	/* its transfer while in flight */
+} io_slot_t;
+
+void free_io_slots(io_slot_t * slots, unsigned int *free_list,
+		   unsigned int depth)
+{
+	unsigned int i;
+
+	if (slots != NULL) {
+		for (i = 0; i < depth; i++) {
+			if (slots[i].buffer != NULL) {
+				FREE(slots[i].buffer);
+			}
+		}
+		FREE(slots);
+	}
+	if (free_list != NULL) {
+		FREE(free_list);
+	}
+}
+
+/*
+ * A thread's io_track_t entries are linked into env->io_tracks while it
+ * runs, so the timer can report any IO that stalls.  Like the list, the
+ * fields of an entry are only changed or read under MutexACTION.
+ */
+void add_track(test_env_t * env, io_track_t * track)
+{
+	LOCK(env->mutexs.MutexACTION);
+	track->next = env->io_tracks;
+	env->io_tracks = track;
+	UNLOCK(env->mutexs.MutexACTION);
+}
+
+void remove_track(test_env_t * env, io_track_t * track)
+{
+	io_track_t **pp;
+
+	LOCK(env->mutexs.MutexACTION);
+	for (pp = &env->io_tracks; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == track) {
+			*pp = track->next;
+			break;
+		}
+	}
+	UNLOCK(env->mutexs.MutexACTION);
+}
+
+void start_track(test_env_t * env, io_track_t * track,
+		 const action_t target)
+{
+	LOCK(env->mutexs.MutexACTION);
+	track->target = target;
+	track->reported = FALSE;
+	track->start_ns = getNsecs();
+	UNLOCK(env->mutexs.MutexACTION);
+}
+
+/*
+ * returns how long, in nsecs, the IO was outstanding; only this thread
+ * sets start_ns, so it is read before taking the lock.
+ */
+unsigned long long end_track(test_env_t * env, io_track_t * track)
+{
+	unsigned long long lat_ns = getNsecs() - track->start_ns;
+
+	LOCK(env->mutexs.MutexACTION);
+	track->start_ns = 0;
+	UNLOCK(env->mutexs.MutexACTION);
+	return lat_ns;
+}
+
 /*
 * This function is really the main function for a thread
 * Once here, this function will act as if it
@@ -589,11 +717,9 @@ void *ChildMain(void *vtest)
 	char *buf1 = NULL, *buffer1 = NULL;	/* 'buf' is the aligned 'buffer' */
 	char *buf2 = NULL, *buffer2 = NULL;	/* 'buf' is the aligned 'buffer' */
 	unsigned long ulLastError;
-	unsigned long delayTime;
 
 	action_t target = { NONE, 0, 0 };
 	unsigned int i;
-	OFF_T ActualBytePos = 0, TargetBytePos = 0, mask = 1, delayMask = 1;
 	long tcnt = 0;
 	int exit_code = 0, rv = 0;
 	char filespec[DEV_NAME_LEN];
@@ -604,6 +730,24 @@ void *ChildMain(void *vtest)
 	lvl_t msg_level = WARN;
 	int SET_CHAR = 0;	/* when data buffers are cleared, using memset, use this */
 
+	/*
+	 * LOCK() is a pthread_cleanup_push(), a setjmp, so the locals set
+	 * before it and changed in the IO loop are volatile.
+	 */
+	char *volatile rbuf = NULL;	/* the data of the read being checked */
+	volatile OFF_T TargetBytePos = 0, mask = 1, delayMask = 1;
+	io_slot_t *volatile slots = NULL;
+	unsigned int *volatile free_list = NULL;	/* indexes of the idle slots */
+	volatile unsigned int depth = 1, inflight = 0;
+	volatile BOOL have_slot = FALSE;
+	volatile unsigned long long lat_ns = 0;	/* of the transfer being checked */
+
+	aio_ctx_t aio;
+	unsigned int nfree = 0;
+	unsigned long tag = 0;	/* the slot of the transfer being checked */
+	BOOL draining = FALSE;
+	io_track_t track;	/* the synchronous transfer in progress */
+
 	extern unsigned long glb_flags;
 	extern unsigned short glb_run;
 	extern int signal_action;
@@ -668,6 +812,58 @@ void *ChildMain(void *vtest)
 	memset(buffer2, SET_CHAR, ((args->htrsiz * BLK_SIZE) + ALIGNSIZE));
 	buf2 = (char *)BUFALIGN(buffer2);
 
+	/* set up the asynchronous IO slots, falling back to synchronous IO */
+	if ((args->flags & CLD_FLG_ASYNC) && (args->qdepth > 1)) {
+		if (AioSetup(&aio, args->qdepth) < 0) {
+			pMsg(WARN, args,
+			     "Thread %d: asynchronous IO setup failed, errno = %u, using synchronous IO\n",
+			     this_thread_id, GETLASTERROR());
+		} else {
+			depth = args->qdepth;
+		}
+	}
+	if (depth > 1) {
+		if (((slots =
+		      (io_slot_t *) ALLOC(depth * sizeof(io_slot_t))) != NULL)
+		    && ((free_list =
+			 (unsigned int *)ALLOC(depth *
+					       sizeof(unsigned int))) !=
+			NULL)) {
+			memset(slots, 0, depth * sizeof(io_slot_t));
+			for (i = 0; i < depth; i++) {
+				if ((slots[i].buffer =
+				     (char *)ALLOC(((args->htrsiz * BLK_SIZE) +
+						    ALIGNSIZE))) == NULL) {
+					break;
+				}
+				memset(slots[i].buffer, SET_CHAR,
+				       ((args->htrsiz * BLK_SIZE) + ALIGNSIZE));
+				slots[i].buf = (char *)BUFALIGN(slots[i].buffer);
+				free_list[nfree++] = i;
+			}
+		}
+		if (nfree != depth) {
+			pMsg(ERR, args,
+			     "Thread %d: Memory allocation failure for IO buffer, errno = %u\n",
+			     this_thread_id, GETLASTERROR());
+			free_io_slots(slots, free_list, depth);
+			AioTeardown(&aio);
+			FREE(buffer1);
+			FREE(buffer2);
+			args->test_state = SET_STS_FAIL(args->test_state);
+			CLOSE(fd);
+			TEXIT((uintptr_t) GETLASTERROR());
+		}
+	}
+
+	memset(&track, 0, sizeof(io_track_t));
+	track.thread_id = this_thread_id;
+	add_track(env, &track);
+	for (i = 0; i < nfree; i++) {
+		slots[i].track.thread_id = this_thread_id;
+		add_track(env, &slots[i].track);
+	}
+
 	/*  set up lba mask of all 1's with value between vsiz and 2*vsiz */
 	while (mask <= (args->stop_lba - args->start_lba)) {
 		mask = mask << 1;
@@ -680,190 +876,217 @@ void *ChildMain(void *vtest)
 	}
 	delayMask -= 1;
 
-	while (env->bContinue) {
-		if (!is_retry) {
-			retries = args->retries;
-#ifdef _DEBUG
-			PDBG5(DBUG, args,
-			      "Thread %d: lastAction: oper: %d, lba: %lld, trsiz: %ld\n",
-			      this_thread_id, target.oper, target.lba,
-			      target.trsiz);
-#endif
-			do {
-				if (signal_action & SIGNAL_STOP) {
-					break;
-				}	/* user request to stop */
-				if (glb_run == 0) {
+	while (env->bContinue || inflight) {
+		if (depth > 1) {
+			/* release, or on a retry resend, the last transfer checked */
+			if (have_slot && is_retry) {
+				slots[tag].retries = retries;
+				start_track(env, &slots[tag].track, target);
+				AioQueue(&aio, fd, target.oper, slots[tag].buf,
+					 target.trsiz * BLK_SIZE,
+					 (OFF_T) (target.lba * BLK_SIZE), tag);
+				inflight++;
+			} else if (have_slot) {
+				free_list[nfree++] = tag;
+			}
+			have_slot = FALSE;
+			is_retry = FALSE;
+
+			/* fill the idle slots with new actions */
+			while (!draining && env->bContinue && (nfree > 0)) {
+				if ((signal_action & SIGNAL_STOP)
+				    || (glb_run == 0)) {
+					draining = TRUE;
 					break;
-				}	/* global request to stop */
+				}
 				LOCK(env->mutexs.MutexACTION);
 				target = get_next_action(args, env, mask);
 				UNLOCK(env->mutexs.MutexACTION);
-				/* this thread has to retry, so give up the reset of my time slice */
+				if (target.oper == NONE) {
+					draining = TRUE;
+					break;
+				}
 				if (target.oper == RETRY) {
+					/* the LBAs may be held by one of our own transfers */
+					if (inflight > 0) {
+						break;
+					}
 					Sleep(0);
+					continue;
 				}
-			} while ((env->bContinue) && (target.oper == RETRY));	/* we failed to get an action, and were asked to retry */
-
-#ifdef _DEBUG
-			PDBG5(DBUG, args,
-			      "Thread %d: nextAction: oper: %d, lba: %lld, trsiz: %ld\n",
-			      this_thread_id, target.oper, target.lba,
-			      target.trsiz);
-#endif
-
-			/*
-			 * Delay delayTime msecs before continuing, for simulated
-			 * processing time, requested by user
-			 */
-
-			if (args->delayTimeMin == args->delayTimeMax) {	/* static delay time */
-				/* only sleep if delay is greater then zero */
-				if (args->delayTimeMin > 0) {
-					Sleep(args->delayTimeMin);
+				io_delay(args, delayMask, this_thread_id);
+				tag = free_list[--nfree];
+				slots[tag].target = target;
+				slots[tag].retries = args->retries;
+				if (target.oper == WRITER) {
+					fill_io_data(args, env, slots[tag].buf,
+						     target);
 				}
-			} else {	/* random delay time between min & max */
-				do {
-					delayTime =
-					    (unsigned long)(rand() & delayMask)
-					    + args->delayTimeMin;
-				} while (delayTime > args->delayTimeMax);
-#ifdef _DEBUG
-				PDBG3(DBUG, args,
-				      "Thread %d: Delay time = %lu\n",
-				      this_thread_id, delayTime);
-#endif
-				Sleep(delayTime);
+				start_track(env, &slots[tag].track, target);
+				AioQueue(&aio, fd, target.oper, slots[tag].buf,
+					 target.trsiz * BLK_SIZE,
+					 (OFF_T) (target.lba * BLK_SIZE), tag);
+				inflight++;
 			}
-		}
-#ifdef _DEBUG
-		if (target.oper == NONE) {	/* nothing left to do */
-			PDBG3(DBUG, args,
-			      "Thread %d: Setting break, oper is NONE\n",
-			      this_thread_id);
-		}
-#endif
-
-		if (target.oper == NONE) {
-			break;
-		}		/* nothing left so stop */
-		if (signal_action & SIGNAL_STOP) {
-			break;
-		}		/* user request to stop */
-		if (env->bContinue == FALSE) {
-			break;
-		}		/* internal request to stop */
-		if (glb_run == 0) {
-			break;
-		}
-		/* global request to stop */
-		TargetBytePos = (OFF_T) (target.lba * BLK_SIZE);
-		ActualBytePos = Seek(fd, TargetBytePos);
-		if (ActualBytePos != TargetBytePos) {
-			ulLastError = GETLASTERROR();
-			pMsg(msg_level, args, SFSTR, this_thread_id,
-			     (target.oper ==
-			      WRITER) ? (env->wcount) : (env->rcount),
-			     target.lba, TargetBytePos, ActualBytePos,
-			     ulLastError);
-			if (retries-- > 1) {	/* request to retry on error, decrement retry */
-				pMsg(INFO, args,
-				     "Thread %d: Retry after seek failure, retry count: %u\n",
-				     this_thread_id, retries);
-				is_retry = TRUE;
-				Sleep(args->retry_delay);
-			} else {
-				exit_code = SEEK_FAILURE;
-				is_retry = FALSE;
-				LOCK(env->mutexs.MutexACTION);
-				update_test_state(args, env, this_thread_id, fd,
-						  buf2);
-				decrement_io_count(args, env, target);
-				UNLOCK(env->mutexs.MutexACTION);
+			if (inflight == 0) {
+				break;
 			}
-			continue;
-		}
 
-		if (target.oper == WRITER) {
-			if (args->flags & CLD_FLG_LPTYPE) {
-				fill_buffer(buf2, target.trsiz, &(target.lba),
-					    sizeof(OFF_T), CLD_FLG_LPTYPE);
-			} else {
-				memcpy(buf2, env->data_buffer,
-				       target.trsiz * BLK_SIZE);
+			/* send the new transfers and take one that finished */
+			if (AioSubmit(&aio, TRUE) < 0) {
+				exit_code = GETLASTERROR();
+				pMsg(ERR, args,
+				     "Thread %d: asynchronous IO submit failed, errno = %d\n",
+				     this_thread_id, exit_code);
+				args->test_state = SET_STS_FAIL(args->test_state);
+				env->bContinue = FALSE;
+				break;
 			}
-			if (args->flags & CLD_FLG_MBLK) {
-				mark_buffer(buf2, target.trsiz * BLK_SIZE,
-					    &(target.lba), args, env);
+			if (!AioReap(&aio, &tag, &tcnt)) {
+				continue;
 			}
+			inflight--;
+			lat_ns = end_track(env, &slots[tag].track);
+			have_slot = TRUE;
+			target = slots[tag].target;
+			retries = slots[tag].retries;
+			rbuf = slots[tag].buf;
+			TargetBytePos = (OFF_T) (target.lba * BLK_SIZE);
+		} else {
+			if (!is_retry) {
+				retries = args->retries;
 #ifdef _DEBUG
-			setStartTime();
+				PDBG5(DBUG, args,
+				      "Thread %d: lastAction: oper: %d, lba: %lld, trsiz: %ld\n",
+				      this_thread_id, target.oper, target.lba,
+				      target.trsiz);
 #endif
-			if (args->flags & CLD_FLG_IO_SERIAL) {
-				LOCK(env->mutexs.MutexIO);
-				tcnt = Write(fd, buf2, target.trsiz * BLK_SIZE);
-				UNLOCK(env->mutexs.MutexIO);
-			} else {
-				tcnt = Write(fd, buf2, target.trsiz * BLK_SIZE);
-			}
+				do {
+					if (signal_action & SIGNAL_STOP) {
+						break;
+					}	/* user request to stop */
+					if (glb_run == 0) {
+						break;
+					}	/* global request to stop */
+					LOCK(env->mutexs.MutexACTION);
+					target =
+					    get_next_action(args, env, mask);
+					UNLOCK(env->mutexs.MutexACTION);
+					/* this thread has to retry, so give up the reset of my time slice */
+					if (target.oper == RETRY) {
+						Sleep(0);
+					}
+				} while ((env->bContinue) && (target.oper == RETRY));	/* we failed to get an action, and were asked to retry */
 
 #ifdef _DEBUG
-			setEndTime();
-			PDBG5(DBUG, args, "Thread %d: I/O Time: %ld usecs\n",
-			      this_thread_id, getTimeDiff());
+				PDBG5(DBUG, args,
+				      "Thread %d: nextAction: oper: %d, lba: %lld, trsiz: %ld\n",
+				      this_thread_id, target.oper, target.lba,
+				      target.trsiz);
 #endif
-			if (args->flags & CLD_FLG_WFSYNC) {
-				rv = 0;
-				/* if need to sync, then only have one thread do it */
-				LOCK(env->mutexs.MutexACTION);
-				if (0 ==
-				    (env->hbeat_stats.wcount %
-				     args->sync_interval)) {
+
+				io_delay(args, delayMask, this_thread_id);
+			}
 #ifdef _DEBUG
-					PDBG3(DBUG, args,
-					      "Thread %d: Performing sync, write IO count %llu\n",
-					      this_thread_id,
-					      env->hbeat_stats.wcount);
+			if (target.oper == NONE) {	/* nothing left to do */
+				PDBG3(DBUG, args,
+				      "Thread %d: Setting break, oper is NONE\n",
+				      this_thread_id);
+			}
 #endif
-					rv = Sync(fd);
-					if (0 != rv) {
-						exit_code = GETLASTERROR();
-						pMsg(msg_level, args,
-						     "Thread %d: fsync error = %d\n",
-						     this_thread_id, exit_code);
-						is_retry = FALSE;
-						update_test_state(args, env,
-								  this_thread_id,
-								  fd, buf2);
-						decrement_io_count(args, env,
-								   target);
-					}
-				}
-				UNLOCK(env->mutexs.MutexACTION);
 
-				if (0 != rv) {	/* sync error, so don't count the write */
-					continue;
+			if (target.oper == NONE) {
+				break;
+			}	/* nothing left so stop */
+			if (signal_action & SIGNAL_STOP) {
+				break;
+			}	/* user request to stop */
+			if (env->bContinue == FALSE) {
+				break;
+			}	/* internal request to stop */
+			if (glb_run == 0) {
+				break;
+			}	/* global request to stop */
+			TargetBytePos = (OFF_T) (target.lba * BLK_SIZE);
+
+			if (target.oper == WRITER) {
+				fill_io_data(args, env, buf2, target);
+				start_track(env, &track, target);
+				if (args->flags & CLD_FLG_IO_SERIAL) {
+					LOCK(env->mutexs.MutexIO);
+					tcnt =
+					    WriteAt(fd, buf2,
+						    target.trsiz * BLK_SIZE,
+						    TargetBytePos);
+					UNLOCK(env->mutexs.MutexIO);
+				} else {
+					tcnt =
+					    WriteAt(fd, buf2,
+						    target.trsiz * BLK_SIZE,
+						    TargetBytePos);
 				}
+				lat_ns = end_track(env, &track);
+#ifdef _DEBUG
+				PDBG5(DBUG, args,
+				      "Thread %d: I/O Time: %llu usecs\n",
+				      this_thread_id, lat_ns / 1000);
+#endif
 			}
-		}
 
-		if (target.oper == READER) {
-			memset(buf1, SET_CHAR, target.trsiz * BLK_SIZE);
+			if (target.oper == READER) {
+				memset(buf1, SET_CHAR, target.trsiz * BLK_SIZE);
+				start_track(env, &track, target);
+				if (args->flags & CLD_FLG_IO_SERIAL) {
+					LOCK(env->mutexs.MutexIO);
+					tcnt =
+					    ReadAt(fd, buf1,
+						   target.trsiz * BLK_SIZE,
+						   TargetBytePos);
+					UNLOCK(env->mutexs.MutexIO);
+				} else {
+					tcnt =
+					    ReadAt(fd, buf1,
+						   target.trsiz * BLK_SIZE,
+						   TargetBytePos);
+				}
+				lat_ns = end_track(env, &track);
 #ifdef _DEBUG
-			setStartTime();
+				PDBG5(DBUG, args,
+				      "Thread %d: I/O Time: %llu usecs\n",
+				      this_thread_id, lat_ns / 1000);
 #endif
-			if (args->flags & CLD_FLG_IO_SERIAL) {
-				LOCK(env->mutexs.MutexIO);
-				tcnt = Read(fd, buf1, target.trsiz * BLK_SIZE);
-				UNLOCK(env->mutexs.MutexIO);
-			} else {
-				tcnt = Read(fd, buf1, target.trsiz * BLK_SIZE);
 			}
+			rbuf = buf1;
+		}
+
+		if ((target.oper == WRITER) && (args->flags & CLD_FLG_WFSYNC)) {
+			rv = 0;
+			/* if need to sync, then only have one thread do it */
+			LOCK(env->mutexs.MutexACTION);
+			if (0 == (env->hbeat_stats.wcount % args->sync_interval)) {
 #ifdef _DEBUG
-			setEndTime();
-			PDBG5(DBUG, args, "Thread %d: I/O Time: %ld usecs\n",
-			      this_thread_id, getTimeDiff());
+				PDBG3(DBUG, args,
+				      "Thread %d: Performing sync, write IO count %llu\n",
+				      this_thread_id, env->hbeat_stats.wcount);
 #endif
+				rv = Sync(fd);
+				if (0 != rv) {
+					exit_code = GETLASTERROR();
+					pMsg(msg_level, args,
+					     "Thread %d: fsync error = %d\n",
+					     this_thread_id, exit_code);
+					is_retry = FALSE;
+					update_test_state(args, env,
+							  this_thread_id, fd,
+							  buf2);
+					decrement_io_count(args, env, target);
+				}
+			}
+			UNLOCK(env->mutexs.MutexACTION);
+
+			if (0 != rv) {	/* sync error, so don't count the write */
+				continue;
+			}
 		}
 
 		if (tcnt != (long)target.trsiz * BLK_SIZE) {
@@ -898,25 +1121,15 @@ void *ChildMain(void *vtest)
 			    || (args->cmp_lng > target.trsiz * BLK_SIZE)) {
 				args->cmp_lng = target.trsiz * BLK_SIZE;
 			}
-			if (args->flags & CLD_FLG_LPTYPE) {
-				fill_buffer(buf2, target.trsiz, &(target.lba),
-					    sizeof(OFF_T), CLD_FLG_LPTYPE);
-			} else {
-				memcpy(buf2, env->data_buffer,
-				       target.trsiz * BLK_SIZE);
-			}
-			if (args->flags & CLD_FLG_MBLK) {
-				mark_buffer(buf2, target.trsiz * BLK_SIZE,
-					    &(target.lba), args, env);
-			}
-			if (memcmp(buf2, buf1, args->cmp_lng) != 0) {
+			fill_io_data(args, env, buf2, target);
+			if (memcmp(buf2, rbuf, args->cmp_lng) != 0) {
 				/* data miscompare, this takes lots of time, but its OK... !!! */
 				LOCK(MutexMISCOMP);
 				pMsg(ERR, args, DMSTR, this_thread_id,
 				     target.lba, target.lba);
 				/* find the actual byte that started the miscompare */
 				for (i = 0; i < args->htrsiz * BLK_SIZE; i++) {
-					if (*(buf2 + i) != *(buf1 + i)) {
+					if (*(buf2 + i) != *(rbuf + i)) {
 						pMsg(ERR, args, DMOFFSTR,
 						     this_thread_id, i, i);
 						break;
@@ -926,67 +1139,43 @@ void *ChildMain(void *vtest)
 						args->htrsiz * BLK_SIZE,
 						target.lba, i, EXP,
 						this_thread_id);
-				miscompare_dump(args, buf1,
+				miscompare_dump(args, rbuf,
 						args->htrsiz * BLK_SIZE,
 						target.lba, i, ACT,
 						this_thread_id);
 				/* perform a reread of the target, if requested */
 				if (args->flags & CLD_FLG_ERR_REREAD) {
-					ActualBytePos = Seek(fd, TargetBytePos);
-					if (ActualBytePos == TargetBytePos) {
-						memset(buf1, SET_CHAR,
-						       target.trsiz * BLK_SIZE);
-#ifdef _DEBUG
-						setStartTime();
-#endif
-						tcnt =
-						    Read(fd, buf1,
-							 target.trsiz *
-							 BLK_SIZE);
+					memset(rbuf, SET_CHAR,
+					       target.trsiz * BLK_SIZE);
+					start_track(env, &track, target);
+					tcnt =
+					    ReadAt(fd, rbuf,
+						   target.trsiz * BLK_SIZE,
+						   TargetBytePos);
+					lat_ns = end_track(env, &track);
 #ifdef _DEBUG
-						setEndTime();
-						PDBG5(DBUG, args,
-						      "Thread %d: ReRead I/O Time: %ld usecs\n",
-						      this_thread_id,
-						      getTimeDiff());
+					PDBG5(DBUG, args,
+					      "Thread %d: ReRead I/O Time: %llu usecs\n",
+					      this_thread_id, lat_ns / 1000);
 #endif
-						if (tcnt !=
-						    (long)target.trsiz *
-						    BLK_SIZE) {
-							pMsg(ERR, args,
-							     "Thread %d: ReRead after data miscompare failed on transfer.\n",
-							     this_thread_id);
-							pMsg(ERR, args, AFSTR,
-							     this_thread_id,
-							     "ReRead",
-							     (target.
-							      oper) ? (env->
-								       rcount)
-							     : (env->wcount),
-							     target.lba,
-							     target.lba, tcnt,
-							     target.trsiz *
-							     BLK_SIZE);
-						}
-						miscompare_dump(args, buf1,
-								args->htrsiz *
-								BLK_SIZE,
-								target.lba, i,
-								REREAD,
-								this_thread_id);
-					} else {
+					if (tcnt != (long)target.trsiz * BLK_SIZE) {
 						pMsg(ERR, args,
-						     "Thread %d: ReRead after data miscompare failed on seek.\n",
+						     "Thread %d: ReRead after data miscompare failed on transfer.\n",
 						     this_thread_id);
-						pMsg(ERR, args, SFSTR,
-						     this_thread_id,
-						     (target.oper ==
-						      WRITER) ? (env->
-								 wcount)
-						     : (env->rcount),
-						     target.lba, TargetBytePos,
-						     ActualBytePos);
+						pMsg(ERR, args, AFSTR,
+						     this_thread_id, "ReRead",
+						     (target.oper) ? (env->
+								      rcount)
+						     : (env->wcount),
+						     target.lba, target.lba,
+						     tcnt,
+						     target.trsiz * BLK_SIZE);
 					}
+					miscompare_dump(args, rbuf,
+							args->htrsiz *
+							BLK_SIZE, target.lba,
+							i, REREAD,
+							this_thread_id);
 				}
 				UNLOCK(MutexMISCOMP);
 
@@ -1003,7 +1192,7 @@ void *ChildMain(void *vtest)
 
 		/* update stats, bitmap, and release LBA */
 		LOCK(env->mutexs.MutexACTION);
-		complete_io(env, args, target);
+		complete_io(env, args, target, lat_ns);
 		UNLOCK(env->mutexs.MutexACTION);
 
 		is_retry = FALSE;
@@ -1017,6 +1206,15 @@ void *ChildMain(void *vtest)
 #endif
 #endif
 
+	remove_track(env, &track);
+	if (depth > 1) {
+		/* closing the ring waits for anything still in flight */
+		AioTeardown(&aio);
+		for (i = 0; i < depth; i++) {
+			remove_track(env, &slots[i].track);
+		}
+		free_io_slots(slots, free_list, depth);
+	}
 	FREE(buffer1);
 	FREE(buffer2);
 
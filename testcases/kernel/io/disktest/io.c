@@ -35,6 +35,12 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#endif
+#ifdef LINUX
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #endif
 
 #include "defs.h"
@@ -63,6 +69,40 @@ long Read(fd_t fd, void *buf, const unsigned long trsiz)
 	return (tcnt);
 }
 
+#ifdef WINDOWS
+OFF_T FileSeek64(HANDLE, OFF_T, DWORD);
+#endif
+
+/*
+ * Positional transfers, so that an IO is one call and does not depend on
+ * (or move) the file position shared by all the threads of a target.
+ */
+long WriteAt(fd_t fd, const void *buf, const unsigned long trsiz, OFF_T pos)
+{
+	long tcnt;
+#ifdef WINDOWS
+	if (FileSeek64(fd, pos, FILE_BEGIN) != pos)
+		return -1;
+	WriteFile(fd, buf, trsiz, &tcnt, NULL);
+#else
+	tcnt = pwrite64(fd, buf, trsiz, pos);
+#endif
+	return (tcnt);
+}
+
+long ReadAt(fd_t fd, void *buf, const unsigned long trsiz, OFF_T pos)
+{
+	long tcnt;
+#ifdef WINDOWS
+	if (FileSeek64(fd, pos, FILE_BEGIN) != pos)
+		return -1;
+	ReadFile(fd, buf, trsiz, &tcnt, NULL);
+#else
+	tcnt = pread64(fd, buf, trsiz, pos);
+#endif
+	return (tcnt);
+}
+
 #ifdef WINDOWS
 /*
  * wrapper for file seeking in WINDOWS API to hind the ugle 32 bit
@@ -182,3 +222,131 @@ int Sync(fd_t fd)
 	return fsync(fd);
 #endif
 }
+
+/*
+ * Asynchronous IO through io_uring, used when -Ia asks for more then one
+ * IO in flight per thread.  Transfers are prepared with AioQueue(), sent
+ * with AioSubmit() and collected one at a time with AioReap(), which
+ * hands back the tag given to AioQueue() and the transfer count.
+ */
+int AioSetup(aio_ctx_t * ctx, unsigned int depth)
+{
+#ifdef AIO_SUPPORTED
+	struct io_uring_params p;
+
+	memset(ctx, 0, sizeof(*ctx));
+	memset(&p, 0, sizeof(p));
+	ctx->fd = syscall(__NR_io_uring_setup, depth, &p);
+	if (ctx->fd < 0)
+		return -1;
+	ctx->entries = p.sq_entries;
+	ctx->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ctx->cq_ring_sz =
+	    p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ctx->sq_ring = mmap(0, ctx->sq_ring_sz, PROT_READ | PROT_WRITE,
+			    MAP_SHARED, ctx->fd, IORING_OFF_SQ_RING);
+	ctx->cq_ring = mmap(0, ctx->cq_ring_sz, PROT_READ | PROT_WRITE,
+			    MAP_SHARED, ctx->fd, IORING_OFF_CQ_RING);
+	ctx->sqes = mmap(0, p.sq_entries * sizeof(struct io_uring_sqe),
+			 PROT_READ | PROT_WRITE, MAP_SHARED, ctx->fd,
+			 IORING_OFF_SQES);
+	if (ctx->sq_ring == MAP_FAILED || ctx->cq_ring == MAP_FAILED
+	    || ctx->sqes == MAP_FAILED) {
+		close(ctx->fd);
+		return -1;
+	}
+	ctx->sq_tail = (unsigned int *)((char *)ctx->sq_ring + p.sq_off.tail);
+	ctx->sq_mask =
+	    (unsigned int *)((char *)ctx->sq_ring + p.sq_off.ring_mask);
+	ctx->sq_array = (unsigned int *)((char *)ctx->sq_ring + p.sq_off.array);
+	ctx->cq_head = (unsigned int *)((char *)ctx->cq_ring + p.cq_off.head);
+	ctx->cq_tail = (unsigned int *)((char *)ctx->cq_ring + p.cq_off.tail);
+	ctx->cq_mask =
+	    (unsigned int *)((char *)ctx->cq_ring + p.cq_off.ring_mask);
+	ctx->cqes =
+	    (struct io_uring_cqe *)((char *)ctx->cq_ring + p.cq_off.cqes);
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+void AioQueue(aio_ctx_t * ctx, fd_t fd, op_t oper, void *buf,
+	      const unsigned long trsiz, OFF_T pos, unsigned long tag)
+{
+#ifdef AIO_SUPPORTED
+	unsigned int tail = *ctx->sq_tail + ctx->queued;
+	unsigned int idx = tail & *ctx->sq_mask;
+	struct io_uring_sqe *sqe = &ctx->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = (oper == WRITER) ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)buf;
+	sqe->len = trsiz;
+	sqe->off = pos;
+	sqe->user_data = tag;
+	ctx->sq_array[idx] = idx;
+	ctx->queued++;
+#endif
+}
+
+/* submit what was queued and, if wait is set, wait for one completion */
+int AioSubmit(aio_ctx_t * ctx, int wait)
+{
+#ifdef AIO_SUPPORTED
+	int rv;
+
+	__atomic_store_n(ctx->sq_tail, *ctx->sq_tail + ctx->queued,
+			 __ATOMIC_RELEASE);
+	ctx->pending += ctx->queued;
+	ctx->queued = 0;
+	do {
+		rv = syscall(__NR_io_uring_enter, ctx->fd, ctx->pending,
+			     wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0,
+			     NULL, 0);
+	} while (rv < 0 && errno == EINTR);
+	if (rv < 0)
+		return -1;
+	ctx->pending -= rv;
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* returns 1 and the tag and count of a finished IO, 0 if none is ready */
+int AioReap(aio_ctx_t * ctx, unsigned long *tag, long *tcnt)
+{
+#ifdef AIO_SUPPORTED
+	unsigned int head = *ctx->cq_head;
+	struct io_uring_cqe *cqe;
+
+	if (head == __atomic_load_n(ctx->cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+	cqe = &ctx->cqes[head & *ctx->cq_mask];
+	*tag = cqe->user_data;
+	if (cqe->res < 0) {
+		errno = -cqe->res;
+		*tcnt = -1;
+	} else {
+		*tcnt = cqe->res;
+	}
+	__atomic_store_n(ctx->cq_head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+void AioTeardown(aio_ctx_t * ctx)
+{
+#ifdef AIO_SUPPORTED
+	munmap(ctx->sqes, ctx->entries * sizeof(struct io_uring_sqe));
+	munmap(ctx->cq_ring, ctx->cq_ring_sz);
+	munmap(ctx->sq_ring, ctx->sq_ring_sz);
+	close(ctx->fd);
+#endif
+}
@@ -52,12 +52,57 @@ typedef HANDLE fd_t;
 typedef int fd_t;
 #endif
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"	/* HAVE_LINUX_IO_URING_H, when built within LTP */
+#endif
+
+#if defined(LINUX) && defined(HAVE_LINUX_IO_URING_H)
+#include <linux/io_uring.h>
+#define AIO_SUPPORTED 1
+
+/*
+ * A bare io_uring used to keep several transfers in flight per thread,
+ * -Ia; see AioSetup() and friends in io.c.
+ */
+typedef struct aio_ctx {
+	int fd;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ring;
+	void *cq_ring;
+	size_t sq_ring_sz;
+	size_t cq_ring_sz;
+	unsigned int entries;
+	unsigned int queued;	/* prepared, not yet visible to the kernel */
+	unsigned int pending;	/* visible, not yet taken by the kernel */
+} aio_ctx_t;
+#else
+typedef struct aio_ctx {
+	int unused;
+} aio_ctx_t;
+#endif
+
 fd_t Open(const char *, const OFF_T);
 OFF_T Seek(fd_t, OFF_T);
 OFF_T SeekEnd(fd_t);
 long Write(fd_t, const void *, const unsigned long);
 long Read(fd_t, void *, const unsigned long);
+long WriteAt(fd_t, const void *, const unsigned long, OFF_T);
+long ReadAt(fd_t, void *, const unsigned long, OFF_T);
 int Sync (fd_t);
 
+int AioSetup(aio_ctx_t *, unsigned int);
+void AioQueue(aio_ctx_t *, fd_t, op_t, void *, const unsigned long, OFF_T,
+	      unsigned long);
+int AioSubmit(aio_ctx_t *, int);
+int AioReap(aio_ctx_t *, unsigned long *, long *);
+void AioTeardown(aio_ctx_t *);
+
 #endif /* IO_H_ */
 
@@ -80,7 +80,7 @@ void linear_read_write_test(test_ll_t * test)
 		test->args->test_state = SET_wFST_TIME(test->args->test_state);
 //              srand(test->args->seed);        /* reseed so we can re create the same random transfers */
 		memset(test->env->action_list, 0,
-		       sizeof(action_t) * test->args->t_kids);
+		       sizeof(action_t) * ACTION_SLOTS(test->args));
 		test->env->action_list_entry = 0;
 		test->env->wcount = 0;
 		test->env->rcount = 0;
@@ -119,7 +119,7 @@ void linear_read_write_test(test_ll_t * test)
 		test->args->test_state = SET_rFST_TIME(test->args->test_state);
 //              srand(test->args->seed);        /* reseed so we can re create the same random transfers */
 		memset(test->env->action_list, 0,
-		       sizeof(action_t) * test->args->t_kids);
+		       sizeof(action_t) * ACTION_SLOTS(test->args));
 		test->env->action_list_entry = 0;
 		test->env->wcount = 0;
 		test->env->rcount = 0;
@@ -203,7 +203,7 @@ unsigned long init_data(test_ll_t * test, unsigned char **data_buffer_unaligned)
 	}
 	/* create list to hold lbas currently be written */
 	if ((test->env->action_list =
-	     (action_t *) ALLOC(sizeof(action_t) * test->args->t_kids)) ==
+	     (action_t *) ALLOC(sizeof(action_t) * ACTION_SLOTS(test->args))) ==
 	    NULL) {
 		pMsg(ERR, test->args,
 		     "Failed to allocate static data buffer memory.\n");
@@ -222,7 +222,7 @@ unsigned long init_data(test_ll_t * test, unsigned char **data_buffer_unaligned)
 	memset(test->env->shared_mem, 0, test->env->bmp_siz + BMP_OFFSET);
 	memset(test->env->data_buffer, 0, data_buffer_size);
 	memset(test->env->action_list, 0,
-	       sizeof(action_t) * test->args->t_kids);
+	       sizeof(action_t) * ACTION_SLOTS(test->args));
 	test->env->action_list_entry = 0;
 
 	pVal1 = (OFF_T *) test->env->shared_mem;
@@ -358,7 +358,7 @@ void *threadedMain(void *vtest)
 				    SET_OPER_R(test->args->test_state);
 			}
 			memset(test->env->action_list, 0,
-			       sizeof(action_t) * test->args->t_kids);
+			       sizeof(action_t) * ACTION_SLOTS(test->args));
 			test->env->action_list_entry = 0;
 			test->env->wcount = 0;
 			test->env->rcount = 0;
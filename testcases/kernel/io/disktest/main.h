@@ -173,6 +173,8 @@
 
 #define CLD_FLG_TMO_ERROR	0x0001000000000000ULL	/* make an IO TIMEOUT warning, fail the IO test */
 #define CLD_FLG_UNIQ_WRT	0x0002000000000000ULL	/* garentees that every write is unique */
+#define CLD_FLG_ASYNC		0x0004000000000000ULL	/* keep qdepth IOs in flight per child */
+#define CLD_FLG_LAT		0x0008000000000000ULL	/* reports IO latency percentiles */
 
 /* startup defaults */
 #define TRSIZ	1		/* default transfer size in blocks */
@@ -192,6 +194,14 @@ typedef struct thread_struct {
 	struct thread_struct *next; /* pointer to next thread */
 } thread_struct_t;
 
+#define LAT_BUCKETS	256		/* 4 latency buckets per power of two nsecs */
+
+typedef struct lat_hist {
+	OFF_T count;				/* number of IOs timed */
+	unsigned long long max_ns;	/* slowest IO */
+	OFF_T bucket[LAT_BUCKETS];
+} lat_hist_t;
+
 typedef struct stats {
 	OFF_T wcount;
 	OFF_T rcount;
@@ -199,8 +209,22 @@ typedef struct stats {
 	OFF_T rbytes;
 	time_t wtime;
 	time_t rtime;
+	lat_hist_t wlat;			/* write latencies */
+	lat_hist_t rlat;			/* read latencies */
 } stats_t;
 
+/*
+ * Each IO in flight is tracked here, so that the timer can tell which
+ * transfer, on which thread, has been outstanding longer then ioTimeout.
+ */
+typedef struct io_track {
+	action_t target;			/* the transfer */
+	unsigned long long start_ns;	/* when it was issued, 0 if idle */
+	int thread_id;
+	BOOL reported;				/* its stall has been reported */
+	struct io_track *next;
+} io_track_t;
+
 typedef struct child_args {
 	char device[DEV_NAME_LEN];	/* device name */
 	char argstr[MAX_ARG_LEN];	/* human readable argument string /w assumtions */
@@ -234,8 +258,12 @@ typedef struct child_args {
 	time_t ioTimeout;			/* the time (sec) before failure do to possible hung IO */
 	unsigned long sync_interval;/* number of write IOs before issuing a sync */
 	long retry_delay;			/* number of msec to wait before retrying an IO */
+	unsigned int qdepth;		/* number of IOs a child keeps in flight, -Ia */
 } child_args_t;
 
+/* every child can hold qdepth entries of the action list */
+#define ACTION_SLOTS(args)	((int) ((args)->t_kids * (args)->qdepth))
+
 typedef struct mutexs {
 #ifdef WINDOWS
 	HANDLE MutexACTION;			/* mutex for the entire target device */
@@ -264,6 +292,7 @@ typedef struct test_env {
 	action_t lastAction;		/* when interleaving tests, tells the threads whcih action was last */
 	action_t *action_list;		/* pointer to list of actions that are currently in use */
 	int action_list_entry;		/* where in the action_list we are */
+	io_track_t *io_tracks;		/* IOs of all the children, under MutexACTION */
 	mutexs_t mutexs;
 } test_env_t;
 
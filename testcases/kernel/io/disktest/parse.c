@@ -43,6 +43,7 @@
 #include "usage.h"
 #include "sfunc.h"
 #include "parse.h"
+#include "io.h"
 
 int fill_cld_args(int argc, char **argv, child_args_t * args)
 {
@@ -482,6 +483,20 @@ int fill_cld_args(int argc, char **argv, child_args_t * args)
 			if (strchr(optarg, 'D') || strchr(optarg, 'd')) {
 				args->flags |= CLD_FLG_DIRECT;
 			}
+			if (strchr(optarg, 'a')) {
+				args->qdepth =
+				    strtoul((char *)strchr(optarg, 'a') + 1,
+					    NULL, 10);
+				args->flags |= CLD_FLG_ASYNC;
+#ifndef AIO_SUPPORTED
+				if (args->qdepth > 1) {
+					pMsg(ERR, args,
+					     "-Ia%u needs io_uring, which this build does not support\n",
+					     args->qdepth);
+					return (-1);
+				}
+#endif
+			}
 			if (strchr(optarg, 's')) {
 				args->sync_interval =
 				    strtoul((char *)strchr(optarg, 's') + 1,
@@ -638,10 +653,14 @@ int fill_cld_args(int argc, char **argv, child_args_t * args)
 			if (strchr(optarg, 'A')) {
 				args->flags |= CLD_FLG_PRFTYPS;
 			}
+			if (strchr(optarg, 'L')) {
+				args->flags |= CLD_FLG_LAT;
+			}
 			if (!strchr(optarg, 'P') &&
 			    !strchr(optarg, 'A') &&
 			    !strchr(optarg, 'X') &&
 			    !strchr(optarg, 'R') &&
+			    !strchr(optarg, 'L') &&
 			    !strchr(optarg, 'C') && !strchr(optarg, 'T')) {
 				pMsg(WARN, args,
 				     "Unknown performance option\n");
@@ -842,6 +861,9 @@ int make_assumptions(child_args_t * args)
 		     "Sync interval set to zero, assuming interval of 1.\n");
 		args->sync_interval = 1;
 	}
+	if (args->qdepth == 0) {
+		args->qdepth = 1;
+	}
 
 	if (args->ltrsiz <= 0) {
 		sprintf(TmpStr, "(-B %d) ", TRSIZ * BLK_SIZE);
@@ -1119,7 +1141,8 @@ int check_conclusions(child_args_t * args)
 		     "Heartbeat should be at least equal to runtime, use -h/-T to adjust.\n");
 		return (-1);
 	}
-	if ((args->hbeat > 0) && !(args->flags & CLD_FLG_PRFTYPS)) {
+	if ((args->hbeat > 0)
+	    && !(args->flags & (CLD_FLG_PRFTYPS | CLD_FLG_LAT))) {
 		pMsg(ERR, args,
 		     "At least one performance option, -P, must be specified when using -h.\n");
 		return (-1);
@@ -1161,6 +1184,18 @@ int check_conclusions(child_args_t * args)
 		     args->cmp_lng, args->ltrsiz * BLK_SIZE);
 		return (-1);
 	}
+	if ((args->flags & CLD_FLG_ASYNC) && (args->flags & CLD_FLG_IO_SERIAL)) {
+		pMsg(ERR, args,
+		     "Can't serialize IO, -AS, with asynchronous IO, -Ia.\n");
+		return (-1);
+	}
+#ifndef LINUX
+	if (args->flags & CLD_FLG_ASYNC) {
+		pMsg(ERR, args,
+		     "Asynchronous IO, -Ia, is only supported on Linux.\n");
+		return (-1);
+	}
+#endif
 	if ((args->flags & CLD_FLG_OFFSET) && (args->offset > args->stop_lba)) {
 		pMsg(ERR, args, LBAOFFGSLBA, args->offset, args->stop_lba);
 		return (-1);
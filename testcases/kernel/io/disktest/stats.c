@@ -52,6 +52,88 @@
 #include "threading.h"
 #include "stats.h"
 
+/*
+ * IO latencies are kept in log-linear buckets, four to each power of two
+ * nsecs, so a percentile is never off by more then a quarter of its value.
+ */
+int lat_bucket(unsigned long long ns)
+{
+	int b;
+
+	if (ns < 4)
+		return (int)ns;
+	b = 63 - __builtin_clzll(ns);
+	b = (b << 2) | (int)((ns >> (b - 2)) & 3);
+	return (b < LAT_BUCKETS) ? b : LAT_BUCKETS - 1;
+}
+
+/*
+ * the largest latency, in nsecs, that falls into bucket b; buckets 4 to 7
+ * are never used, 4ns and up start at bucket 8
+ */
+unsigned long long lat_bucket_max(int b)
+{
+	int e = b >> 2;
+
+	if (b < 8)
+		return (b < 4) ? b : 3;
+	return ((4ULL | (b & 3)) << (e - 2)) + (1ULL << (e - 2)) - 1;
+}
+
+void add_latency(lat_hist_t * hist, unsigned long long ns)
+{
+	hist->bucket[lat_bucket(ns)]++;
+	hist->count++;
+	if (ns > hist->max_ns)
+		hist->max_ns = ns;
+}
+
+void merge_lat(lat_hist_t * dst, lat_hist_t * src)
+{
+	int b;
+
+	for (b = 0; b < LAT_BUCKETS; b++)
+		dst->bucket[b] += src->bucket[b];
+	dst->count += src->count;
+	if (src->max_ns > dst->max_ns)
+		dst->max_ns = src->max_ns;
+	memset(src, 0, sizeof(lat_hist_t));
+}
+
+/* the latency, in usecs, below which the fraction q of the IOs completed */
+double lat_usecs(const lat_hist_t * hist, double q)
+{
+	OFF_T want = (OFF_T) (q * hist->count), seen = 0;
+	unsigned long long ns;
+	int b;
+
+	if (hist->count == 0)
+		return 0.0;
+	for (b = 0; b < LAT_BUCKETS - 1; b++) {
+		seen += hist->bucket[b];
+		if (seen > want)
+			break;
+	}
+	ns = lat_bucket_max(b);
+	if (ns > hist->max_ns)
+		ns = hist->max_ns;
+	return (double)ns / 1000.;
+}
+
+void print_lat(child_args_t * args, char *fmt, const lat_hist_t * hist)
+{
+	extern unsigned long glb_flags;	/* global flags GLB_FLG_xxx */
+
+	if (glb_flags & GLB_FLG_PERFP) {
+		printf(fmt, lat_usecs(hist, 0.5), lat_usecs(hist, 0.99),
+		       lat_usecs(hist, 0.999), (double)hist->max_ns / 1000.);
+	} else {
+		pMsg(STAT, args, fmt, lat_usecs(hist, 0.5),
+		     lat_usecs(hist, 0.99), lat_usecs(hist, 0.999),
+		     (double)hist->max_ns / 1000.);
+	}
+}
+
 void print_stats(child_args_t * args, test_env_t * env, statop_t operation)
 {
 	extern time_t global_start_time;	/* global pointer to overall start */
@@ -99,7 +181,7 @@ void print_stats(child_args_t * args, test_env_t * env, statop_t operation)
 		gw_time++;
 
 	if (glb_flags & GLB_FLG_PERFP) {
-		if (args->flags & CLD_FLG_PRFTYPS) {
+		if (args->flags & (CLD_FLG_PRFTYPS | CLD_FLG_LAT)) {
 			printf("%s;", args->device);
 		}
 		switch (operation) {
@@ -126,6 +208,10 @@ void print_stats(child_args_t * args, test_env_t * env, statop_t operation)
 				printf("%lu;Rsecs;%lu;Wsecs;", hread_time,
 				       hwrite_time);
 			}
+			if ((args->flags & CLD_FLG_LAT)) {
+				print_lat(args, CTRLSTR, &env->hbeat_stats.rlat);
+				print_lat(args, CTWLSTR, &env->hbeat_stats.wlat);
+			}
 			break;
 		case CYCLE:	/* only display current CYCLE stats */
 			if ((args->flags & CLD_FLG_XFERS)) {
@@ -150,6 +236,10 @@ void print_stats(child_args_t * args, test_env_t * env, statop_t operation)
 				printf("%lu;Rsecs;%lu;Wsecs;", read_time,
 				       write_time);
 			}
+			if ((args->flags & CLD_FLG_LAT)) {
+				print_lat(args, CTRLSTR, &env->cycle_stats.rlat);
+				print_lat(args, CTWLSTR, &env->cycle_stats.wlat);
+			}
 			break;
 		case TOTAL:	/* display total read and write stats */
 			if ((args->flags & CLD_FLG_XFERS)) {
@@ -174,12 +264,16 @@ void print_stats(child_args_t * args, test_env_t * env, statop_t operation)
 				printf("%lu;secs;",
 				       (curr_time - env->start_time));
 			}
+			if ((args->flags & CLD_FLG_LAT)) {
+				print_lat(args, TCTRLSTR, &env->global_stats.rlat);
+				print_lat(args, TCTWLSTR, &env->global_stats.wlat);
+			}
 			break;
 		default:
 			pMsg(ERR, args, "Unknown stats display type.\n");
 		}
 
-		if (args->flags & CLD_FLG_PRFTYPS) {
+		if (args->flags & (CLD_FLG_PRFTYPS | CLD_FLG_LAT)) {
 			printf("\n");
 		}
 	} else {
@@ -371,6 +465,43 @@ void print_stats(child_args_t * args, test_env_t * env, statop_t operation)
 				     "Unknown stats display type.\n");
 			}
 		}
+		if (args->flags & CLD_FLG_LAT) {
+			switch (operation) {
+			case HBEAT:	/* only display current heartbeat latencies */
+				if (args->flags & CLD_FLG_R) {
+					print_lat(args, HRLATSTR,
+						  &env->hbeat_stats.rlat);
+				}
+				if (args->flags & CLD_FLG_W) {
+					print_lat(args, HWLATSTR,
+						  &env->hbeat_stats.wlat);
+				}
+				break;
+			case CYCLE:	/* only display current cycle latencies */
+				if (args->flags & CLD_FLG_R) {
+					print_lat(args, CRLATSTR,
+						  &env->cycle_stats.rlat);
+				}
+				if (args->flags & CLD_FLG_W) {
+					print_lat(args, CWLATSTR,
+						  &env->cycle_stats.wlat);
+				}
+				break;
+			case TOTAL:	/* display total read and write latencies */
+				if (args->flags & CLD_FLG_R) {
+					print_lat(args, TRLATSTR,
+						  &env->global_stats.rlat);
+				}
+				if (args->flags & CLD_FLG_W) {
+					print_lat(args, TWLATSTR,
+						  &env->global_stats.wlat);
+				}
+				break;
+			default:
+				pMsg(ERR, args,
+				     "Unknown stats display type.\n");
+			}
+		}
 	}
 }
 
@@ -382,6 +513,8 @@ void update_gbl_stats(test_env_t * env)
 	env->global_stats.rbytes += env->cycle_stats.rbytes;
 	env->global_stats.wtime += env->cycle_stats.wtime;
 	env->global_stats.rtime += env->cycle_stats.rtime;
+	merge_lat(&env->global_stats.wlat, &env->cycle_stats.wlat);
+	merge_lat(&env->global_stats.rlat, &env->cycle_stats.rlat);
 
 	env->cycle_stats.wcount = 0;
 	env->cycle_stats.rcount = 0;
@@ -399,6 +532,8 @@ void update_cyc_stats(test_env_t * env)
 	env->cycle_stats.rbytes += env->hbeat_stats.rbytes;
 	env->cycle_stats.wtime += env->hbeat_stats.wtime;
 	env->cycle_stats.rtime += env->hbeat_stats.rtime;
+	merge_lat(&env->cycle_stats.wlat, &env->hbeat_stats.wlat);
+	merge_lat(&env->cycle_stats.rlat, &env->hbeat_stats.rlat);
 
 	env->hbeat_stats.wcount = 0;
 	env->hbeat_stats.rcount = 0;
@@ -82,6 +82,16 @@
 #define CTRWSTR "%.1f;WB/s;%.1f;WIOPS;"
 #define TCTRRSTR "%.1f;TRB/s;%.1f;TRIOPS;"
 #define TCTRWSTR "%.1f;TWB/s;%.1f;TWIOPS;"
+#define HRLATSTR "Heartbeat read latency: p50 %.1fus, p99 %.1fus, p99.9 %.1fus, max %.1fus.\n"
+#define HWLATSTR "Heartbeat write latency: p50 %.1fus, p99 %.1fus, p99.9 %.1fus, max %.1fus.\n"
+#define CRLATSTR "Cycle read latency: p50 %.1fus, p99 %.1fus, p99.9 %.1fus, max %.1fus.\n"
+#define CWLATSTR "Cycle write latency: p50 %.1fus, p99 %.1fus, p99.9 %.1fus, max %.1fus.\n"
+#define TRLATSTR "Total read latency: p50 %.1fus, p99 %.1fus, p99.9 %.1fus, max %.1fus.\n"
+#define TWLATSTR "Total write latency: p50 %.1fus, p99 %.1fus, p99.9 %.1fus, max %.1fus.\n"
+#define CTRLSTR "%.1f;Rp50us;%.1f;Rp99us;%.1f;Rp999us;%.1f;Rmaxus;"
+#define CTWLSTR "%.1f;Wp50us;%.1f;Wp99us;%.1f;Wp999us;%.1f;Wmaxus;"
+#define TCTRLSTR "%.1f;TRp50us;%.1f;TRp99us;%.1f;TRp999us;%.1f;TRmaxus;"
+#define TCTWLSTR "%.1f;TWp50us;%.1f;TWp99us;%.1f;TWp999us;%.1f;TWmaxus;"
 
 typedef enum statop {
 	HBEAT,CYCLE,TOTAL
@@ -89,6 +99,7 @@ typedef enum statop {
 
 
 void print_stats(child_args_t *, test_env_t *, statop_t);
+void add_latency(lat_hist_t *, unsigned long long);
 void update_gbl_stats(test_env_t *);
 void update_cyc_stats(test_env_t *);
 
@@ -55,6 +55,7 @@
 #include "sfunc.h"
 #include "stats.h"
 #include "signals.h"
+#include "timer.h"
 
 /*
  * The main purpose of this thread is track time during the test. Along with
@@ -146,6 +147,8 @@ void *ChildTimer(void *vtest)
 		      ((double)(total_time) / (double)(tmp_io_count)));
 #endif
 
+		check_io_stalls(args, env);
+
 		if (cur_total_io_count == last_total_io_count) {	/* no IOs completed in interval */
 			if (0 == (++ioTimeoutCount % args->ioTimeout)) {	/* no progress after modulo ioTimeout interval */
 				if (args->flags & CLD_FLG_TMO_ERROR) {
@@ -210,43 +213,57 @@ void *ChildTimer(void *vtest)
 	TEXIT((uintptr_t) GETLASTERROR());
 }
 
-#ifdef _DEBUG
-#ifdef WINDOWS
-DWORD startTime;
-DWORD endTime;
-
-void setStartTime(void)
-{
-	startTime = GetTickCount();
-}
-
-void setEndTime(void)
+/*
+ * A monotonic time stamp in nsecs, used to time each IO.
+ */
+unsigned long long getNsecs(void)
 {
-	endTime = GetTickCount();
-}
+#ifdef WINDOWS
+	LARGE_INTEGER count, freq;
 
-unsigned long getTimeDiff(void)
-{
-	return ((endTime - startTime) * 1000);	/* since we report in usecs, and windows is msec, multiply by 1000 */
-}
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (unsigned long long)((double)count.QuadPart * 1e9 /
+				    (double)freq.QuadPart);
 #else
-struct timeval tv_start;
-struct timeval tv_end;
+	struct timespec ts;
 
-void setStartTime(void)
-{
-	gettimeofday(&tv_start, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#endif
 }
 
-void setEndTime(void)
+/*
+ * Reports every IO that has been outstanding for ioTimeout seconds,
+ * once, with the thread, operation and LBA range it was issued for.
+ */
+void check_io_stalls(child_args_t * args, test_env_t * env)
 {
-	gettimeofday(&tv_end, NULL);
-}
+	unsigned long long now = getNsecs(), start;
+	io_track_t *track;
 
-unsigned long getTimeDiff(void)
-{
-	return (tv_end.tv_usec - tv_start.tv_usec);
+	if (args->ioTimeout == 0) {	/* IO timeouts are disabled */
+		return;
+	}
+	LOCK(env->mutexs.MutexACTION);
+	for (track = env->io_tracks; track != NULL; track = track->next) {
+		start = track->start_ns;
+		/* an IO started while we waited for the lock is newer then now */
+		if ((start == 0) || (start > now) || track->reported
+		    || ((now - start) / 1000000000ULL <
+			(unsigned long long)args->ioTimeout)) {
+			continue;
+		}
+		track->reported = TRUE;
+		pMsg((args->flags & CLD_FLG_TMO_ERROR) ? ERR : WARN, args,
+		     STALLSTR, track->thread_id,
+		     (track->target.oper == WRITER) ? "Write" : "Read",
+		     track->target.trsiz, track->target.lba,
+		     track->target.lba, (double)(now - start) / 1e9);
+		if (args->flags & CLD_FLG_TMO_ERROR) {
+			args->test_state = SET_STS_FAIL(args->test_state);
+			env->bContinue = FALSE;
+		}
+	}
+	UNLOCK(env->mutexs.MutexACTION);
 }
-
-#endif
-#endif
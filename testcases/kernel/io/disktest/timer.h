@@ -30,13 +30,14 @@
 #ifndef _TIMER_H_ /* _TIMER_H */
 #define _TIMER_H_
 
-void setStartTime(void);
-void setEndTime(void);
-unsigned long getTimeDiff(void);
+unsigned long long getNsecs(void);
+void check_io_stalls(child_args_t *, test_env_t *);
 
 #ifdef WINDOWS
+#define STALLSTR "Thread %d: %s of %lu blocks at lba %I64d (0x%I64X) outstanding for %.1f seconds\n"
 DWORD WINAPI ChildTimer(test_ll_t *);
 #else
+#define STALLSTR "Thread %d: %s of %lu blocks at lba %lld (0x%llX) outstanding for %.1f seconds\n"
 void *ChildTimer(void *);
 #endif
 
@@ -745,6 +745,8 @@ static void help(void)
   -i #writes   - number write per child, zero means forever.\n\
   -I io_type   - Specifies io type: s - sync, p - polled async, a - async (def s)\n\
                  l - listio sync, L - listio async, r - random\n\
+                 u - io_uring, U - io_uring batched, F - io_uring fixed buffer\n\
+                 n - linux native aio\n\
   -l           - loop forever (implied by -n 0).\n\
   -n #writes   - same as -i (for compatability).\n\
   -p num_rpt   - number of reads before a report\n\
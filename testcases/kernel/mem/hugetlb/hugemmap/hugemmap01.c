@@ -63,6 +63,7 @@
 #include "usctest.h"
 #include "safe_macros.h"
 #include "mem.h"
+#include "hugepool.h"
 
 static char TEMPFILE[MAXPATHLEN];
 
@@ -76,7 +77,6 @@ static long beforetest;
 static long aftertest;
 static long hugepagesmapped;
 static long hugepages = 128;
-static long orig_hugepages;
 
 static void help(void);
 
@@ -167,8 +167,7 @@ void setup(void)
 	if (mount("none", Hopt, "hugetlbfs", 0, NULL) < 0)
 		tst_brkm(TBROK | TERRNO, NULL, "mount failed on %s", Hopt);
 
-	orig_hugepages = get_sys_tune("nr_hugepages");
-	set_sys_tune("nr_hugepages", hugepages, 1);
+	hugepool_lease(0, hugepages, cleanup);
 	snprintf(TEMPFILE, sizeof(TEMPFILE), "%s/mmapfile%d", Hopt, getpid());
 }
 
@@ -177,7 +176,7 @@ void cleanup(void)
 	TEST_CLEANUP;
 
 	unlink(TEMPFILE);
-	set_sys_tune("nr_hugepages", orig_hugepages, 0);
+	hugepool_release();
 
 	umount(Hopt);
 	tst_rmdir();
@@ -56,6 +56,7 @@
 #include "usctest.h"
 #include "safe_macros.h"
 #include "mem.h"
+#include "hugepool.h"
 
 #define LOW_ADDR       (void *)(0x80000000)
 #define LOW_ADDR2      (void *)(0x90000000)
@@ -73,7 +74,6 @@ static int nfildes;
 static char *Hopt;
 static char *nr_opt;
 static long hugepages = 128;
-static long orig_hugepages;
 
 static void help(void);
 
@@ -191,8 +191,7 @@ void setup(void)
 	tst_require_root(NULL);
 	if (mount("none", Hopt, "hugetlbfs", 0, NULL) < 0)
 		tst_brkm(TBROK | TERRNO, NULL, "mount failed on %s", Hopt);
-	orig_hugepages = get_sys_tune("nr_hugepages");
-	set_sys_tune("nr_hugepages", hugepages, 1);
+	hugepool_lease(0, hugepages, cleanup);
 	snprintf(TEMPFILE, sizeof(TEMPFILE), "%s/mmapfile%d", Hopt, getpid());
 }
 
@@ -201,7 +200,7 @@ void cleanup(void)
 	TEST_CLEANUP;
 
 	unlink(TEMPFILE);
-	set_sys_tune("nr_hugepages", orig_hugepages, 0);
+	hugepool_release();
 
 	umount(Hopt);
 	tst_rmdir();
@@ -64,6 +64,7 @@
 #include "usctest.h"
 #include "safe_macros.h"
 #include "mem.h"
+#include "hugepool.h"
 
 static char TEMPFILE[MAXPATHLEN];
 
@@ -77,7 +78,6 @@ static long beforetest;
 static long aftertest;
 static long hugepagesmapped;
 static long hugepages = 128;
-static long orig_hugepages;
 static char *Hopt;
 static char *nr_opt;
 
@@ -182,8 +182,7 @@ void setup(void)
 	tst_require_root(NULL);
 	if (mount("none", Hopt, "hugetlbfs", 0, NULL) < 0)
 		tst_brkm(TBROK | TERRNO, NULL, "mount failed on %s", Hopt);
-	orig_hugepages = get_sys_tune("nr_hugepages");
-	set_sys_tune("nr_hugepages", hugepages, 1);
+	hugepool_lease(0, hugepages, cleanup);
 	snprintf(TEMPFILE, sizeof(TEMPFILE), "%s/mmapfile%d", Hopt, getpid());
 }
 
@@ -192,7 +191,7 @@ void cleanup(void)
 	TEST_CLEANUP;
 
 	unlink(TEMPFILE);
-	set_sys_tune("nr_hugepages", orig_hugepages, 0);
+	hugepool_release();
 
 	umount(Hopt);
 	tst_rmdir();
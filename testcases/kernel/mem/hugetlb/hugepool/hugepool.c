@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2026 Linux Test Project
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ * the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program;  if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * hugepool - reserve the huge page pool once for a run of hugetlb tests
+ *
+ *	export LTP_HUGEPOOL=/tmp/hugepool
+ *	hugepool init 128 1048576:2
+ *	... hugemmap and hugeshm tests ...
+ *	hugepool fini
+ *
+ * init records the current size of each given pool and grows it to at
+ * least nr pages ([kB:]nr, the default huge page size when kB is left
+ * out); the tests then lease their pages from $LTP_HUGEPOOL instead of
+ * resizing the pool.  fini restores the recorded sizes and removes the
+ * lease file, status prints the pools and the live leases.
+ */
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+#include "hugepool.h"
+
+char *TCID = "hugepool";
+int TST_TOTAL = 1;
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: %s init [kB:]nr...|fini|status\n"
+		"  the lease file is $%s\n", TCID, HUGEPOOL_ENV);
+	exit(1);
+}
+
+static int find_orig(struct hugepool_file *hf, long size_kb)
+{
+	int i;
+
+	for (i = 0; i < hf->norig; i++)
+		if (hf->orig[i].size_kb == size_kb)
+			return i;
+	return -1;
+}
+
+static void pool_init(const char *path, int ac, char **av)
+{
+	struct hugepool_file hf;
+	long size_kb, nr, total;
+	char *end;
+	int i;
+
+	hugepool_open(&hf, path, O_RDWR | O_CREAT, NULL);
+
+	for (i = 0; i < ac; i++) {
+		size_kb = 0;
+		nr = strtol(av[i], &end, 0);
+		if (*end == ':') {
+			size_kb = nr;
+			nr = strtol(end + 1, &end, 0);
+		}
+		if (*end != '\0' || nr < 0 || size_kb < 0)
+			usage();
+		if (size_kb == 0)
+			size_kb = hugepool_default_size(NULL);
+
+		total = hugepool_get(size_kb, "nr_hugepages", NULL);
+		if (find_orig(&hf, size_kb) == -1) {
+			if (hf.norig == HUGEPOOL_MAX_SIZES)
+				tst_brkm(TBROK, NULL, "too many pool sizes");
+			hf.orig[hf.norig].size_kb = size_kb;
+			hf.orig[hf.norig++].nr = total;
+		}
+		if (total < nr) {
+			hugepool_set(size_kb, "nr_hugepages", nr, NULL);
+			total = hugepool_get(size_kb, "nr_hugepages", NULL);
+		}
+		if (total < nr)
+			tst_resm(TWARN, "%ldkB pool has %ld of %ld pages",
+				 size_kb, total, nr);
+		else
+			tst_resm(TINFO, "%ldkB pool has %ld pages", size_kb,
+				 total);
+	}
+
+	hugepool_close(&hf, NULL);
+}
+
+static void pool_fini(const char *path)
+{
+	struct hugepool_file hf;
+	int i;
+
+	hugepool_open(&hf, path, O_RDWR, NULL);
+
+	for (i = 0; i < hf.nlease; i++)
+		tst_resm(TWARN, "pid %d still holds %ld %ldkB pages",
+			 hf.lease[i].pid, hf.lease[i].nr, hf.lease[i].size_kb);
+	for (i = 0; i < hf.norig; i++) {
+		tst_resm(TINFO, "restore %ldkB pool to %ld pages",
+			 hf.orig[i].size_kb, hf.orig[i].nr);
+		hugepool_set(hf.orig[i].size_kb, "nr_hugepages",
+			     hf.orig[i].nr, NULL);
+	}
+
+	if (unlink(path) == -1)
+		tst_brkm(TBROK | TERRNO, NULL, "unlink %s", path);
+	close(hf.fd);
+}
+
+static void pool_status(const char *path)
+{
+	struct hugepool_file hf;
+	long size_kb;
+	int i;
+
+	hugepool_open(&hf, path, O_RDONLY, NULL);
+
+	printf("%10s %8s %8s %8s %8s %8s %8s\n", "size(kB)", "orig",
+	       "total", "free", "resv", "surplus", "leased");
+	for (i = 0; i < hf.norig; i++) {
+		size_kb = hf.orig[i].size_kb;
+		printf("%10ld %8ld %8ld %8ld %8ld %8ld %8ld\n", size_kb,
+		       hf.orig[i].nr,
+		       hugepool_get(size_kb, "nr_hugepages", NULL),
+		       hugepool_get(size_kb, "free_hugepages", NULL),
+		       hugepool_get(size_kb, "resv_hugepages", NULL),
+		       hugepool_get(size_kb, "surplus_hugepages", NULL),
+		       hugepool_leased(&hf, size_kb));
+	}
+	for (i = 0; i < hf.nlease; i++)
+		printf("lease: pid %d, %ld %ldkB pages\n", hf.lease[i].pid,
+		       hf.lease[i].nr, hf.lease[i].size_kb);
+
+	close(hf.fd);
+}
+
+int main(int ac, char **av)
+{
+	char *path = getenv(HUGEPOOL_ENV);
+
+	if (ac < 2)
+		usage();
+
+	tst_require_root(NULL);
+	if (path == NULL || *path == '\0')
+		tst_brkm(TBROK, NULL, "%s is not set", HUGEPOOL_ENV);
+
+	if (!strcmp(av[1], "init") && ac > 2)
+		pool_init(path, ac - 2, av + 2);
+	else if (!strcmp(av[1], "fini") && ac == 2)
+		pool_fini(path);
+	else if (!strcmp(av[1], "status") && ac == 2)
+		pool_status(path);
+	else
+		usage();
+
+	tst_exit();
+}
@@ -54,6 +54,7 @@
 #include "ipcshm.h"
 #include "safe_macros.h"
 #include "mem.h"
+#include "hugepool.h"
 
 char *TCID = "hugeshmat02";
 int TST_TOTAL = 2;
@@ -130,8 +131,7 @@ void setup(void)
 	tst_sig(NOFORK, DEF_HANDLER, cleanup);
 	tst_tmpdir();
 
-	orig_hugepages = get_sys_tune("nr_hugepages");
-	set_sys_tune("nr_hugepages", hugepages, 1);
+	hugepool_lease(0, hugepages, cleanup);
 	hpage_size = read_meminfo("Hugepagesize:") * 1024;
 
 	shm_size = hpage_size * hugepages / 2;
@@ -154,7 +154,7 @@ void cleanup(void)
 
 	rm_shm(shm_id_2);
 
-	set_sys_tune("nr_hugepages", orig_hugepages, 0);
+	hugepool_release();
 
 	tst_rmdir();
 }
@@ -64,6 +64,7 @@
 #include "ipcshm.h"
 #include "safe_macros.h"
 #include "mem.h"
+#include "hugepool.h"
 
 char *TCID = "hugeshmctl01";
 int TST_TOTAL = 4;
@@ -397,8 +398,7 @@ void setup(void)
 	tst_sig(FORK, sighandler, cleanup);
 	tst_tmpdir();
 
-	orig_hugepages = get_sys_tune("nr_hugepages");
-	set_sys_tune("nr_hugepages", hugepages, 1);
+	hugepool_lease(0, hugepages, cleanup);
 	hpage_size = read_meminfo("Hugepagesize:") * 1024;
 
 	shm_size = hpage_size * hugepages / 2;
@@ -414,7 +414,7 @@ void cleanup(void)
 
 	rm_shm(shm_id_1);
 
-	set_sys_tune("nr_hugepages", orig_hugepages, 0);
+	hugepool_release();
 
 	tst_rmdir();
 }
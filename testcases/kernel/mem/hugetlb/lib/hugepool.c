@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2026 Linux Test Project
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ * the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program;  if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * NAME
+ *	hugepool.c
+ *
+ * DESCRIPTION
+ *	huge page pool leases shared by the hugetlb tests, see hugepool.h.
+ *
+ *	The library contains the following routines:
+ *
+ *	hugepool_lease()
+ *	hugepool_release()
+ *	hugepool_default_size()
+ *	hugepool_get()
+ *	hugepool_set()
+ *	hugepool_open()
+ *	hugepool_close()
+ *	hugepool_leased()
+ */
+
+#include <sys/types.h>
+#include <sys/file.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+#include "safe_file_ops.h"
+#include "hugepool.h"
+
+#define LEASE_FILE_MAX	16384
+
+/* the lease held by this process */
+static pid_t lease_pid;
+static int lease_pooled;
+static long lease_size_kb;
+static long lease_orig;
+
+long hugepool_default_size(void (*cleanup)(void))
+{
+	FILE *fp;
+	char line[BUFSIZ];
+	long size_kb = 0;
+
+	fp = fopen("/proc/meminfo", "r");
+	if (fp == NULL)
+		tst_brkm(TBROK | TERRNO, cleanup, "fopen /proc/meminfo");
+	while (fgets(line, sizeof(line), fp) != NULL)
+		if (sscanf(line, "Hugepagesize: %ld", &size_kb) == 1)
+			break;
+	fclose(fp);
+
+	if (size_kb <= 0)
+		tst_brkm(TCONF, cleanup, "huge pages are not supported");
+	return size_kb;
+}
+
+static void pool_path(char *path, long size_kb, const char *item)
+{
+	snprintf(path, PATH_MAX, PATH_HUGEPAGES "/hugepages-%ldkB/%s",
+		 size_kb, item);
+}
+
+long hugepool_get(long size_kb, const char *item, void (*cleanup)(void))
+{
+	char path[PATH_MAX];
+	long val;
+
+	pool_path(path, size_kb, item);
+	SAFE_FILE_SCANF(cleanup, path, "%ld", &val);
+	return val;
+}
+
+void hugepool_set(long size_kb, const char *item, long val,
+		  void (*cleanup)(void))
+{
+	char path[PATH_MAX];
+
+	pool_path(path, size_kb, item);
+	SAFE_FILE_PRINTF(cleanup, path, "%ld", val);
+}
+
+/*
+ * The start time of pid in clock ticks after boot, field 22 of
+ * /proc/<pid>/stat, or 0 if there is no such process.
+ */
+static unsigned long long pid_start_time(pid_t pid)
+{
+	char path[PATH_MAX], buf[BUFSIZ];
+	unsigned long long start;
+	char *p;
+	ssize_t len;
+	int fd, i;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return 0;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return 0;
+	buf[len] = '\0';
+
+	/* the command name may hold spaces, count the fields after it */
+	p = strrchr(buf, ')');
+	for (i = 2; p != NULL && i < 22; i++)
+		p = strchr(p + 1, ' ');
+	if (p == NULL || sscanf(p, "%llu", &start) != 1)
+		return 0;
+	return start;
+}
+
+void hugepool_open(struct hugepool_file *hf, const char *path, int flags,
+		   void (*cleanup)(void))
+{
+	char buf[LEASE_FILE_MAX];
+	char *line, *save;
+	unsigned long long start;
+	long kb, nr;
+	ssize_t len;
+	int pid, i;
+
+	memset(hf, 0, sizeof(*hf));
+
+	hf->fd = open(path, flags, 0644);
+	if (hf->fd == -1)
+		tst_brkm(TBROK | TERRNO, cleanup, "open %s", path);
+	if (flock(hf->fd, LOCK_EX) == -1) {
+		close(hf->fd);
+		tst_brkm(TBROK | TERRNO, cleanup, "flock %s", path);
+	}
+
+	len = read(hf->fd, buf, sizeof(buf) - 1);
+	if (len == -1) {
+		close(hf->fd);
+		tst_brkm(TBROK | TERRNO, cleanup, "read %s", path);
+	}
+	buf[len] = '\0';
+
+	for (line = strtok_r(buf, "\n", &save); line;
+	     line = strtok_r(NULL, "\n", &save)) {
+		if (sscanf(line, "orig %ld %ld", &kb, &nr) == 2 &&
+		    hf->norig < HUGEPOOL_MAX_SIZES) {
+			i = hf->norig++;
+			hf->orig[i].size_kb = kb;
+			hf->orig[i].nr = nr;
+		} else if (sscanf(line, "lease %d %llu %ld %ld", &pid, &start,
+				  &kb, &nr) == 4 &&
+			   hf->nlease < HUGEPOOL_MAX_LEASES) {
+			/* a test that died without cleanup holds nothing */
+			if (pid_start_time(pid) != start)
+				continue;
+			i = hf->nlease++;
+			hf->lease[i].pid = pid;
+			hf->lease[i].start = start;
+			hf->lease[i].size_kb = kb;
+			hf->lease[i].nr = nr;
+		}
+	}
+}
+
+void hugepool_close(struct hugepool_file *hf, void (*cleanup)(void))
+{
+	char buf[LEASE_FILE_MAX];
+	int len = 0, i;
+
+	for (i = 0; i < hf->norig; i++)
+		len += snprintf(buf + len, sizeof(buf) - len, "orig %ld %ld\n",
+				hf->orig[i].size_kb, hf->orig[i].nr);
+	for (i = 0; i < hf->nlease; i++)
+		len += snprintf(buf + len, sizeof(buf) - len,
+				"lease %d %llu %ld %ld\n", hf->lease[i].pid,
+				hf->lease[i].start, hf->lease[i].size_kb,
+				hf->lease[i].nr);
+
+	if (ftruncate(hf->fd, 0) == -1 ||
+	    pwrite(hf->fd, buf, len, 0) != len) {
+		close(hf->fd);
+		hf->fd = -1;
+		tst_brkm(TBROK | TERRNO, cleanup, "write lease file");
+	}
+	close(hf->fd);
+	hf->fd = -1;
+}
+
+long hugepool_leased(struct hugepool_file *hf, long size_kb)
+{
+	long nr = 0;
+	int i;
+
+	for (i = 0; i < hf->nlease; i++)
+		if (hf->lease[i].size_kb == size_kb)
+			nr += hf->lease[i].nr;
+	return nr;
+}
+
+/*
+ * With no test holding pages every page of the pool must be free and
+ * none reserved or surplus; anything else was left behind by a test.
+ */
+static void check_idle(long size_kb, long total, void (*cleanup)(void))
+{
+	long free_pages, resv, surplus;
+
+	free_pages = hugepool_get(size_kb, "free_hugepages", cleanup);
+	resv = hugepool_get(size_kb, "resv_hugepages", cleanup);
+	surplus = hugepool_get(size_kb, "surplus_hugepages", cleanup);
+
+	if (free_pages != total || resv != 0 || surplus != 0)
+		tst_resm(TWARN, "%ldkB pool is not idle: total %ld, free %ld, "
+			 "resv %ld, surplus %ld", size_kb, total, free_pages,
+			 resv, surplus);
+}
+
+static void lease_pooled_pages(const char *path, long size_kb, long nr_pages,
+			       void (*cleanup)(void))
+{
+	struct hugepool_file hf;
+	long leased, total;
+	int i;
+
+	hugepool_open(&hf, path, O_RDWR, cleanup);
+
+	leased = hugepool_leased(&hf, size_kb);
+	total = hugepool_get(size_kb, "nr_hugepages", cleanup);
+	if (leased == 0)
+		check_idle(size_kb, total, cleanup);
+
+	for (i = 0; i < hf.norig; i++)
+		if (hf.orig[i].size_kb == size_kb)
+			break;
+	if (i == hf.norig) {
+		if (hf.norig == HUGEPOOL_MAX_SIZES) {
+			hugepool_close(&hf, cleanup);
+			tst_brkm(TBROK, cleanup, "too many pool sizes in %s",
+				 path);
+		}
+		hf.orig[hf.norig].size_kb = size_kb;
+		hf.orig[hf.norig++].nr = total;
+	}
+
+	if (total - leased < nr_pages) {
+		tst_resm(TINFO, "grow %ldkB pool from %ld to %ld pages",
+			 size_kb, total, leased + nr_pages);
+		hugepool_set(size_kb, "nr_hugepages", leased + nr_pages,
+			     cleanup);
+		total = hugepool_get(size_kb, "nr_hugepages", cleanup);
+	}
+	if (total - leased < nr_pages) {
+		hugepool_close(&hf, cleanup);
+		tst_brkm(TCONF, cleanup, "only %ld of %ld %ldkB huge pages "
+			 "available", total - leased, nr_pages, size_kb);
+	}
+
+	if (hf.nlease == HUGEPOOL_MAX_LEASES) {
+		hugepool_close(&hf, cleanup);
+		tst_brkm(TBROK, cleanup, "too many leases in %s", path);
+	}
+	hf.lease[hf.nlease].pid = getpid();
+	hf.lease[hf.nlease].start = pid_start_time(getpid());
+	hf.lease[hf.nlease].size_kb = size_kb;
+	hf.lease[hf.nlease++].nr = nr_pages;
+
+	hugepool_close(&hf, cleanup);
+
+	tst_resm(TINFO, "leased %ld of %ld %ldkB huge pages", nr_pages, total,
+		 size_kb);
+}
+
+void hugepool_lease(long size_kb, long nr_pages, void (*cleanup)(void))
+{
+	char path[PATH_MAX];
+	char *pool = getenv(HUGEPOOL_ENV);
+	long val;
+
+	if (size_kb == 0)
+		size_kb = hugepool_default_size(cleanup);
+	pool_path(path, size_kb, "");
+	if (access(path, F_OK) == -1)
+		tst_brkm(TCONF, cleanup, "%ldkB huge pages are not supported",
+			 size_kb);
+
+	if (pool != NULL && *pool != '\0' && access(pool, F_OK) == 0) {
+		lease_pooled_pages(pool, size_kb, nr_pages, cleanup);
+		lease_pooled = 1;
+		lease_size_kb = size_kb;
+		lease_pid = getpid();
+		return;
+	}
+
+	/* the cleanup of a failed resize restores the original size */
+	lease_pooled = 0;
+	lease_size_kb = size_kb;
+	lease_orig = hugepool_get(size_kb, "nr_hugepages", cleanup);
+	lease_pid = getpid();
+
+	tst_resm(TINFO, "set %ldkB nr_hugepages to %ld", size_kb, nr_pages);
+	hugepool_set(size_kb, "nr_hugepages", nr_pages, cleanup);
+	val = hugepool_get(size_kb, "nr_hugepages", cleanup);
+	if (val != nr_pages)
+		tst_brkm(TBROK, cleanup, "nr_hugepages = %ld, but expect %ld",
+			 val, nr_pages);
+}
+
+void hugepool_release(void)
+{
+	struct hugepool_file hf;
+	char *pool = getenv(HUGEPOOL_ENV);
+	int i, j;
+
+	/* nothing leased, or a forked child running cleanup() */
+	if (lease_pid == 0 || lease_pid != getpid())
+		return;
+	lease_pid = 0;
+
+	if (!lease_pooled) {
+		hugepool_set(lease_size_kb, "nr_hugepages", lease_orig, NULL);
+		return;
+	}
+
+	if (pool == NULL || access(pool, F_OK) == -1) {
+		tst_resm(TWARN, "lease file %s is gone", pool ? pool : "");
+		return;
+	}
+	hugepool_open(&hf, pool, O_RDWR, NULL);
+	for (i = j = 0; i < hf.nlease; i++)
+		if (hf.lease[i].pid != getpid())
+			hf.lease[j++] = hf.lease[i];
+	hf.nlease = j;
+	hugepool_close(&hf, NULL);
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2026 Linux Test Project
+ *
+ * This program is free software;  you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ * the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program;  if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * hugepool.h - shared huge page pool for the hugetlb tests
+ *
+ * A test takes the huge pages it needs with hugepool_lease() in setup()
+ * and gives them back with hugepool_release() in cleanup().
+ *
+ * When $LTP_HUGEPOOL names a lease file created by "hugepool init", the
+ * pool is reserved once for the whole run: a lease only records the
+ * pid and the number of pages in the file, the pool is grown when the
+ * live leases do not leave enough pages free and is never shrunk until
+ * "hugepool fini" restores the original sizes.  Before the first lease
+ * on an idle pool the free, reserved and surplus counters are checked
+ * so pages leaked by an earlier test are reported.
+ *
+ * Without $LTP_HUGEPOOL the pool is resized to the requested number of
+ * pages and restored on release, as the tests always did.
+ */
+
+#ifndef __HUGEPOOL_H
+#define __HUGEPOOL_H
+
+#include <sys/types.h>
+
+#define PATH_HUGEPAGES	"/sys/kernel/mm/hugepages"
+#define HUGEPOOL_ENV	"LTP_HUGEPOOL"
+
+#define HUGEPOOL_MAX_SIZES	8
+#define HUGEPOOL_MAX_LEASES	256
+
+/*
+ * The lease file holds one "orig <kB> <nr>" line per managed huge page
+ * size, the pool size to restore on fini, and one
+ * "lease <pid> <start> <kB> <nr>" line per test holding pages, <start>
+ * being the start time of <pid> from /proc/<pid>/stat so that a reused
+ * pid does not keep the lease alive.
+ */
+struct hugepool_file {
+	int fd;
+	int norig;
+	struct {
+		long size_kb;
+		long nr;
+	} orig[HUGEPOOL_MAX_SIZES];
+	int nlease;
+	struct {
+		pid_t pid;
+		unsigned long long start;
+		long size_kb;
+		long nr;
+	} lease[HUGEPOOL_MAX_LEASES];
+};
+
+/*
+ * Lease nr_pages huge pages of size_kb (0 for the default huge page
+ * size), calling tst_brkm() with cleanup on failure.
+ */
+void hugepool_lease(long size_kb, long nr_pages, void (*cleanup)(void));
+
+/* Give back the lease taken by this process, if any. */
+void hugepool_release(void);
+
+/* The default huge page size in kB. */
+long hugepool_default_size(void (*cleanup)(void));
+
+/* Read or write one counter of the size_kb pool, e.g. "free_hugepages". */
+long hugepool_get(long size_kb, const char *item, void (*cleanup)(void));
+void hugepool_set(long size_kb, const char *item, long val,
+		  void (*cleanup)(void));
+
+/*
+ * Open and lock the lease file, dropping the leases of dead processes;
+ * hugepool_close() writes it back and unlocks it.
+ */
+void hugepool_open(struct hugepool_file *hf, const char *path, int flags,
+		   void (*cleanup)(void));
+void hugepool_close(struct hugepool_file *hf, void (*cleanup)(void));
+
+/* Pages of size_kb held by the leases in hf. */
+long hugepool_leased(struct hugepool_file *hf, long size_kb);
+
+#endif /* hugepool.h */
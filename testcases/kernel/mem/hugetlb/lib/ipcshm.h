@@ -56,7 +56,6 @@ void setup(void);
 
 char *nr_opt;
 int sflag;
-long orig_hugepages;
 void help(void);
 
 #endif /* ipcshm.h */
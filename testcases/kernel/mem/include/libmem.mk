@@ -24,7 +24,7 @@ LIBMEM_DIR		:= $(MEM_DIR)/lib
 LIBMEM			:= $(LIBMEM_DIR)/libmem.a
 FILTER_OUT_DIRS		:= $(LIBMEM_DIR)
 CFLAGS			+= -I$(MEM_SRCDIR)/include
-LDLIBS			+= $(NUMA_LIBS) -lmem -lltp
+LDLIBS			+= $(NUMA_LIBS) -lmem -lltp -lpthread
 LDFLAGS			+= -L$(LIBMEM_DIR)
 
 $(LIBMEM_DIR):
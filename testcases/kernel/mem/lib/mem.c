@@ -3,9 +3,12 @@
 #include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/wait.h>
+#include <sys/param.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #if HAVE_NUMA_H
 #include <numa.h>
 #endif
@@ -195,44 +198,104 @@ static void check(char *path, long int value)
 		tst_resm(TFAIL, "%s is not %ld.", path, value);
 }
 
-static void wait_ksmd_done(void)
+static long long now_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+
+static long read_sysfs_long(const char *dir, const char *name)
 {
-	long pages_shared, pages_sharing, pages_volatile, pages_unshared;
-	long old_pages_shared = 0, old_pages_sharing = 0;
-	long old_pages_volatile = 0, old_pages_unshared = 0;
-	int changing = 1, count = 0;
-
-	while (changing) {
-		sleep(10);
-		count++;
-
-		SAFE_FILE_SCANF(cleanup, PATH_KSM "pages_shared",
-				"%ld", &pages_shared);
-
-		SAFE_FILE_SCANF(cleanup, PATH_KSM "pages_sharing",
-				"%ld", &pages_sharing);
-
-		SAFE_FILE_SCANF(cleanup, PATH_KSM "pages_volatile",
-				"%ld", &pages_volatile);
-
-		SAFE_FILE_SCANF(cleanup, PATH_KSM "pages_unshared",
-				"%ld", &pages_unshared);
-
-		if (pages_shared != old_pages_shared ||
-		    pages_sharing != old_pages_sharing ||
-		    pages_volatile != old_pages_volatile ||
-		    pages_unshared != old_pages_unshared) {
-			old_pages_shared = pages_shared;
-			old_pages_sharing = pages_sharing;
-			old_pages_volatile = pages_volatile;
-			old_pages_unshared = pages_unshared;
+	char path[BUFSIZ];
+	long val;
+
+	snprintf(path, BUFSIZ, "%s%s", dir, name);
+	SAFE_FILE_SCANF(cleanup, path, "%ld", &val);
+
+	return val;
+}
+
+#define MAX_SCAN_COUNTERS	4
+
+/*
+ * Wait until a scanning daemon (ksmd or khugepaged) has converged:
+ * none of the counters in dir changed during the last two full scans,
+ * as reported by dir/full_scans. Two are needed because ksmd uses one
+ * scan to fill its unstable tree and the next one to merge.
+ *
+ * The poll interval starts at a quarter of expected_ms, the expected
+ * duration of one full scan, and backs off exponentially while nothing
+ * happens. If the daemon is not scanning, the counters only need to
+ * stay the same between two polls. Returns the time waited in ms.
+ */
+static long long wait_scans_done(const char *dir, const char *counters[],
+				 int nr, long long expected_ms, int scanning)
+{
+	long vals[MAX_SCAN_COUNTERS], old_vals[MAX_SCAN_COUNTERS];
+	long full_scans, stable_scans;
+	long long interval, max_interval, start, deadline;
+	int i;
+
+	start = now_ms();
+	for (i = 0; i < nr; i++)
+		old_vals[i] = read_sysfs_long(dir, counters[i]);
+	stable_scans = read_sysfs_long(dir, "full_scans");
+
+	interval = MAX(expected_ms / 4, 10);
+	max_interval = MAX(2 * expected_ms, 1000);
+	deadline = start + MAX(100 * expected_ms, 300000);
+
+	for (;;) {
+		usleep(interval * 1000);
+
+		for (i = 0; i < nr; i++)
+			vals[i] = read_sysfs_long(dir, counters[i]);
+		full_scans = read_sysfs_long(dir, "full_scans");
+
+		if (memcmp(vals, old_vals, nr * sizeof(long))) {
+			memcpy(old_vals, vals, nr * sizeof(long));
+			stable_scans = full_scans;
+			interval = MAX(expected_ms / 4, 10);
+		} else if (!scanning || full_scans >= stable_scans + 2) {
+			break;
 		} else {
-			changing = 0;
+			interval = MIN(interval * 2, max_interval);
 		}
+
+		if (now_ms() > deadline)
+			tst_brkm(TBROK, cleanup, "%s did not converge within "
+				 "%llds", dir, (deadline - start) / 1000);
 	}
 
-	tst_resm(TINFO, "ksm daemon takes %ds to scan all mergeable pages",
-		 count * 10);
+	return now_ms() - start;
+}
+
+static void wait_ksmd_done(void)
+{
+	static const char *counters[] = {
+		"pages_shared", "pages_sharing",
+		"pages_volatile", "pages_unshared",
+	};
+	long pages, pages_to_scan, sleep_millisecs;
+	long long expected_ms, waited;
+	int i;
+
+	pages_to_scan = read_sysfs_long(PATH_KSM, "pages_to_scan");
+	sleep_millisecs = read_sysfs_long(PATH_KSM, "sleep_millisecs");
+
+	/* ksmd handles pages_to_scan pages, then sleeps */
+	for (i = 0, pages = 0; i < 4; i++)
+		pages += read_sysfs_long(PATH_KSM, counters[i]);
+	expected_ms = (pages / MAX(pages_to_scan, 1) + 1) * (sleep_millisecs + 1);
+
+	/* while unmerging (run = 2) there are no scans to wait for */
+	waited = wait_scans_done(PATH_KSM, counters, 4, expected_ms,
+				 read_sysfs_long(PATH_KSM, "run") == 1);
+
+	tst_resm(TINFO, "ksm daemon takes %.2fs to scan all mergeable pages",
+		 waited / 1000.0);
 }
 
 static void group_check(int run, int pages_shared, int pages_sharing,
@@ -252,28 +315,204 @@ static void group_check(int run, int pages_shared, int pages_sharing,
 	check("pages_to_scan", pages_to_scan);
 }
 
+/*
+ * verify() checks that rows memory[start..end) hold value in the byte
+ * range [start2, end2). It compares against the constant word by word,
+ * so no second buffer is needed and the inner loop is vectorized by the
+ * compiler, and it reports mismatches as ranges rather than per byte.
+ * Large regions are split between threads.
+ */
+#define VERIFY_CHUNK		(256 * KB)
+#define VERIFY_MAX_RANGES	16
+#define VERIFY_THREAD_MIN	(64 * MB)
+#define VERIFY_MAX_THREADS	16
+
+struct verify_range {
+	int row;
+	size_t off;
+	size_t len;
+	char first;
+};
+
+struct verify_part {
+	char **memory;
+	char value;
+	int start;
+	int start2;
+	size_t rowlen;
+	size_t from, to;
+	struct verify_range ranges[VERIFY_MAX_RANGES];	/* the first ones */
+	struct verify_range tail;	/* the last one */
+	int nr_ranges;
+	unsigned long total_ranges;
+	size_t bad_bytes;
+};
+
+/* Return the offset of the first byte in p[0..len) which is not value. */
+static size_t first_mismatch(const char *p, size_t len, char value)
+{
+	unsigned long pattern, acc;
+	const unsigned long *w;
+	size_t i = 0, k;
+
+	memset(&pattern, value, sizeof(pattern));
+
+	while (i < len && ((unsigned long)(p + i) % sizeof(long)))
+		if (p[i++] != value)
+			return i - 1;
+
+	w = (const unsigned long *)(p + i);
+	while (len - i >= 8 * sizeof(long)) {
+		acc = 0;
+		for (k = 0; k < 8; k++)
+			acc |= w[k] ^ pattern;
+		if (acc)
+			break;
+		w += 8;
+		i += 8 * sizeof(long);
+	}
+
+	for (; i < len; i++)
+		if (p[i] != value)
+			return i;
+
+	return len;
+}
+
+static void verify_add_range(struct verify_part *vp, int row, size_t off,
+			     size_t len, char first)
+{
+	struct verify_range *tail = &vp->tail;
+
+	vp->bad_bytes += len;
+
+	/* continues the range found at the end of the previous chunk */
+	if (vp->total_ranges && tail->row == row &&
+	    tail->off + tail->len == off) {
+		tail->len += len;
+		if (vp->total_ranges == (unsigned long)vp->nr_ranges)
+			vp->ranges[vp->nr_ranges - 1].len += len;
+		return;
+	}
+
+	vp->total_ranges++;
+	tail->row = row;
+	tail->off = off;
+	tail->len = len;
+	tail->first = first;
+	if (vp->nr_ranges < VERIFY_MAX_RANGES)
+		vp->ranges[vp->nr_ranges++] = *tail;
+}
+
+static void *verify_part(void *arg)
+{
+	struct verify_part *vp = arg;
+	size_t pos, off, len, i, j;
+	const char *p;
+	int row;
+
+	for (pos = vp->from; pos < vp->to; pos += len) {
+		row = vp->start + pos / vp->rowlen;
+		off = pos % vp->rowlen;
+		len = MIN(MIN(vp->rowlen - off, vp->to - pos), VERIFY_CHUNK);
+		p = vp->memory[row] + vp->start2 + off;
+
+		for (i = 0; (i += first_mismatch(p + i, len - i, vp->value)) < len;
+		     i = j) {
+			for (j = i + 1; j < len && p[j] != vp->value; j++)
+				;
+			verify_add_range(vp, row, vp->start2 + off + i, j - i,
+					 p[i]);
+		}
+	}
+
+	return NULL;
+}
+
 static void verify(char **memory, char value, int proc,
 		    int start, int end, int start2, int end2)
 {
-	int i, j;
-	void *s = NULL;
-
-	s = malloc((end - start) * (end2 - start2));
-	if (s == NULL)
-		tst_brkm(TBROK | TERRNO, tst_exit, "malloc");
+	struct verify_part parts[VERIFY_MAX_THREADS], *vp;
+	struct verify_range shown[VERIFY_MAX_RANGES], run, *r;
+	pthread_t threads[VERIFY_MAX_THREADS];
+	size_t rowlen = end2 - start2, total = rowlen * (end - start);
+	unsigned long total_ranges = 0;
+	size_t bad_bytes = 0;
+	int i, j, nr_parts = 1, nr_shown = 0, started = 0;
+	int have_run = 0, run_shown = 0;
+	long ncpus;
 
 	tst_resm(TINFO, "child %d verifies memory content.", proc);
-	memset(s, value, (end - start) * (end2 - start2));
-	if (memcmp(memory[start], s, (end - start) * (end2 - start2))
-	    != 0)
-		for (j = start; j < end; j++)
-			for (i = start2; i < end2; i++)
-				if (memory[j][i] != value)
-					tst_resm(TFAIL, "child %d has %c at "
-						 "%d,%d,%d.",
-						 proc, memory[j][i], proc,
-						 j, i);
-	free(s);
+
+	if (total >= VERIFY_THREAD_MIN) {
+		ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nr_parts = MIN(MAX(ncpus, 1), VERIFY_MAX_THREADS);
+	}
+
+	for (i = 0; i < nr_parts; i++) {
+		vp = &parts[i];
+		memset(vp, 0, sizeof(*vp));
+		vp->memory = memory;
+		vp->value = value;
+		vp->start = start;
+		vp->start2 = start2;
+		vp->rowlen = rowlen;
+		vp->from = total / nr_parts * i;
+		vp->to = i == nr_parts - 1 ? total : total / nr_parts * (i + 1);
+	}
+
+	/* the first part is done by us, or all of them if threads fail */
+	for (i = 1; i < nr_parts; i++, started++)
+		if (pthread_create(&threads[i], NULL, verify_part, &parts[i]))
+			break;
+	verify_part(&parts[0]);
+	for (i = 1; i <= started; i++)
+		pthread_join(threads[i], NULL);
+	for (i = started + 1; i < nr_parts; i++)
+		verify_part(&parts[i]);
+
+	/*
+	 * run is the last range seen so far, whatever part it started in,
+	 * so a range split between any number of parts is one range.
+	 */
+	memset(&run, 0, sizeof(run));
+	for (i = 0; i < nr_parts; i++) {
+		vp = &parts[i];
+		total_ranges += vp->total_ranges;
+		bad_bytes += vp->bad_bytes;
+
+		for (j = 0; j < vp->nr_ranges; j++) {
+			r = &vp->ranges[j];
+			if (!j && have_run && run.row == r->row &&
+			    run.off + run.len == r->off) {
+				total_ranges--;
+				run.len += r->len;
+				if (run_shown)
+					shown[nr_shown - 1].len += r->len;
+				continue;
+			}
+			run = *r;
+			run_shown = nr_shown < VERIFY_MAX_RANGES;
+			if (run_shown)
+				shown[nr_shown++] = *r;
+		}
+		/* the ranges kept stop short of the part's last one */
+		if (vp->total_ranges > (unsigned long)vp->nr_ranges) {
+			run = vp->tail;
+			run_shown = 0;
+		}
+		have_run = vp->total_ranges != 0;
+	}
+
+	for (i = 0; i < nr_shown; i++)
+		tst_resm(TFAIL, "child %d has %zu bytes not '%c' (first '%c') "
+			 "at %d,%d,%zu.", proc, shown[i].len, value,
+			 shown[i].first, proc, shown[i].row, shown[i].off);
+
+	if (total_ranges > (unsigned long)nr_shown)
+		tst_resm(TFAIL, "child %d has %zu bytes not '%c' in %lu "
+			 "ranges, %lu not shown.", proc, bad_bytes, value,
+			 total_ranges, total_ranges - nr_shown);
 }
 
 void write_memcg(void)
@@ -648,42 +887,21 @@ static int alloc_transparent_hugepages(int nr_thps, int hg_aligned)
 
 static void khugepaged_scan_done(void)
 {
-	int changing = 1, count = 0, interval;
-	long old_pages_collapsed = 0, old_max_ptes_none = 0,
-		old_pages_to_scan = 0;
-	long pages_collapsed = 0, max_ptes_none = 0, pages_to_scan = 0;
+	static const char *counters[] = {
+		"pages_collapsed", "max_ptes_none", "pages_to_scan",
+	};
+	long long waited;
 
 	/*
-	 * as 'khugepaged' run 100% during testing, so 5s is an
-	 * enough interval for us to recognize if 'khugepaged'
-	 * finish scanning proceses' anonymous hugepages or not.
+	 * khugepaged scans pages_to_scan pages per scan_sleep_millisecs;
+	 * use one such pass as the first poll interval.
 	 */
-	interval = 5;
-
-	while (changing) {
-		sleep(interval);
-		count++;
-
-		SAFE_FILE_SCANF(cleanup, PATH_KHPD "pages_collapsed",
-			       "%ld", &pages_collapsed);
-		SAFE_FILE_SCANF(cleanup, PATH_KHPD "max_ptes_none",
-			       "%ld", &max_ptes_none);
-		SAFE_FILE_SCANF(cleanup, PATH_KHPD "pages_to_scan",
-			       "%ld", &pages_to_scan);
-
-		if (pages_collapsed != old_pages_collapsed ||
-		    max_ptes_none != old_max_ptes_none ||
-		    pages_to_scan != old_pages_to_scan) {
-			old_pages_collapsed = pages_collapsed;
-			old_max_ptes_none = max_ptes_none;
-			old_pages_to_scan = pages_to_scan;
-		} else {
-			changing = 0;
-		}
-	}
+	waited = wait_scans_done(PATH_KHPD, counters, 3,
+				 read_sysfs_long(PATH_KHPD,
+						 "scan_sleep_millisecs") + 1, 1);
 
-	tst_resm(TINFO, "khugepaged daemon takes %ds to scan all thp pages",
-		 count * interval);
+	tst_resm(TINFO, "khugepaged daemon takes %.2fs to scan all thp pages",
+		 waited / 1000.0);
 }
 
 static void verify_thp_size(int *children, int nr_children, int nr_thps)
@@ -1012,25 +1230,36 @@ int path_exist(const char *path, ...)
 	return access(pathbuf, F_OK) == 0;
 }
 
+/*
+ * /proc/meminfo is kept open and re-read with pread(), and the item is
+ * looked up in place instead of sscanf()ing every line.
+ */
 long read_meminfo(char *item)
 {
-	FILE *fp;
-	char line[BUFSIZ], buf[BUFSIZ];
-	long val;
+	static int fd = -1;
+	static char buf[8192];
+	size_t len = strlen(item);
+	char *line;
+	ssize_t n;
 
-	fp = fopen(PATH_MEMINFO, "r");
-	if (fp == NULL)
-		tst_brkm(TBROK | TERRNO, cleanup, "fopen %s", PATH_MEMINFO);
+	if (fd == -1) {
+		fd = open(PATH_MEMINFO, O_RDONLY);
+		if (fd == -1)
+			tst_brkm(TBROK | TERRNO, cleanup, "open %s",
+				 PATH_MEMINFO);
+	}
 
-	while (fgets(line, BUFSIZ, fp) != NULL) {
-		if (sscanf(line, "%64s %ld", buf, &val) == 2)
-			if (strcmp(buf, item) == 0) {
-				fclose(fp);
-				return val;
-			}
-		continue;
+	n = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (n <= 0)
+		tst_brkm(TBROK | TERRNO, cleanup, "read %s", PATH_MEMINFO);
+	buf[n] = '\0';
+
+	for (line = buf; line; line = strchr(line, '\n')) {
+		if (*line == '\n')
+			line++;
+		if (strncmp(line, item, len) == 0)
+			return strtol(line + len, NULL, 10);
 	}
-	fclose(fp);
 
 	tst_brkm(TBROK, cleanup, "cannot find \"%s\" in %s",
 		 item, PATH_MEMINFO);
@@ -0,0 +1,513 @@
+/*
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ *  Page fault throughput benchmark, derived from mmapstress01.
+ *
+ *  Where mmapstress01 has children map a shared file and check random
+ *  pages, this has N workers, threads sharing one mm or processes with
+ *  one each, repeatedly map a region, touch every page of it and unmap
+ *  it again, and reports how fast the faults go.  The region is a
+ *  slice of a shared file or anonymous memory, mapped shared or
+ *  private, optionally with MAP_POPULATE, MAP_HUGETLB or a madvise()
+ *  hint.
+ *
+ *  Besides the totals it reports the fault latency percentiles, the
+ *  time spent in mmap, faulting and munmap, the context switches taken
+ *  while faulting and the faults per cpu.  With threads, mmap and
+ *  munmap take mmap_lock for writing while the faults of the other
+ *  threads take it for reading, so a long fault tail, voluntary
+ *  context switches and slow mmap/munmap point at mmap_lock; when the
+ *  kernel has lock_stat the mmap_lock contentions are printed too.
+ *
+ *  usage:
+ *	mmapfault-bench [-P] [-t workers] [-s size] [-i cycles] [-A]
+ *			[-p] [-r] [-F] [-H] [-M advice] [-c] [-d dir]
+ */
+
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "tst_clock.h"
+#include "tst_hist.h"
+
+#define CPU_SAMPLE	64	/* pages between sched_getcpu() samples */
+#define MAX_LOCKS	16	/* mmap_lock classes taken from lock_stat */
+
+struct worker {
+	pthread_t tid;
+	int id;
+	unsigned long minflt;
+	unsigned long majflt;
+	unsigned long nvcsw;
+	unsigned long nivcsw;
+	unsigned long long mmap_ns;
+	unsigned long long fault_ns;
+	unsigned long long munmap_ns;
+	struct tst_hist hist;		/* of the pages touched outside populate */
+	int error;
+};
+
+struct lock_class {
+	char name[64];
+	unsigned long long contentions;
+	double wait_us;
+};
+
+static int nworkers = 1;
+static int use_procs;
+static size_t size = 64 << 20;	/* per worker */
+static int cycles = 10;
+static int anon;
+static int map_private;
+static int read_only;
+static int populate;
+static int hugetlb;
+static int advice = -1;
+static const char *advice_name;
+static int pin;
+static char *dir = ".";
+
+static int fd = -1;
+static size_t page_size;
+static int nr_cpus;
+static struct worker *workers;		/* shared with worker processes */
+static unsigned long *cpu_pages;	/* [worker][cpu], ditto */
+static int gate[2];			/* closed to start the workers */
+
+static const struct {
+	const char *name;
+	int advice;
+} advices[] = {
+	{"normal", MADV_NORMAL},
+	{"random", MADV_RANDOM},
+	{"sequential", MADV_SEQUENTIAL},
+	{"willneed", MADV_WILLNEED},
+#ifdef MADV_HUGEPAGE
+	{"hugepage", MADV_HUGEPAGE},
+	{"nohugepage", MADV_NOHUGEPAGE},
+#endif
+};
+
+static size_t huge_page_size(void)
+{
+	FILE *fp;
+	char line[128];
+	unsigned long kb = 0;
+
+	fp = fopen("/proc/meminfo", "r");
+	if (fp == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), fp))
+		if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1)
+			break;
+	fclose(fp);
+	return kb << 10;
+}
+
+/*
+ * Snapshot the lock_stat classes of mmap_lock (mmap_sem on older
+ * kernels).  Returns the number of classes, 0 without lock_stat.
+ */
+static int read_lock_stat(struct lock_class *lc)
+{
+	FILE *fp;
+	char line[512], name[64];
+	unsigned long long bounces, contentions;
+	double wmin, wmax, wtotal;
+	int n = 0;
+
+	fp = fopen("/proc/lock_stat", "r");
+	if (fp == NULL)
+		return 0;
+	while (n < MAX_LOCKS && fgets(line, sizeof(line), fp)) {
+		if (!strstr(line, "mmap_lock") && !strstr(line, "mmap_sem"))
+			continue;
+		if (sscanf(line, " %63s %llu %llu %lf %lf %lf", name, &bounces,
+			   &contentions, &wmin, &wmax, &wtotal) != 6)
+			continue;
+		strcpy(lc[n].name, name);
+		lc[n].contentions = contentions;
+		lc[n].wait_us = wtotal;
+		n++;
+	}
+	fclose(fp);
+	return n;
+}
+
+static void touch(struct worker *w, char *addr, size_t stride)
+{
+	unsigned long *cpus = &cpu_pages[w->id * nr_cpus];
+	unsigned long long t0;
+	size_t off;
+	unsigned long i;
+	volatile char c;
+	int cpu = 0;
+
+	for (off = 0, i = 0; off < size; off += stride, i++) {
+		if (i % CPU_SAMPLE == 0) {
+			cpu = sched_getcpu();
+			if (cpu < 0 || cpu >= nr_cpus)
+				cpu = 0;
+		}
+		t0 = tst_clock_ns();
+		if (read_only)
+			c = addr[off];
+		else
+			addr[off] = 1;
+		tst_hist_add(&w->hist, tst_clock_ns() - t0);
+		cpus[cpu]++;
+	}
+	(void)c;
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+	struct rusage ru0, ru1;
+	unsigned long long t0, t1, t2, t3;
+	size_t stride = hugetlb ? huge_page_size() : page_size;
+	int prot = read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+	int flags = map_private ? MAP_PRIVATE : MAP_SHARED;
+	cpu_set_t set;
+	char *addr;
+	char c;
+	int i;
+
+	if (anon)
+		flags |= MAP_ANONYMOUS;
+	if (populate)
+		flags |= MAP_POPULATE;
+	if (hugetlb)
+		flags |= MAP_HUGETLB;
+
+	if (pin) {
+		CPU_ZERO(&set);
+		CPU_SET(w->id % nr_cpus, &set);
+		sched_setaffinity(0, sizeof(set), &set);
+	}
+
+	/* wait for the gate to close so all workers start together */
+	if (read(gate[0], &c, 1) != 0) {
+		w->error = EINVAL;
+		return NULL;
+	}
+
+	getrusage(RUSAGE_THREAD, &ru0);
+	for (i = 0; i < cycles; i++) {
+		t0 = tst_clock_ns();
+		addr = mmap(NULL, size, prot, flags, anon ? -1 : fd,
+			    anon ? 0 : (off_t)w->id * size);
+		if (addr == MAP_FAILED) {
+			w->error = errno;
+			return NULL;
+		}
+		if (advice != -1 && madvise(addr, size, advice)) {
+			w->error = errno;
+			munmap(addr, size);
+			return NULL;
+		}
+		t1 = tst_clock_ns();
+		if (!populate)
+			touch(w, addr, stride);
+		t2 = tst_clock_ns();
+		munmap(addr, size);
+		t3 = tst_clock_ns();
+		w->mmap_ns += t1 - t0;
+		w->fault_ns += t2 - t1;
+		w->munmap_ns += t3 - t2;
+	}
+	getrusage(RUSAGE_THREAD, &ru1);
+
+	w->minflt = ru1.ru_minflt - ru0.ru_minflt;
+	w->majflt = ru1.ru_majflt - ru0.ru_majflt;
+	w->nvcsw = ru1.ru_nvcsw - ru0.ru_nvcsw;
+	w->nivcsw = ru1.ru_nivcsw - ru0.ru_nivcsw;
+	return NULL;
+}
+
+static void *shared_alloc(size_t len)
+{
+	void *p;
+
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+		 -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	return p;
+}
+
+static void report(double secs, struct lock_class *lc0, int nlc0)
+{
+	struct lock_class lc1[MAX_LOCKS];
+	struct tst_hist hist;
+	unsigned long minflt = 0, majflt = 0, nvcsw = 0, nivcsw = 0;
+	unsigned long long mmap_ns = 0, fault_ns = 0, munmap_ns = 0;
+	unsigned long cpu;
+	int i, j, nlc1;
+
+	memset(&hist, 0, sizeof(hist));
+	for (i = 0; i < nworkers; i++) {
+		tst_hist_merge(&hist, &workers[i].hist);
+		minflt += workers[i].minflt;
+		majflt += workers[i].majflt;
+		nvcsw += workers[i].nvcsw;
+		nivcsw += workers[i].nivcsw;
+		mmap_ns += workers[i].mmap_ns;
+		fault_ns += workers[i].fault_ns;
+		munmap_ns += workers[i].munmap_ns;
+	}
+
+	printf("%10s %8s %10s %10s %8s %9s %9s %9s %9s\n", "faults", "secs",
+	       "faults/s", "pages/s", "majflt", "p50(us)", "p99(us)",
+	       "p99.9(us)", "max(us)");
+	printf("%10lu %8.3f %10.0f %10.0f %8lu %9.2f %9.2f %9.2f %9.2f\n",
+	       minflt + majflt, secs, secs > 0 ? (minflt + majflt) / secs : 0.0,
+	       secs > 0 ? hist.count / secs : 0.0, majflt,
+	       tst_hist_usecs(&hist, 0.5), tst_hist_usecs(&hist, 0.99),
+	       tst_hist_usecs(&hist, 0.999), hist.max_ns / 1000.0);
+
+	printf("\ntime per worker and cycle (us): mmap %.1f, fault %.1f, "
+	       "munmap %.1f\n", mmap_ns / 1000.0 / nworkers / cycles,
+	       fault_ns / 1000.0 / nworkers / cycles,
+	       munmap_ns / 1000.0 / nworkers / cycles);
+	printf("context switches: %lu voluntary, %lu involuntary\n",
+	       nvcsw, nivcsw);
+
+	printf("\n%4s %10s %10s\n", "cpu", "pages", "pages/s");
+	for (j = 0; j < nr_cpus; j++) {
+		for (cpu = 0, i = 0; i < nworkers; i++)
+			cpu += cpu_pages[i * nr_cpus + j];
+		if (cpu)
+			printf("%4d %10lu %10.0f\n", j, cpu,
+			       secs > 0 ? cpu / secs : 0.0);
+	}
+
+	nlc1 = read_lock_stat(lc1);
+	if (nlc1 == 0)
+		return;
+	printf("\n%-32s %12s %14s\n", "lock_stat class", "contentions",
+	       "wait(us)");
+	for (j = 0; j < nlc1; j++) {
+		for (i = 0; i < nlc0; i++) {
+			if (!strcmp(lc0[i].name, lc1[j].name)) {
+				lc1[j].contentions -= lc0[i].contentions;
+				lc1[j].wait_us -= lc0[i].wait_us;
+				break;
+			}
+		}
+		printf("%-32s %12llu %14.2f\n", lc1[j].name,
+		       lc1[j].contentions, lc1[j].wait_us);
+	}
+}
+
+static void usage(char *prog)
+{
+	unsigned int i;
+
+	printf("%s [-P] [-t workers] [-s size] [-i cycles] [-A] [-p] [-r] "
+	       "[-F] [-H] [-M advice] [-c] [-d dir]\n", prog);
+	printf("  -P          processes instead of threads\n");
+	printf("  -t workers  number of workers (default 1)\n");
+	printf("  -s size     bytes mapped by each worker, k, m or g "
+	       "suffix (default 64m)\n");
+	printf("  -i cycles   map, touch, unmap cycles per worker "
+	       "(default 10)\n");
+	printf("  -A          anonymous memory instead of a file\n");
+	printf("  -p          MAP_PRIVATE instead of MAP_SHARED\n");
+	printf("  -r          read faults instead of write faults\n");
+	printf("  -F          MAP_POPULATE, the faults happen in mmap\n");
+	printf("  -H          MAP_HUGETLB, needs -A and reserved huge "
+	       "pages\n");
+	printf("  -M advice   madvise() the mapping:");
+	for (i = 0; i < sizeof(advices) / sizeof(advices[0]); i++)
+		printf(" %s", advices[i].name);
+	printf("\n  -c          pin worker n to cpu n %% cpus\n");
+	printf("  -d dir      directory of the mapped file (default .)\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct lock_class lc0[MAX_LOCKS];
+	char filename[4096];
+	unsigned long long start, stop;
+	unsigned int j;
+	char *end;
+	pid_t *pids = NULL;
+	int c, i, nlc0, status, failed = 0;
+
+	while ((c = getopt(argc, argv, "Pt:s:i:AprFHM:cd:")) != -1) {
+		switch (c) {
+		case 'P':
+			use_procs = 1;
+			break;
+		case 't':
+			nworkers = atoi(optarg);
+			break;
+		case 's':
+			size = strtoull(optarg, &end, 0);
+			if (*end == 'k' || *end == 'K')
+				size <<= 10;
+			else if (*end == 'm' || *end == 'M')
+				size <<= 20;
+			else if (*end == 'g' || *end == 'G')
+				size <<= 30;
+			break;
+		case 'i':
+			cycles = atoi(optarg);
+			break;
+		case 'A':
+			anon = 1;
+			break;
+		case 'p':
+			map_private = 1;
+			break;
+		case 'r':
+			read_only = 1;
+			break;
+		case 'F':
+			populate = 1;
+			break;
+		case 'H':
+			hugetlb = 1;
+			break;
+		case 'M':
+			for (j = 0; j < sizeof(advices) / sizeof(advices[0]); j++)
+				if (!strcmp(optarg, advices[j].name))
+					break;
+			if (j == sizeof(advices) / sizeof(advices[0]))
+				usage(argv[0]);
+			advice = advices[j].advice;
+			advice_name = advices[j].name;
+			break;
+		case 'c':
+			pin = 1;
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || nworkers < 1 || cycles < 1 || size == 0 ||
+	    (hugetlb && !anon))
+		usage(argv[0]);
+
+	page_size = sysconf(_SC_PAGE_SIZE);
+	nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	if (hugetlb && huge_page_size() == 0) {
+		fprintf(stderr, "no huge page size in /proc/meminfo\n");
+		exit(1);
+	}
+	size = (size + (hugetlb ? huge_page_size() : page_size) - 1) &
+	    ~((hugetlb ? huge_page_size() : page_size) - 1);
+
+	if (!anon) {
+		snprintf(filename, sizeof(filename), "%s/mmapfault.%d", dir,
+			 getpid());
+		fd = open(filename, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd == -1) {
+			perror(filename);
+			exit(1);
+		}
+		unlink(filename);
+		if (ftruncate(fd, (off_t)size * nworkers) == -1) {
+			perror("ftruncate");
+			exit(1);
+		}
+	}
+
+	workers = shared_alloc(nworkers * sizeof(*workers));
+	cpu_pages = shared_alloc(nworkers * nr_cpus * sizeof(*cpu_pages));
+	if (pipe(gate)) {
+		perror("pipe");
+		exit(1);
+	}
+
+	for (i = 0; i < nworkers; i++) {
+		workers[i].id = i;
+		if (use_procs) {
+			if (pids == NULL &&
+			    (pids = calloc(nworkers, sizeof(*pids))) == NULL) {
+				perror("malloc");
+				exit(1);
+			}
+			pids[i] = fork();
+			if (pids[i] == -1) {
+				perror("fork");
+				exit(1);
+			}
+			if (pids[i] == 0) {
+				close(gate[1]);
+				worker(&workers[i]);
+				_exit(0);
+			}
+		} else {
+			errno = pthread_create(&workers[i].tid, NULL, worker,
+					       &workers[i]);
+			if (errno) {
+				perror("pthread_create");
+				exit(1);
+			}
+		}
+	}
+
+	printf("%d %s, %s %s mapping of %zu kB each, %d cycles, %s faults%s%s"
+	       "%s%s\n", nworkers, use_procs ? "processes" : "threads",
+	       map_private ? "private" : "shared",
+	       anon ? "anonymous" : "file", size >> 10, cycles,
+	       read_only ? "read" : "write", populate ? ", populate" : "",
+	       hugetlb ? ", hugetlb" : "", advice_name ? ", madvise " : "",
+	       advice_name ? advice_name : "");
+	fflush(stdout);
+
+	nlc0 = read_lock_stat(lc0);
+	start = tst_clock_ns();
+	close(gate[1]);
+	for (i = 0; i < nworkers; i++) {
+		if (use_procs)
+			waitpid(pids[i], &status, 0);
+		else
+			pthread_join(workers[i].tid, NULL);
+	}
+	stop = tst_clock_ns();
+
+	for (i = 0; i < nworkers; i++) {
+		if (workers[i].error) {
+			fprintf(stderr, "worker %d: %s\n", i,
+				strerror(workers[i].error));
+			failed = 1;
+		}
+	}
+	report((stop - start) / 1e9, lc0, nlc0);
+
+	return failed;
+}
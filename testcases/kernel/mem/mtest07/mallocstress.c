@@ -60,6 +60,12 @@
 /* Description:	This program stresses the VMM and C library                   */
 /*              by spawning N threads which                                   */
 /*              malloc blocks of increasing size until malloc returns NULL.   */
+/*									      */
+/*		With -b SECS it instead benchmarks the allocator: each thread */
+/*		churns a set of live blocks (or, with -x, hands them to a     */
+/*		partner thread to free) for SECS seconds, and the per-thread  */
+/*		allocs/sec, peak RSS and allocator overhead are reported.     */
+/*		Run it under LD_PRELOAD to compare allocators.                */
 /******************************************************************************/
 #include <stdio.h>
 #include <pthread.h>
@@ -69,6 +75,9 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/sem.h>
@@ -91,6 +100,40 @@
 int num_loop = MAXL;		/* number of loops to perform                     */
 int semid;
 
+#define NSLOTS	1024		/* live blocks per thread in benchmark mode   */
+#define RINGSZ	4096		/* blocks in flight between a -x thread pair  */
+#define SCHEME_MAX (1 << 20)	/* growth schemes restart above this size     */
+#define SAMPLE_MS 100		/* RSS sampling period                        */
+
+enum { DIST_SCHEME, DIST_SMALL, DIST_MIXED, DIST_LARGE, NDISTS };
+static const char *dist_names[NDISTS] = { "scheme", "small", "mixed", "large" };
+
+struct ring {
+	size_t *slot[RINGSZ];
+	unsigned long head __attribute__ ((aligned(64)));	/* producer */
+	unsigned long tail __attribute__ ((aligned(64)));	/* consumer */
+	int done;		/* producer pushed its last block             */
+};
+
+struct bench_thread {
+	pthread_t tid;
+	int id;
+	uint64_t rnd;		/* xorshift state                             */
+	size_t size;		/* growth scheme state                        */
+	size_t oldsize;
+	unsigned long allocs;
+	unsigned long frees;
+	long live;		/* bytes this thread allocated minus freed    */
+	double secs;
+	struct ring *ring;	/* -x: shared with the partner thread         */
+	int failed;
+};
+
+static int bench_dist = DIST_SCHEME;
+static int bench_cross;		/* -x: producer/consumer thread pairs         */
+static volatile int bench_stop;
+static pthread_barrier_t bench_start;
+
 /* Define SPEW_SIGNALS to tickle thread_create bug (it fails if interrupted). */
 #define SPEW_SIGNALS
 
@@ -133,10 +176,16 @@ static void my_yield()
 static void usage(char *progname)
 {				/* name of this program                       */
 	fprintf(stderr,
-		"Usage: %s -d NUMDIR -f NUMFILES -h -t NUMTHRD\n"
+		"Usage: %s [-h] [-l NUMLOOPS] [-t NUMTHRD] [-b SECS [-d DIST] [-x]]\n"
 		"\t -h Help!\n"
 		"\t -l Number of loops:               Default: 1000\n"
-		"\t -t Number of threads to generate: Default: 30\n", progname);
+		"\t -t Number of threads to generate: Default: 30\n"
+		"\t -b Benchmark the allocator for SECS seconds\n"
+		"\t    (threads default to the number of online CPUs)\n"
+		"\t -d Block sizes: scheme, small, mixed or large\n"
+		"\t    Default: scheme (the growth schemes of the stress test)\n"
+		"\t -x Free every block in the partner thread of a pair\n",
+		progname);
 	exit(-1);
 }
 
@@ -272,6 +321,305 @@ void *alloc_mem(void *threadnum)
 	return (void *)(uintptr_t) (err ? -1 : 0);
 }
 
+/******************************************************************************/
+/* Function:	next_size						      */
+/*									      */
+/* Description:	Size of the next block in benchmark mode. "scheme" replays    */
+/*		the growth scheme allocate_free() would use for this thread,  */
+/*		"small" is 16..256 bytes, "mixed" is 70% up to 128 bytes, 25% */
+/*		up to 4KB and 5% up to 256KB, and "large" is 64KB..4MB, on    */
+/*		both sides of the usual mmap threshold.                       */
+/******************************************************************************/
+static uint64_t xorshift(uint64_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+static size_t next_size(struct bench_thread *t)
+{
+	uint64_t r = xorshift(&t->rnd);
+	size_t size, lo, hi;
+
+	switch (bench_dist) {
+	case DIST_SCHEME:
+		size = t->size;
+		switch (t->id % 4) {
+		case 0:
+			t->size = size + t->oldsize;
+			t->oldsize = size;
+			break;
+		case 1:
+			t->size = size * 2;
+			break;
+		case 2:
+			t->size = size * 3;
+			break;
+		default:
+			t->size = size * 5;
+			break;
+		}
+		if (t->size > SCHEME_MAX) {
+			t->size = 2 * sizeof(size_t);
+			t->oldsize = 5;
+		}
+		return size;
+	case DIST_SMALL:
+		return 16 + (r % 31) * 8;
+	case DIST_MIXED:
+		if (r % 100 < 70)
+			lo = 16, hi = 128;
+		else if (r % 100 < 95)
+			lo = 128, hi = 4096;
+		else
+			lo = 4096, hi = 256 << 10;
+		return lo + (r >> 8) % (hi - lo);
+	default:
+		return (64 << 10) + (r >> 8) % ((4 << 20) - (64 << 10));
+	}
+}
+
+/*
+ * Blocks carry their size and its complement in the first two words, so
+ * the freeing thread can account for them and catch corruption; one byte
+ * per page is touched so that RSS follows the live set.
+ */
+static size_t *bench_alloc(struct bench_thread *t)
+{
+	size_t size = next_size(t);
+	size_t *p, off;
+
+	p = malloc(size);
+	if (p == NULL) {
+		t->failed = 1;
+		return NULL;
+	}
+	p[0] = size;
+	p[1] = ~size;
+	for (off = 4096; off < size; off += 4096)
+		((char *)p)[off] = 1;
+	t->allocs++;
+	__atomic_store_n(&t->live, t->live + size, __ATOMIC_RELAXED);
+	return p;
+}
+
+static void bench_free(struct bench_thread *t, size_t *p)
+{
+	size_t size = p[0];
+
+	if (p[1] != ~size) {
+		fprintf(stderr, "thread [%d]: fail: bad block header\n", t->id);
+		t->failed = 1;
+		return;
+	}
+	free(p);
+	t->frees++;
+	__atomic_store_n(&t->live, t->live - size, __ATOMIC_RELAXED);
+}
+
+static void bench_local(struct bench_thread *t)
+{
+	size_t *slots[NSLOTS];
+	int i;
+
+	memset(slots, 0, sizeof(slots));
+	while (!bench_stop && !t->failed) {
+		i = xorshift(&t->rnd) % NSLOTS;
+		if (slots[i])
+			bench_free(t, slots[i]);
+		slots[i] = bench_alloc(t);
+	}
+	for (i = 0; i < NSLOTS; i++)
+		if (slots[i])
+			bench_free(t, slots[i]);
+}
+
+static void bench_producer(struct bench_thread *t)
+{
+	struct ring *r = t->ring;
+	unsigned long head = 0;
+	size_t *p;
+
+	while (!bench_stop && !t->failed) {
+		if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)
+		    == RINGSZ) {
+			sched_yield();
+			continue;
+		}
+		if ((p = bench_alloc(t)) == NULL)
+			break;
+		r->slot[head % RINGSZ] = p;
+		__atomic_store_n(&r->head, ++head, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&r->done, 1, __ATOMIC_RELEASE);
+}
+
+static void bench_consumer(struct bench_thread *t)
+{
+	struct ring *r = t->ring;
+	unsigned long tail = 0;
+	int done;
+
+	for (;;) {
+		done = __atomic_load_n(&r->done, __ATOMIC_ACQUIRE);
+		if (tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) {
+			if (done)
+				break;
+			sched_yield();
+			continue;
+		}
+		bench_free(t, r->slot[tail % RINGSZ]);
+		__atomic_store_n(&r->tail, ++tail, __ATOMIC_RELEASE);
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *bench_thread_main(void *arg)
+{
+	struct bench_thread *t = arg;
+	double start;
+
+	pthread_barrier_wait(&bench_start);
+	start = now();
+	if (!bench_cross)
+		bench_local(t);
+	else if (t->id % 2 == 0)
+		bench_producer(t);
+	else
+		bench_consumer(t);
+	t->secs = now() - start;
+	return NULL;
+}
+
+/* a "Key:   value kB" field of a /proc file in bytes, -1 if missing */
+static long proc_kb(const char *path, const char *key)
+{
+	char line[256];
+	size_t len = strlen(key);
+	long val = -1;
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, key, len)) {
+			val = atol(line + len) * 1024;
+			break;
+		}
+	fclose(f);
+	return val;
+}
+
+static long read_rss(void)
+{
+	long rss = proc_kb("/proc/self/smaps_rollup", "Rss:");
+
+	return rss >= 0 ? rss : proc_kb("/proc/self/status", "VmRSS:");
+}
+
+/******************************************************************************/
+/* Function:	benchmark						      */
+/*									      */
+/* Description:	Run num_thrd benchmark threads for secs seconds while the     */
+/*		main thread samples RSS against the bytes the threads hold.   */
+/*		The overhead reported is the RSS above the pre-run baseline   */
+/*		that is not live data, at the sample with the highest RSS.    */
+/*									      */
+/* Return:	-1 on failure						      */
+/*		 0 on success						      */
+/******************************************************************************/
+static int benchmark(int num_thrd, int secs)
+{
+	struct bench_thread *th;
+	struct ring *rings = NULL;
+	const struct timespec period = { 0, SAMPLE_MS * 1000000L };
+	const char *preload = getenv("LD_PRELOAD");
+	long base_rss, rss, live, peak_rss = 0, peak_live = 0, hwm;
+	double end, total_allocs = 0, total_frees = 0;
+	int i, ret = 0;
+
+	th = calloc(num_thrd, sizeof(*th));
+	if (bench_cross)
+		rings = calloc(num_thrd / 2, sizeof(*rings));
+	if (th == NULL || (bench_cross && rings == NULL)) {
+		perror("benchmark(): calloc()");
+		return -1;
+	}
+	pthread_barrier_init(&bench_start, NULL, num_thrd + 1);
+
+	for (i = 0; i < num_thrd; i++) {
+		th[i].id = i;
+		th[i].rnd = 0x9e3779b97f4a7c15ULL * (i + 1);
+		th[i].size = 2 * sizeof(size_t);
+		th[i].oldsize = 5;
+		if (bench_cross)
+			th[i].ring = &rings[i / 2];
+		errno = pthread_create(&th[i].tid, NULL, bench_thread_main,
+				       &th[i]);
+		if (errno) {
+			perror("benchmark(): pthread_create()");
+			exit(-1);
+		}
+	}
+
+	base_rss = read_rss();
+	pthread_barrier_wait(&bench_start);
+	for (end = now() + secs; now() < end;) {
+		nanosleep(&period, NULL);
+		rss = read_rss();
+		/* consumers before their producers, so live is not undercounted */
+		for (live = 0, i = num_thrd - 1; i >= 0; i--)
+			live += __atomic_load_n(&th[i].live, __ATOMIC_RELAXED);
+		if (rss > peak_rss) {
+			peak_rss = rss;
+			peak_live = live;
+		}
+	}
+	bench_stop = 1;
+	for (i = 0; i < num_thrd; i++)
+		pthread_join(th[i].tid, NULL);
+	hwm = proc_kb("/proc/self/status", "VmHWM:");
+
+	printf("%d threads, %s sizes, %s frees, %d s, allocator %s\n",
+	       num_thrd, dist_names[bench_dist],
+	       bench_cross ? "cross-thread" : "local", secs,
+	       preload && *preload ? preload : "default");
+	printf("%6s %-9s %12s %12s\n", "thread", "role", "allocs/s",
+	       "frees/s");
+	for (i = 0; i < num_thrd; i++) {
+		printf("%6d %-9s %12.0f %12.0f\n", i,
+		       !bench_cross ? "local" :
+		       i % 2 == 0 ? "producer" : "consumer",
+		       th[i].allocs / th[i].secs, th[i].frees / th[i].secs);
+		total_allocs += th[i].allocs / th[i].secs;
+		total_frees += th[i].frees / th[i].secs;
+		if (th[i].failed)
+			ret = -1;
+	}
+	printf("%6s %-9s %12.0f %12.0f\n", "total", "", total_allocs,
+	       total_frees);
+	printf("peak RSS %ld kB (VmHWM %ld kB, baseline %ld kB), "
+	       "live %ld kB, overhead %.1f%%\n", peak_rss / 1024, hwm / 1024,
+	       base_rss / 1024, peak_live / 1024,
+	       peak_rss - base_rss > 0 ? 100.0 * (peak_rss - base_rss -
+						  peak_live) /
+	       (peak_rss - base_rss) : 0.0);
+
+	pthread_barrier_destroy(&bench_start);
+	free(rings);
+	free(th);
+	return ret;
+}
+
 /******************************************************************************/
 /*								 	      */
 /* Function:	main							      */
@@ -293,13 +641,15 @@ int main(int argc,		/* number of input parameters                 */
 {				/* pointer to the command line arguments.     */
 	int c;			/* command line options                       */
 	int num_thrd = MAXT;	/* number of threads to create                */
+	int thrd_set = 0;	/* -t was given                               */
+	int bench_secs = 0;	/* -b: benchmark for this many seconds        */
 	int thrd_ndx;		/* index into the array of thread ids         */
 	pthread_t *thrdid;	/* the threads                                */
 	extern int optopt;	/* options to the program                     */
 	struct sembuf sop[1];
 	int ret = 0;
 
-	while ((c = getopt(argc, argv, "hl:t:")) != -1) {
+	while ((c = getopt(argc, argv, "hl:t:b:d:x")) != -1) {
 		switch (c) {
 		case 'h':
 			usage(argv[0]);
@@ -321,6 +671,21 @@ int main(int argc,		/* number of input parameters                 */
 					"WARNING: bad argument. Using default\n");
 				num_thrd = MAXT;
 			}
+			thrd_set = 1;
+			break;
+		case 'b':
+			if ((bench_secs = atoi(optarg)) < 1)
+				usage(argv[0]);
+			break;
+		case 'd':
+			for (bench_dist = 0; bench_dist < NDISTS; bench_dist++)
+				if (!strcmp(optarg, dist_names[bench_dist]))
+					break;
+			if (bench_dist == NDISTS)
+				usage(argv[0]);
+			break;
+		case 'x':
+			bench_cross = 1;
 			break;
 		default:
 			usage(argv[0]);
@@ -328,6 +693,14 @@ int main(int argc,		/* number of input parameters                 */
 		}
 	}
 
+	if (bench_secs) {
+		if (!thrd_set)
+			num_thrd = sysconf(_SC_NPROCESSORS_ONLN);
+		if (bench_cross && num_thrd % 2)
+			num_thrd++;
+		exit(benchmark(num_thrd, bench_secs));
+	}
+
 	dprt(("number of times to loop in the thread = %d\n", num_loop));
 
 	thrdid = malloc(sizeof(pthread_t) * num_thrd);
@@ -0,0 +1,570 @@
+/*
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ *  Transparent hugepage benchmark.
+ *
+ *  thp01-thp05 only check that THPs show up once khugepaged has done
+ *  its full scans.  This measures how fast they show up:
+ *
+ *  collapse mode (default) maps a region with small pages, madvise()s
+ *  it MADV_HUGEPAGE and samples the AnonHugePages of smaps_rollup and
+ *  the khugepaged and vmstat counters every interval until the whole
+ *  region is collapsed.  Lists of pages_to_scan and
+ *  scan_sleep_millisecs values are run one combination after the
+ *  other.
+ *
+ *  fault mode (-f) faults a MADV_HUGEPAGE region in one huge page at a
+ *  time, after optionally fragmenting memory by freeing every other
+ *  small page of a -F sized buffer, and samples how many of the faults
+ *  got a THP (thp_fault_alloc against thp_fault_fallback) along with
+ *  their latency.
+ *
+ *  Every sample is printed as a "series" row and every run ends with a
+ *  "summary" row; the "#" lines name the columns and the kernel, so the
+ *  output of two kernels can be diffed or plotted as is.  The sysfs
+ *  settings changed by -S, -W and -D are restored on exit.
+ *
+ *  usage:
+ *	thp-bench [-s size] [-S pages_to_scan,...] [-W scan_sleep_ms,...]
+ *		  [-I interval_ms] [-T timeout] [-D defrag] [-f] [-F size]
+ *		  [-b batch]
+ */
+
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/utsname.h>
+#include "tst_clock.h"
+#include "tst_hist.h"
+#include "tst_size.h"
+
+#define PATH_THP	"/sys/kernel/mm/transparent_hugepage/"
+#define PATH_KHPD	PATH_THP "khugepaged/"
+
+#define MAX_VALUES	16	/* entries of a -S or -W list */
+
+enum vmstat_item {
+	VM_FAULT_ALLOC,
+	VM_FAULT_FALLBACK,
+	VM_COLLAPSE_ALLOC,
+	VM_COLLAPSE_FAILED,
+	NR_VMSTAT,
+};
+
+static const char *vmstat_names[NR_VMSTAT] = {
+	"thp_fault_alloc", "thp_fault_fallback",
+	"thp_collapse_alloc", "thp_collapse_alloc_failed",
+};
+
+/* a sysfs setting, written back on exit if we changed it */
+struct knob {
+	const char *path;
+	char orig[128];
+	int saved;
+};
+
+static struct knob knobs[] = {
+	{PATH_KHPD "pages_to_scan", "", 0},
+	{PATH_KHPD "scan_sleep_millisecs", "", 0},
+	{PATH_THP "defrag", "", 0},
+};
+
+#define KNOB_SCAN	(&knobs[0])
+#define KNOB_SLEEP	(&knobs[1])
+#define KNOB_DEFRAG	(&knobs[2])
+
+static size_t size = 256 << 20;
+static long scan_list[MAX_VALUES];
+static int nscan;
+static long sleep_list[MAX_VALUES];
+static int nsleep;
+static int interval_ms = 100;
+static int timeout = 60;
+static char *defrag;
+static int fault_mode;
+static size_t frag_size;
+static int batch = 16;
+
+static size_t hpage_size;
+static size_t page_size;
+
+static volatile sig_atomic_t caught_sig;
+
+static int read_file(const char *path, char *buf, size_t len)
+{
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return -1;
+	if (fgets(buf, len, fp) == NULL)
+		buf[0] = '\0';
+	fclose(fp);
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
+}
+
+static long read_long(const char *path)
+{
+	char buf[64];
+
+	if (read_file(path, buf, sizeof(buf)) == -1) {
+		perror(path);
+		exit(1);
+	}
+	return atol(buf);
+}
+
+static void write_knob(struct knob *k, const char *val)
+{
+	FILE *fp;
+
+	if (!k->saved) {
+		if (read_file(k->path, k->orig, sizeof(k->orig)) == -1) {
+			perror(k->path);
+			exit(1);
+		}
+		k->saved = 1;
+	}
+	fp = fopen(k->path, "w");
+	if (fp == NULL || fprintf(fp, "%s", val) < 0 || fclose(fp) == EOF) {
+		perror(k->path);
+		exit(1);
+	}
+}
+
+static void write_knob_long(struct knob *k, long val)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%ld", val);
+	write_knob(k, buf);
+}
+
+static void restore_knobs(void)
+{
+	unsigned int i;
+	char *val, *end;
+	FILE *fp;
+
+	for (i = 0; i < sizeof(knobs) / sizeof(knobs[0]); i++) {
+		if (!knobs[i].saved)
+			continue;
+		/* defrag reads back as "always [madvise] never" */
+		val = strchr(knobs[i].orig, '[');
+		if (val != NULL && (end = strchr(val, ']')) != NULL) {
+			val++;
+			*end = '\0';
+		} else {
+			val = knobs[i].orig;
+		}
+		fp = fopen(knobs[i].path, "w");
+		if (fp == NULL || fprintf(fp, "%s", val) < 0 ||
+		    fclose(fp) == EOF)
+			perror(knobs[i].path);
+		knobs[i].saved = 0;
+	}
+}
+
+/* restore_knobs() is not async-signal-safe, so only note the signal */
+static void sig_catch(int sig)
+{
+	caught_sig = sig;
+}
+
+/* called from the main loops: restore and die of a signal caught */
+static void check_signal(void)
+{
+	int sig = caught_sig;
+
+	if (!sig)
+		return;
+	restore_knobs();
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+static void read_vmstat(unsigned long long *vals)
+{
+	FILE *fp;
+	char line[128], name[64];
+	unsigned long long val;
+	int i;
+
+	memset(vals, 0, NR_VMSTAT * sizeof(*vals));
+	fp = fopen("/proc/vmstat", "r");
+	if (fp == NULL) {
+		perror("/proc/vmstat");
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%63s %llu", name, &val) != 2)
+			continue;
+		for (i = 0; i < NR_VMSTAT; i++)
+			if (!strcmp(name, vmstat_names[i]))
+				vals[i] = val;
+	}
+	fclose(fp);
+}
+
+/*
+ * AnonHugePages of this process in kB, from smaps_rollup when the
+ * kernel has it and summed over smaps otherwise.
+ */
+static long anon_huge_kb(void)
+{
+	static int no_rollup;
+	FILE *fp = NULL;
+	char line[256];
+	long kb, total = 0;
+
+	if (!no_rollup && (fp = fopen("/proc/self/smaps_rollup", "r")) == NULL)
+		no_rollup = 1;
+	if (fp == NULL && (fp = fopen("/proc/self/smaps", "r")) == NULL) {
+		perror("/proc/self/smaps");
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), fp))
+		if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+			total += kb;
+	fclose(fp);
+	return total;
+}
+
+/* an anonymous mapping of len bytes aligned to a huge page */
+static char *map_aligned(size_t len)
+{
+	char *p;
+	size_t off;
+
+	p = mmap(NULL, len + hpage_size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	off = (hpage_size - (unsigned long)p % hpage_size) % hpage_size;
+	if (off)
+		munmap(p, off);
+	munmap(p + off + len, hpage_size - off);
+	return p + off;
+}
+
+static void do_madvise(char *p, size_t len, int advice, const char *name)
+{
+	if (madvise(p, len, advice) == -1) {
+		fprintf(stderr, "madvise(%s): %s\n", name, strerror(errno));
+		exit(1);
+	}
+}
+
+static void collapse_run(long pages_to_scan, long scan_sleep)
+{
+	unsigned long long vm0[NR_VMSTAT], vm[NR_VMSTAT];
+	unsigned long long start, t, last_t, t50 = 0, t90 = 0, t100 = 0;
+	long collapsed0, scans0, kb0, kb, last_kb, target_kb;
+	double rate, peak = 0;
+	size_t off;
+	char *p;
+
+	if (nscan)
+		write_knob_long(KNOB_SCAN, pages_to_scan);
+	if (nsleep)
+		write_knob_long(KNOB_SLEEP, scan_sleep);
+
+	p = map_aligned(size);
+	do_madvise(p, size, MADV_NOHUGEPAGE, "nohugepage");
+	for (off = 0; off < size; off += page_size)
+		p[off] = 1;
+
+	target_kb = size >> 10;
+	kb0 = anon_huge_kb();
+	collapsed0 = read_long(PATH_KHPD "pages_collapsed");
+	scans0 = read_long(PATH_KHPD "full_scans");
+	read_vmstat(vm0);
+
+	start = last_t = tst_clock_ns();
+	last_kb = 0;
+	do_madvise(p, size, MADV_HUGEPAGE, "hugepage");
+	do {
+		usleep(interval_ms * 1000);
+		check_signal();
+		t = tst_clock_ns();
+		kb = anon_huge_kb() - kb0;
+		read_vmstat(vm);
+
+		rate = (kb - last_kb) / (double)(hpage_size >> 10) /
+		    ((t - last_t) / 1e9);
+		if (rate > peak)
+			peak = rate;
+		if (!t50 && kb * 2 >= target_kb)
+			t50 = t - start;
+		if (!t90 && kb * 10 >= target_kb * 9)
+			t90 = t - start;
+		if (kb >= target_kb)
+			t100 = t - start;
+
+		printf("series %ld %ld %.3f %ld %.1f %.1f %ld %ld %llu\n",
+		       pages_to_scan, scan_sleep, (t - start) / 1e9, kb,
+		       100.0 * kb / target_kb, rate,
+		       read_long(PATH_KHPD "pages_collapsed") - collapsed0,
+		       read_long(PATH_KHPD "full_scans") - scans0,
+		       vm[VM_COLLAPSE_FAILED] - vm0[VM_COLLAPSE_FAILED]);
+		fflush(stdout);
+		last_t = t;
+		last_kb = kb;
+	} while (kb < target_kb && t - start < timeout * 1000000000ULL);
+
+	printf("summary %ld %ld %.3f %.3f %.3f %.1f %.1f %.1f %llu %llu\n",
+	       pages_to_scan, scan_sleep, t50 ? t50 / 1e9 : -1.0,
+	       t90 ? t90 / 1e9 : -1.0, t100 ? t100 / 1e9 : -1.0,
+	       100.0 * kb / target_kb,
+	       kb / (double)(hpage_size >> 10) / ((t - start) / 1e9), peak,
+	       vm[VM_COLLAPSE_ALLOC] - vm0[VM_COLLAPSE_ALLOC],
+	       vm[VM_COLLAPSE_FAILED] - vm0[VM_COLLAPSE_FAILED]);
+	fflush(stdout);
+
+	munmap(p, size);
+}
+
+static void collapse_mode(void)
+{
+	int i, j;
+
+	if (!nscan)
+		scan_list[nscan++] = read_long(PATH_KHPD "pages_to_scan");
+	if (!nsleep)
+		sleep_list[nsleep++] = read_long(PATH_KHPD
+						 "scan_sleep_millisecs");
+
+	printf("# series pages_to_scan scan_sleep_ms t_s anon_huge_kB "
+	       "collapsed_pct thp_per_s pages_collapsed full_scans "
+	       "collapse_failed\n");
+	printf("# summary pages_to_scan scan_sleep_ms t50_s t90_s t100_s "
+	       "collapsed_pct mean_thp_per_s peak_thp_per_s collapse_alloc "
+	       "collapse_failed\n");
+	for (i = 0; i < nscan; i++)
+		for (j = 0; j < nsleep; j++)
+			collapse_run(scan_list[i], sleep_list[j]);
+}
+
+/*
+ * Touch all of a buffer with small pages and give back every other
+ * page, so that its free memory is scattered in single pages that
+ * the buddy allocator cannot merge into huge pages.
+ */
+static char *fragment(void)
+{
+	size_t off;
+	char *p;
+
+	p = map_aligned(frag_size);
+	do_madvise(p, frag_size, MADV_NOHUGEPAGE, "nohugepage");
+	for (off = 0; off < frag_size; off += page_size)
+		p[off] = 1;
+	for (off = 0; off < frag_size; off += 2 * page_size)
+		do_madvise(p + off, page_size, MADV_DONTNEED, "dontneed");
+	return p;
+}
+
+static void fault_mode_run(void)
+{
+	struct tst_hist hist, bhist;	/* all faults, the current batch */
+	unsigned long long vm0[NR_VMSTAT], vm[NR_VMSTAT], last[NR_VMSTAT];
+	unsigned long long start, t0, ns;
+	unsigned long long alloc, fallback;
+	unsigned long i, nr = size / hpage_size;
+	char *p, *frag = NULL;
+
+	if (frag_size)
+		frag = fragment();
+
+	printf("# series faults t_s thp_alloc thp_fallback success_pct "
+	       "p50_us p99_us max_us\n");
+	printf("# summary faults secs thp_alloc thp_fallback success_pct "
+	       "p50_us p90_us p99_us max_us\n");
+
+	p = map_aligned(size);
+	do_madvise(p, size, MADV_HUGEPAGE, "hugepage");
+	memset(&hist, 0, sizeof(hist));
+	memset(&bhist, 0, sizeof(bhist));
+
+	read_vmstat(vm0);
+	memcpy(last, vm0, sizeof(last));
+	start = tst_clock_ns();
+	for (i = 0; i < nr; i++) {
+		check_signal();
+		t0 = tst_clock_ns();
+		p[i * hpage_size] = 1;
+		ns = tst_clock_ns() - t0;
+		tst_hist_add(&hist, ns);
+		tst_hist_add(&bhist, ns);
+		if (bhist.count < (unsigned long long)batch && i + 1 < nr)
+			continue;
+
+		read_vmstat(vm);
+		alloc = vm[VM_FAULT_ALLOC] - last[VM_FAULT_ALLOC];
+		fallback = vm[VM_FAULT_FALLBACK] - last[VM_FAULT_FALLBACK];
+		printf("series %lu %.3f %llu %llu %.1f %.1f %.1f %.1f\n",
+		       i + 1, (tst_clock_ns() - start) / 1e9, alloc, fallback,
+		       alloc + fallback ? 100.0 * alloc / (alloc + fallback)
+		       : 0.0, tst_hist_usecs(&bhist, 0.5),
+		       tst_hist_usecs(&bhist, 0.99), bhist.max_ns / 1000.0);
+		memcpy(last, vm, sizeof(last));
+		memset(&bhist, 0, sizeof(bhist));
+	}
+
+	read_vmstat(vm);
+	alloc = vm[VM_FAULT_ALLOC] - vm0[VM_FAULT_ALLOC];
+	fallback = vm[VM_FAULT_FALLBACK] - vm0[VM_FAULT_FALLBACK];
+	printf("summary %lu %.3f %llu %llu %.1f %.1f %.1f %.1f %.1f\n", nr,
+	       (tst_clock_ns() - start) / 1e9, alloc, fallback,
+	       alloc + fallback ? 100.0 * alloc / (alloc + fallback) : 0.0,
+	       tst_hist_usecs(&hist, 0.5), tst_hist_usecs(&hist, 0.9),
+	       tst_hist_usecs(&hist, 0.99), hist.max_ns / 1000.0);
+
+	munmap(p, size);
+	if (frag)
+		munmap(frag, frag_size);
+}
+
+static int parse_list(char *arg, long *list)
+{
+	char *tok;
+	int n = 0;
+
+	for (tok = strtok(arg, ","); tok && n < MAX_VALUES;
+	     tok = strtok(NULL, ","))
+		list[n++] = atol(tok);
+	return n;
+}
+
+static void usage(char *prog)
+{
+	printf("%s [-s size] [-S pages_to_scan,...] [-W scan_sleep_ms,...] "
+	       "[-I interval_ms] [-T timeout] [-D defrag] [-f] [-F size] "
+	       "[-b batch]\n", prog);
+	printf("  -s size     region to collapse or fault, k, m or g suffix "
+	       "(default 256m)\n");
+	printf("  -S list     khugepaged pages_to_scan values to run "
+	       "(default current)\n");
+	printf("  -W list     khugepaged scan_sleep_millisecs values to run "
+	       "(default current)\n");
+	printf("  -I ms       sampling interval of collapse mode "
+	       "(default 100)\n");
+	printf("  -T secs     give up collapsing after secs (default 60)\n");
+	printf("  -D defrag   set transparent_hugepage/defrag for the run\n");
+	printf("  -f          fault mode instead of collapse mode\n");
+	printf("  -F size     fragment a buffer of size before faulting\n");
+	printf("  -b batch    huge page faults per fault mode sample "
+	       "(default 16)\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct utsname uts;
+	unsigned long long val;
+	char buf[128];
+	int c;
+
+	while ((c = getopt(argc, argv, "s:S:W:I:T:D:fF:b:")) != -1) {
+		switch (c) {
+		case 's':
+			if (tst_parse_size(optarg, &val))
+				usage(argv[0]);
+			size = val;
+			break;
+		case 'S':
+			nscan = parse_list(optarg, scan_list);
+			break;
+		case 'W':
+			nsleep = parse_list(optarg, sleep_list);
+			break;
+		case 'I':
+			interval_ms = atoi(optarg);
+			break;
+		case 'T':
+			timeout = atoi(optarg);
+			break;
+		case 'D':
+			defrag = optarg;
+			break;
+		case 'f':
+			fault_mode = 1;
+			break;
+		case 'F':
+			if (tst_parse_size(optarg, &val))
+				usage(argv[0]);
+			frag_size = val;
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || interval_ms < 1 || timeout < 1 || batch < 1)
+		usage(argv[0]);
+
+	if (read_file(PATH_THP "enabled", buf, sizeof(buf)) == -1) {
+		fprintf(stderr, "transparent hugepages are not supported\n");
+		exit(1);
+	}
+	if (strstr(buf, "[never]")) {
+		fprintf(stderr, "transparent hugepages are disabled\n");
+		exit(1);
+	}
+	hpage_size = read_long(PATH_THP "hpage_pmd_size");
+	page_size = sysconf(_SC_PAGE_SIZE);
+	size = (size + hpage_size - 1) & ~(hpage_size - 1);
+	frag_size = (frag_size + hpage_size - 1) & ~(hpage_size - 1);
+	if (size == 0)
+		usage(argv[0]);
+
+	atexit(restore_knobs);
+	signal(SIGINT, sig_catch);
+	signal(SIGTERM, sig_catch);
+	if (defrag)
+		write_knob(KNOB_DEFRAG, defrag);
+
+	uname(&uts);
+	printf("# thp-bench %s %s, %s mode, %zu kB region, %zu kB huge "
+	       "pages\n", uts.release, uts.machine,
+	       fault_mode ? "fault" : "collapse", size >> 10,
+	       hpage_size >> 10);
+	read_file(PATH_THP "defrag", buf, sizeof(buf));
+	printf("# defrag %s", buf);
+	if (fault_mode)
+		printf(", %zu kB fragmented\n", frag_size >> 10);
+	else
+		printf(", interval %d ms\n", interval_ms);
+
+	if (fault_mode)
+		fault_mode_run();
+	else
+		collapse_mode();
+
+	return 0;
+}
@@ -0,0 +1,552 @@
+/*
+ * zram compression throughput benchmark
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ *  Where zram01 fills a zram device once and prints its counters, this
+ *  sets the device up for every combination of the given
+ *  comp_algorithm and max_comp_streams values and runs up to three
+ *  phases against it with O_DIRECT i/o:
+ *
+ *	write	writer threads fill their slices of the device
+ *	read	reader threads read the slices back and check them
+ *	mixed	writers rewrite and readers read random blocks for -M secs
+ *
+ *  Each block is filled so that the given percentage of every page is
+ *  random and the rest zeroes, which makes the data roughly
+ *  100 / percent compressible.  Every phase prints its MB/s, IOPS and
+ *  latency percentiles; after the write phase mm_stat gives the
+ *  compression ratio and the memory zram really used for the data.
+ *
+ *  The device is hot added and removed again unless -d names an
+ *  existing, unused one, which is reset on exit.  max_comp_streams is
+ *  ignored by kernels with per-cpu streams and absent on recent ones.
+ *
+ *  usage:
+ *	zram-bench [-a alg,...] [-m streams,...] [-s size] [-b bsize]
+ *		   [-w writers] [-r readers] [-c percent] [-M secs] [-d dev]
+ */
+
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include "tst_clock.h"
+#include "tst_hist.h"
+#include "tst_size.h"
+
+#define PATH_ZRAM_CTL	"/sys/class/zram-control/"
+#define MAX_VALUES	16	/* entries of a -a or -m list */
+#define PAGE		4096	/* compressibility is set per 4k page */
+#define DATA_PAGES	256	/* distinct pages each worker cycles through */
+
+enum phase {
+	PH_WRITE,
+	PH_READ,
+	PH_MIXED,
+};
+
+struct worker {
+	pthread_t tid;
+	int id;
+	int writer;
+	off_t start;			/* slice of the device */
+	off_t len;
+	unsigned int seed;
+	char *buf;			/* DATA_PAGES pages of test data */
+	char *rbuf;
+	unsigned long errors;
+	struct tst_hist hist;		/* one sample per block */
+};
+
+static char *algs[MAX_VALUES];
+static int nalgs;
+static long streams[MAX_VALUES];
+static int nstreams;
+static off_t size = 256 << 20;
+static size_t bsize = PAGE;
+static int nwriters = 1;
+static int nreaders = 1;
+static int percent = 50;
+static int mixed_secs;
+static int dev_id = -1;
+
+static int hot_added;
+static char zram_path[64];		/* /sys/block/zramN/ */
+static char dev_path[64];
+static int fd = -1;
+static enum phase cur_phase;
+static volatile int stop;
+static volatile sig_atomic_t caught_sig;
+
+static int read_attr(const char *name, char *buf, size_t len)
+{
+	char path[128];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s%s", zram_path, name);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return -1;
+	if (fgets(buf, len, fp) == NULL)
+		buf[0] = '\0';
+	fclose(fp);
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
+}
+
+static int write_attr(const char *name, const char *val)
+{
+	char path[128];
+	int afd, ret = 0;
+
+	snprintf(path, sizeof(path), "%s%s", zram_path, name);
+	afd = open(path, O_WRONLY);
+	if (afd == -1)
+		return -1;
+	if (write(afd, val, strlen(val)) != (ssize_t)strlen(val))
+		ret = -1;
+	close(afd);
+	return ret;
+}
+
+static void must_write_attr(const char *name, const char *val)
+{
+	if (write_attr(name, val) == -1) {
+		fprintf(stderr, "write %s to %s%s: %s\n", val, zram_path,
+			name, strerror(errno));
+		exit(1);
+	}
+}
+
+static void teardown(void)
+{
+	char buf[16];
+
+	if (fd != -1) {
+		close(fd);
+		fd = -1;
+	}
+	if (zram_path[0] == '\0')
+		return;
+	write_attr("reset", "1");
+	if (hot_added) {
+		snprintf(buf, sizeof(buf), "%d", dev_id);
+		snprintf(zram_path, sizeof(zram_path), PATH_ZRAM_CTL);
+		write_attr("hot_remove", buf);
+		hot_added = 0;
+	}
+	zram_path[0] = '\0';
+}
+
+/*
+ * Resetting the device under the workers' I/O is no good, so the handler
+ * only stops them; the main thread tears down once they are joined.
+ */
+static void sig_stop(int sig)
+{
+	caught_sig = sig;
+	stop = 1;
+}
+
+static void check_signal(void)
+{
+	int sig = caught_sig;
+
+	if (!sig)
+		return;
+	teardown();
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+/* hot add a device, or use -d, and make sure its node exists */
+static void setup_device(void)
+{
+	char buf[64];
+	unsigned int major, minor;
+	struct stat st;
+
+	if (dev_id == -1) {
+		snprintf(zram_path, sizeof(zram_path), PATH_ZRAM_CTL);
+		if (read_attr("hot_add", buf, sizeof(buf)) == -1) {
+			fprintf(stderr, "no %s, is zram loaded?\n",
+				PATH_ZRAM_CTL);
+			exit(1);
+		}
+		dev_id = atoi(buf);
+		hot_added = 1;
+	}
+	snprintf(zram_path, sizeof(zram_path), "/sys/block/zram%d/", dev_id);
+	snprintf(dev_path, sizeof(dev_path), "/dev/zram%d", dev_id);
+
+	if (read_attr("initstate", buf, sizeof(buf)) == -1) {
+		fprintf(stderr, "no zram%d device\n", dev_id);
+		exit(1);
+	}
+	if (!hot_added && atoi(buf)) {
+		fprintf(stderr, "zram%d is in use\n", dev_id);
+		exit(1);
+	}
+
+	if (stat(dev_path, &st) == -1) {
+		if (read_attr("dev", buf, sizeof(buf)) == -1 ||
+		    sscanf(buf, "%u:%u", &major, &minor) != 2 ||
+		    mknod(dev_path, S_IFBLK | 0600, makedev(major, minor))) {
+			perror(dev_path);
+			exit(1);
+		}
+	}
+}
+
+/* the algorithms the device offers, "lzo [lz4] zstd" */
+static int available_algs(char *list, char **names)
+{
+	char *tok;
+	int n = 0;
+
+	for (tok = strtok(list, " []"); tok && n < MAX_VALUES;
+	     tok = strtok(NULL, " []"))
+		names[n++] = strdup(tok);
+	return n;
+}
+
+static void fill_data(struct worker *w)
+{
+	size_t rnd = PAGE * percent / 100;
+	size_t i, j;
+
+	for (i = 0; i < DATA_PAGES; i++) {
+		for (j = 0; j < rnd; j++)
+			w->buf[i * PAGE + j] = rand_r(&w->seed);
+		memset(w->buf + i * PAGE + rnd, 0, PAGE - rnd);
+	}
+}
+
+static off_t random_block(struct worker *w)
+{
+	off_t nblocks = size / bsize;
+	off_t b = ((off_t)rand_r(&w->seed) << 31 | rand_r(&w->seed)) %
+	    nblocks;
+
+	return b * bsize;
+}
+
+/*
+ * Blocks take their data from the worker's pages by block number, so
+ * a reader knows what every block of its slice should hold.
+ */
+static char *block_data(struct worker *w, off_t off)
+{
+	return w->buf + off / bsize % (DATA_PAGES * PAGE / bsize) * bsize;
+}
+
+static void do_block(struct worker *w, off_t off, int writer)
+{
+	unsigned long long t0, ns;
+	ssize_t ret;
+
+	t0 = tst_clock_ns();
+	if (writer)
+		ret = pwrite(fd, block_data(w, off), bsize, off);
+	else
+		ret = pread(fd, w->rbuf, bsize, off);
+	ns = tst_clock_ns() - t0;
+
+	if (ret != (ssize_t)bsize ||
+	    (!writer && cur_phase == PH_READ &&
+	     memcmp(w->rbuf, block_data(w, off), bsize)))
+		w->errors++;
+	tst_hist_add(&w->hist, ns);
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+	off_t off;
+
+	if (cur_phase == PH_MIXED) {
+		while (!stop)
+			do_block(w, random_block(w), w->writer);
+		return NULL;
+	}
+	for (off = w->start; off < w->start + w->len && !stop; off += bsize)
+		do_block(w, off, cur_phase == PH_WRITE);
+	return NULL;
+}
+
+/*
+ * orig_data_size, compr_data_size and mem_used_total in bytes, from
+ * mm_stat or the separate files of older kernels.
+ */
+static void read_mm_stat(unsigned long long *orig, unsigned long long *compr,
+			 unsigned long long *used)
+{
+	char buf[256];
+
+	*orig = *compr = *used = 0;
+	if (read_attr("mm_stat", buf, sizeof(buf)) == 0) {
+		sscanf(buf, "%llu %llu %llu", orig, compr, used);
+		return;
+	}
+	if (read_attr("orig_data_size", buf, sizeof(buf)) == 0)
+		*orig = strtoull(buf, NULL, 0);
+	if (read_attr("compr_data_size", buf, sizeof(buf)) == 0)
+		*compr = strtoull(buf, NULL, 0);
+	if (read_attr("mem_used_total", buf, sizeof(buf)) == 0)
+		*used = strtoull(buf, NULL, 0);
+}
+
+static void run_phase(struct worker *workers, int nw, enum phase ph,
+		      const char *alg, const char *nstr)
+{
+	static const char *names[] = {"write", "read", "mixed"};
+	struct tst_hist hist;
+	unsigned long errors = 0;
+	unsigned long long start;
+	unsigned long long orig, compr, used;
+	sigset_t sigs, oldsigs;
+	double secs;
+	int i;
+
+	cur_phase = ph;
+	stop = 0;
+	check_signal();
+	for (i = 0; i < nw; i++) {
+		memset(&workers[i].hist, 0, sizeof(workers[i].hist));
+		workers[i].errors = 0;
+	}
+
+	/* the workers block the signals, so that they wake the main thread */
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &sigs, &oldsigs);
+	start = tst_clock_ns();
+	for (i = 0; i < nw; i++) {
+		errno = pthread_create(&workers[i].tid, NULL, worker,
+				       &workers[i]);
+		if (errno) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+	if (ph == PH_MIXED) {
+		sleep(mixed_secs);
+		stop = 1;
+	}
+	for (i = 0; i < nw; i++)
+		pthread_join(workers[i].tid, NULL);
+	secs = (tst_clock_ns() - start) / 1e9;
+	check_signal();
+
+	memset(&hist, 0, sizeof(hist));
+	for (i = 0; i < nw; i++) {
+		tst_hist_merge(&hist, &workers[i].hist);
+		errors += workers[i].errors;
+	}
+	read_mm_stat(&orig, &compr, &used);
+
+	printf("%-8s %7s %-6s %7d %9.1f %9.0f %8.1f %8.1f %8.1f %9.1f "
+	       "%6.2f %6.2f %6lu\n", alg, nstr, names[ph], nw,
+	       hist.count * (double)bsize / (1 << 20) / secs,
+	       hist.count / secs, tst_hist_usecs(&hist, 0.5),
+	       tst_hist_usecs(&hist, 0.99), tst_hist_usecs(&hist, 0.999),
+	       hist.max_ns / 1000.0,
+	       compr ? (double)orig / compr : 0.0,
+	       used ? (double)orig / used : 0.0, errors);
+	fflush(stdout);
+}
+
+static void run_config(const char *alg, long nstreams_val)
+{
+	struct worker *workers;
+	char nstr[24] = "-";
+	char buf[32];
+	off_t slice;
+	int i, nw = nwriters + nreaders;
+
+	must_write_attr("reset", "1");
+	if (write_attr("comp_algorithm", alg) == -1) {
+		fprintf(stderr, "%s: %s\n", alg, strerror(errno));
+		return;
+	}
+	if (nstreams_val > 0) {
+		snprintf(buf, sizeof(buf), "%ld", nstreams_val);
+		if (write_attr("max_comp_streams", buf) == 0)
+			snprintf(nstr, sizeof(nstr), "%ld", nstreams_val);
+	}
+	snprintf(buf, sizeof(buf), "%lld", (long long)size);
+	must_write_attr("disksize", buf);
+
+	fd = open(dev_path, O_RDWR | O_DIRECT);
+	if (fd == -1) {
+		perror(dev_path);
+		exit(1);
+	}
+
+	workers = calloc(nw, sizeof(*workers));
+	if (workers == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	/* the writers own the slices, the readers check one each */
+	slice = size / nwriters / bsize * bsize;
+	for (i = 0; i < nw; i++) {
+		workers[i].id = i;
+		workers[i].writer = i < nwriters;
+		workers[i].seed = i % nwriters + 1;
+		workers[i].start = i % nwriters * slice;
+		workers[i].len = slice;
+		if (posix_memalign((void **)&workers[i].buf, PAGE,
+				   DATA_PAGES * PAGE) ||
+		    posix_memalign((void **)&workers[i].rbuf, PAGE, bsize)) {
+			perror("posix_memalign");
+			exit(1);
+		}
+		fill_data(&workers[i]);
+	}
+
+	run_phase(workers, nwriters, PH_WRITE, alg, nstr);
+	/* the readers are the workers after the writers */
+	if (nreaders)
+		run_phase(workers + nwriters, nreaders, PH_READ, alg, nstr);
+	if (mixed_secs)
+		run_phase(workers, nw, PH_MIXED, alg, nstr);
+
+	for (i = 0; i < nw; i++) {
+		free(workers[i].buf);
+		free(workers[i].rbuf);
+	}
+	free(workers);
+	close(fd);
+	fd = -1;
+}
+
+static void usage(char *prog)
+{
+	printf("%s [-a alg,...] [-m streams,...] [-s size] [-b bsize] "
+	       "[-w writers] [-r readers] [-c percent] [-M secs] "
+	       "[-d dev]\n", prog);
+	printf("  -a list     comp_algorithm values (default all the "
+	       "device offers)\n");
+	printf("  -m list     max_comp_streams values (default left "
+	       "alone)\n");
+	printf("  -s size     disksize, k, m or g suffix (default 256m)\n");
+	printf("  -b bsize    i/o size, a multiple of 4k (default 4k)\n");
+	printf("  -w writers  writer threads (default 1)\n");
+	printf("  -r readers  reader threads, at most writers (default 1)\n");
+	printf("  -c percent  random bytes per page, the rest is zero "
+	       "(default 50)\n");
+	printf("  -M secs     run a mixed phase of secs (default none)\n");
+	printf("  -d dev      use the unused /dev/zram<dev> instead of "
+	       "hot adding one\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long long val;
+	char buf[256];
+	char *tok;
+	int c, i, j;
+
+	while ((c = getopt(argc, argv, "a:m:s:b:w:r:c:M:d:")) != -1) {
+		switch (c) {
+		case 'a':
+			for (tok = strtok(optarg, ","); tok && nalgs <
+			     MAX_VALUES; tok = strtok(NULL, ","))
+				algs[nalgs++] = tok;
+			break;
+		case 'm':
+			for (tok = strtok(optarg, ","); tok && nstreams <
+			     MAX_VALUES; tok = strtok(NULL, ","))
+				streams[nstreams++] = atol(tok);
+			break;
+		case 's':
+			if (tst_parse_size(optarg, &val))
+				usage(argv[0]);
+			size = val;
+			break;
+		case 'b':
+			if (tst_parse_size(optarg, &val))
+				usage(argv[0]);
+			bsize = val;
+			break;
+		case 'w':
+			nwriters = atoi(optarg);
+			break;
+		case 'r':
+			nreaders = atoi(optarg);
+			break;
+		case 'c':
+			percent = atoi(optarg);
+			break;
+		case 'M':
+			mixed_secs = atoi(optarg);
+			break;
+		case 'd':
+			dev_id = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || bsize == 0 || bsize % PAGE ||
+	    bsize > DATA_PAGES * PAGE || nwriters < 1 || nreaders < 0 ||
+	    nreaders > nwriters || percent < 0 || percent > 100 ||
+	    mixed_secs < 0 || size / nwriters < (off_t)bsize)
+		usage(argv[0]);
+
+	atexit(teardown);
+	signal(SIGINT, sig_stop);
+	signal(SIGTERM, sig_stop);
+	setup_device();
+
+	if (nalgs == 0) {
+		if (read_attr("comp_algorithm", buf, sizeof(buf)) == -1) {
+			perror("comp_algorithm");
+			exit(1);
+		}
+		nalgs = available_algs(buf, algs);
+	}
+	if (nstreams == 0)
+		streams[nstreams++] = 0;
+
+	printf("# zram%d, %lld kB disk, %zu byte i/o, %d%% random data, "
+	       "%d writers, %d readers\n", dev_id, (long long)size >> 10,
+	       bsize, percent, nwriters, nreaders);
+	printf("%-8s %7s %-6s %7s %9s %9s %8s %8s %8s %9s %6s %6s %6s\n",
+	       "alg", "streams", "phase", "threads", "MB/s", "IOPS",
+	       "p50(us)", "p99(us)", "p99.9(us)", "max(us)", "ratio",
+	       "mem", "errors");
+	for (i = 0; i < nalgs; i++)
+		for (j = 0; j < nstreams; j++) {
+			run_config(algs[i], streams[j]);
+			check_signal();
+		}
+
+	return 0;
+}
@@ -57,7 +57,11 @@
 #include <sys/wait.h>
 #include <sys/time.h>
 #include <sys/poll.h>
+#include <sys/mman.h>
 #include <limits.h>
+#include <time.h>
+#include "tst_clock.h"
+#include "tst_hist.h"
 
 #define SAFE_FREE(p) { if (p) { free(p); (p)=NULL; } }
 #define DATASIZE 100
@@ -72,6 +76,24 @@ static unsigned int process_mode = 1;
 
 static int use_pipes = 0;
 
+/*
+ * With -latency every message carries the time it was written, and the
+ * receiver accounts the delay until it has read the whole message.
+ */
+static int measure_latency = 0;
+
+/*
+ * Per-receiver statistics. They live in a shared anonymous mapping so
+ * that forked receivers can report back to the parent.
+ */
+struct receiver_stats {
+	unsigned long long finish;	/* ns when the last message arrived */
+	unsigned long long sum;
+	struct tst_hist lat;
+};
+
+static struct receiver_stats *stats_tab;
+
 struct sender_context {
 	unsigned int num_fds;
 	int ready_out;
@@ -84,6 +106,7 @@ struct receiver_context {
 	int in_fds[2];
 	int ready_out;
 	int wakefd;
+	struct receiver_stats *stats;
 };
 
 static void barf(const char *msg)
@@ -94,8 +117,8 @@ static void barf(const char *msg)
 
 static void print_usage_exit()
 {
-	printf
-	    ("Usage: hackbench [-pipe] <num groups> [process|thread] [loops]\n");
+	printf("Usage: hackbench [-pipe] [-latency] <num groups> "
+	       "[process|thread] [loops]\n");
 	exit(1);
 }
 
@@ -139,6 +162,11 @@ static void *sender(struct sender_context *ctx)
 		for (j = 0; j < ctx->num_fds; j++) {
 			int ret, done = 0;
 
+			if (measure_latency) {
+				unsigned long long stamp = tst_clock_ns();
+
+				memcpy(data, &stamp, sizeof(stamp));
+			}
 again:
 			ret =
 			    write(ctx->out_fds[j], data + done,
@@ -177,8 +205,20 @@ again:
 		done += ret;
 		if (done < DATASIZE)
 			goto again;
+
+		if (measure_latency) {
+			unsigned long long stamp;
+
+			memcpy(&stamp, data, sizeof(stamp));
+			stamp = tst_clock_ns() - stamp;
+			ctx->stats->sum += stamp;
+			tst_hist_add(&ctx->stats->lat, stamp);
+		}
 	}
 
+	if (measure_latency)
+		ctx->stats->finish = tst_clock_ns();
+
 	return NULL;
 }
 
@@ -234,6 +274,70 @@ void reap_worker(pthread_t id)
 	}
 }
 
+static void merge_stats(struct receiver_stats *dst,
+			const struct receiver_stats *src)
+{
+	dst->sum += src->sum;
+	if (src->finish > dst->finish)
+		dst->finish = src->finish;
+	tst_hist_merge(&dst->lat, &src->lat);
+}
+
+/* only with -latency, the default output is left as it always was */
+static void print_group_stats(unsigned int num_groups, unsigned int num_fds,
+			      unsigned long long start)
+{
+	struct receiver_stats all, grp;
+	unsigned long long msgs = (unsigned long long)num_fds * num_fds * loops;
+	double rate, fastest = 0, slowest = 0;
+	unsigned int i, j;
+
+	memset(&all, 0, sizeof(all));
+
+	printf("%-6s %10s %14s %10s %10s %10s\n", "Group", "Time(s)",
+	       "Msgs/sec", "p50(us)", "p99(us)", "max(us)");
+
+	for (i = 0; i < num_groups; i++) {
+		memset(&grp, 0, sizeof(grp));
+		for (j = 0; j < num_fds; j++)
+			merge_stats(&grp, &stats_tab[i * num_fds + j]);
+		merge_stats(&all, &grp);
+
+		rate = grp.finish > start ?
+		    msgs * 1e9 / (grp.finish - start) : 0;
+		if (i == 0 || rate > fastest)
+			fastest = rate;
+		if (i == 0 || rate < slowest)
+			slowest = rate;
+
+		printf("%-6u %10.3f %14.0f %10.1f %10.1f %10.1f\n", i,
+		       (grp.finish - start) / 1e9, rate,
+		       tst_hist_usecs(&grp.lat, 0.5),
+		       tst_hist_usecs(&grp.lat, 0.99), grp.lat.max_ns / 1e3);
+	}
+
+	printf("Group throughput: fastest %.0f, slowest %.0f msgs/sec "
+	       "(spread %.1f%%)\n", fastest, slowest,
+	       fastest ? (fastest - slowest) * 100 / fastest : 0);
+
+	if (!all.lat.count)
+		return;
+
+	printf("Wakeup latency: %llu msgs, avg %.1f us, p50 %.1f us, "
+	       "p99 %.1f us, p99.9 %.1f us, max %.1f us\n", all.lat.count,
+	       all.sum / 1e3 / all.lat.count, tst_hist_usecs(&all.lat, 0.5),
+	       tst_hist_usecs(&all.lat, 0.99), tst_hist_usecs(&all.lat, 0.999),
+	       all.lat.max_ns / 1e3);
+
+	printf("%12s %12s %14s\n", ">= (us)", "< (us)", "msgs");
+	for (i = 0; i < TST_HIST_BUCKETS; i++) {
+		if (!all.lat.bucket[i])
+			continue;
+		printf("%12.3f %12.3f %14llu\n", tst_hist_bucket_min(i) / 1e3,
+		       (tst_hist_bucket_max(i) + 1) / 1e3, all.lat.bucket[i]);
+	}
+}
+
 /* One group of senders and receivers */
 static unsigned int group(pthread_t * pth,
 			  unsigned int num_fds, int ready_out, int wakefd)
@@ -262,6 +366,7 @@ static unsigned int group(pthread_t * pth,
 		ctx->in_fds[1] = fds[1];
 		ctx->ready_out = ready_out;
 		ctx->wakefd = wakefd;
+		ctx->stats = &stats_tab[gr_num * num_fds + i];
 
 		pth[i] = create_worker(ctx, (void *)(void *)receiver);
 
@@ -294,13 +399,19 @@ int main(int argc, char *argv[])
 {
 	unsigned int i, j, num_groups = 10, total_children;
 	struct timeval start, stop, diff;
+	unsigned long long start_ns;
 	unsigned int num_fds = 20;
 	int readyfds[2], wakefds[2];
 	char dummy;
 	pthread_t *pth_tab;
 
-	if (argv[1] && strcmp(argv[1], "-pipe") == 0) {
-		use_pipes = 1;
+	while (argv[1] && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-pipe") == 0)
+			use_pipes = 1;
+		else if (strcmp(argv[1], "-latency") == 0)
+			measure_latency = 1;
+		else
+			print_usage_exit();
 		argc--;
 		argv++;
 	}
@@ -331,6 +442,12 @@ int main(int argc, char *argv[])
 	if (!pth_tab || !snd_ctx_tab || !rev_ctx_tab)
 		barf("main:malloc()");
 
+	stats_tab = mmap(NULL, num_groups * num_fds * sizeof(*stats_tab),
+			 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+			 -1, 0);
+	if (stats_tab == MAP_FAILED)
+		barf("main:mmap()");
+
 	fdpair(readyfds);
 	fdpair(wakefds);
 
@@ -346,6 +463,7 @@ int main(int argc, char *argv[])
 			barf("Reading for readyfds");
 
 	gettimeofday(&start, NULL);
+	start_ns = tst_clock_ns();
 
 	/* Kick them off */
 	if (write(wakefds[1], &dummy, 1) != 1)
@@ -361,6 +479,9 @@ int main(int argc, char *argv[])
 	timersub(&stop, &start, &diff);
 	printf("Time: %lu.%03lu\n", diff.tv_sec, diff.tv_usec / 1000);
 
+	if (measure_latency)
+		print_group_stats(num_groups, num_fds, start_ns);
+
 	/* free the memory */
 	for (i = 0; i < num_groups; i++) {
 		for (j = 0; j < num_fds; j++) {
@@ -371,5 +492,6 @@ int main(int argc, char *argv[])
 	SAFE_FREE(pth_tab);
 	SAFE_FREE(snd_ctx_tab);
 	SAFE_FREE(rev_ctx_tab);
+	munmap(stats_tab, num_groups * num_fds * sizeof(*stats_tab));
 	exit(0);
 }
@@ -17,10 +17,12 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#define _GNU_SOURCE
 #include <ctype.h>
 #include <errno.h>
 #include <libgen.h>
 #include <math.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -50,6 +52,20 @@ static char *global_progname = PACKAGE;
 /* By default, do not hang after allocating memory.  */
 static int global_vmhang = 0;
 
+/* By default, paced workers are busy for the whole period.  */
+static int global_duty = 100;
+
+/* By default, use a 100ms duty-cycle period.  */
+static long global_period = 100000;
+
+/* By default, do not print per-worker throughput reports.  */
+static int global_report = 0;
+
+/* By default, do not pin workers.  Otherwise worker n of each hog runs on
+ * global_cpus[n % global_ncpus].  */
+static int global_cpus[CPU_SETSIZE];
+static int global_ncpus = 0;
+
 /* Implemention of runtime-selectable severity message printing.  */
 #define dbg if (global_debug >= 3) \
             fprintf (stdout, "%s: debug: (%d) ", global_progname, __LINE__), \
@@ -78,12 +94,15 @@ int usage(int status);
 int version(int status);
 long long atoll_s(const char *nptr);
 long long atoll_b(const char *nptr);
+int parse_cpus(const char *list);
 
 /* Prototypes for the worker functions.  */
 int hogcpu(long long forks);
 int hogio(long long forks);
 int hogvm(long long forks, long long chunks, long long bytes);
 int hoghdd(long long forks, int clean, long long files, long long bytes);
+int hogmembw(long long forks, long long bytes);
+int hogcache(long long forks, long long bytes);
 
 int main(int argc, char **argv)
 {
@@ -106,6 +125,11 @@ int main(int argc, char **argv)
 	int do_hdd_clean = 0;
 	long long do_hdd_files = 1;
 	long long do_hdd_bytes = 1024 * 1024 * 1024;
+	int do_membw = 0;	/* Default to 1 fork.  */
+	long long do_membw_forks = 1;
+	int do_cache = 0;	/* Default to 1 fork.  */
+	long long do_cache_forks = 1;
+	long long do_ws_bytes = 64 * 1024 * 1024;
 
 	/* Record our start time.  */
 	if ((starttime = time(NULL)) == -1) {
@@ -116,6 +140,10 @@ int main(int argc, char **argv)
 	/* SuSv3 does not define any error conditions for this function.  */
 	global_progname = basename(argv[0]);
 
+	/* Workers report periodically; do not let them inherit and flush
+	 * our buffered messages.  */
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
 	/* For portability, parse command line options without getopt_long.  */
 	for (i = 1; i < argc; i++) {
 		char *arg = argv[i];
@@ -190,6 +218,50 @@ int main(int argc, char **argv)
 		} else if (strcmp(arg, "--hdd-bytes") == 0) {
 			assert_arg("--hdd-bytes");
 			do_hdd_bytes = atoll_b(arg);
+		} else if (strcmp(arg, "--membw") == 0
+			   || strcmp(arg, "-b") == 0) {
+			do_membw = 1;
+			assert_arg("--membw");
+			do_membw_forks = atoll_b(arg);
+		} else if (strcmp(arg, "--cache") == 0
+			   || strcmp(arg, "-C") == 0) {
+			do_cache = 1;
+			assert_arg("--cache");
+			do_cache_forks = atoll_b(arg);
+		} else if (strcmp(arg, "--ws-bytes") == 0) {
+			assert_arg("--ws-bytes");
+			do_ws_bytes = atoll_b(arg);
+			if (do_ws_bytes < 4096) {
+				err(stderr, "working set too small: %lli\n",
+				    do_ws_bytes);
+				exit(1);
+			}
+		} else if (strcmp(arg, "--duty") == 0) {
+			assert_arg("--duty");
+			global_duty = atoll(arg);
+			if (global_duty < 1 || global_duty > 100) {
+				err(stderr, "invalid duty cycle: %i\n",
+				    global_duty);
+				exit(1);
+			}
+			dbg(stdout, "setting duty cycle to %d%%\n",
+			    global_duty);
+		} else if (strcmp(arg, "--period") == 0) {
+			assert_arg("--period");
+			global_period = atoll(arg);
+			if (global_period < 1000) {
+				err(stderr, "invalid period: %li\n",
+				    global_period);
+				exit(1);
+			}
+			dbg(stdout, "setting period to %lius\n", global_period);
+		} else if (strcmp(arg, "--affinity") == 0) {
+			assert_arg("--affinity");
+			global_ncpus = parse_cpus(arg);
+		} else if (strcmp(arg, "--report") == 0) {
+			assert_arg("--report");
+			global_report = atoll_s(arg);
+			dbg(stdout, "reporting every %ds\n", global_report);
 		} else {
 			err(stderr, "unrecognized option: %s\n", arg);
 			exit(1);
@@ -273,6 +345,46 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/* Hog memory bandwidth option.  */
+	if (do_membw) {
+		out(stdout, "dispatching %lli hogmembw forks, each copying "
+		    "%lli bytes\n", do_membw_forks, do_ws_bytes);
+
+		switch (pid = fork()) {
+		case 0:	/* child */
+			if (do_dryrun)
+				exit(0);
+			exit(hogmembw(do_membw_forks, do_ws_bytes));
+		case -1:	/* error */
+			err(stderr, "hogmembw dispatcher fork failed\n");
+			exit(1);
+		default:	/* parent */
+			children++;
+			dbg(stdout, "--> hogmembw dispatcher forked (%i)\n",
+			    pid);
+		}
+	}
+
+	/* Hog cache option.  */
+	if (do_cache) {
+		out(stdout, "dispatching %lli hogcache forks, each thrashing "
+		    "%lli bytes\n", do_cache_forks, do_ws_bytes);
+
+		switch (pid = fork()) {
+		case 0:	/* child */
+			if (do_dryrun)
+				exit(0);
+			exit(hogcache(do_cache_forks, do_ws_bytes));
+		case -1:	/* error */
+			err(stderr, "hogcache dispatcher fork failed\n");
+			exit(1);
+		default:	/* parent */
+			children++;
+			dbg(stdout, "--> hogcache dispatcher forked (%i)\n",
+			    pid);
+		}
+	}
+
 	/* We have no work to do, so bail out.  */
 	if (children == 0)
 		usage(0);
@@ -351,7 +463,15 @@ int usage(int status)
 	    " -d, --hdd n           spawn n procs spinning on write()\n"
 	    "     --hdd-noclean     do not unlink file to which random data written\n"
 	    "     --hdd-files f     write to f files (default is 1)\n"
-	    "     --hdd-bytes b     write b bytes (default is 1GB)\n\n"
+	    "     --hdd-bytes b     write b bytes (default is 1GB)\n"
+	    " -b, --membw n         spawn n procs spinning on memcpy()\n"
+	    " -C, --cache n         spawn n procs chasing pointers in memory\n"
+	    "     --ws-bytes b      working set of -b, -C (default is 64MB)\n"
+	    "     --duty p          keep -c, -i, -b, -C busy p%% of each period\n"
+	    "     --period n        duty-cycle period of n us (default is 100ms)\n"
+	    "     --affinity l      pin worker n of each hog to the n-th cpu of\n"
+	    "                       list l (e.g. 0,2-3)\n"
+	    "     --report n        print -c, -i, -b, -C rates every n seconds\n\n"
 	    "Infinity is denoted with 0.  For -m, -d: n=0 means infinite redo,\n"
 	    "n<0 means redo abs(n) times. Valid suffixes are m,h,d,y for time;\n"
 	    "k,m,g for size.\n\n";
@@ -415,6 +535,349 @@ long long atoll_b(const char *nptr)
 	return factor;
 }
 
+/* Parse a cpu list such as "0,2-5" into global_cpus and return the number
+ * of entries.
+ */
+int parse_cpus(const char *list)
+{
+	const char *p = list;
+	char *end;
+	long first, last;
+	int n = 0;
+
+	while (*p) {
+		first = last = strtol(p, &end, 10);
+		if (end == p)
+			goto invalid;
+		if (*end == '-') {
+			p = end + 1;
+			last = strtol(p, &end, 10);
+			if (end == p)
+				goto invalid;
+		}
+		if (first < 0 || last < first || last >= CPU_SETSIZE)
+			goto invalid;
+		for (; first <= last && n < CPU_SETSIZE; first++)
+			global_cpus[n++] = first;
+		if (*end == ',')
+			end++;
+		else if (*end)
+			goto invalid;
+		p = end;
+	}
+
+	if (n)
+		return n;
+
+invalid:
+	err(stderr, "invalid cpu list: %s\n", list);
+	exit(1);
+}
+
+/* Pin worker n to its cpu from the --affinity list, if any.  */
+static void pin_worker(long long n)
+{
+	cpu_set_t set;
+	int cpu;
+
+	if (!global_ncpus)
+		return;
+
+	cpu = global_cpus[n % global_ncpus];
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		err(stderr, "failed to pin worker to cpu %i: %s\n", cpu,
+		    strerror(errno));
+		exit(1);
+	}
+	dbg(stdout, "worker %lli pinned to cpu %i\n", n, cpu);
+}
+
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void sleep_until_us(long long deadline)
+{
+	struct timespec ts;
+
+	ts.tv_sec = deadline / 1000000;
+	ts.tv_nsec = (deadline % 1000000) * 1000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+	       == EINTR) ;
+}
+
+static void paced_loop(const char *name, long long n, long long (*op) (void *),
+		       void *arg, double scale, const char *unit)
+    __attribute__ ((noreturn));
+
+/* Run op() for the busy part of every --period and sleep for the rest,
+ * reporting the rate every --report seconds.  op() should do a short burst
+ * of work and return how many units it completed; scale converts the units
+ * to the ones named by unit.
+ */
+static void paced_loop(const char *name, long long n, long long (*op) (void *),
+		       void *arg, double scale, const char *unit)
+{
+	long long period = global_period;
+	long long busy = period * global_duty / 100;
+	long long start, now, last_report, units = 0;
+
+	pin_worker(n);
+
+	start = last_report = now_us();
+
+	while (1) {
+		do {
+			units += op(arg);
+			now = now_us();
+		} while (now < start + busy);
+
+		if (global_duty < 100)
+			sleep_until_us(start + period);
+
+		start += period;
+		now = now_us();
+		/* Do not try to catch up after being preempted for a while.  */
+		if (now > start + period)
+			start = now;
+
+		if (global_report && now - last_report >= global_report * 1000000LL) {
+			out(stdout, "%s worker %lli: %.1f %s/s\n", name, n,
+			    units * scale * 1e6 / (now - last_report), unit);
+			fflush(stdout);
+			units = 0;
+			last_report = now;
+		}
+	}
+}
+
+static volatile double sqrt_sink;
+
+static long long op_sqrt(void *arg)
+{
+	int i;
+
+	(void)arg;
+	for (i = 0; i < 1024; i++)
+		sqrt_sink = sqrt(rand());
+
+	return i;
+}
+
+static long long op_sync(void *arg)
+{
+	(void)arg;
+	sync();
+
+	return 1;
+}
+
+struct membw_arg {
+	char *buf;
+	size_t half;
+	size_t off;
+};
+
+/* Copy the first half of the working set to the second one, 1MB at a time
+ * so that pacing stays accurate for large working sets.
+ */
+static long long op_memcpy(void *arg)
+{
+	struct membw_arg *a = arg;
+	size_t len = a->half - a->off;
+
+	if (len > 1024 * 1024)
+		len = 1024 * 1024;
+
+	memcpy(a->buf + a->half + a->off, a->buf + a->off, len);
+
+	a->off += len;
+	if (a->off >= a->half)
+		a->off = 0;
+
+	return len;
+}
+
+struct cache_arg {
+	void **pos;
+};
+
+/* Follow a random cyclic chain through every cache line of the working set
+ * so that neither prefetchers nor a small cache can hide the misses.
+ */
+static long long op_chase(void *arg)
+{
+	struct cache_arg *a = arg;
+	void **p = a->pos;
+	int i;
+
+	for (i = 0; i < 4096; i++)
+		p = *p;
+
+	a->pos = p;
+
+	return i;
+}
+
+#define CACHE_LINE 64
+
+static void **build_chain(long long bytes)
+{
+	size_t i, j, lines = bytes / CACHE_LINE;
+	size_t *order;
+	char *buf;
+
+	buf = malloc(lines * CACHE_LINE);
+	order = malloc(lines * sizeof(*order));
+	if (!buf || !order) {
+		err(stderr, "failed to allocate %lli bytes\n", bytes);
+		exit(1);
+	}
+
+	/* Sattolo's shuffle yields a single cycle through all lines.  */
+	for (i = 0; i < lines; i++)
+		order[i] = i;
+	for (i = lines - 1; i > 0; i--) {
+		size_t tmp;
+
+		j = rand() % i;
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	for (i = 0; i < lines; i++)
+		*(void **)(buf + order[i] * CACHE_LINE) =
+		    buf + order[(i + 1) % lines] * CACHE_LINE;
+
+	free(order);
+
+	return (void **)buf;
+}
+
+/* Fork forks workers running worker() and wait for them, with the same
+ * retry and backoff handling as the other hogs.
+ */
+static int hogpaced(const char *name, long long forks,
+		    void (*worker) (long long n, long long bytes),
+		    long long bytes)
+{
+	long long i;
+	int pid, retval = 0;
+
+	/* Make local copies of global variables.  */
+	int ignore = global_ignore;
+	int retry = global_retry;
+	int timeout = global_timeout;
+	long backoff = global_backoff * forks;
+
+	dbg(stdout, "using backoff sleep of %lius for %s\n", backoff, name);
+
+	for (i = 0; forks == 0 || i < forks; i++) {
+		switch (pid = fork()) {
+		case 0:	/* child */
+			alarm(timeout);
+
+			/* Use a backoff sleep to ensure we get good fork throughput.  */
+			usleep(backoff);
+
+			worker(i, bytes);
+
+			/* This case never falls through; alarm signal can cause exit.  */
+			exit(1);
+		case -1:	/* error */
+			if (ignore) {
+				++retval;
+				wrn(stderr,
+				    "%s worker fork failed, continuing\n",
+				    name);
+				usleep(retry);
+				continue;
+			}
+
+			err(stderr, "%s worker fork failed\n", name);
+			return 1;
+		default:	/* parent */
+			dbg(stdout, "--> %s worker forked (%i)\n", name, pid);
+		}
+	}
+
+	/* Wait for our children to exit.  */
+	while (i) {
+		int status, ret;
+
+		if ((pid = wait(&status)) > 0) {
+			if ((WIFEXITED(status)) != 0) {
+				if ((ret = WEXITSTATUS(status)) != 0) {
+					err(stderr, "%s worker %i exited %i\n",
+					    name, pid, ret);
+					retval += ret;
+				} else {
+					dbg(stdout,
+					    "<-- %s worker exited (%i)\n",
+					    name, pid);
+				}
+			} else {
+				dbg(stdout, "<-- %s worker signalled (%i)\n",
+				    name, pid);
+			}
+
+			--i;
+		} else {
+			dbg(stdout, "wait() returned error: %s\n",
+			    strerror(errno));
+			err(stderr, "detected missing %s worker children\n",
+			    name);
+			++retval;
+			break;
+		}
+	}
+
+	return retval;
+}
+
+static void membw_worker(long long n, long long bytes)
+{
+	struct membw_arg arg;
+
+	arg.half = bytes / 2;
+	arg.off = 0;
+	if (!(arg.buf = malloc(bytes))) {
+		err(stderr, "hogmembw malloc of %lli bytes failed\n", bytes);
+		exit(1);
+	}
+	/* Fault the pages in before we start measuring.  */
+	memset(arg.buf, 'Z', bytes);
+
+	paced_loop("hogmembw", n, op_memcpy, &arg, 1.0 / (1024 * 1024), "MB");
+}
+
+static void cache_worker(long long n, long long bytes)
+{
+	struct cache_arg arg;
+
+	srand(getpid());
+	arg.pos = build_chain(bytes);
+
+	paced_loop("hogcache", n, op_chase, &arg, 1, "loads");
+}
+
+int hogmembw(long long forks, long long bytes)
+{
+	return hogpaced("hogmembw", forks, membw_worker, bytes);
+}
+
+int hogcache(long long forks, long long bytes)
+{
+	return hogpaced("hogcache", forks, cache_worker, bytes);
+}
+
 /* Convert a string representation of a number with an optional time suffix
  * to a long long.
  */
@@ -465,7 +928,6 @@ long long atoll_s(const char *nptr)
 int hogcpu(long long forks)
 {
 	long long i;
-	double d;
 	int pid, retval = 0;
 
 	/* Make local copies of global variables.  */
@@ -484,8 +946,7 @@ int hogcpu(long long forks)
 			/* Use a backoff sleep to ensure we get good fork throughput.  */
 			usleep(backoff);
 
-			while (1)
-				d = sqrt(rand());
+			paced_loop("hogcpu", i, op_sqrt, NULL, 1, "sqrts");
 
 			/* This case never falls through; alarm signal can cause exit.  */
 		case -1:	/* error */
@@ -560,8 +1021,7 @@ int hogio(long long forks)
 			/* Use a backoff sleep to ensure we get good fork throughput.  */
 			usleep(backoff);
 
-			while (1)
-				sync();
+			paced_loop("hogio", i, op_sync, NULL, 1, "syncs");
 
 			/* This case never falls through; alarm signal can cause exit.  */
 		case -1:	/* error */
@@ -641,6 +1101,8 @@ int hogvm(long long forks, long long chunks, long long bytes)
 			/* Use a backoff sleep to ensure we get good fork throughput.  */
 			usleep(backoff);
 
+			pin_worker(i);
+
 			while (1) {
 				ptr = (char **)malloc(chunks * 2);
 				for (j = 0; chunks == 0 || j < chunks; j++) {
@@ -770,6 +1232,8 @@ int hoghdd(long long forks, int clean, long long files, long long bytes)
 			/* Use a backoff sleep to ensure we get good fork throughput.  */
 			usleep(backoff);
 
+			pin_worker(i);
+
 			while (1) {
 				for (i = 0; i < files; i++) {
 					char name[] = "./stress.XXXXXX";
@@ -26,11 +26,102 @@
 #include <sys/dir.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 
 #ifdef FLASK_LINUX
 #include <fs_secure.h>
 #endif
 
+/* PROC_CACHED keeps the /proc/#/ files of every task open between scans and
+ * re-reads them with pread().  If /proc/#/stat did not change since the last
+ * scan (same length and hash) the task neither ran nor changed its memory
+ * footprint, so the previous parse result is handed out again and statm and
+ * status are not even read.
+ */
+typedef struct pid_cache {
+	struct pid_cache *next;
+	pid_t pid;
+	unsigned gen;		/* last scan that saw this task */
+	int stat_fd, statm_fd, status_fd;
+	int len;		/* length of the last /proc/#/stat */
+	unsigned long long hash;	/* and its FNV-1a hash */
+	int filled;		/* PROC_FILL* flags valid in last */
+	proc_t last;
+} pid_cache;
+
+#define PID_CACHE_BITS 12
+
+static pid_cache *pid_hash[1 << PID_CACHE_BITS];
+static unsigned pid_gen;
+
+static inline unsigned pid_slot(pid_t pid)
+{
+	return (unsigned)pid & ((1 << PID_CACHE_BITS) - 1);
+}
+
+static void pid_cache_drop(pid_cache *c)
+{
+	if (c->stat_fd != -1)
+		close(c->stat_fd);
+	if (c->statm_fd != -1)
+		close(c->statm_fd);
+	if (c->status_fd != -1)
+		close(c->status_fd);
+	free(c);
+}
+
+static pid_cache *pid_cache_get(pid_t pid)
+{
+	pid_cache *c;
+
+	for (c = pid_hash[pid_slot(pid)]; c; c = c->next)
+		if (c->pid == pid)
+			return c;
+
+	c = xcalloc(NULL, sizeof *c);
+	c->pid = pid;
+	c->stat_fd = c->statm_fd = c->status_fd = -1;
+	c->next = pid_hash[pid_slot(pid)];
+	pid_hash[pid_slot(pid)] = c;
+	return c;
+}
+
+static void pid_cache_unlink(pid_cache *c)
+{
+	pid_cache **pp = &pid_hash[pid_slot(c->pid)];
+
+	while (*pp != c)
+		pp = &(*pp)->next;
+	*pp = c->next;
+	pid_cache_drop(c);
+}
+
+/* close the files of tasks which were not seen by the last full scan */
+static void pid_cache_sweep(void)
+{
+	pid_cache **pp, *c;
+	unsigned i;
+
+	for (i = 0; i < sizeof pid_hash / sizeof *pid_hash; i++) {
+		pp = &pid_hash[i];
+		while ((c = *pp)) {
+			if (c->gen != pid_gen) {
+				*pp = c->next;
+				pid_cache_drop(c);
+			} else
+				pp = &c->next;
+		}
+	}
+}
+
+/* close all files kept open by PROC_CACHED scans
+ */
+void flushproc_cache(void)
+{
+	pid_gen++;
+	pid_cache_sweep();
+}
+
 /* initiate a process table scan
  */
 PROCTAB *openproc(int flags, ...)
@@ -38,6 +129,19 @@ PROCTAB *openproc(int flags, ...)
 	va_list ap;
 	PROCTAB *PT = xmalloc(sizeof(PROCTAB));
 
+	if (flags & PROC_CACHED) {
+		static int raised;
+		struct rlimit rl;
+
+		/* we want up to three fds per task */
+		if (!raised && !getrlimit(RLIMIT_NOFILE, &rl)) {
+			rl.rlim_cur = rl.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &rl);
+			raised = 1;
+		}
+		pid_gen++;
+	}
+
 	if (flags & PROC_PID)
 		PT->procfs = NULL;
 	else if (!(PT->procfs = opendir("/proc")))
@@ -59,6 +163,9 @@ PROCTAB *openproc(int flags, ...)
 void closeproc(PROCTAB * PT)
 {
 	if (PT) {
+		/* a pid list scan says nothing about the other tasks */
+		if ((PT->flags & PROC_CACHED) && !(PT->flags & PROC_PID))
+			pid_cache_sweep();
 		if (PT->procfs)
 			closedir(PT->procfs);
 		free(PT);
@@ -184,6 +291,36 @@ static void status2proc(const char *S, proc_t * restrict P)
 		fprintf(stderr, "Internal error!\n");
 }
 
+// Parse the next space separated decimal number and advance past it.  This
+// is what the sscanf() calls below used to do, minus the format parsing.
+// Negative values come back two's complement, callers cast to the signed type.
+static inline unsigned long long get_num(const char **sp)
+{
+	const char *s = *sp;
+	unsigned long long v = 0;
+	int neg = 0;
+
+	while (*s == ' ')
+		s++;
+	if (*s == '-') {
+		neg = 1;
+		s++;
+	}
+	while ((unsigned)(*s - '0') < 10)
+		v = v * 10 + (*s++ - '0');
+	while (*s && *s != ' ' && *s != '\n')	// skip what we cannot parse
+		s++;
+	*sp = s;
+	return neg ? -v : v;
+}
+
+static inline int more_nums(const char *s)
+{
+	while (*s == ' ')
+		s++;
+	return *s && *s != '\n';
+}
+
 // Reads /proc/*/stat files, being careful not to trip over processes with
 // names like ":-) 1 2 3 4 5 6".
 static void stat2proc(const char *S, proc_t * restrict P)
@@ -206,36 +343,63 @@ static void stat2proc(const char *S, proc_t * restrict P)
 	P->cmd[num] = '\0';
 	S = tmp + 2;		// skip ") "
 
-	num = sscanf(S, "%c " "%d %d %d %d %d " "%lu %lu %lu %lu %lu " "%Lu %Lu %Lu %Lu "	/* utime stime cutime cstime */
-		     "%ld %ld %ld %ld " "%Lu "	/* start_time */
-		     "%lu " "%ld " "%lu %lu %lu %lu %lu %lu " "%*s %*s %*s %*s "	/* discard, no RT signals & Linux 2.1 used hex */
-		     "%lu %lu %lu "
-		     "%d %d "
-		     "%lu %lu",
-		     &P->state,
-		     &P->ppid, &P->pgrp, &P->session, &P->tty, &P->tpgid,
-		     &P->flags, &P->min_flt, &P->cmin_flt, &P->maj_flt,
-		     &P->cmaj_flt, &P->utime, &P->stime, &P->cutime, &P->cstime,
-		     &P->priority, &P->nice, &P->timeout, &P->it_real_value,
-		     &P->start_time, &P->vsize, &P->rss, &P->rss_rlim,
-		     &P->start_code, &P->end_code, &P->start_stack,
-		     &P->kstk_esp, &P->kstk_eip,
-		     /*     P->signal, P->blocked, P->sigignore, P->sigcatch,   *//* can't use */
-		     &P->wchan, &P->nswap, &P->cnswap,
+	P->state = *S++;
+	P->ppid = get_num(&S);
+	P->pgrp = get_num(&S);
+	P->session = get_num(&S);
+	P->tty = get_num(&S);
+	P->tpgid = get_num(&S);
+	P->flags = get_num(&S);
+	P->min_flt = get_num(&S);
+	P->cmin_flt = get_num(&S);
+	P->maj_flt = get_num(&S);
+	P->cmaj_flt = get_num(&S);
+	P->utime = get_num(&S);
+	P->stime = get_num(&S);
+	P->cutime = get_num(&S);
+	P->cstime = get_num(&S);
+	P->priority = get_num(&S);
+	P->nice = get_num(&S);
+	P->timeout = get_num(&S);
+	P->it_real_value = get_num(&S);
+	P->start_time = get_num(&S);
+	P->vsize = get_num(&S);
+	P->rss = get_num(&S);
+	P->rss_rlim = get_num(&S);
+	P->start_code = get_num(&S);
+	P->end_code = get_num(&S);
+	P->start_stack = get_num(&S);
+	P->kstk_esp = get_num(&S);
+	P->kstk_eip = get_num(&S);
+	/* discard, no RT signals & Linux 2.1 used hex */
+	for (num = 0; num < 4; num++)
+		get_num(&S);
+	P->wchan = get_num(&S);
+	P->nswap = get_num(&S);
+	P->cnswap = get_num(&S);
 /* -- Linux 2.0.35 ends here -- */
-		     &P->exit_signal, &P->processor,	/* 2.2.1 ends with "exit_signal" */
+	if (!more_nums(S))
+		return;
+	P->exit_signal = get_num(&S);	/* 2.2.1 ends with "exit_signal" */
+	if (!more_nums(S))
+		return;
+	P->processor = get_num(&S);
 /* -- Linux 2.2.8 to 2.5.17 end here -- */
-		     &P->rtprio, &P->sched	/* both added to 2.5.18 */
-	    );
+	if (!more_nums(S))
+		return;
+	P->rtprio = get_num(&S);	/* both added to 2.5.18 */
+	P->sched = get_num(&S);
 }
 
 static void statm2proc(const char *s, proc_t * restrict P)
 {
-	int num;
-	num = sscanf(s, "%ld %ld %ld %ld %ld %ld %ld",
-		     &P->size, &P->resident, &P->share,
-		     &P->trs, &P->lrs, &P->drs, &P->dt);
-/*    fprintf(stderr, "statm2proc converted %d fields.\n",num); */
+	P->size = get_num(&s);
+	P->resident = get_num(&s);
+	P->share = get_num(&s);
+	P->trs = get_num(&s);
+	P->lrs = get_num(&s);
+	P->drs = get_num(&s);
+	P->dt = get_num(&s);
 }
 
 static int file2str(const char *directory, const char *what, char *ret, int cap)
@@ -256,6 +420,108 @@ static int file2str(const char *directory, const char *what, char *ret, int cap)
 	return num_read;
 }
 
+// Like file2str, but re-read an fd kept open by a PROC_CACHED scan,
+// opening it first if needed.
+static int fd2str(int *fd, const char *directory, const char *what,
+		  char *ret, int cap)
+{
+	char filename[64];
+	int num_read;
+
+	if (*fd == -1) {
+		snprintf(filename, sizeof filename, "%s/%s", directory, what);
+		*fd = open(filename, O_RDONLY, 0);
+		if (unlikely(*fd == -1))
+			return -1;
+	}
+	num_read = pread(*fd, ret, cap - 1, 0);
+	if (unlikely(num_read <= 0)) {
+		if (!num_read)
+			errno = ESRCH;
+		return -1;
+	}
+	ret[num_read] = 0;
+	return num_read;
+}
+
+static unsigned long long fnv1a(const char *s, int len)
+{
+	unsigned long long h = 14695981039346656037ULL;
+
+	while (len--) {
+		h ^= (unsigned char)*s++;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+// The PROC_CACHED counterpart of the stat/statm/status part of readproc().
+// Returns 0 when p was filled, -1 when the task is gone and 1 when we ran
+// out of fds and the caller should fall back to the uncached path.
+static int cached2proc(const char *path, proc_t * restrict p, int flags,
+		       pid_t pid)
+{
+	char sbuf[1024];
+	unsigned long long hash;
+	pid_cache *c;
+	struct stat sb;
+	int len, want;
+
+	want = flags & (PROC_FILLMEM | PROC_FILLSTATUS);
+
+	c = pid_cache_get(pid);
+	len = fd2str(&c->stat_fd, path, "stat", sbuf, sizeof sbuf);
+	if (unlikely(len == -1)) {
+		int gone = errno != EMFILE && errno != ENFILE;
+
+		// a stale fd means the pid was reused, try once more from scratch
+		if (c->filled && gone) {
+			pid_cache_unlink(c);
+			c = pid_cache_get(pid);
+			len = fd2str(&c->stat_fd, path, "stat", sbuf,
+				     sizeof sbuf);
+			gone = errno != EMFILE && errno != ENFILE;
+		}
+		if (len == -1) {
+			pid_cache_unlink(c);
+			return gone ? -1 : 1;
+		}
+	}
+	c->gen = pid_gen;
+
+	hash = fnv1a(sbuf, len);
+	if (c->filled && len == c->len && hash == c->hash
+	    && (c->filled & want) == want) {
+		*p = c->last;
+		return 0;
+	}
+
+	if (unlikely(fstat(c->stat_fd, &sb) == -1))
+		return -1;
+	p->euid = sb.st_uid;
+	p->pid = pid;
+	stat2proc(sbuf, p);
+
+	if (flags & PROC_FILLMEM) {
+		if (likely(fd2str(&c->statm_fd, path, "statm", sbuf,
+				  sizeof sbuf) != -1))
+			statm2proc(sbuf, p);
+	}
+	if (flags & PROC_FILLSTATUS) {
+		if (likely(fd2str(&c->status_fd, path, "status", sbuf,
+				  sizeof sbuf) != -1))
+			status2proc(sbuf, p);
+	}
+
+	c->len = len;
+	c->hash = hash;
+	c->filled = want | PROC_FILLSTAT;
+	c->last = *p;
+	c->last.cmdline = NULL;
+	c->last.environ = NULL;
+	return 0;
+}
+
 static char **file2strvec(const char *directory, const char *what)
 {
 	char buf[2048];		/* read buf bytes at a time */
@@ -421,6 +687,23 @@ next_proc:			/* get next PID for consideration */
 		strcpy(path + 6, ent->d_name);	// trust /proc to not contain evil top-level entries
 //      snprintf(path, sizeof path, "/proc/%s", ent->d_name);
 	}
+
+	if (flags & PROC_CACHED) {
+		int ret;
+
+		if (!p)
+			p = xcalloc(p, sizeof *p);
+		ret = cached2proc(path, p, flags, pid);
+		if (ret == -1)
+			goto next_proc;
+		if (ret == 0) {
+			if ((flags & PROC_UID)
+			    && !XinLN(uid_t, p->euid, PT->uids, PT->nuid))
+				goto next_proc;
+			goto fill_names;
+		}
+		/* out of fds, do this one the slow way */
+	}
 #ifdef FLASK_LINUX
 	if (stat_secure(path, &sb, &secsid) == -1)	/* no such dirent (anymore) */
 #else
@@ -457,6 +740,7 @@ next_proc:			/* get next PID for consideration */
 		}
 	}
 
+fill_names:
 	/* some number->text resolving which is time consuming */
 	if (flags & PROC_FILLUSR) {
 		strncpy(p->euser, user_from_uid(p->euid), sizeof p->euser);
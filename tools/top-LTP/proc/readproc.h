@@ -187,6 +187,10 @@ extern void look_up_our_self(proc_t *p);
  */
 extern void freeproc(proc_t* p);
 
+/* close the /proc files kept open by PROC_CACHED scans
+ */
+extern void flushproc_cache(void);
+
 /* openproc/readproctab:
  *
  * Return PROCTAB* / *proc_t[] or NULL on error ((probably) "/proc" cannot be
@@ -218,6 +222,9 @@ extern void freeproc(proc_t* p);
 #define PROC_PID     0x1000  /* process id numbers ( 0   terminated) */
 #define PROC_UID     0x4000  /* user id numbers    ( length needed ) */
 
+/* keep /proc/#/ files open between scans, skip tasks whose stat is unchanged */
+#define PROC_CACHED  0x2000
+
 // it helps to give app code a few spare bits
 #define PROC_SPARE_1 0x01000000
 #define PROC_SPARE_2 0x02000000
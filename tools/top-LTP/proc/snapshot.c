@@ -0,0 +1,153 @@
+// Copyright (c) 2026 Linux Test Project
+//
+// This file is placed under the conditions of the GNU Library
+// General Public License, version 2, or any later version.
+// See file COPYING for information on distribution conditions.
+
+/* Writing and replaying compact binary process table snapshots. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "alloc.h"
+#include "snapshot.h"		/* include self to verify prototypes */
+
+#define SNAP_MAGIC	"PROCSNP1"
+#define FRAME_MAGIC	0x4d415246	/* "FRAM" */
+
+struct snap_header {
+	char magic[8];
+	uint32_t hertz;
+	uint32_t recsize;	/* sizeof(struct snap_task) of the writer */
+};
+
+struct snap_frame {
+	uint32_t magic;
+	uint32_t ntasks;
+	uint64_t usec;
+};
+
+struct snap_task {
+	int32_t pid, ppid;
+	uint32_t euid;
+	int32_t processor;
+	int32_t priority, nice;
+	char state, pad[3];
+	uint64_t utime, stime, start_time;
+	uint64_t vsize, rss;
+	uint64_t min_flt, maj_flt;
+	char cmd[16];
+};
+
+int snapproc_write_header(FILE *fp, unsigned hertz)
+{
+	struct snap_header h;
+
+	memcpy(h.magic, SNAP_MAGIC, sizeof h.magic);
+	h.hertz = hertz;
+	h.recsize = sizeof(struct snap_task);
+	return fwrite(&h, sizeof h, 1, fp) == 1 ? 0 : -1;
+}
+
+// ptab is terminated by either a NULL pointer or a proc_t with a pid of -1,
+// so both readproctab() results and top's frame table can be written.
+int snapproc_write(FILE *fp, proc_t **ptab, unsigned long long usec)
+{
+	struct snap_frame f;
+	struct snap_task t;
+	unsigned i;
+
+	for (i = 0; ptab[i] && ptab[i]->pid != -1; i++) ;
+
+	f.magic = FRAME_MAGIC;
+	f.ntasks = i;
+	f.usec = usec;
+	if (fwrite(&f, sizeof f, 1, fp) != 1)
+		return -1;
+
+	memset(&t, 0, sizeof t);
+	for (i = 0; i < f.ntasks; i++) {
+		const proc_t *p = ptab[i];
+
+		t.pid = p->pid;
+		t.ppid = p->ppid;
+		t.euid = p->euid;
+		t.processor = p->processor;
+		t.priority = p->priority;
+		t.nice = p->nice;
+		t.state = p->state;
+		t.utime = p->utime;
+		t.stime = p->stime;
+		t.start_time = p->start_time;
+		t.vsize = p->vsize;
+		t.rss = p->rss;
+		t.min_flt = p->min_flt;
+		t.maj_flt = p->maj_flt;
+		memcpy(t.cmd, p->cmd, sizeof t.cmd);
+		if (fwrite(&t, sizeof t, 1, fp) != 1)
+			return -1;
+	}
+	return 0;
+}
+
+int snapproc_read_header(FILE *fp, unsigned *hertz)
+{
+	struct snap_header h;
+
+	if (fread(&h, sizeof h, 1, fp) != 1
+	    || memcmp(h.magic, SNAP_MAGIC, sizeof h.magic)
+	    || h.recsize != sizeof(struct snap_task))
+		return -1;
+	*hertz = h.hertz;
+	return 0;
+}
+
+proc_t **snapproc_read(FILE *fp, proc_t **ptab, unsigned *n,
+		       unsigned long long *usec)
+{
+	struct snap_frame f;
+	struct snap_task t;
+	unsigned i;
+
+	if (fread(&f, sizeof f, 1, fp) != 1 || f.magic != FRAME_MAGIC)
+		return NULL;
+
+	// the old entries are reused, NULL marks the end of what is allocated
+	for (i = 0; ptab && ptab[i]; i++) ;
+	if (i < f.ntasks) {
+		ptab = xrealloc(ptab, (f.ntasks + 1) * sizeof *ptab);
+		for (; i < f.ntasks; i++)
+			ptab[i] = xmalloc(sizeof **ptab);
+		ptab[i] = NULL;
+	}
+
+	for (i = 0; i < f.ntasks; i++) {
+		proc_t *p = ptab[i];
+
+		if (fread(&t, sizeof t, 1, fp) != 1)
+			return NULL;
+		memset(p, 0, sizeof *p);
+		p->pid = t.pid;
+		p->ppid = t.ppid;
+		p->euid = t.euid;
+		p->processor = t.processor;
+		p->priority = t.priority;
+		p->nice = t.nice;
+		p->state = t.state;
+		p->utime = t.utime;
+		p->stime = t.stime;
+		p->start_time = t.start_time;
+		p->vsize = t.vsize;
+		p->rss = t.rss;
+		p->min_flt = t.min_flt;
+		p->maj_flt = t.maj_flt;
+		memcpy(p->cmd, t.cmd, sizeof p->cmd);
+		p->cmd[sizeof p->cmd - 1] = '\0';
+	}
+
+	*n = f.ntasks;
+	*usec = f.usec;
+	return ptab;
+}
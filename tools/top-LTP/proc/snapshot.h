@@ -0,0 +1,27 @@
+#ifndef PROC_SNAPSHOT_H
+#define PROC_SNAPSHOT_H
+
+#include <stdio.h>
+#include "procps.h"
+#include "readproc.h"
+
+EXTERN_C_BEGIN
+
+/* Compact binary process table snapshots.  A file is a header followed by
+ * frames, each frame a timestamp and one fixed size record per task.  Only
+ * the fields needed to replay cpu and memory usage are kept.  Records are in
+ * host byte order; snapshots are meant to be replayed on the same kind of
+ * machine that took them.
+ */
+extern int snapproc_write_header(FILE *fp, unsigned hertz);
+extern int snapproc_write(FILE *fp, proc_t **ptab, unsigned long long usec);
+
+extern int snapproc_read_header(FILE *fp, unsigned *hertz);
+/* returns tab, grown if needed, holding the *n tasks of the next frame or
+ * NULL at EOF; pass NULL the first time and the result afterwards */
+extern proc_t **snapproc_read(FILE *fp, proc_t **ptab, unsigned *n,
+			      unsigned long long *usec);
+
+EXTERN_C_END
+
+#endif
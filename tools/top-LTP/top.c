@@ -45,6 +45,7 @@
 #include "proc/readproc.h"
 #include "proc/escape.h"
 #include "proc/sig.h"
+#include "proc/snapshot.h"
 #ifdef USE_LIB_STA3
 #include "proc/status.h"
 #endif
@@ -59,6 +60,10 @@
 static FILE *outfile;
 static FILE *datafile;
 static int o_flag;
+	/* Binary process snapshots written each frame (-w) and the extra
+	   openproc flags, PROC_CACHED for cheap sub-second sampling (-F) */
+static FILE *snapfile;
+static int Scan_flags = 0;
 	/* The original and new terminal attributes */
 static struct termios Savedtty, Rawtty;
 static int Ttychanged = 0;
@@ -1025,9 +1030,9 @@ static proc_t **procs_refresh(proc_t ** table, int flags)
 
 	prochlp(NULL);		// prep for a new frame
 	if (Monpidsidx)
-		PT = openproc(PROC_FILLBUG | PROC_PID, Monpids);
+		PT = openproc(PROC_FILLBUG | PROC_PID | Scan_flags, Monpids);
 	else
-		PT = openproc(flags);
+		PT = openproc(flags | Scan_flags);
 
 	// i) Allocated Chunks:  *Existing* table;  refresh + reuse
 	while (curmax < savmax) {
@@ -1810,6 +1815,70 @@ static void configs_read(void)
 		Rc.delay_time = delay;
 }
 
+	/*
+	 * Replay a snapshot file written with -w, printing per frame the
+	 * tasks which used any cpu, busiest first -- then we're outta here */
+static void snap_replay(const char *fname)
+{
+	static HST_t *hist_sav = NULL, *hist_new = NULL;
+	proc_t **ptab = NULL;
+	unsigned hertz, n, nsav = 0, frame = 0, i;
+	unsigned long long usec, usec_sav = 0;
+	FILE *fp;
+
+	if (!(fp = fopen(fname, "r")))
+		std_err(fmtmk("bad file arg; failed to fopen '%s' for reading",
+			      fname));
+	if (snapproc_read_header(fp, &hertz))
+		std_err(fmtmk("'%s' is not a process snapshot", fname));
+
+	while ((ptab = snapproc_read(fp, ptab, &n, &usec))) {
+		float et = (usec - usec_sav) / 1000000.0;
+		HST_t *hist_tmp, tmp;
+		const HST_t *ptr;
+		unsigned running = 0;
+
+		hist_new = alloc_r(hist_new, sizeof(HST_t) * (n + 1));
+		for (i = 0; i < n; i++) {
+			if (ptab[i]->state == 'R')
+				running++;
+			hist_new[i].pid = ptab[i]->pid;
+			hist_new[i].tics = ptab[i]->utime + ptab[i]->stime;
+			// pcpu holds the tics used since the previous frame
+			tmp.pid = ptab[i]->pid;
+			ptr = nsav ? bsearch(&tmp, hist_sav, nsav, sizeof tmp,
+					     (QFP_t) sort_HST_t) : NULL;
+			ptab[i]->pcpu = ptr ? hist_new[i].tics - ptr->tics : 0;
+		}
+		Frame_srtflg = 1;	// busiest first
+		qsort(ptab, n, sizeof *ptab, (QFP_t) sort_P_CPU);
+
+		printf("frame %u: %llu.%03llu  tasks: %u total, %u running\n",
+		       frame, usec / 1000000, usec % 1000000 / 1000, n,
+		       running);
+		if (frame) {
+			printf("  PID  PPID S  %%CPU RES(k) MINFLT MAJFLT COMMAND\n");
+			for (i = 0; i < n && ptab[i]->pcpu; i++)
+				printf("%5d %5d %c %5.1f %6u %6lu %6lu %s\n",
+				       ptab[i]->pid, ptab[i]->ppid, ptab[i]->state,
+				       ptab[i]->pcpu * 100.0f / (hertz * et),
+				       PAGES_2K(ptab[i]->rss), ptab[i]->min_flt,
+				       ptab[i]->maj_flt, ptab[i]->cmd);
+		}
+
+		// reuse memory each time around, sorted for the binary search
+		hist_tmp = hist_sav;
+		hist_sav = hist_new;
+		hist_new = hist_tmp;
+		nsav = n;
+		qsort(hist_sav, nsav, sizeof(HST_t), (QFP_t) sort_HST_t);
+		usec_sav = usec;
+		frame++;
+	}
+	fclose(fp);
+	exit(0);
+}
+
 	/*
 	 * Parse command line arguments.
 	 * Note: it's assumed that the rc file(s) have already been read
@@ -1831,7 +1900,7 @@ static void parse_args(char **args)
 	   .  bunched args are actually handled properly and none are ignored
 	   .  we tolerate NO whitespace and NO switches -- maybe too tolerant? */
 	static const char usage[] =
-	    " -hv | -bcisS -d delay -n iterations [-u user | -U user] -o filename -p pid [,pid ...] | -f filename";
+	    " -hv | -bcisSF -d delay -n iterations [-u user | -U user] -o filename -w snapfile -p pid [,pid ...] | -f filename | -r snapfile";
 	float tmp_delay = MAXFLOAT;
 	char *p;
 	char buff[BUFF_SIZE];
@@ -1982,6 +2051,9 @@ static void parse_args(char **args)
 				     loopcntr, cp);
 				exit(0);
 				break;
+			case 'F':
+				Scan_flags |= PROC_CACHED;
+				break;
 			case 'h':
 			case 'H':
 			case 'v':
@@ -2021,6 +2093,29 @@ static void parse_args(char **args)
 					o_flag = 1;
 				cp = cp + strlen(cp);
 				break;
+			case 'r':
+				if (cp[1])
+					cp++;
+				else if (*args)
+					cp = *args++;
+				else
+					std_err("-r requires argument");
+				snap_replay(cp);
+				break;
+			case 'w':
+				if (cp[1])
+					cp++;
+				else if (*args)
+					cp = *args++;
+				else
+					std_err("-w requires argument");
+				if (!(snapfile = fopen(cp, "w"))
+				    || snapproc_write_header(snapfile, Hertz))
+					std_err(fmtmk
+						("bad file arg; failed to fopen '%s' for write",
+						 cp));
+				cp = cp + strlen(cp);
+				break;
 			case 'p':
 				do {
 					if (selection_type)
@@ -3165,6 +3260,15 @@ static proc_t **summary_show(void)
 	} else
 		putp(Batch ? "\n\n" : Cap_home);
 	p_table = procs_refresh(p_table, Frames_libflags);
+	if (snapfile) {
+		struct timeval tv;
+
+		gettimeofday(&tv, NULL);
+		if (snapproc_write(snapfile, p_table,
+				   tv.tv_sec * 1000000ULL + tv.tv_usec)
+		    || fflush(snapfile))
+			std_err("failed to write process snapshot");
+	}
 
 	/*
 	 ** Display Uptime and Loadavg */
@@ -3640,9 +3744,14 @@ int main(int dont_care_argc, char **argv)
 		if (!Loops)
 			end_pgm(0);
 
-		if (Batch)
-			sleep((unsigned)Rc.delay_time);
-		else {		//   Linux reports time not slept,
+		if (Batch) {	//   sub-second delays matter with -F
+			struct timespec ts;
+
+			ts.tv_sec = Rc.delay_time;
+			ts.tv_nsec =
+			    (Rc.delay_time - (int)Rc.delay_time) * 1000000000;
+			nanosleep(&ts, NULL);
+		} else {		//   Linux reports time not slept,
 			tv.tv_sec = Rc.delay_time;	//   so we must reinit every time.
 			tv.tv_usec =
 			    (Rc.delay_time - (int)Rc.delay_time) * 1000000;
@@ -601,6 +601,7 @@ typedef struct WIN_t {
 //atic void         before (char *me);
 //atic void         confighlp (char *fields);
 //atic void         configs_read (void);
+//atic void         snap_replay (const char *fname);
 //atic void         parse_args (char **args);
 //atic void         whack_terminal (void);
 /*------  Field Selection/Ordering routines  -----------------------------*/